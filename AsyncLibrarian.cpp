@@ -0,0 +1,29 @@
+#include "AsyncLibrarian.h"
+
+/**
+ * @brief Constructs a facade over a librarian.
+ *
+ * @param librarian The librarian to call.
+ * @param executor The executor the request coroutines run on.
+ */
+AsyncLibrarian::AsyncLibrarian(Librarian &librarian, CoroutineExecutor &executor)
+        : librarian(librarian), executor(executor), circulation(executor) {
+}
+
+/**
+ * @brief Gets the librarian behind the facade.
+ *
+ * @return Reference to the librarian.
+ */
+Librarian &AsyncLibrarian::getLibrarian() {
+    return librarian;
+}
+
+/**
+ * @brief Gets the executor the request coroutines run on.
+ *
+ * @return Reference to the executor.
+ */
+CoroutineExecutor &AsyncLibrarian::getExecutor() {
+    return executor;
+}
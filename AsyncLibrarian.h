@@ -0,0 +1,64 @@
+#ifndef LIBRARYMANAGEMENT_ASYNCLIBRARIAN_H
+#define LIBRARYMANAGEMENT_ASYNCLIBRARIAN_H
+
+#include "AsyncMutex.h"
+#include "CoroutineExecutor.h"
+#include "Librarian.h"
+#include "Task.h"
+#include <type_traits>
+
+/**
+ * @class AsyncLibrarian
+ * @brief An awaitable front end to a `Librarian`, for request coroutines running on a `CoroutineExecutor`.
+ *
+ * Circulation changes wait for the facade's `AsyncMutex` before calling into the librarian. A request
+ * that arrives while another change is in progress suspends and gives its thread back to the executor,
+ * instead of blocking the thread on the librarian's circulation lock. The librarian's own lock is then
+ * almost never contended. Lookups and snapshot reports take no locks, so requests call the librarian for
+ * them directly.
+ *
+ * Every call made through one facade must come from coroutines on the facade's executor.
+ */
+class AsyncLibrarian {
+public:
+    /**
+     * @brief Constructs a facade over a librarian.
+     *
+     * @param librarian The librarian to call.
+     * @param executor The executor the request coroutines run on.
+     */
+    AsyncLibrarian(Librarian& librarian, CoroutineExecutor& executor);
+
+    /**
+     * @brief Runs a function that changes circulation state once no other change is in progress.
+     *
+     * @param change The function, called with no arguments.
+     * @return A task producing the function's result.
+     */
+    template<typename F>
+    Task<invoke_result_t<F&>> write(F change) {
+        AsyncMutex::Guard guard = co_await circulation.lock();
+        co_return change();
+    }
+
+    /**
+     * @brief Gets the librarian behind the facade.
+     *
+     * @return Reference to the librarian.
+     */
+    [[nodiscard]] Librarian& getLibrarian();
+
+    /**
+     * @brief Gets the executor the request coroutines run on.
+     *
+     * @return Reference to the executor.
+     */
+    [[nodiscard]] CoroutineExecutor& getExecutor();
+
+private:
+    Librarian& librarian; ///< The librarian behind the facade.
+    CoroutineExecutor& executor; ///< The executor the request coroutines run on.
+    AsyncMutex circulation; ///< Serializes circulation changes without blocking executor threads.
+};
+
+#endif //LIBRARYMANAGEMENT_ASYNCLIBRARIAN_H
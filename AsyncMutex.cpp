@@ -0,0 +1,51 @@
+#include "AsyncMutex.h"
+
+/**
+ * @brief Constructs an unlocked mutex.
+ *
+ * @param executor The executor waiters are resumed on.
+ */
+AsyncMutex::AsyncMutex(CoroutineExecutor &executor) : executor(executor), locked(false) {
+}
+
+/**
+ * @brief Locks the mutex.
+ *
+ * @return An awaitable for `co_await`, whose result holds the mutex until it is destroyed.
+ */
+AsyncMutex::LockAwaiter AsyncMutex::lock() {
+    return LockAwaiter{*this};
+}
+
+/**
+ * @brief Takes the mutex if it is free, or queues the awaiting coroutine.
+ *
+ * @param awaiting The coroutine locking the mutex.
+ * @return false if the mutex was taken and the coroutine continues at once, true if it was queued.
+ */
+bool AsyncMutex::LockAwaiter::await_suspend(coroutine_handle<> awaiting) {
+    lock_guard<std::mutex> guard(mutex.state);
+    if (!mutex.locked) {
+        mutex.locked = true;
+        return false;
+    }
+    mutex.waiters.push_back(awaiting);
+    return true;
+}
+
+/**
+ * @brief Releases the mutex, handing it to the oldest waiter if there is one.
+ */
+void AsyncMutex::unlock() {
+    coroutine_handle<> next;
+    {
+        lock_guard<std::mutex> guard(state);
+        if (waiters.empty()) {
+            locked = false;
+            return;
+        }
+        next = waiters.front();
+        waiters.pop_front();
+    }
+    executor.post(next);
+}
@@ -0,0 +1,89 @@
+#ifndef LIBRARYMANAGEMENT_ASYNCMUTEX_H
+#define LIBRARYMANAGEMENT_ASYNCMUTEX_H
+
+#include "CoroutineExecutor.h"
+#include <coroutine>
+#include <deque>
+#include <mutex>
+
+using namespace std;
+
+/**
+ * @class AsyncMutex
+ * @brief A mutex that coroutines wait for by suspending rather than by blocking their thread.
+ *
+ * Waiters are queued in arrival order. Unlocking hands the mutex straight to the oldest waiter and posts
+ * it to the executor, so a waiter can't be overtaken by a coroutine that arrives later.
+ */
+class AsyncMutex {
+public:
+    /**
+     * @brief Releases the mutex when it goes out of scope.
+     */
+    class Guard {
+    public:
+        explicit Guard(AsyncMutex* owner) : owner(owner) {
+        }
+
+        Guard(Guard&& other) noexcept : owner(other.owner) {
+            other.owner = nullptr;
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+
+        ~Guard() {
+            if (owner != nullptr) {
+                owner->unlock();
+            }
+        }
+
+    private:
+        AsyncMutex* owner; ///< The mutex to release, or nullptr once moved from.
+    };
+
+    /**
+     * @brief Awaitable that locks the mutex, suspending the awaiting coroutine while another holds it.
+     */
+    struct LockAwaiter {
+        AsyncMutex& mutex; ///< The mutex to lock.
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        bool await_suspend(coroutine_handle<> awaiting);
+
+        Guard await_resume() const noexcept {
+            return Guard(&mutex);
+        }
+    };
+
+    /**
+     * @brief Constructs an unlocked mutex.
+     *
+     * @param executor The executor waiters are resumed on.
+     */
+    explicit AsyncMutex(CoroutineExecutor& executor);
+
+    /**
+     * @brief Locks the mutex.
+     *
+     * @return An awaitable for `co_await`, whose result holds the mutex until it is destroyed.
+     */
+    LockAwaiter lock();
+
+    /**
+     * @brief Releases the mutex, handing it to the oldest waiter if there is one.
+     */
+    void unlock();
+
+private:
+    CoroutineExecutor& executor; ///< The executor waiters are resumed on.
+    std::mutex state; ///< Guards `locked` and `waiters`.
+    bool locked; ///< Whether a coroutine holds the mutex.
+    deque<coroutine_handle<>> waiters; ///< Coroutines waiting for the mutex, oldest at the front.
+};
+
+#endif //LIBRARYMANAGEMENT_ASYNCMUTEX_H
@@ -0,0 +1,508 @@
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Book.h"
+#include "CatalogQuery.h"
+#include "CatalogSnapshot.h"
+#include "Inventory.h"
+#include "IoBackend.h"
+#include "Librarian.h"
+#include "LibraryHash.h"
+#include "TaskScheduler.h"
+#include "ZipfSampler.h"
+
+using namespace std;
+
+/**
+ * @brief The result of one benchmark at one catalog size.
+ */
+struct BenchResult {
+    string name; ///< Name of the benchmark.
+    long catalogSize; ///< Number of books in the catalog.
+    long long rounds; ///< Number of timed rounds.
+    long long ops; ///< Total number of operations timed.
+    double seconds; ///< Total time spent in the timed sections.
+};
+
+/**
+ * @brief Settings taken from the command line.
+ */
+struct BenchOptions {
+    vector<long> sizes = {10000, 100000, 1000000, 10000000}; ///< Catalog sizes to run every benchmark at.
+    double minTime = 0.5; ///< Seconds each benchmark is timed for at least.
+    string filter; ///< Only benchmarks whose name contains this run.
+    string outPath; ///< File the JSON report is written to, or empty for standard output.
+    string scratchDir = filesystem::temp_directory_path().string(); ///< Where generated catalogs are written.
+};
+
+/**
+ * @brief Written with benchmark results so the compiler cannot drop the work that produced them.
+ */
+static volatile long long sink = 0;
+
+/**
+ * @brief Runs a benchmark for at least the minimum time.
+ *
+ * Each round performs `opsPerRound` operations and returns the seconds its timed section took, so work that
+ * only prepares a round, such as building a fresh inventory, is not counted.
+ *
+ * @param options The benchmark settings.
+ * @param name Name of the benchmark.
+ * @param catalogSize Number of books in the catalog.
+ * @param opsPerRound Number of operations each round performs.
+ * @param round Runs one round and returns the seconds it took.
+ * @param results The list the result is added to.
+ */
+static void measure(const BenchOptions& options, const string& name, long catalogSize, long long opsPerRound,
+                    const function<double()>& round, vector<BenchResult>& results) {
+    if (name.find(options.filter) == string::npos) {
+        return;
+    }
+    BenchResult result{name, catalogSize, 0, 0, 0};
+    do {
+        result.seconds += round();
+        result.rounds++;
+        result.ops += opsPerRound;
+    } while (result.seconds < options.minTime);
+    cerr << name << " @ " << catalogSize << ": " << result.seconds * 1e9 / result.ops << " ns/op" << endl;
+    results.push_back(result);
+}
+
+/**
+ * @brief Times a loop.
+ *
+ * @param body The loop to time.
+ * @return The seconds it took.
+ */
+static double timed(const function<void()>& body) {
+    auto start = chrono::steady_clock::now();
+    body();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Gets the ISBN of the i-th generated book.
+ *
+ * @param i Position of the book in the generated catalog.
+ * @return The ISBN.
+ */
+static long long generatedIsbn(long i) {
+    return 9780000000000LL + i * 7;
+}
+
+/**
+ * @brief Creates the i-th generated book.
+ *
+ * @param i Position of the book in the generated catalog.
+ * @return The new book.
+ */
+static Book* generateBook(long i) {
+    static const char* genres[] = {"Fiction", "Classic", "Fantasy", "Dystopian", "Thriller", "Horror"};
+    return new Book("Title " + to_string(i), "Author " + to_string(i % 5000), genres[i % 6],
+                    static_cast<short>(1900 + i % 120), generatedIsbn(i), true);
+}
+
+/**
+ * @brief Writes a generated catalog in the format the librarian loads.
+ *
+ * @param path Path of the file.
+ * @param size Number of books.
+ * @return true if the file was written, false otherwise.
+ */
+static bool writeCatalog(const string& path, long size) {
+    IoBackend io;
+    int fd = io.openFile(path, true);
+    if (fd == -1) {
+        return false;
+    }
+    string chunk = "ISBN,Title,Author,Genre,PublicationYear,IsAvailable\n";
+    for (long i = 0; i < size; i++) {
+        Book* b = generateBook(i);
+        chunk += to_string(b->getIsbn()) + ',' + b->getTitle() + ',' + b->getAuthor() + ',' + b->getGenre() + ',' +
+                 to_string(b->getPublicationYear()) + ",true\n";
+        delete b;
+        if (chunk.size() >= 1 << 20) {
+            io.append(fd, chunk);
+            chunk.clear();
+        }
+    }
+    io.append(fd, chunk);
+    return io.closeFile(fd);
+}
+
+/**
+ * @brief Picks catalog positions to look up, so lookups land all over the table rather than in the cache.
+ *
+ * @param size Number of books in the catalog.
+ * @param count Number of positions.
+ * @return The positions.
+ */
+static vector<long> randomPositions(long size, size_t count) {
+    mt19937_64 random(size);
+    uniform_int_distribution<long> pick(0, size - 1);
+    vector<long> positions(count);
+    for (long& p : positions) {
+        p = pick(random);
+    }
+    return positions;
+}
+
+/**
+ * @brief Runs the benchmarks that use a bare inventory: adds, lookups, counting, ISBN parsing and formatting.
+ *
+ * @param options The benchmark settings.
+ * @param size Number of books in the catalog.
+ * @param results The list the results are added to.
+ */
+static void benchInventory(const BenchOptions& options, long size, vector<BenchResult>& results) {
+    vector<Book*> books(size);
+    for (long i = 0; i < size; i++) {
+        books[i] = generateBook(i);
+    }
+
+    measure(options, "inventory_add_book", size, size, [&] {
+        Inventory inventory;
+        return timed([&] {
+            for (Book* b : books) {
+                inventory.addBook(b);
+            }
+        });
+    }, results);
+
+    Inventory inventory;
+    for (Book* b : books) {
+        inventory.addBook(b);
+    }
+    vector<long> positions = randomPositions(size, 100000);
+
+    measure(options, "inventory_find_by_isbn", size, positions.size(), [&] {
+        return timed([&] {
+            long long found = 0;
+            for (long p : positions) {
+                found += inventory.findBookByISBN(generatedIsbn(p)) != nullptr;
+            }
+            sink = found;
+        });
+    }, results);
+
+    measure(options, "inventory_find_by_isbn_miss", size, positions.size(), [&] {
+        return timed([&] {
+            long long found = 0;
+            for (long p : positions) {
+                found += inventory.findBookByISBN(generatedIsbn(p) + 1) != nullptr;
+            }
+            sink = found;
+        });
+    }, results);
+
+    // A title lookup scans the table, so fewer are done per round on large catalogs.
+    vector<string> titles;
+    for (size_t i = 0; i < min<size_t>(positions.size(), max(1L, 1000000 / size)); i++) {
+        titles.push_back("Title " + to_string(positions[i]));
+    }
+    measure(options, "inventory_find_by_title", size, titles.size(), [&] {
+        return timed([&] {
+            long long found = 0;
+            for (const string& title : titles) {
+                found += inventory.findBookByTitle(title) != nullptr;
+            }
+            sink = found;
+        });
+    }, results);
+
+    measure(options, "inventory_count_total_books", size, 1000000, [&] {
+        return timed([&] {
+            long long total = 0;
+            for (int i = 0; i < 1000000; i++) {
+                total += inventory.countTotalBooks();
+            }
+            sink = total;
+        });
+    }, results);
+
+    vector<string> formatted;
+    for (size_t i = 0; i < 10000; i++) {
+        string digits = to_string(generatedIsbn(positions[i]));
+        formatted.push_back(digits.substr(0, 3) + '-' + digits.substr(3, 1) + '-' + digits.substr(4, 2) + '-' +
+                            digits.substr(6, 6) + '-' + digits.substr(12));
+    }
+    measure(options, "hash_format_isbn", size, formatted.size(), [&] {
+        return timed([&] {
+            long long total = 0;
+            for (const string& text : formatted) {
+                string input = text;
+                total += LibraryHash::formatISBN(input);
+            }
+            sink = total;
+        });
+    }, results);
+
+    measure(options, "book_get_info", size, 10000, [&] {
+        return timed([&] {
+            long long length = 0;
+            for (size_t i = 0; i < 10000; i++) {
+                length += books[positions[i]]->getInfo().size();
+            }
+            sink = length;
+        });
+    }, results);
+
+    for (Book* b : books) {
+        delete b;
+    }
+}
+
+/**
+ * @brief Destroys a librarian and the books it loaded, which the librarian itself does not free.
+ *
+ * @param l The librarian.
+ */
+static void destroyLibrarian(Librarian* l) {
+    vector<const Book*> books;
+    l->snapshot().forEachBook([&books](const Book* b, const BookVersion&) { books.push_back(b); });
+    delete l;
+    for (const Book* b : books) {
+        delete b;
+    }
+}
+
+/**
+ * @brief Runs the benchmarks that use a librarian: loading a catalog file and circulation.
+ *
+ * @param options The benchmark settings.
+ * @param size Number of books in the catalog.
+ * @param results The list the results are added to.
+ */
+static void benchLibrarian(const BenchOptions& options, long size, vector<BenchResult>& results) {
+    string path = (filesystem::path(options.scratchDir) / ("library_bench_" + to_string(size) + ".csv")).string();
+    if (!writeCatalog(path, size)) {
+        cerr << "Could not write " << path << "." << endl;
+        return;
+    }
+
+    // The loader reports the header row on standard output, which would break up the JSON report.
+    streambuf* console = cout.rdbuf();
+    measure(options, "librarian_load_csv", size, size, [&] {
+        cout.rdbuf(nullptr);
+        Librarian* l = nullptr;
+        double seconds = timed([&] { l = new Librarian(path); });
+        cout.rdbuf(console);
+        destroyLibrarian(l);
+        return seconds;
+    }, results);
+
+    // The same load reading only ISBNs, years and availability from the mapped file.
+    measure(options, "librarian_load_csv_lazy", size, size, [&] {
+        cout.rdbuf(nullptr);
+        Librarian* l = nullptr;
+        double seconds = timed([&] { l = new Librarian(path, DetailLoading::Lazy); });
+        cout.rdbuf(console);
+        destroyLibrarian(l);
+        return seconds;
+    }, results);
+
+    cout.rdbuf(nullptr);
+    Librarian* l = new Librarian(path);
+    cout.rdbuf(console);
+    // The same books again as a compressed archive, for the archive benchmarks below.
+    l->loadArchive(path);
+    remove(path.c_str());
+
+    // Check out a book, place a hold on it, and return it twice: once to hand it to the holder, once to shelve it.
+    vector<long> positions = randomPositions(size, 10000);
+    PatronId reader = l->registerPatron();
+    PatronId holder = l->registerPatron();
+    measure(options, "librarian_circulation_cycle", size, positions.size(), [&] {
+        return timed([&] {
+            for (long p : positions) {
+                long long isbn = generatedIsbn(p);
+                l->checkoutBook(isbn, reader);
+                l->reserveBook(isbn, holder);
+                l->returnBook(isbn);
+                l->returnBook(isbn);
+            }
+        });
+    }, results);
+
+    // Swap two letters of the title so every search has to allow an edit.
+    vector<string> misspelled;
+    for (size_t i = 0; i < 1000 && i < positions.size(); i++) {
+        misspelled.push_back("Tilte " + to_string(positions[i]));
+    }
+    // Adding and removing a book between rounds invalidates the search cache, so every round searches the index.
+    Book* spare = generateBook(size);
+    measure(options, "librarian_search_fuzzy", size, misspelled.size(), [&] {
+        l->addNewBook(spare);
+        l->removeBookFromInventory(spare);
+        return timed([&] {
+            size_t found = 0;
+            for (const string& title : misspelled) {
+                found += l->searchFuzzy(title).size();
+            }
+            sink = static_cast<long long>(found);
+        });
+    }, results);
+
+    // Most searches ask for a hundred popular titles. Each title's first search scans the catalog and fills the
+    // search cache, so those are run before timing and the rounds measure the searches the cache answers.
+    ZipfSampler popularity(100, 1.0);
+    mt19937_64 random(42);
+    vector<string> popular;
+    for (int i = 0; i < 10000; i++) {
+        popular.push_back("Title " + to_string(positions[popularity.sample(random) - 1]));
+    }
+    for (const string& title : popular) {
+        sink = l->searchBooks(title) != nullptr;
+    }
+    measure(options, "librarian_search_title_popular", size, popular.size(), [&] {
+        return timed([&] {
+            long long found = 0;
+            for (const string& title : popular) {
+                found += l->searchBooks(title) != nullptr;
+            }
+            sink = found;
+        });
+    }, results);
+
+    // An ad-hoc report with too many matches to cache, so every round scans the catalog.
+    CatalogQuery report;
+    string error;
+    CatalogQuery::compile("genre=Fantasy AND year<1950 AND available", report, error);
+    measure(options, "librarian_query_scan", size, size, [&] {
+        return timed([&] {
+            size_t found = l->queryBooks(report, [](const Book*, const BookVersion&) {});
+            sink = static_cast<long long>(found);
+        });
+    }, results);
+
+    // The same report over the archive, which tests the numeric columns and decodes only the genres it reaches.
+    measure(options, "archive_query_scan", size, size, [&] {
+        return timed([&] {
+            size_t found = l->queryArchive(report, [](const ArchivedBook&) {});
+            sink = static_cast<long long>(found);
+        });
+    }, results);
+
+    // Find archived books by ISBN and decode their front-coded titles.
+    measure(options, "archive_lookup_title", size, positions.size(), [&] {
+        return timed([&] {
+            size_t letters = 0;
+            ArchivedBook book{};
+            for (long p : positions) {
+                if (l->getArchive().findByIsbn(generatedIsbn(p), book)) {
+                    letters += book.getTitle().size();
+                }
+            }
+            sink = static_cast<long long>(letters);
+        });
+    }, results);
+
+    // Read the catalog 50 books at a time, following the cursors and starting over at the end.
+    CatalogQuery everything;
+    string cursor;
+    measure(options, "librarian_list_page", size, 1000, [&] {
+        return timed([&] {
+            size_t listed = 0;
+            string next;
+            for (int page = 0; page < 1000; page++) {
+                l->listPage(everything, cursor, 50, [&listed](const Book*, const BookVersion&) { listed++; }, next);
+                cursor = next;
+            }
+            sink = static_cast<long long>(listed);
+        });
+    }, results);
+
+    destroyLibrarian(l);
+    delete spare;
+}
+
+/**
+ * @brief Writes the results as JSON.
+ *
+ * @param out The stream to write to.
+ * @param options The benchmark settings.
+ * @param results The results.
+ */
+static void writeReport(ostream& out, const BenchOptions& options, const vector<BenchResult>& results) {
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    out << "{\n  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+#ifdef __VERSION__
+    out << "    \"compiler\": \"" << __VERSION__ << "\",\n";
+#endif
+#ifdef NDEBUG
+    out << "    \"build_type\": \"release\",\n";
+#else
+    out << "    \"build_type\": \"debug\",\n";
+#endif
+    out << "    \"threads\": " << TaskScheduler::instance().getThreadCount() << ",\n";
+    out << "    \"io_uring\": " << (IoBackend().usesIoUring() ? "true" : "false") << ",\n";
+    out << "    \"min_time\": " << options.minTime << "\n  },\n";
+    out << "  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\"name\": \"" << r.name << "\", \"catalog_size\": " << r.catalogSize << ", \"rounds\": " << r.rounds
+            << ", \"ops\": " << r.ops << ", \"ns_per_op\": " << r.seconds * 1e9 / r.ops << ", \"ops_per_sec\": "
+            << r.ops / r.seconds << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    // --sizes N,N,... sets the catalog sizes (10K to 10M by default). --min-time S sets how long each benchmark
+    // is timed for at least. --filter TEXT runs only the benchmarks whose name contains TEXT. --out FILE writes
+    // the JSON report to FILE instead of standard output. --scratch DIR is where generated catalogs are written.
+    // --threads N sets how many threads the bulk jobs use, as in the main program.
+    BenchOptions options;
+    for (int i = 1; i + 1 < argc; i++) {
+        string option = argv[i];
+        if (option == "--sizes") {
+            options.sizes.clear();
+            stringstream list(argv[++i]);
+            string size;
+            while (getline(list, size, ',')) {
+                options.sizes.push_back(stol(size));
+            }
+        } else if (option == "--min-time") {
+            options.minTime = stod(argv[++i]);
+        } else if (option == "--filter") {
+            options.filter = argv[++i];
+        } else if (option == "--out") {
+            options.outPath = argv[++i];
+        } else if (option == "--scratch") {
+            options.scratchDir = argv[++i];
+        } else if (option == "--threads") {
+            TaskScheduler::setDefaultThreadCount(stoi(argv[++i]));
+        }
+    }
+
+    vector<BenchResult> results;
+    for (long size : options.sizes) {
+        benchInventory(options, size, results);
+        benchLibrarian(options, size, results);
+    }
+
+    if (options.outPath.empty()) {
+        writeReport(cout, options, results);
+        return 0;
+    }
+    ofstream out(options.outPath);
+    writeReport(out, options, results);
+    if (!out) {
+        cerr << "Could not write " << options.outPath << "." << endl;
+        return 1;
+    }
+    return 0;
+}
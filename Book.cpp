@@ -1,8 +1,36 @@
 #include "Book.h"
+#include "CatalogFile.h"
 #include <iostream>
+#include <mutex>
 
 using namespace std;
 
+static const size_t DETAIL_LOCKS = 64; ///< Number of locks that books loading their details are spread over.
+static mutex detailLocks[DETAIL_LOCKS]; ///< Serializes loading the details of books that hash to the same lock.
+
+/**
+ * @brief Allocates a version and counts it under `MemoryAccounting::BookVersions`.
+ *
+ * @param size The size of the version.
+ * @return Pointer to the space.
+ */
+void *BookVersion::operator new(size_t size) {
+    void* p = ::operator new(size);
+    MemoryAccounting::allocated(MemoryAccounting::BookVersions, size);
+    return p;
+}
+
+/**
+ * @brief Frees a version and counts it as freed.
+ *
+ * @param p Pointer to the version.
+ * @param size The size of the version.
+ */
+void BookVersion::operator delete(void *p, size_t size) {
+    MemoryAccounting::freed(MemoryAccounting::BookVersions, size);
+    ::operator delete(p);
+}
+
 /**
  * @brief Default constructor for the Book class.
  * Initializes a book with default values.
@@ -16,6 +44,14 @@ Book::Book() {
     available = true;
     daysCheckedOut = 0;
     fine = 0;
+    borrower = 0;
+    checkOutSlot = -1;
+    firstHold = -1;
+    prevLoan = nullptr;
+    nextLoan = nullptr;
+    versions = nullptr;
+    source = nullptr;
+    sourceOffset = 0;
 }
 
 /**
@@ -31,7 +67,38 @@ Book::Book() {
  */
 Book::Book(string title, string author, string genre, short publicationYear, long long isbn,
            bool isAvailable) : title(std::move(title)), author(std::move(author)), genre(std::move(genre)), publicationYear(publicationYear), ISBN(isbn),
-                               available(isAvailable) { fine = 0; daysCheckedOut = 0;}
+                               available(isAvailable) { fine = 0; daysCheckedOut = 0; borrower = 0; checkOutSlot = -1;
+                               firstHold = -1; prevLoan = nullptr; nextLoan = nullptr; versions = nullptr;
+                               source = nullptr; sourceOffset = 0;}
+
+/**
+ * @brief Constructs a book whose title, author and genre are read from a catalog file when first needed.
+ *
+ * @param source The file, which must stay mapped for as long as the book exists.
+ * @param offset Where the book's row starts in the file.
+ * @param publicationYear Year the book was published.
+ * @param isbn ISBN of the book.
+ * @param isAvailable Availability of the book (true if available).
+ */
+Book::Book(const CatalogFile *source, uint64_t offset, short publicationYear, long long isbn, bool isAvailable)
+        : source(source), sourceOffset(offset), publicationYear(publicationYear), ISBN(isbn), available(isAvailable),
+          fine(0), daysCheckedOut(0), borrower(0), checkOutSlot(-1), firstHold(-1), prevLoan(nullptr),
+          nextLoan(nullptr), versions(nullptr) {
+}
+
+/**
+ * @brief Destructor. Frees the versions of the book's circulation state.
+ */
+Book::~Book() {
+    BookVersion* v = versions.load();
+    while (v != nullptr) {
+        BookVersion* older = v->older.load();
+        if (v != &firstVersion) {
+            delete v;
+        }
+        v = older;
+    }
+}
 
 /**
  * @brief Get the title of the book.
@@ -39,6 +106,9 @@ Book::Book(string title, string author, string genre, short publicationYear, lon
  * @return The title of the book.
  */
 const string &Book::getTitle() const {
+    if (source.load(memory_order_acquire) != nullptr) {
+        loadDetails();
+    }
     return title;
 }
 
@@ -48,6 +118,9 @@ const string &Book::getTitle() const {
  * @param title The new title for the book.
  */
 void Book::setTitle(const string &title) {
+    if (source.load(memory_order_acquire) != nullptr) {
+        loadDetails();
+    }
     Book::title = title;
 }
 
@@ -57,6 +130,9 @@ void Book::setTitle(const string &title) {
  * @return The author of the book.
  */
 const string &Book::getAuthor() const {
+    if (source.load(memory_order_acquire) != nullptr) {
+        loadDetails();
+    }
     return author;
 }
 
@@ -66,6 +142,9 @@ const string &Book::getAuthor() const {
  * @param author The new author for the book.
  */
 void Book::setAuthor(const string &author) {
+    if (source.load(memory_order_acquire) != nullptr) {
+        loadDetails();
+    }
     Book::author = author;
 }
 
@@ -75,6 +154,9 @@ void Book::setAuthor(const string &author) {
  * @return The genre of the book.
  */
 const string &Book::getGenre() const {
+    if (source.load(memory_order_acquire) != nullptr) {
+        loadDetails();
+    }
     return genre;
 }
 
@@ -84,6 +166,9 @@ const string &Book::getGenre() const {
  * @param genre The new genre for the book.
  */
 void Book::setGenre(const string &genre) {
+    if (source.load(memory_order_acquire) != nullptr) {
+        loadDetails();
+    }
     Book::genre = genre;
 }
 
@@ -148,7 +233,7 @@ void Book::setIsAvailable(bool isAvailable) {
  * @return true if the current book's ISBN is less than the other book's ISBN.
  */
 bool Book::operator<(const Book &b) const {
-    return b.ISBN < ISBN;
+    return ISBN < b.ISBN;
 }
 
 /**
@@ -167,14 +252,53 @@ bool Book::operator==(const Book &b) const {
  * @return A string containing the book's title, author, genre, ISBN, publication year, availability status, fines, and days checked out.
  */
 string Book::getInfo() const {
-    return "Title: " + title +
-           "\n    Author: " + author +
-           "\n    Genre: " + genre +
+    BookVersion state;
+    state.available = available;
+    state.fine = fine;
+    state.daysCheckedOut = daysCheckedOut;
+    return getInfo(state);
+}
+
+/**
+ * @brief Get detailed information about the book as of a version of its circulation state.
+ *
+ * @param state The version whose availability, fine and days checked out to show.
+ * @return A string in the same format as `getInfo()`.
+ */
+string Book::getInfo(const BookVersion &state) const {
+    return "Title: " + getTitle() +
+           "\n    Author: " + getAuthor() +
+           "\n    Genre: " + getGenre() +
            "\n    ISBN: " + to_string(ISBN) +
            "\n    Publication Year: " + to_string(publicationYear) +
-           "\n    Available: " + (available ? "Yes" : "No") +
-           "\n    Fines: " + to_string(fine) +
-           "\n    Days Left: " + to_string(daysCheckedOut) ;
+           "\n    Available: " + (state.available ? "Yes" : "No") +
+           "\n    Fines: " + to_string(state.fine) +
+           "\n    Days Left: " + to_string(state.daysCheckedOut) ;
+}
+
+/**
+ * @brief Tells whether the title, author and genre are in memory, rather than still to be read from the file.
+ *
+ * @return true if they are in memory.
+ */
+bool Book::hasDetails() const {
+    return source.load(memory_order_acquire) == nullptr;
+}
+
+/**
+ * @brief Reads the title, author and genre from the catalog file, unless another thread already has.
+ *
+ * Readers that find `source` cleared skip the lock, so after the first read the getters cost one atomic load.
+ * Books share a fixed set of locks rather than holding one each, which would make every book larger.
+ */
+void Book::loadDetails() const {
+    lock_guard<mutex> guard(detailLocks[reinterpret_cast<uintptr_t>(this) / sizeof(Book) % DETAIL_LOCKS]);
+    const CatalogFile* file = source.load(memory_order_relaxed);
+    if (file == nullptr) {
+        return;
+    }
+    file->readDetails(sourceOffset, title, author, genre);
+    source.store(nullptr, memory_order_release);
 }
 
 /**
@@ -212,3 +336,157 @@ int Book::getDaysCheckedOut() const {
 void Book::setDaysCheckedOut(int daysCheckedOut) {
     Book::daysCheckedOut = daysCheckedOut;
 }
+
+/**
+ * @brief Get the ID of the patron who has the book checked out.
+ *
+ * @return The borrowing patron's ID, or 0 if no patron is recorded for the loan.
+ */
+unsigned int Book::getBorrower() const {
+    return borrower;
+}
+
+/**
+ * @brief Set the ID of the patron who has the book checked out.
+ *
+ * @param borrower The borrowing patron's ID, or 0 for none.
+ */
+void Book::setBorrower(unsigned int borrower) {
+    Book::borrower = borrower;
+}
+
+/**
+ * @brief Get the next book in the borrower's loan list.
+ *
+ * @return Pointer to the next loaned book, or nullptr if this is the last loan.
+ */
+Book *Book::getNextLoan() const {
+    return nextLoan;
+}
+
+/**
+ * @brief Set the next book in the borrower's loan list.
+ *
+ * @param nextLoan Pointer to the next loaned book.
+ */
+void Book::setNextLoan(Book *nextLoan) {
+    Book::nextLoan = nextLoan;
+}
+
+/**
+ * @brief Get the previous book in the borrower's loan list.
+ *
+ * @return Pointer to the previous loaned book, or nullptr if this is the first loan.
+ */
+Book *Book::getPrevLoan() const {
+    return prevLoan;
+}
+
+/**
+ * @brief Set the previous book in the borrower's loan list.
+ *
+ * @param prevLoan Pointer to the previous loaned book.
+ */
+void Book::setPrevLoan(Book *prevLoan) {
+    Book::prevLoan = prevLoan;
+}
+
+/**
+ * @brief Get the position of the book in the librarian's checked-out list.
+ *
+ * @return The index into the checked-out list, or -1 if the book is not in it.
+ */
+int Book::getCheckOutSlot() const {
+    return checkOutSlot;
+}
+
+/**
+ * @brief Set the position of the book in the librarian's checked-out list.
+ *
+ * @param checkOutSlot The index into the checked-out list, or -1 if the book is not in it.
+ */
+void Book::setCheckOutSlot(int checkOutSlot) {
+    Book::checkOutSlot = checkOutSlot;
+}
+
+/**
+ * @brief Get the oldest hold in the book's hold queue.
+ *
+ * @return Handle of the hold in the librarian's `PatronStore`, or -1 if nobody is waiting for the book.
+ */
+int Book::getFirstHold() const {
+    return firstHold;
+}
+
+/**
+ * @brief Set the oldest hold in the book's hold queue.
+ *
+ * @param firstHold Handle of the hold in the librarian's `PatronStore`, or -1 for none.
+ */
+void Book::setFirstHold(int firstHold) {
+    Book::firstHold = firstHold;
+}
+
+/**
+ * @brief Publishes the book's current circulation state as a new version.
+ *
+ * Must not be called by two threads at once. Versions published with the same stamp are merged.
+ * Versions older than the newest one that a reader at `oldestStamp` would see are unlinked and
+ * returned so the caller can free them once no reader can still reach them.
+ *
+ * @param stamp The commit stamp of the new version.
+ * @param oldestStamp The oldest stamp any current or future reader may read at.
+ * @return The unlinked versions, linked through `older`, or nullptr if none were unlinked.
+ */
+BookVersion *Book::publishVersion(unsigned long long stamp, unsigned long long oldestStamp) {
+    BookVersion* head = versions.load(memory_order_relaxed);
+    if (head != nullptr && head->stamp == stamp) {
+        // Not visible to any reader until the stamp is published, so it can be updated in place.
+        head->available = available;
+        head->fine = fine;
+        head->daysCheckedOut = daysCheckedOut;
+        return nullptr;
+    }
+    BookVersion* v = head == nullptr ? &firstVersion : new BookVersion;
+    v->stamp = stamp;
+    v->available = available;
+    v->fine = fine;
+    v->daysCheckedOut = daysCheckedOut;
+    v->older.store(head, memory_order_relaxed);
+    versions.store(v, memory_order_release);
+
+    // Find the version a reader at oldestStamp sees. No reader goes past it, so the rest can be dropped.
+    BookVersion* keep = v;
+    while (keep != nullptr && keep->stamp > oldestStamp) {
+        keep = keep->older.load(memory_order_relaxed);
+    }
+    if (keep == nullptr) {
+        return nullptr;
+    }
+    BookVersion* unlinked = keep->older.exchange(nullptr, memory_order_relaxed);
+    // The first version lives inside the book, so it is always last and is never handed back to be freed.
+    if (unlinked == &firstVersion) {
+        return nullptr;
+    }
+    for (BookVersion* u = unlinked; u != nullptr; u = u->older.load(memory_order_relaxed)) {
+        if (u->older.load(memory_order_relaxed) == &firstVersion) {
+            u->older.store(nullptr, memory_order_relaxed);
+            break;
+        }
+    }
+    return unlinked;
+}
+
+/**
+ * @brief Gets the version of the circulation state that was current at a commit stamp.
+ *
+ * @param stamp The commit stamp to read at.
+ * @return The newest version published at or before `stamp`, or nullptr if the book had none yet.
+ */
+const BookVersion *Book::versionAt(unsigned long long stamp) const {
+    const BookVersion* v = versions.load(memory_order_acquire);
+    while (v != nullptr && v->stamp > stamp) {
+        v = v->older.load(memory_order_acquire);
+    }
+    return v;
+}
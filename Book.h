@@ -5,10 +5,45 @@
 #ifndef LIBRARYMANAGEMENT_BOOK_H
 #define LIBRARYMANAGEMENT_BOOK_H
 
+#include "MemoryAccounting.h"
+#include <atomic>
+#include <cstdint>
 #include <string>
 
 using namespace std;
 
+class CatalogFile;
+
+/**
+ * @brief One committed version of a book's circulation state, read by point-in-time snapshots.
+ *
+ * Versions of a book form a list from newest to oldest. A version is never changed once a reader
+ * could see it, except that `older` is cleared when the versions behind it are no longer needed.
+ */
+struct BookVersion {
+    unsigned long long stamp; ///< Commit stamp at which this version became current.
+    bool available; ///< Availability status of the book.
+    int fine; ///< The fine associated with the book.
+    int daysCheckedOut; ///< The number of days the book has been checked out.
+    atomic<BookVersion*> older; ///< The version this one replaced, nullptr if no older version is kept.
+
+    /**
+     * @brief Allocates a version and counts it under `MemoryAccounting::BookVersions`.
+     *
+     * @param size The size of the version.
+     * @return Pointer to the space.
+     */
+    static void* operator new(size_t size);
+
+    /**
+     * @brief Frees a version and counts it as freed.
+     *
+     * @param p Pointer to the version.
+     * @param size The size of the version.
+     */
+    static void operator delete(void* p, size_t size);
+};
+
 /**
  * @class Book
  * @brief Represents a book in the library management system.
@@ -16,6 +51,18 @@ using namespace std;
  * This class holds information about a book, including its title, author, genre, publication year,
  * ISBN, availability status, fines, and days checked out. It provides methods to access and modify
  * these properties, as well as to compare books and generate a detailed book description.
+ *
+ * The availability, fine and days checked out are atomic so that they can be read without locks while
+ * another thread checks the book out or returns it. The title, author, genre and ISBN must not be changed
+ * once the book has been added to an inventory that other threads are reading.
+ *
+ * Besides its live state, a book keeps the versions of its circulation state that open snapshots may
+ * still need. The first version is stored inside the book so that a catalog that is never changed
+ * costs no extra allocations.
+ *
+ * A book loaded lazily starts with only its ISBN, year and availability, and the offset of its row in a
+ * `CatalogFile`. Its title, author and genre are read from the file the first time any of them is asked for, and
+ * kept from then on, so circulation never touches them.
  */
 class Book {
 public:
@@ -39,6 +86,25 @@ public:
     Book(string title, string author, string genre, short publicationYear, long long isbn,
          bool isAvailable);
 
+    /**
+     * @brief Constructs a book whose title, author and genre are read from a catalog file when first needed.
+     *
+     * @param source The file, which must stay mapped for as long as the book exists.
+     * @param offset Where the book's row starts in the file.
+     * @param publicationYear Year the book was published.
+     * @param isbn ISBN of the book.
+     * @param isAvailable Availability of the book (true if available).
+     */
+    Book(const CatalogFile* source, uint64_t offset, short publicationYear, long long isbn, bool isAvailable);
+
+    /**
+     * @brief Destructor. Frees the versions of the book's circulation state.
+     */
+    ~Book();
+
+    Book(const Book&) = delete;
+    Book& operator=(const Book&) = delete;
+
     /**
      * @brief Get the title of the book.
      *
@@ -146,6 +212,21 @@ public:
      */
     [[nodiscard]] string getInfo() const;
 
+    /**
+     * @brief Tells whether the title, author and genre are in memory, rather than still to be read from the file.
+     *
+     * @return true if they are in memory.
+     */
+    [[nodiscard]] bool hasDetails() const;
+
+    /**
+     * @brief Get detailed information about the book as of a version of its circulation state.
+     *
+     * @param state The version whose availability, fine and days checked out to show.
+     * @return A string in the same format as `getInfo()`.
+     */
+    [[nodiscard]] string getInfo(const BookVersion& state) const;
+
     /**
      * @brief Get the fine associated with the book.
      *
@@ -174,15 +255,120 @@ public:
      */
     void setDaysCheckedOut(int daysCheckedOut);
 
+    /**
+     * @brief Get the ID of the patron who has the book checked out.
+     *
+     * @return The borrowing patron's ID, or 0 if no patron is recorded for the loan.
+     */
+    [[nodiscard]] unsigned int getBorrower() const;
+
+    /**
+     * @brief Set the ID of the patron who has the book checked out.
+     *
+     * @param borrower The borrowing patron's ID, or 0 for none.
+     */
+    void setBorrower(unsigned int borrower);
+
+    /**
+     * @brief Get the next book in the borrower's loan list.
+     *
+     * @return Pointer to the next loaned book, or nullptr if this is the last loan.
+     */
+    [[nodiscard]] Book* getNextLoan() const;
+
+    /**
+     * @brief Set the next book in the borrower's loan list.
+     *
+     * @param nextLoan Pointer to the next loaned book.
+     */
+    void setNextLoan(Book* nextLoan);
+
+    /**
+     * @brief Get the previous book in the borrower's loan list.
+     *
+     * @return Pointer to the previous loaned book, or nullptr if this is the first loan.
+     */
+    [[nodiscard]] Book* getPrevLoan() const;
+
+    /**
+     * @brief Set the previous book in the borrower's loan list.
+     *
+     * @param prevLoan Pointer to the previous loaned book.
+     */
+    void setPrevLoan(Book* prevLoan);
+
+    /**
+     * @brief Get the position of the book in the librarian's checked-out list.
+     *
+     * @return The index into the checked-out list, or -1 if the book is not in it.
+     */
+    [[nodiscard]] int getCheckOutSlot() const;
+
+    /**
+     * @brief Set the position of the book in the librarian's checked-out list.
+     *
+     * @param checkOutSlot The index into the checked-out list, or -1 if the book is not in it.
+     */
+    void setCheckOutSlot(int checkOutSlot);
+
+    /**
+     * @brief Get the oldest hold in the book's hold queue.
+     *
+     * @return Handle of the hold in the librarian's `PatronStore`, or -1 if nobody is waiting for the book.
+     */
+    [[nodiscard]] int getFirstHold() const;
+
+    /**
+     * @brief Set the oldest hold in the book's hold queue.
+     *
+     * @param firstHold Handle of the hold in the librarian's `PatronStore`, or -1 for none.
+     */
+    void setFirstHold(int firstHold);
+
+    /**
+     * @brief Publishes the book's current circulation state as a new version.
+     *
+     * Must not be called by two threads at once. Versions published with the same stamp are merged.
+     * Versions older than the newest one that a reader at `oldestStamp` would see are unlinked and
+     * returned so the caller can free them once no reader can still reach them.
+     *
+     * @param stamp The commit stamp of the new version.
+     * @param oldestStamp The oldest stamp any current or future reader may read at.
+     * @return The unlinked versions, linked through `older`, or nullptr if none were unlinked.
+     */
+    BookVersion* publishVersion(unsigned long long stamp, unsigned long long oldestStamp);
+
+    /**
+     * @brief Gets the version of the circulation state that was current at a commit stamp.
+     *
+     * @param stamp The commit stamp to read at.
+     * @return The newest version published at or before `stamp`, or nullptr if the book had none yet.
+     */
+    [[nodiscard]] const BookVersion* versionAt(unsigned long long stamp) const;
+
 private:
-    string title; ///< The title of the book.
-    string author; ///< The author of the book.
-    string genre; ///< The genre of the book.
+    /**
+     * @brief Reads the title, author and genre from the catalog file, unless another thread already has.
+     */
+    void loadDetails() const;
+
+    mutable string title; ///< The title of the book.
+    mutable string author; ///< The author of the book.
+    mutable string genre; ///< The genre of the book.
+    mutable atomic<const CatalogFile*> source; ///< File holding the title, author and genre, nullptr once read.
+    uint64_t sourceOffset; ///< Where the book's row starts in `source`.
     short publicationYear; ///< The year the book was published.
     long long ISBN; ///< The ISBN of the book.
-    bool available; ///< Availability status of the book.
-    int fine; ///< The fine associated with the book.
-    int daysCheckedOut; ///< The number of days the book has been checked out.
+    atomic<bool> available; ///< Availability status of the book.
+    atomic<int> fine; ///< The fine associated with the book.
+    atomic<int> daysCheckedOut; ///< The number of days the book has been checked out.
+    unsigned int borrower; ///< ID of the patron the book is loaned to, 0 if none.
+    int checkOutSlot; ///< Index of the book in the checked-out list, -1 if not checked out.
+    int firstHold; ///< Oldest hold in the book's hold queue, -1 if none.
+    Book* prevLoan; ///< Previous book in the borrower's loan list.
+    Book* nextLoan; ///< Next book in the borrower's loan list.
+    BookVersion firstVersion; ///< Storage for the first published version.
+    atomic<BookVersion*> versions; ///< Newest published version, nullptr until the first one is published.
 };
 
 #endif //LIBRARYMANAGEMENT_BOOK_H
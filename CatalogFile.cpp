@@ -0,0 +1,99 @@
+#include "CatalogFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Constructs a catalog file with nothing mapped.
+ */
+CatalogFile::CatalogFile() : data(nullptr), size(0) {
+}
+
+/**
+ * @brief Destructor. Unmaps the file.
+ */
+CatalogFile::~CatalogFile() {
+    close();
+}
+
+/**
+ * @brief Maps a file, unmapping the one mapped before.
+ *
+ * An empty file is opened without mapping anything, since it has no pages to map.
+ *
+ * @param path Path of the file.
+ * @return true if the file was mapped, false otherwise.
+ */
+bool CatalogFile::open(const string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (info.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    data = static_cast<const char*>(mapped);
+    size = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+/**
+ * @brief Gets the contents of the file.
+ *
+ * @return The contents, empty if no file is mapped.
+ */
+string_view CatalogFile::getText() const {
+    return {data, size};
+}
+
+/**
+ * @brief Reads the title, author and genre of the row at an offset, in the catalog's CSV format.
+ *
+ * They are the second, third and fourth fields of the row. Rows were checked for six fields when the catalog was
+ * loaded, so a missing field is left empty rather than reported.
+ *
+ * @param offset Where the row starts.
+ * @param title Set to the title.
+ * @param author Set to the author.
+ * @param genre Set to the genre.
+ */
+void CatalogFile::readDetails(uint64_t offset, string &title, string &author, string &genre) const {
+    string_view row = getText().substr(offset);
+    row = row.substr(0, row.find('\n'));
+    string* fields[] = {&title, &author, &genre};
+    size_t start = row.find(',');
+    for (string* field : fields) {
+        if (start == string_view::npos) {
+            field->clear();
+            continue;
+        }
+        size_t end = row.find(',', start + 1);
+        field->assign(row.substr(start + 1, end == string_view::npos ? string_view::npos : end - start - 1));
+        start = end;
+    }
+}
+
+/**
+ * @brief Unmaps the file, if one is mapped.
+ */
+void CatalogFile::close() {
+    if (data != nullptr) {
+        munmap(const_cast<char*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+}
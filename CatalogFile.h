@@ -0,0 +1,70 @@
+#ifndef LIBRARYMANAGEMENT_CATALOGFILE_H
+#define LIBRARYMANAGEMENT_CATALOGFILE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * @class CatalogFile
+ * @brief A catalog CSV file mapped into memory, which books loaded lazily read their title, author and genre from.
+ *
+ * The file is mapped read-only, so its pages are only read from disk when a row is first looked at, and the
+ * kernel may drop them again under memory pressure since they can always be read back. The file must not be
+ * changed or truncated while it is mapped.
+ *
+ * Mapping and unmapping are not thread-safe; reading rows is.
+ */
+class CatalogFile {
+public:
+    /**
+     * @brief Constructs a catalog file with nothing mapped.
+     */
+    CatalogFile();
+
+    /**
+     * @brief Destructor. Unmaps the file.
+     */
+    ~CatalogFile();
+
+    CatalogFile(const CatalogFile&) = delete;
+    CatalogFile& operator=(const CatalogFile&) = delete;
+
+    /**
+     * @brief Maps a file, unmapping the one mapped before.
+     *
+     * @param path Path of the file.
+     * @return true if the file was mapped, false otherwise.
+     */
+    bool open(const string& path);
+
+    /**
+     * @brief Gets the contents of the file.
+     *
+     * @return The contents, empty if no file is mapped.
+     */
+    [[nodiscard]] string_view getText() const;
+
+    /**
+     * @brief Reads the title, author and genre of the row at an offset, in the catalog's CSV format.
+     *
+     * @param offset Where the row starts.
+     * @param title Set to the title.
+     * @param author Set to the author.
+     * @param genre Set to the genre.
+     */
+    void readDetails(uint64_t offset, string& title, string& author, string& genre) const;
+
+private:
+    /**
+     * @brief Unmaps the file, if one is mapped.
+     */
+    void close();
+
+    const char* data; ///< The mapped contents, nullptr if nothing is mapped.
+    size_t size; ///< Length of the contents.
+};
+
+#endif //LIBRARYMANAGEMENT_CATALOGFILE_H
@@ -0,0 +1,323 @@
+#include "CatalogQuery.h"
+#include "IsbnIndex.h"
+#include <algorithm>
+#include <limits>
+
+/**
+ * @brief Lowercases an ASCII letter, leaving other bytes alone.
+ *
+ * @param c The byte.
+ * @return The lowercased byte.
+ */
+static char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+/**
+ * @brief Tells whether a byte is whitespace.
+ *
+ * @param c The byte.
+ * @return true for a space, tab or line break.
+ */
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * @brief Removes the whitespace around text.
+ *
+ * @param text The text.
+ * @return The text without it.
+ */
+static string_view trim(string_view text) {
+    while (!text.empty() && isBlank(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && isBlank(text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+/**
+ * @brief Lowercases text.
+ *
+ * @param text The text.
+ * @return A lowercased copy.
+ */
+static string lowered(string_view text) {
+    string result(text);
+    transform(result.begin(), result.end(), result.begin(), lower);
+    return result;
+}
+
+/**
+ * @brief Tells whether the word `AND` starts at a position of a query, in any case and standing alone.
+ *
+ * @param text The query.
+ * @param i The position.
+ * @return true if `AND` is there.
+ */
+static bool isAnd(string_view text, size_t i) {
+    return i + 3 <= text.size() && (i == 0 || isBlank(text[i - 1])) && lowered(text.substr(i, 3)) == "and" &&
+           (i + 3 == text.size() || isBlank(text[i + 3]));
+}
+
+/**
+ * @brief Parses a decimal integer, which may be negative or, for ISBNs, contain hyphens.
+ *
+ * @param text The text of the number.
+ * @param hyphens true to skip hyphens between digits.
+ * @param value Set to the number.
+ * @return true if the text was a valid number, false otherwise.
+ */
+static bool parseInteger(string_view text, bool hyphens, long long &value) {
+    bool negative = !hyphens && !text.empty() && text.front() == '-';
+    if (negative) {
+        text.remove_prefix(1);
+    }
+    long long result = 0;
+    int digits = 0;
+    for (char c : text) {
+        if (c >= '0' && c <= '9') {
+            if (++digits > 18) {
+                return false;
+            }
+            result = result * 10 + (c - '0');
+        } else if (!hyphens || c != '-') {
+            return false;
+        }
+    }
+    value = negative ? -result : result;
+    return digits != 0;
+}
+
+/**
+ * @brief Constructs a query that matches every book.
+ */
+CatalogQuery::CatalogQuery() : availability(Any) {
+    fill(low, low + NUMERIC_FIELDS, numeric_limits<long long>::min());
+    fill(high, high + NUMERIC_FIELDS, numeric_limits<long long>::max());
+}
+
+/**
+ * @brief Parses and compiles a query.
+ *
+ * The text is split into terms at every `AND` outside quotes, and each term is folded into the compiled query.
+ *
+ * @param text The query, such as `genre=Dystopian AND year<1960 AND available`.
+ * @param query Set to the compiled query.
+ * @param error Set to a description of the first problem if the query is not valid.
+ * @return true if the query was compiled, false otherwise.
+ */
+bool CatalogQuery::compile(string_view text, CatalogQuery &query, string &error) {
+    query = CatalogQuery();
+    query.text = trim(text);
+    size_t start = 0;
+    bool quoted = false;
+    for (size_t i = 0; i <= text.size(); i++) {
+        bool end = i == text.size();
+        if (!end && text[i] == '"') {
+            quoted = !quoted;
+        }
+        if (!end && (quoted || !isAnd(text, i))) {
+            continue;
+        }
+        if (quoted) {
+            error = "unterminated quote";
+            return false;
+        }
+        string_view term = trim(text.substr(start, i - start));
+        if (term.empty()) {
+            error = end ? "expected a term at the end" : "expected a term before AND";
+            return false;
+        }
+        if (!query.addTerm(term, error)) {
+            return false;
+        }
+        i += 2;
+        start = i + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Gets the text the query was compiled from.
+ *
+ * @return The text, without surrounding whitespace.
+ */
+const string &CatalogQuery::getText() const {
+    return text;
+}
+
+/**
+ * @brief Tells whether no book can match, because the ranges of some field do not overlap.
+ *
+ * @return true if the query matches nothing.
+ */
+bool CatalogQuery::isEmpty() const {
+    for (int i = 0; i < NUMERIC_FIELDS; i++) {
+        if (low[i] > high[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Gets the range of ISBNs the query allows.
+ *
+ * @param first Set to the smallest ISBN a match can have.
+ * @param last Set to the largest ISBN a match can have.
+ * @return true if the range is narrower than every ISBN, false otherwise.
+ */
+bool CatalogQuery::isbnRange(long long &first, long long &last) const {
+    first = low[Isbn];
+    last = high[Isbn];
+    return first != numeric_limits<long long>::min() || last != numeric_limits<long long>::max();
+}
+
+/**
+ * @brief Tells whether the query reads circulation state, whose changes do not change the catalog.
+ *
+ * @return true if the query tests availability, fines or days left.
+ */
+bool CatalogQuery::readsCirculation() const {
+    if (availability != Any) {
+        return true;
+    }
+    for (NumericField field : {Fine, Days}) {
+        if (low[field] != numeric_limits<long long>::min() || high[field] != numeric_limits<long long>::max()) {
+            return true;
+        }
+    }
+    return any_of(exclusions.begin(), exclusions.end(), [](const Exclusion& e) {
+        return e.field == Fine || e.field == Days;
+    });
+}
+
+/**
+ * @brief Tells whether a book's field satisfies the term.
+ *
+ * @param text The value of the term's field.
+ * @return true if the term holds.
+ */
+bool CatalogQuery::TextTerm::matches(const string &text) const {
+    auto same = [](char a, char b) {
+        return lower(a) == b;
+    };
+    bool found = contains ? search(text.begin(), text.end(), value.begin(), value.end(), same) != text.end()
+                          : text.size() == value.size() && equal(text.begin(), text.end(), value.begin(), same);
+    return found != negated;
+}
+
+/**
+ * @brief Compiles one term into the query.
+ *
+ * A numeric comparison narrows its field's range, or adds an exclusion for `!=`. A text comparison is kept with
+ * its value lowercased, so matching only has to lowercase the book's side.
+ *
+ * @param term The term, without the surrounding `AND`s.
+ * @param error Set to a description of the problem if the term is not valid.
+ * @return true if the term was compiled, false otherwise.
+ */
+bool CatalogQuery::addTerm(string_view term, string &error) {
+    string lowerTerm = lowered(term);
+    if (lowerTerm == "available" || lowerTerm == "checkedout") {
+        Availability wanted = lowerTerm == "available" ? Available : CheckedOut;
+        if (availability != Any && availability != wanted) {
+            // A book cannot be both, so leave the query empty.
+            low[Isbn] = 1;
+            high[Isbn] = 0;
+        }
+        availability = wanted;
+        return true;
+    }
+
+    size_t nameLength = 0;
+    while (nameLength < term.size() && lower(term[nameLength]) >= 'a' && lower(term[nameLength]) <= 'z') {
+        nameLength++;
+    }
+    string name = lowered(term.substr(0, nameLength));
+    string_view rest = trim(term.substr(nameLength));
+    string op;
+    for (const char* candidate : {"<=", ">=", "!=", "=", "<", ">", "~"}) {
+        if (rest.substr(0, char_traits<char>::length(candidate)) == candidate) {
+            op = candidate;
+            break;
+        }
+    }
+    if (name.empty()) {
+        error = "expected a field name in \"" + string(term) + "\"";
+        return false;
+    }
+    if (op.empty()) {
+        error = "expected an operator after \"" + name + "\"";
+        return false;
+    }
+    string_view value = trim(rest.substr(op.size()));
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+    }
+    if (value.empty()) {
+        error = "expected a value after \"" + name + op + "\"";
+        return false;
+    }
+
+    if (name == "title" || name == "author" || name == "genre") {
+        if (op != "=" && op != "!=" && op != "~") {
+            error = name + " can only be compared with =, != or ~";
+            return false;
+        }
+        TextField field = name == "title" ? Title : name == "author" ? Author : Genre;
+        textTerms.push_back({field, op == "~", op == "!=", lowered(value)});
+        return true;
+    }
+
+    NumericField field;
+    if (name == "isbn") {
+        field = Isbn;
+    } else if (name == "year") {
+        field = Year;
+    } else if (name == "fine") {
+        field = Fine;
+    } else if (name == "days") {
+        field = Days;
+    } else {
+        error = "unknown field \"" + name + "\"";
+        return false;
+    }
+    if (op == "~") {
+        error = "~ only applies to title, author and genre";
+        return false;
+    }
+    long long first;
+    long long last;
+    if (field == Isbn && op == "=" && value.back() == '*') {
+        if (!IsbnIndex::prefixRange(value.substr(0, value.size() - 1), first, last)) {
+            error = "\"" + string(value) + "\" is not an ISBN prefix";
+            return false;
+        }
+    } else if (parseInteger(value, field == Isbn, first)) {
+        last = first;
+    } else {
+        error = "\"" + string(value) + "\" is not a number";
+        return false;
+    }
+
+    if (op == "!=") {
+        exclusions.push_back({field, first});
+    } else if (op == "=") {
+        low[field] = max(low[field], first);
+        high[field] = min(high[field], last);
+    } else if (op == "<") {
+        high[field] = min(high[field], first - 1);
+    } else if (op == "<=") {
+        high[field] = min(high[field], first);
+    } else if (op == ">") {
+        low[field] = max(low[field], first + 1);
+    } else {
+        low[field] = max(low[field], first);
+    }
+    return true;
+}
@@ -0,0 +1,178 @@
+#ifndef LIBRARYMANAGEMENT_CATALOGQUERY_H
+#define LIBRARYMANAGEMENT_CATALOGQUERY_H
+
+#include "Book.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class CatalogQuery
+ * @brief A filter over the catalog, such as `genre=Dystopian AND year<1960 AND available`, compiled once into a
+ *        predicate that reads each book's fields a single time.
+ *
+ * A query is one or more terms joined by `AND`. A term compares a field with a value:
+ *
+ * | Field                      | Operators                     | Example                                      |
+ * |----------------------------|-------------------------------|----------------------------------------------|
+ * | `isbn`                     | `=` `!=` `<` `<=` `>` `>=`    | `isbn>=978-0-14`, or a prefix `isbn=978-0-*` |
+ * | `year`, `fine`, `days`     | `=` `!=` `<` `<=` `>` `>=`    | `year<1960`                                  |
+ * | `title`, `author`, `genre` | `=` `!=` and `~` for contains | `title~"brave new"`                          |
+ *
+ * `available` and `checkedout` are terms of their own. Text comparisons ignore case, and values with spaces
+ * may be quoted. `fine` and `days` are the overdue fine and the days left of a checked-out book.
+ *
+ * Compiling folds every comparison of a number into an inclusive range per field, so `year>1900 AND year<1960`
+ * becomes one range and the predicate checks all numeric ranges and the availability together before it looks
+ * at any text. The ISBN range also tells the librarian whether the ordered ISBN index can narrow the books to
+ * check; see `Librarian::queryBooks`.
+ */
+class CatalogQuery {
+public:
+    /**
+     * @brief The numeric fields, each compiled into one range.
+     */
+    enum NumericField {
+        Isbn, Year, Fine, Days, NUMERIC_FIELDS
+    };
+
+    /**
+     * @brief Constructs a query that matches every book.
+     */
+    CatalogQuery();
+
+    /**
+     * @brief Parses and compiles a query.
+     *
+     * @param text The query, such as `genre=Dystopian AND year<1960 AND available`.
+     * @param query Set to the compiled query.
+     * @param error Set to a description of the first problem if the query is not valid.
+     * @return true if the query was compiled, false otherwise.
+     */
+    static bool compile(string_view text, CatalogQuery& query, string& error);
+
+    /**
+     * @brief Tells whether a book matches the query.
+     *
+     * @tparam BookType `Book`, or any type with the same getters, such as `ArchivedBook`.
+     * @param book The book.
+     * @param state The book's circulation state to test, such as its state in a snapshot.
+     * @return true if every term holds for the book.
+     */
+    template<typename BookType>
+    [[nodiscard]] bool matches(const BookType& book, const BookVersion& state) const {
+        long long values[NUMERIC_FIELDS] = {book.getIsbn(), book.getPublicationYear(), state.fine,
+                                            state.daysCheckedOut};
+        // Evaluate every range without branching; most books fail here and never reach the text.
+        bool inRange = availability == Any || state.available == (availability == Available);
+        for (int i = 0; i < NUMERIC_FIELDS; i++) {
+            inRange &= (values[i] >= low[i]) & (values[i] <= high[i]);
+        }
+        if (!inRange) {
+            return false;
+        }
+        for (const Exclusion& e : exclusions) {
+            if (values[e.field] == e.value) {
+                return false;
+            }
+        }
+        for (const TextTerm& t : textTerms) {
+            if (!t.matches(t.field == Title ? book.getTitle() : t.field == Author ? book.getAuthor()
+                                                                                  : book.getGenre())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Gets the text the query was compiled from.
+     *
+     * @return The text, without surrounding whitespace.
+     */
+    [[nodiscard]] const string& getText() const;
+
+    /**
+     * @brief Tells whether no book can match, because the ranges of some field do not overlap.
+     *
+     * @return true if the query matches nothing.
+     */
+    [[nodiscard]] bool isEmpty() const;
+
+    /**
+     * @brief Gets the range of ISBNs the query allows.
+     *
+     * @param first Set to the smallest ISBN a match can have.
+     * @param last Set to the largest ISBN a match can have.
+     * @return true if the range is narrower than every ISBN, false otherwise.
+     */
+    bool isbnRange(long long& first, long long& last) const;
+
+    /**
+     * @brief Tells whether the query reads circulation state, whose changes do not change the catalog.
+     *
+     * @return true if the query tests availability, fines or days left.
+     */
+    [[nodiscard]] bool readsCirculation() const;
+
+private:
+    /**
+     * @brief Which availability the query requires.
+     */
+    enum Availability {
+        Any, Available, CheckedOut
+    };
+
+    /**
+     * @brief The text fields.
+     */
+    enum TextField {
+        Title, Author, Genre
+    };
+
+    /**
+     * @brief A value a numeric field must not have.
+     */
+    struct Exclusion {
+        NumericField field; ///< The field.
+        long long value; ///< The value it must not have.
+    };
+
+    /**
+     * @brief A comparison of a text field.
+     */
+    struct TextTerm {
+        TextField field; ///< The field.
+        bool contains; ///< true to look for the value anywhere in the field, false to compare the whole field.
+        bool negated; ///< true if the field must not match.
+        string value; ///< The value, lowercased.
+
+        /**
+         * @brief Tells whether a book's field satisfies the term.
+         *
+         * @param text The value of the term's field.
+         * @return true if the term holds.
+         */
+        [[nodiscard]] bool matches(const string& text) const;
+    };
+
+    /**
+     * @brief Compiles one term into the query.
+     *
+     * @param term The term, without the surrounding `AND`s.
+     * @param error Set to a description of the problem if the term is not valid.
+     * @return true if the term was compiled, false otherwise.
+     */
+    bool addTerm(string_view term, string& error);
+
+    string text; ///< The text the query was compiled from.
+    long long low[NUMERIC_FIELDS]; ///< The smallest value each numeric field may have.
+    long long high[NUMERIC_FIELDS]; ///< The largest value each numeric field may have.
+    Availability availability; ///< The availability the query requires.
+    vector<Exclusion> exclusions; ///< Values excluded with `!=`.
+    vector<TextTerm> textTerms; ///< Comparisons of text fields, checked after the ranges.
+};
+
+#endif //LIBRARYMANAGEMENT_CATALOGQUERY_H
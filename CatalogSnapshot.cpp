@@ -0,0 +1,69 @@
+#include "CatalogSnapshot.h"
+
+/**
+ * @brief Takes a snapshot at the most recently published commit stamp.
+ *
+ * @param inventory The inventory to read.
+ * @param reclaimer The reclaimer that frees the versions of the inventory's books.
+ * @param clock The most recently published commit stamp.
+ */
+CatalogSnapshot::CatalogSnapshot(const Inventory &inventory, EpochReclaimer &reclaimer,
+                                 const atomic<unsigned long long> &clock) : inventory(inventory), reclaimer(reclaimer) {
+    slot = reclaimer.pin(clock, stamp);
+}
+
+/**
+ * @brief Destructor. Unpins the snapshot's reader slot.
+ */
+CatalogSnapshot::~CatalogSnapshot() {
+    reclaimer.unpin(slot);
+}
+
+/**
+ * @brief Gets the commit stamp the snapshot reads at.
+ *
+ * @return The commit stamp.
+ */
+unsigned long long CatalogSnapshot::getStamp() const {
+    return stamp;
+}
+
+/**
+ * @brief Gets a book's circulation state as of the snapshot.
+ *
+ * @param b Pointer to the book.
+ * @return The book's version at the snapshot's stamp, or nullptr if the book was not yet in the catalog.
+ */
+const BookVersion *CatalogSnapshot::stateOf(const Book *b) const {
+    return b->versionAt(stamp);
+}
+
+/**
+ * @brief Calls a function on every book in the snapshot, along with its state as of the snapshot.
+ *
+ * @param visit The function to call with each book and its state.
+ */
+void CatalogSnapshot::forEachBook(const function<void(const Book *, const BookVersion &)> &visit) const {
+    inventory.forEachBook([&](Book* b) {
+        const BookVersion* state = b->versionAt(stamp);
+        if (state != nullptr) {
+            visit(b, *state);
+        }
+    });
+}
+
+/**
+ * @brief Calls a function on every book in the snapshot from several threads at once.
+ *
+ * @param chunks The number of slot ranges to split the inventory into, as in `Inventory::parallelForEachBook`.
+ * @param visit The function to call with the index of the range, each book in it and the book's state.
+ */
+void CatalogSnapshot::parallelForEachBook(size_t chunks,
+                                          const function<void(size_t, const Book *, const BookVersion &)> &visit) const {
+    inventory.parallelForEachBook(chunks, [&](size_t chunk, Book* b) {
+        const BookVersion* state = b->versionAt(stamp);
+        if (state != nullptr) {
+            visit(chunk, b, *state);
+        }
+    });
+}
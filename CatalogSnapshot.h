@@ -0,0 +1,75 @@
+#ifndef LIBRARYMANAGEMENT_CATALOGSNAPSHOT_H
+#define LIBRARYMANAGEMENT_CATALOGSNAPSHOT_H
+
+#include "EpochReclaimer.h"
+#include "Inventory.h"
+#include <functional>
+
+/**
+ * @class CatalogSnapshot
+ * @brief A consistent point-in-time view of the inventory and its circulation state.
+ *
+ * A snapshot reads every book as of one commit stamp, so a report sees each checkout, return or batch
+ * either entirely or not at all, and never blocks writers. While it is alive the snapshot keeps a reader
+ * slot pinned, which keeps the book versions it may read from being freed, so it should be destroyed
+ * as soon as the report is done. Books added after the snapshot was taken are left out of it. Books
+ * removed from the inventory while the snapshot is alive may also be left out.
+ */
+class CatalogSnapshot {
+public:
+    /**
+     * @brief Takes a snapshot at the most recently published commit stamp.
+     *
+     * @param inventory The inventory to read.
+     * @param reclaimer The reclaimer that frees the versions of the inventory's books.
+     * @param clock The most recently published commit stamp.
+     */
+    CatalogSnapshot(const Inventory& inventory, EpochReclaimer& reclaimer, const atomic<unsigned long long>& clock);
+
+    /**
+     * @brief Destructor. Unpins the snapshot's reader slot.
+     */
+    ~CatalogSnapshot();
+
+    CatalogSnapshot(const CatalogSnapshot&) = delete;
+    CatalogSnapshot& operator=(const CatalogSnapshot&) = delete;
+
+    /**
+     * @brief Gets the commit stamp the snapshot reads at.
+     *
+     * @return The commit stamp.
+     */
+    [[nodiscard]] unsigned long long getStamp() const;
+
+    /**
+     * @brief Gets a book's circulation state as of the snapshot.
+     *
+     * @param b Pointer to the book.
+     * @return The book's version at the snapshot's stamp, or nullptr if the book was not yet in the catalog.
+     */
+    [[nodiscard]] const BookVersion* stateOf(const Book* b) const;
+
+    /**
+     * @brief Calls a function on every book in the snapshot, along with its state as of the snapshot.
+     *
+     * @param visit The function to call with each book and its state.
+     */
+    void forEachBook(const function<void(const Book*, const BookVersion&)>& visit) const;
+
+    /**
+     * @brief Calls a function on every book in the snapshot from several threads at once.
+     *
+     * @param chunks The number of slot ranges to split the inventory into, as in `Inventory::parallelForEachBook`.
+     * @param visit The function to call with the index of the range, each book in it and the book's state.
+     */
+    void parallelForEachBook(size_t chunks,
+                             const function<void(size_t, const Book*, const BookVersion&)>& visit) const;
+
+private:
+    const Inventory& inventory; ///< The inventory being read.
+    EpochReclaimer& reclaimer; ///< The reclaimer the reader slot is pinned in.
+    unsigned long long stamp; ///< The commit stamp the snapshot reads at.
+    int slot; ///< The pinned reader slot.
+};
+
+#endif //LIBRARYMANAGEMENT_CATALOGSNAPSHOT_H
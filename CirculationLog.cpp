@@ -0,0 +1,199 @@
+#include "CirculationLog.h"
+#include <iostream>
+
+/**
+ * @brief Opens a log for appending, creating it if needed, and starts the flusher thread.
+ *
+ * @param path Path of the log file.
+ * @param executor The executor coroutines waiting for durability are resumed on, or nullptr if none wait.
+ */
+CirculationLog::CirculationLog(const string &path, CoroutineExecutor *executor)
+        : io(4, 64 * 1024), executor(executor), appended(0), durable(0), stopping(false), failed(false) {
+    fd = io.openFile(path, false);
+    if (fd != -1) {
+        flusher = thread(&CirculationLog::flushLoop, this);
+    }
+}
+
+/**
+ * @brief Destructor. Makes every appended record durable, then stops the flusher and closes the file.
+ */
+CirculationLog::~CirculationLog() {
+    if (fd == -1) {
+        return;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    work.notify_one();
+    flusher.join();
+    io.closeFile(fd);
+}
+
+/**
+ * @brief Tells whether the log file was opened.
+ *
+ * @return true if the log is open, false otherwise.
+ */
+bool CirculationLog::isOpen() const {
+    return fd != -1;
+}
+
+/**
+ * @brief Appends a record. It is written in the background.
+ *
+ * @param record The record, without a line break.
+ * @return The record's sequence number, for `waitDurable`.
+ */
+unsigned long long CirculationLog::append(string_view record) {
+    unsigned long long sequence;
+    {
+        lock_guard<mutex> guard(lock);
+        pending.append(record);
+        pending += '\n';
+        sequence = ++appended;
+    }
+    work.notify_one();
+    return sequence;
+}
+
+/**
+ * @brief Waits until a record and every record before it is durable.
+ *
+ * @param sequence The record's sequence number, as returned by `append`.
+ * @return An awaitable for `co_await`, producing false if the record can no longer become durable.
+ */
+CirculationLog::DurableAwaiter CirculationLog::waitDurable(unsigned long long sequence) {
+    return DurableAwaiter{*this, sequence};
+}
+
+/**
+ * @brief Tells whether the record's fate is already known, so the coroutine need not suspend.
+ *
+ * @return true if the record is durable, the log has failed or the log is closed.
+ */
+bool CirculationLog::DurableAwaiter::await_ready() const {
+    if (log.fd == -1) {
+        return true;
+    }
+    lock_guard<mutex> guard(log.lock);
+    return log.durable >= sequence || log.failed;
+}
+
+/**
+ * @brief Queues the coroutine to be resumed once the record is durable.
+ *
+ * @param awaiting The coroutine waiting for the record.
+ * @return false if the record became durable in the meantime and the coroutine continues at once.
+ */
+bool CirculationLog::DurableAwaiter::await_suspend(coroutine_handle<> awaiting) {
+    lock_guard<mutex> guard(log.lock);
+    if (log.durable >= sequence || log.failed) {
+        return false;
+    }
+    log.waiters.emplace_back(sequence, awaiting);
+    return true;
+}
+
+/**
+ * @brief Tells the resumed coroutine whether its record became durable.
+ *
+ * @return true if the record is durable or the log is closed, false if the log failed before the record was synced.
+ */
+bool CirculationLog::DurableAwaiter::await_resume() const {
+    if (log.fd == -1) {
+        return true;
+    }
+    lock_guard<mutex> guard(log.lock);
+    return log.durable >= sequence;
+}
+
+/**
+ * @brief Blocks the calling thread until every record appended so far is durable, or the log has failed.
+ */
+void CirculationLog::flush() {
+    if (fd == -1) {
+        return;
+    }
+    unique_lock<mutex> guard(lock);
+    unsigned long long target = appended;
+    synced.wait(guard, [this, target] { return durable >= target || failed; });
+}
+
+/**
+ * @brief Sets a function the flusher calls with every batch of records once it is durable.
+ *
+ * @param listener The function, given the batch's records, each ending in a line break, and the sequence number
+ *                 of the batch's last record.
+ */
+void CirculationLog::setDurableListener(function<void(string_view, unsigned long long)> listener) {
+    durableListener = std::move(listener);
+}
+
+/**
+ * @brief Tells whether the log is written with io_uring.
+ *
+ * @return true for io_uring, false for the pwrite fallback.
+ */
+bool CirculationLog::usesIoUring() const {
+    return io.usesIoUring();
+}
+
+/**
+ * @brief Body of the flusher thread. Writes and syncs accumulated records until the log is destroyed.
+ *
+ * Once a write or sync fails, later records are dropped rather than written after a batch that may be incomplete.
+ */
+void CirculationLog::flushLoop() {
+    string batch;
+    vector<coroutine_handle<>> ready;
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        work.wait(guard, [this] { return stopping || !pending.empty(); });
+        if (pending.empty()) {
+            return;
+        }
+        batch.swap(pending);
+        unsigned long long target = appended;
+        if (failed) {
+            batch.clear();
+            continue;
+        }
+        guard.unlock();
+
+        io.append(fd, batch);
+        bool ok = io.sync(fd);
+        if (ok && durableListener) {
+            durableListener(batch, target);
+        }
+        batch.clear();
+
+        guard.lock();
+        if (ok) {
+            durable = target;
+        } else {
+            failed = true;
+            cerr << "Circulation log write failed; changes after record " << durable
+                 << " are not durable and are no longer logged." << endl;
+        }
+        size_t kept = 0;
+        for (auto& waiter : waiters) {
+            if (waiter.first <= durable || failed) {
+                ready.push_back(waiter.second);
+            } else {
+                waiters[kept++] = waiter;
+            }
+        }
+        waiters.resize(kept);
+        synced.notify_all();
+        if (!ready.empty()) {
+            guard.unlock();
+            for (coroutine_handle<> h : ready) {
+                executor->post(h);
+            }
+            ready.clear();
+            guard.lock();
+        }
+    }
+}
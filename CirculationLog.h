@@ -0,0 +1,135 @@
+#ifndef LIBRARYMANAGEMENT_CIRCULATIONLOG_H
+#define LIBRARYMANAGEMENT_CIRCULATIONLOG_H
+
+#include "CoroutineExecutor.h"
+#include "IoBackend.h"
+#include <condition_variable>
+#include <coroutine>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class CirculationLog
+ * @brief A write-ahead log of the commands that changed the library, made durable in the background.
+ *
+ * Each record is one line in the `CommandProcessor` command language, so replaying the log as a script
+ * against the same starting catalog rebuilds the circulation state. Records are appended to a buffer in
+ * memory, and a flusher thread writes and fsyncs whatever has accumulated through an `IoBackend`. All the
+ * records that arrive during one fsync go out with the next one, so many requests share each disk sync.
+ *
+ * A request coroutine that must not be answered before its change is durable awaits `waitDurable`,
+ * which suspends it until the flusher has synced its record and then posts it back to the executor.
+ *
+ * A listener set with `setDurableListener` is handed each batch once it is durable, which is how a `LogShipper`
+ * streams the log to replicas.
+ *
+ * If a write or sync fails, the log stops: no record from that batch on becomes durable or reaches the listener,
+ * and every coroutine waiting on one is resumed with the failure instead.
+ */
+class CirculationLog {
+public:
+    /**
+     * @brief Opens a log for appending, creating it if needed, and starts the flusher thread.
+     *
+     * @param path Path of the log file.
+     * @param executor The executor coroutines waiting for durability are resumed on, or nullptr if none wait.
+     */
+    CirculationLog(const string& path, CoroutineExecutor* executor);
+
+    /**
+     * @brief Destructor. Makes every appended record durable, then stops the flusher and closes the file.
+     */
+    ~CirculationLog();
+
+    CirculationLog(const CirculationLog&) = delete;
+    CirculationLog& operator=(const CirculationLog&) = delete;
+
+    /**
+     * @brief Tells whether the log file was opened.
+     *
+     * @return true if the log is open, false otherwise.
+     */
+    [[nodiscard]] bool isOpen() const;
+
+    /**
+     * @brief Appends a record. It is written in the background.
+     *
+     * @param record The record, without a line break.
+     * @return The record's sequence number, for `waitDurable`.
+     */
+    unsigned long long append(string_view record);
+
+    /**
+     * @brief Awaitable that suspends the awaiting coroutine until a record is durable.
+     */
+    struct DurableAwaiter {
+        CirculationLog& log; ///< The log.
+        unsigned long long sequence; ///< Sequence number of the record to wait for.
+
+        bool await_ready() const;
+
+        bool await_suspend(coroutine_handle<> awaiting);
+
+        bool await_resume() const;
+    };
+
+    /**
+     * @brief Waits until a record and every record before it is durable.
+     *
+     * @param sequence The record's sequence number, as returned by `append`.
+     * @return An awaitable for `co_await`, producing false if the record can no longer become durable.
+     */
+    DurableAwaiter waitDurable(unsigned long long sequence);
+
+    /**
+     * @brief Blocks the calling thread until every record appended so far is durable, or the log has failed.
+     */
+    void flush();
+
+    /**
+     * @brief Sets a function the flusher calls with every batch of records once it is durable.
+     *
+     * The function is called on the flusher thread, in sequence order, before the batch's waiters are resumed, so
+     * it should only queue the records. Must be set before the first record is appended.
+     *
+     * @param listener The function, given the batch's records, each ending in a line break, and the sequence number
+     *                 of the batch's last record.
+     */
+    void setDurableListener(function<void(string_view records, unsigned long long last)> listener);
+
+    /**
+     * @brief Tells whether the log is written with io_uring.
+     *
+     * @return true for io_uring, false for the pwrite fallback.
+     */
+    [[nodiscard]] bool usesIoUring() const;
+
+private:
+    /**
+     * @brief Body of the flusher thread. Writes and syncs accumulated records until the log is destroyed.
+     */
+    void flushLoop();
+
+    IoBackend io; ///< The backend that writes the log. Only used by the flusher thread once it starts.
+    int fd; ///< The log file, or -1 if it could not be opened.
+    CoroutineExecutor* executor; ///< The executor waiting coroutines are resumed on.
+    mutable mutex lock; ///< Guards the fields below.
+    condition_variable work; ///< Signalled when records are appended or the log stops.
+    condition_variable synced; ///< Signalled when records become durable.
+    string pending; ///< Records appended since the flusher last took them.
+    unsigned long long appended; ///< Sequence number of the last record appended.
+    unsigned long long durable; ///< Sequence number of the last record made durable.
+    vector<pair<unsigned long long, coroutine_handle<>>> waiters; ///< Coroutines waiting for a sequence number.
+    bool stopping; ///< Set when the log is being destroyed.
+    bool failed; ///< Set once a write or sync fails; no record becomes durable after that.
+    function<void(string_view, unsigned long long)> durableListener; ///< Called with each durable batch, or empty.
+    thread flusher; ///< The flusher thread.
+};
+
+#endif //LIBRARYMANAGEMENT_CIRCULATIONLOG_H
@@ -0,0 +1,327 @@
+#include "CirculationSimulator.h"
+#include "CatalogSnapshot.h"
+#include <algorithm>
+#include <iomanip>
+
+/**
+ * @brief Days a loan lasts, as `Librarian::loanBook` sets it.
+ */
+static const int LOAN_DAYS = 10;
+
+/**
+ * @brief Constructs a simulator over a librarian. Registers the patrons and indexes the catalog.
+ *
+ * @param librarian The librarian to drive. Its catalog should not change while the simulation runs.
+ * @param config The simulation settings.
+ */
+CirculationSimulator::CirculationSimulator(Librarian &librarian, const SimulationConfig &config)
+        : librarian(librarian), config(config), firstPatron(0), random(config.seed),
+          popularity(max(1L, librarian.getInventory().countTotalBooks()), config.hotSkew), scheduled(0),
+          holdsPlaced(0), holdsFilled(0), turnedAway(0), dayEvents(0), dayCalls(0), daySeconds(0) {
+    for (long i = 0; i < config.patrons; i++) {
+        PatronId id = librarian.registerPatron();
+        if (i == 0) {
+            firstPatron = id;
+        }
+    }
+    librarian.snapshot().forEachBook([this](const Book* b, const BookVersion&) { books.push_back(b); });
+    shuffle(books.begin(), books.end(), random);
+    demand.assign(books.size(), 0);
+    holds.assign(books.size(), 0);
+    returnScheduled.assign(books.size(), false);
+    listedAsHeld.assign(books.size(), false);
+}
+
+/**
+ * @brief Runs the simulation, printing one line per simulated day.
+ *
+ * @param out The stream to print to.
+ */
+void CirculationSimulator::run(ostream &out) {
+    if (books.empty() || config.patrons <= 0) {
+        out << "Nothing to simulate: the catalog or the patron list is empty.\n";
+        return;
+    }
+    out << right << setw(5) << "day" << setw(10) << "events" << setw(10) << "calls" << setw(12) << "calls/s"
+        << setw(10) << "out" << setw(10) << "holds" << setw(10) << "queue" << setw(14) << "fines owed" << '\n';
+    double visitRate = static_cast<double>(config.patrons) * config.visitsPerPatronPerDay;
+    exponential_distribution<double> arrivals(visitRate);
+    if (visitRate > 0) {
+        schedule(arrivals(random), EventType::Visit);
+    }
+    schedule(1.0, EventType::EndOfDay);
+    while (!events.empty()) {
+        Event e = events.top();
+        if (e.time > config.days) {
+            break;
+        }
+        events.pop();
+        dayEvents++;
+        switch (e.type) {
+            case EventType::Visit:
+                visit(e.time);
+                schedule(e.time + arrivals(random), EventType::Visit);
+                break;
+            case EventType::Return:
+                endLoan(e.time, e.book);
+                break;
+            case EventType::EndOfDay:
+                endDay(static_cast<int>(e.time), out);
+                if (e.time < config.days) {
+                    schedule(e.time + 1.0, EventType::EndOfDay);
+                }
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Prints the summary of the simulation: time per operation, the most demanded books, and hash probe lengths.
+ *
+ * @param out The stream to print to.
+ */
+void CirculationSimulator::printReport(ostream &out) const {
+    static const char* const names[OPERATION_COUNT] = {
+        "search", "checkout", "reserve", "return", "renew", "overdue run", "reservation run"
+    };
+    out << '\n' << left << setw(16) << "operation" << right << setw(12) << "count" << setw(12) << "total ms"
+        << setw(12) << "mean us" << setw(12) << "max us" << '\n';
+    for (int i = 0; i < OPERATION_COUNT; i++) {
+        const OperationStats& s = operations[i];
+        if (s.count == 0) {
+            continue;
+        }
+        out << left << setw(16) << names[i] << right << setw(12) << s.count
+            << setw(12) << fixed << setprecision(1) << s.seconds * 1e3
+            << setw(12) << setprecision(2) << s.seconds * 1e6 / s.count
+            << setw(12) << s.longest * 1e6 << '\n';
+    }
+    out << '\n' << holdsPlaced << " holds placed, " << holdsFilled << " filled; patrons left without a book "
+        << turnedAway << " times.\n";
+
+    vector<long> hottest(books.size());
+    for (size_t i = 0; i < books.size(); i++) {
+        hottest[i] = static_cast<long>(i);
+    }
+    size_t shown = min<size_t>(10, books.size());
+    partial_sort(hottest.begin(), hottest.begin() + shown, hottest.end(),
+                 [this](long a, long b) { return demand[a] > demand[b]; });
+    const Inventory& inventory = librarian.getInventory();
+    out << "\nMost demanded books:\n" << right << setw(10) << "demand" << setw(8) << "holds" << setw(8) << "probes"
+        << "  title\n";
+    for (size_t i = 0; i < shown; i++) {
+        const Book* b = books[hottest[i]];
+        out << setw(10) << demand[hottest[i]] << setw(8) << holds[hottest[i]]
+            << setw(8) << inventory.probeLength(b->getIsbn()) << "  " << b->getTitle() << '\n';
+    }
+
+    vector<int> probes(books.size());
+    double probeTotal = 0;
+    for (size_t i = 0; i < books.size(); i++) {
+        probes[i] = inventory.probeLength(books[i]->getIsbn());
+        probeTotal += probes[i];
+    }
+    sort(probes.begin(), probes.end());
+    out << "\nInventory probe lengths: mean " << setprecision(2) << probeTotal / probes.size()
+        << ", 99th percentile " << probes[probes.size() * 99 / 100] << ", longest " << probes.back() << ".\n";
+}
+
+/**
+ * @brief Adds an event to the queue.
+ *
+ * @param time When the event happens.
+ * @param type What happens.
+ * @param book Position of the book, for returns.
+ */
+void CirculationSimulator::schedule(double time, EventType type, long book) {
+    events.push(Event{time, scheduled++, type, book});
+}
+
+/**
+ * @brief Handles a patron's visit.
+ *
+ * The patron searches for each book a few times, then checks it out if it is on the shelf, or may place a hold
+ * on it if it is not.
+ *
+ * @param now The simulated time.
+ */
+void CirculationSimulator::visit(double now) {
+    PatronId patron = firstPatron + static_cast<PatronId>(random() % config.patrons);
+    geometric_distribution<int> extraBooks(1.0 / max(1.0, config.booksPerVisit));
+    poisson_distribution<int> searches(config.searchesPerBook);
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    int wanted = 1 + extraBooks(random);
+    for (int i = 0; i < wanted; i++) {
+        long book = static_cast<long>(popularity.sample(random) - 1);
+        const Book* b = books[book];
+        demand[book]++;
+        for (int s = searches(random); s > 0; s--) {
+            auto start = chrono::steady_clock::now();
+            (void) librarian.searchBooks(b->getIsbn());
+            record(Search, start);
+        }
+        if (b->isAvailable()) {
+            auto start = chrono::steady_clock::now();
+            Book* loaned = librarian.checkoutBook(b->getIsbn(), patron);
+            record(Checkout, start);
+            if (loaned != nullptr) {
+                scheduleReturn(now, book);
+            } else {
+                turnedAway++;
+            }
+        } else if (holds[book] < config.holdQueueLimit && chance(random) < config.holdProbability) {
+            short before = librarian.getPatrons().getPatron(patron).getHoldCount();
+            auto start = chrono::steady_clock::now();
+            librarian.reserveBook(b->getIsbn(), patron);
+            record(Reserve, start);
+            if (librarian.getPatrons().getPatron(patron).getHoldCount() > before) {
+                holdsPlaced++;
+                holds[book]++;
+                if (!listedAsHeld[book]) {
+                    listedAsHeld[book] = true;
+                    heldBooks.push_back(book);
+                }
+            } else {
+                turnedAway++;
+            }
+        } else {
+            turnedAway++;
+        }
+    }
+}
+
+/**
+ * @brief Handles the end of a loan.
+ *
+ * A book nobody is waiting for may be renewed; otherwise it is returned, and if the librarian hands it to a
+ * patron holding it, that loan's return is scheduled.
+ *
+ * @param now The simulated time.
+ * @param book Position of the book.
+ */
+void CirculationSimulator::endLoan(double now, long book) {
+    const Book* b = books[book];
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    if (holds[book] == 0 && chance(random) < config.renewProbability) {
+        auto start = chrono::steady_clock::now();
+        librarian.renewBook(b->getIsbn(), LOAN_DAYS);
+        record(Renew, start);
+        returnScheduled[book] = false;
+        scheduleReturn(now, book);
+        return;
+    }
+    returnScheduled[book] = false;
+    auto start = chrono::steady_clock::now();
+    librarian.returnBook(b->getIsbn());
+    record(Return, start);
+    if (!b->isAvailable()) {
+        holdsFilled++;
+        if (holds[book] > 0) {
+            holds[book]--;
+        }
+        scheduleReturn(now, book);
+    }
+}
+
+/**
+ * @brief Schedules the return of a book that was just loaned.
+ *
+ * Most loans come back at a random time before they are due; a share come back late.
+ *
+ * @param now The simulated time.
+ * @param book Position of the book.
+ */
+void CirculationSimulator::scheduleReturn(double now, long book) {
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    double length;
+    if (chance(random) < config.lateProbability) {
+        exponential_distribution<double> lateness(1.0 / max(0.01, config.meanLateDays));
+        length = LOAN_DAYS + lateness(random);
+    } else {
+        length = uniform_real_distribution<double>(0.5, LOAN_DAYS)(random);
+    }
+    returnScheduled[book] = true;
+    schedule(now + length, EventType::Return, book);
+}
+
+/**
+ * @brief Schedules returns for books the librarian loaned to patrons holding them, outside a return.
+ *
+ * Holds are filled when their book is returned, but a hold whose patron was at the loan limit then is only
+ * filled later, by the overnight run or by another return.
+ *
+ * @param now The simulated time.
+ */
+void CirculationSimulator::scheduleHeldLoans(double now) {
+    size_t kept = 0;
+    for (long book : heldBooks) {
+        if (!books[book]->isAvailable() && !returnScheduled[book]) {
+            holdsFilled++;
+            if (holds[book] > 0) {
+                holds[book]--;
+            }
+            scheduleReturn(now, book);
+        }
+        if (holds[book] > 0) {
+            heldBooks[kept++] = book;
+        } else {
+            listedAsHeld[book] = false;
+        }
+    }
+    heldBooks.resize(kept);
+}
+
+/**
+ * @brief Records the time of a librarian call.
+ *
+ * @param operation The operation.
+ * @param start When the call started.
+ */
+void CirculationSimulator::record(Operation operation, chrono::steady_clock::time_point start) {
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    OperationStats& s = operations[operation];
+    s.count++;
+    s.seconds += seconds;
+    s.longest = max(s.longest, seconds);
+    dayCalls++;
+    daySeconds += seconds;
+}
+
+/**
+ * @brief Handles the end of a day: runs the overnight jobs and prints the day's line.
+ *
+ * @param day The day that ends, starting from 1.
+ * @param out The stream to print to.
+ */
+void CirculationSimulator::endDay(int day, ostream &out) {
+    auto start = chrono::steady_clock::now();
+    librarian.processOverdueBooks(1);
+    record(OverdueRun, start);
+    start = chrono::steady_clock::now();
+    librarian.processReservations();
+    record(ReservationRun, start);
+    scheduleHeldLoans(day);
+
+    out << right << setw(5) << day << setw(10) << dayEvents << setw(10) << dayCalls
+        << setw(12) << fixed << setprecision(0) << (daySeconds > 0 ? dayCalls / daySeconds : 0.0)
+        << setw(10) << librarian.countCheckedOut() << setw(10) << librarian.countReservations()
+        << setw(10) << events.size() << setw(14) << totalFines() << '\n';
+    out.flush();
+    dayEvents = 0;
+    dayCalls = 0;
+    daySeconds = 0;
+}
+
+/**
+ * @brief Adds up the fines the patrons owe.
+ *
+ * @return The total.
+ */
+long long CirculationSimulator::totalFines() const {
+    const PatronStore& patrons = librarian.getPatrons();
+    long long total = 0;
+    for (long i = 0; i < config.patrons; i++) {
+        total += patrons.getPatron(firstPatron + static_cast<PatronId>(i)).getFineTotal();
+    }
+    return total;
+}
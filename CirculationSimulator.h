@@ -0,0 +1,203 @@
+#ifndef LIBRARYMANAGEMENT_CIRCULATIONSIMULATOR_H
+#define LIBRARYMANAGEMENT_CIRCULATIONSIMULATOR_H
+
+#include "Librarian.h"
+#include "ZipfSampler.h"
+#include <chrono>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Settings of a circulation simulation.
+ */
+struct SimulationConfig {
+    long patrons = 1000000; ///< Number of patrons registered before the first day.
+    int days = 90; ///< Number of days to simulate.
+    double visitsPerPatronPerDay = 0.02; ///< How often each patron visits, on average.
+    double booksPerVisit = 2.0; ///< Mean number of books a patron looks for in one visit.
+    double searchesPerBook = 2.0; ///< Mean number of catalog searches before each book is found.
+    double hotSkew = 0.9; ///< Zipf exponent of the books' popularity.
+    double holdProbability = 0.5; ///< Chance a patron places a hold when the book they want is checked out.
+    int holdQueueLimit = 5; ///< Patrons do not place a hold on a book that already has this many.
+    double lateProbability = 0.15; ///< Chance a loan is returned after it is due.
+    double meanLateDays = 5.0; ///< Mean number of days late returns are late by.
+    double renewProbability = 0.1; ///< Chance a patron renews a loan that has no holds on it instead of returning it.
+    unsigned long long seed = 1; ///< Seed of the random choices.
+};
+
+/**
+ * @class CirculationSimulator
+ * @brief A discrete-event simulation of patrons borrowing from a library, for capacity planning.
+ *
+ * The simulator drives a real `Librarian` through simulated days. Events are kept in a queue ordered by
+ * simulated time: patron visits, which arrive as one Poisson stream across all patrons; returns and
+ * renewals, scheduled when a book is loaned; and the end of each day, which runs `processOverdueBooks(1)`
+ * and `processReservations()` as the library does overnight, so fines accrue by `calculateFine` rules.
+ *
+ * During a visit a patron searches the catalog and asks for books chosen by a Zipf distribution, so a few
+ * titles are in high demand. Available books are checked out; for a checked-out book the patron may place
+ * a hold, which the librarian fills when the book comes back. Loans are due after the librarian's loan
+ * period, and a share of them are returned late or renewed.
+ *
+ * Every call into the librarian is timed, and each simulated day reports its throughput, the length of the
+ * event and reservation queues, the number of books out, and the fines owed. The final report lists the
+ * time spent in each operation, the books with the most demand, and the probe lengths of the inventory's
+ * hash table, which together show where the data structures are under strain.
+ */
+class CirculationSimulator {
+public:
+    /**
+     * @brief Constructs a simulator over a librarian. Registers the patrons and indexes the catalog.
+     *
+     * @param librarian The librarian to drive. Its catalog should not change while the simulation runs.
+     * @param config The simulation settings.
+     */
+    CirculationSimulator(Librarian& librarian, const SimulationConfig& config);
+
+    /**
+     * @brief Runs the simulation, printing one line per simulated day.
+     *
+     * @param out The stream to print to.
+     */
+    void run(ostream& out = cout);
+
+    /**
+     * @brief Prints the summary of the simulation: time per operation, the most demanded books, and hash probe lengths.
+     *
+     * @param out The stream to print to.
+     */
+    void printReport(ostream& out = cout) const;
+
+private:
+    /**
+     * @brief The kinds of events.
+     */
+    enum class EventType {
+        Visit, ///< A patron visits.
+        Return, ///< A loan ends; the patron returns or renews the book.
+        EndOfDay, ///< The library closes; overdue books and reservations are processed.
+    };
+
+    /**
+     * @brief A scheduled event.
+     */
+    struct Event {
+        double time; ///< When the event happens, in days since the start.
+        unsigned long long sequence; ///< Order the event was scheduled in, to break ties.
+        EventType type; ///< What happens.
+        long book; ///< Position of the book in `books`, for returns.
+
+        /**
+         * @brief Orders events so that the earliest comes out of the priority queue first.
+         */
+        bool operator>(const Event& e) const {
+            return time != e.time ? time > e.time : sequence > e.sequence;
+        }
+    };
+
+    /**
+     * @brief The librarian operations that are timed.
+     */
+    enum Operation {
+        Search, Checkout, Reserve, Return, Renew, OverdueRun, ReservationRun, OPERATION_COUNT
+    };
+
+    /**
+     * @brief Time spent in one librarian operation.
+     */
+    struct OperationStats {
+        long long count = 0; ///< Number of calls.
+        double seconds = 0; ///< Total time of the calls.
+        double longest = 0; ///< Time of the slowest call.
+    };
+
+    /**
+     * @brief Adds an event to the queue.
+     *
+     * @param time When the event happens.
+     * @param type What happens.
+     * @param book Position of the book, for returns.
+     */
+    void schedule(double time, EventType type, long book = -1);
+
+    /**
+     * @brief Handles a patron's visit.
+     *
+     * @param now The simulated time.
+     */
+    void visit(double now);
+
+    /**
+     * @brief Handles the end of a loan.
+     *
+     * @param now The simulated time.
+     * @param book Position of the book.
+     */
+    void endLoan(double now, long book);
+
+    /**
+     * @brief Schedules the return of a book that was just loaned.
+     *
+     * @param now The simulated time.
+     * @param book Position of the book.
+     */
+    void scheduleReturn(double now, long book);
+
+    /**
+     * @brief Schedules returns for books the librarian loaned to patrons holding them, outside a return.
+     *
+     * @param now The simulated time.
+     */
+    void scheduleHeldLoans(double now);
+
+    /**
+     * @brief Records the time of a librarian call.
+     *
+     * @param operation The operation.
+     * @param start When the call started.
+     */
+    void record(Operation operation, chrono::steady_clock::time_point start);
+
+    /**
+     * @brief Handles the end of a day: runs the overnight jobs and prints the day's line.
+     *
+     * @param day The day that ends, starting from 1.
+     * @param out The stream to print to.
+     */
+    void endDay(int day, ostream& out);
+
+    /**
+     * @brief Adds up the fines the patrons owe.
+     *
+     * @return The total.
+     */
+    [[nodiscard]] long long totalFines() const;
+
+    Librarian& librarian; ///< The librarian being driven.
+    SimulationConfig config; ///< The settings.
+    PatronId firstPatron; ///< ID of the first simulated patron; the rest follow it.
+    mt19937_64 random; ///< Source of the random choices.
+    ZipfSampler popularity; ///< Draws a book's popularity rank.
+    vector<const Book*> books; ///< The catalog, in a shuffled order so popularity does not follow the hash table.
+    vector<unsigned> demand; ///< Number of times each book was asked for.
+    vector<unsigned short> holds; ///< Holds the simulation has placed on each book and not yet seen filled.
+    vector<bool> returnScheduled; ///< Whether each book's current loan has a return scheduled.
+    vector<long> heldBooks; ///< Books with holds that may be filled by the overnight reservation run.
+    vector<bool> listedAsHeld; ///< Whether each book is in `heldBooks`.
+    priority_queue<Event, vector<Event>, greater<>> events; ///< The event queue.
+    unsigned long long scheduled; ///< Number of events scheduled so far.
+    OperationStats operations[OPERATION_COUNT]; ///< Time spent in each librarian operation.
+    long long holdsPlaced; ///< Number of holds placed.
+    long long holdsFilled; ///< Number of holds the librarian has filled.
+    long long turnedAway; ///< Number of times a patron left without a book they wanted.
+    long long dayEvents; ///< Number of events handled on the current day.
+    long long dayCalls; ///< Number of librarian calls made on the current day.
+    double daySeconds; ///< Time spent in librarian calls on the current day.
+};
+
+#endif //LIBRARYMANAGEMENT_CIRCULATIONSIMULATOR_H
@@ -0,0 +1,675 @@
+#include "CommandProcessor.h"
+#include "IoBackend.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+const string_view CommandProcessor::NAMES[COMMAND_COUNT] = {
+    "checkout", "return", "reserve", "cancel", "renew", "advance", "add", "remove", "search", "title", "fuzzy",
+    "range", "prefix", "query", "page", "archive", "list", "checkedout", "overdue", "reservations", "patron", "account",
+    "export", "stats", "memory", "quit"
+};
+
+/**
+ * @brief Constructs a processor that runs commands against a librarian.
+ *
+ * @param librarian The librarian to run commands against.
+ * @param log The log to record successful changes in, or nullptr to not record them.
+ */
+CommandProcessor::CommandProcessor(Librarian &librarian, CirculationLog *log)
+        : librarian(librarian), log(log), errors(0), lineNumber(0), readOnly(false), fileWritesAllowed(true) {
+}
+
+/**
+ * @brief Runs one command line.
+ *
+ * @param line The command line, without its line break.
+ * @param out The stream to print the command's output and any error to.
+ * @return false if the line was `quit`, true otherwise.
+ */
+bool CommandProcessor::execute(string_view line, ostream &out) {
+    string_view text = line;
+    Command command = begin(line, out);
+    if (command == Quit) {
+        return false;
+    }
+    if (command != COMMAND_COUNT) {
+        auto start = chrono::steady_clock::now();
+        bool valid = dispatch(command, line, out);
+        if (valid) {
+            record(command, text);
+        }
+        finish(command, start, valid, out);
+    }
+    return true;
+}
+
+/**
+ * @brief Runs one command line as a coroutine on an `AsyncLibrarian`'s executor.
+ *
+ * Commands that change circulation state, or read it under the librarian's lock, wait for the facade's
+ * circulation lock by suspending. The other commands run at once. When the processor has a log, a change is
+ * not finished until its record is durable, and the coroutine suspends until then; a change whose record could not
+ * be written is reported as an error.
+ *
+ * @param line The command line, without its line break. Must stay valid until the task finishes.
+ * @param out The stream to print the command's output and any error to.
+ * @param async The facade to run the command through.
+ * @return A task producing false if the line was `quit`, true otherwise.
+ */
+Task<bool> CommandProcessor::executeAsync(string_view line, ostream &out, AsyncLibrarian &async) {
+    string_view text = line;
+    Command command = begin(line, out);
+    if (command == Quit) {
+        co_return false;
+    }
+    if (command != COMMAND_COUNT) {
+        auto start = chrono::steady_clock::now();
+        bool valid;
+        if (usesCirculationLock(command)) {
+            // The change is recorded under the lock so the log has the changes in the order they were made.
+            unsigned long long sequence = 0;
+            valid = co_await async.write([&] {
+                bool ok = dispatch(command, line, out);
+                if (ok) {
+                    sequence = record(command, text);
+                }
+                return ok;
+            });
+            if (sequence != 0 && !co_await log->waitDurable(sequence)) {
+                errors++;
+                out << "line " << lineNumber << ": " << NAMES[command] << " was made but could not be logged\n";
+            }
+        } else {
+            valid = dispatch(command, line, out);
+        }
+        finish(command, start, valid, out);
+    }
+    co_return true;
+}
+
+/**
+ * @brief Runs every command line of a stream until the end of the stream or a `quit` command.
+ *
+ * The stream is read in large blocks and split into lines in place, so no per-line strings are made.
+ *
+ * @param in The stream to read commands from.
+ * @param out The stream to print output to.
+ * @return The number of lines read.
+ */
+long CommandProcessor::run(istream &in, ostream &out) {
+    const size_t BLOCK = 1 << 20;
+    vector<char> buffer(BLOCK);
+    size_t kept = 0;
+    long lines = 0;
+    for (;;) {
+        if (kept == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        in.read(buffer.data() + kept, static_cast<streamsize>(buffer.size() - kept));
+        size_t filled = kept + static_cast<size_t>(in.gcount());
+        bool last = filled == kept;
+        size_t start = 0;
+        for (size_t i = kept; i < filled; i++) {
+            if (buffer[i] == '\n') {
+                lines++;
+                if (!execute(string_view(buffer.data() + start, i - start), out)) {
+                    return lines;
+                }
+                start = i + 1;
+            }
+        }
+        if (last) {
+            // The final line may have no line break.
+            if (start < filled) {
+                lines++;
+                execute(string_view(buffer.data() + start, filled - start), out);
+            }
+            return lines;
+        }
+        // Move the unfinished line to the front so the next block continues it.
+        kept = filled - start;
+        copy(buffer.begin() + static_cast<long>(start), buffer.begin() + static_cast<long>(filled), buffer.begin());
+    }
+}
+
+/**
+ * @brief Runs every command line of a file until the end of the file or a `quit` command.
+ *
+ * The file is read with an `IoBackend`, which is how a circulation log is replayed at startup.
+ *
+ * @param path Path of the file.
+ * @param out The stream to print output to.
+ * @return The number of lines read, or -1 if the file could not be read.
+ */
+long CommandProcessor::runFile(const string &path, ostream &out) {
+    string text;
+    {
+        IoBackend io;
+        if (!io.readFile(path, text)) {
+            return -1;
+        }
+    }
+    long lines = 0;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == string::npos) {
+            end = text.size();
+        }
+        lines++;
+        if (!execute(string_view(text.data() + start, end - start), out)) {
+            break;
+        }
+        start = end + 1;
+    }
+    return lines;
+}
+
+/**
+ * @brief Prints how many times each command ran, its total time, throughput and mean latency.
+ *
+ * @param out The stream to print to.
+ */
+void CommandProcessor::printStats(ostream &out) const {
+    out << left << setw(14) << "command" << right << setw(12) << "count" << setw(12) << "total ms"
+        << setw(14) << "ops/s" << setw(12) << "mean us" << '\n';
+    unsigned long total = 0;
+    chrono::nanoseconds totalTime{0};
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        if (stats[i].count == 0) {
+            continue;
+        }
+        double seconds = chrono::duration<double>(stats[i].time).count();
+        out << left << setw(14) << NAMES[i] << right << setw(12) << stats[i].count
+            << setw(12) << fixed << setprecision(1) << seconds * 1e3
+            << setw(14) << setprecision(0) << (seconds > 0 ? stats[i].count / seconds : 0.0)
+            << setw(12) << setprecision(2) << seconds * 1e6 / stats[i].count << '\n';
+        total += stats[i].count;
+        totalTime += stats[i].time;
+    }
+    double seconds = chrono::duration<double>(totalTime).count();
+    out << left << setw(14) << "all" << right << setw(12) << total
+        << setw(12) << fixed << setprecision(1) << seconds * 1e3
+        << setw(14) << setprecision(0) << (seconds > 0 ? total / seconds : 0.0) << '\n';
+    if (errors != 0) {
+        out << errors << " lines were not valid commands.\n";
+    }
+}
+
+/**
+ * @brief Gets the number of lines that were not valid commands so far.
+ *
+ * @return The number of invalid lines.
+ */
+unsigned long CommandProcessor::getErrorCount() const {
+    return errors;
+}
+
+/**
+ * @brief Makes the processor refuse, or accept again, the commands that change the library.
+ *
+ * @param readOnly true to report changes as errors instead of running them.
+ */
+void CommandProcessor::setReadOnly(bool readOnly) {
+    this->readOnly = readOnly;
+}
+
+/**
+ * @brief Makes the processor refuse, or accept again, the commands that write files on this machine.
+ *
+ * @param allowed false to report `export` as an error instead of running it.
+ */
+void CommandProcessor::setFileWritesAllowed(bool allowed) {
+    fileWritesAllowed = allowed;
+}
+
+/**
+ * @brief Counts a line and splits its command name off.
+ *
+ * @param line The command line. The command name is removed from it, leaving the arguments.
+ * @param out The stream to report an unknown or refused command to.
+ * @return The command, or COMMAND_COUNT if there is nothing to run.
+ */
+CommandProcessor::Command CommandProcessor::begin(string_view &line, ostream &out) {
+    lineNumber++;
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    string_view name = nextToken(line);
+    if (name.empty() || name.front() == '#') {
+        return COMMAND_COUNT;
+    }
+    Command command = lookup(name);
+    if (command == COMMAND_COUNT) {
+        errors++;
+        out << "line " << lineNumber << ": unknown command " << name << '\n';
+    } else if (readOnly && changesLibrary(command)) {
+        errors++;
+        out << "line " << lineNumber << ": " << name << " is read-only here; send it to the primary\n";
+        return COMMAND_COUNT;
+    } else if (!fileWritesAllowed && writesFiles(command)) {
+        errors++;
+        out << "line " << lineNumber << ": " << name << " is not allowed on this connection\n";
+        return COMMAND_COUNT;
+    }
+    return command;
+}
+
+/**
+ * @brief Records that a command ran and reports bad arguments.
+ *
+ * @param command The command.
+ * @param start When the command started.
+ * @param valid Whether the command's arguments were valid.
+ * @param out The stream to report bad arguments to.
+ */
+void CommandProcessor::finish(Command command, chrono::steady_clock::time_point start, bool valid, ostream &out) {
+    stats[command].time += chrono::steady_clock::now() - start;
+    stats[command].count++;
+    if (!valid) {
+        errors++;
+        out << "line " << lineNumber << ": bad arguments to " << NAMES[command] << '\n';
+    }
+}
+
+/**
+ * @brief Records a successful command in the log if it changed the library.
+ *
+ * @param command The command.
+ * @param text The whole command line.
+ * @return The record's sequence number in the log, or 0 if nothing was recorded.
+ */
+unsigned long long CommandProcessor::record(Command command, string_view text) {
+    if (log == nullptr || !changesLibrary(command)) {
+        return 0;
+    }
+    if (!text.empty() && text.back() == '\r') {
+        text.remove_suffix(1);
+    }
+    return log->append(text);
+}
+
+/**
+ * @brief Tells whether a command changes the library, so it is recorded in the log.
+ *
+ * @param command The command.
+ * @return true for circulation changes, catalog changes and patron registration.
+ */
+bool CommandProcessor::changesLibrary(Command command) {
+    switch (command) {
+        case Checkout:
+        case Return:
+        case Reserve:
+        case Cancel:
+        case Renew:
+        case Advance:
+        case Add:
+        case Remove:
+        case NewPatron:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Tells whether a command writes a file at a path it is given.
+ *
+ * @param command The command.
+ * @return true for `export`.
+ */
+bool CommandProcessor::writesFiles(Command command) {
+    return command == Export;
+}
+
+/**
+ * @brief Tells whether a command must hold the circulation lock.
+ *
+ * @param command The command.
+ * @return true for commands that change circulation state or read it under the librarian's lock.
+ */
+bool CommandProcessor::usesCirculationLock(Command command) {
+    switch (command) {
+        case Search:
+        case Title:
+        case Fuzzy:
+        case Range:
+        case Prefix:
+        case Query:
+        case Page:
+        case Archive:
+        case List:
+        case CheckedOut:
+        case Overdue:
+        case Export:
+        case Stats:
+        case Memory:
+            return false;
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Runs a parsed command.
+ *
+ * @param command The command.
+ * @param args The rest of the line after the command name.
+ * @param out The stream to print output to.
+ * @return false if the arguments were not valid, true otherwise.
+ */
+bool CommandProcessor::dispatch(Command command, string_view args, ostream &out) {
+    long long ISBN = 0;
+    long long number = 0;
+    switch (command) {
+        case Checkout:
+        case Reserve: {
+            if (!parseISBN(nextToken(args), ISBN)) {
+                return false;
+            }
+            string_view patron = nextToken(args);
+            if (!patron.empty() && (!parseNumber(patron, number) || number < 0)) {
+                return false;
+            }
+            if (command == Checkout) {
+                librarian.checkoutBook(ISBN, static_cast<PatronId>(number));
+            } else {
+                librarian.reserveBook(ISBN, static_cast<PatronId>(number));
+            }
+            return true;
+        }
+        case Return:
+            if (!parseISBN(nextToken(args), ISBN)) {
+                return false;
+            }
+            librarian.returnBook(ISBN);
+            return true;
+        case Cancel:
+            if (!parseISBN(nextToken(args), ISBN)) {
+                return false;
+            }
+            librarian.cancelReservation(ISBN);
+            return true;
+        case Renew:
+            if (!parseISBN(nextToken(args), ISBN) || !parseNumber(nextToken(args), number)) {
+                return false;
+            }
+            librarian.renewBook(ISBN, static_cast<int>(number));
+            return true;
+        case Advance:
+            if (!parseNumber(nextToken(args), number)) {
+                return false;
+            }
+            librarian.processOverdueBooks(static_cast<int>(number));
+            return true;
+        case Add: {
+            string_view fields[5];
+            for (int i = 0; i < 4; i++) {
+                size_t comma = args.find(',');
+                if (comma == string_view::npos) {
+                    return false;
+                }
+                fields[i] = args.substr(0, comma);
+                args.remove_prefix(comma + 1);
+            }
+            fields[4] = args;
+            if (!parseISBN(fields[0], ISBN) || !parseNumber(nextToken(fields[4]), number)) {
+                return false;
+            }
+            librarian.addNewBook(new Book(string(fields[1]), string(fields[2]), string(fields[3]),
+                                          static_cast<short>(number), ISBN, true));
+            return true;
+        }
+        case Remove:
+            if (!parseISBN(nextToken(args), ISBN)) {
+                return false;
+            }
+            librarian.removeBookFromInventory(ISBN);
+            return true;
+        case Search: {
+            if (!parseISBN(nextToken(args), ISBN)) {
+                return false;
+            }
+            Book* b = librarian.searchBooks(ISBN);
+            if (b == nullptr) {
+                out << "Book " << ISBN << " not found.\n";
+            } else {
+                out << b->getInfo() << '\n';
+            }
+            return true;
+        }
+        case Title: {
+            if (args.empty()) {
+                return false;
+            }
+            Book* b = librarian.searchBooks(string(args));
+            if (b == nullptr) {
+                out << "Book " << args << " not found.\n";
+            } else {
+                out << b->getInfo() << '\n';
+            }
+            return true;
+        }
+        case Fuzzy: {
+            if (args.empty()) {
+                return false;
+            }
+            vector<FuzzyMatch> matches = librarian.searchFuzzy(string(args));
+            if (matches.empty()) {
+                out << "No books close to " << args << ".\n";
+            }
+            for (const FuzzyMatch& m : matches) {
+                out << (m.field == FuzzyField::Title ? "Title" : "Author") << " matched with " << m.distance
+                    << (m.distance == 1 ? " edit:\n" : " edits:\n") << m.book->getInfo() << '\n';
+            }
+            return true;
+        }
+        case Range:
+        case Prefix: {
+            long long first;
+            long long last;
+            if (command == Range ? !parseISBN(nextToken(args), first) || !parseISBN(nextToken(args), last)
+                                 : !IsbnIndex::prefixRange(nextToken(args), first, last)) {
+                return false;
+            }
+            if (librarian.listBooksInRange(first, last, out) == 0) {
+                out << "No books with ISBNs from " << first << " to " << last << ".\n";
+            }
+            return true;
+        }
+        case Query: {
+            CatalogQuery query;
+            string error;
+            if (!CatalogQuery::compile(args, query, error)) {
+                out << "Bad query: " << error << ".\n";
+                return true;
+            }
+            size_t matched = librarian.queryBooks(query, [&out](const Book* b, const BookVersion& state) {
+                out << b->getInfo(state) << '\n';
+            });
+            if (matched == 0) {
+                out << "No books match " << query.getText() << ".\n";
+            }
+            return true;
+        }
+        case Page: {
+            string_view cursor;
+            if (!parseNumber(nextToken(args), number) || number <= 0 || (cursor = nextToken(args)).empty()) {
+                return false;
+            }
+            CatalogQuery query;
+            string error;
+            if (!args.empty() && !CatalogQuery::compile(args, query, error)) {
+                out << "Bad query: " << error << ".\n";
+                return true;
+            }
+            string next;
+            if (!librarian.listPage(query, cursor == "-" ? "" : string(cursor), static_cast<size_t>(number),
+                                    [&out](const Book* b, const BookVersion& state) {
+                                        out << b->getInfo(state) << '\n';
+                                    }, next)) {
+                return false;
+            }
+            if (next.empty()) {
+                out << "Last page.\n";
+            } else {
+                out << "Next page: " << next << '\n';
+            }
+            return true;
+        }
+        case Archive: {
+            CatalogQuery query;
+            string error;
+            if (!CatalogQuery::compile(args, query, error)) {
+                out << "Bad query: " << error << ".\n";
+                return true;
+            }
+            size_t matched = librarian.queryArchive(query, [&out](const ArchivedBook& b) {
+                out << b.getInfo() << '\n';
+            });
+            if (matched == 0) {
+                out << "No archived books match " << query.getText() << ".\n";
+            }
+            return true;
+        }
+        case List:
+            librarian.listAllBooks(out);
+            return true;
+        case CheckedOut:
+            librarian.listCheckedOutBooks(out);
+            return true;
+        case Overdue:
+            librarian.listOverdueBooks(out);
+            return true;
+        case Reservations:
+            librarian.listReservations(out);
+            return true;
+        case NewPatron:
+            out << "New Patron ID: " << librarian.registerPatron() << '\n';
+            return true;
+        case Account:
+            if (!parseNumber(nextToken(args), number) || number < 0) {
+                return false;
+            }
+            librarian.listPatronAccount(static_cast<PatronId>(number), out);
+            return true;
+        case Export:
+            if (args.empty()) {
+                return false;
+            }
+            if (!librarian.exportCatalog(string(args))) {
+                out << "Could not write " << args << ".\n";
+            }
+            return true;
+        case Stats: {
+            string_view mode = nextToken(args);
+            if (mode.empty()) {
+                Metrics::print(out);
+                librarian.searchCacheStats().print(out);
+            } else if (mode == "json") {
+                Metrics::writeJson(out);
+            } else if (mode == "reset") {
+                Metrics::reset();
+                librarian.resetSearchCacheStats();
+            } else {
+                return false;
+            }
+            return true;
+        }
+        case Memory:
+            MemoryAccounting::print(librarian.memoryUsage(), out);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Looks up a command by name.
+ *
+ * @param name The command name.
+ * @return The command, or COMMAND_COUNT if there is no command with that name.
+ */
+CommandProcessor::Command CommandProcessor::lookup(string_view name) {
+    for (int i = 0; i < COMMAND_COUNT; i++) {
+        if (NAMES[i] == name) {
+            return static_cast<Command>(i);
+        }
+    }
+    return COMMAND_COUNT;
+}
+
+/**
+ * @brief Splits the next space- or tab-separated token off the front of a line.
+ *
+ * @param line The rest of the line. The token and the blanks around it are removed from it.
+ * @return The token, or an empty view at the end of the line.
+ */
+string_view CommandProcessor::nextToken(string_view &line) {
+    size_t start = 0;
+    while (start < line.size() && (line[start] == ' ' || line[start] == '\t')) {
+        start++;
+    }
+    size_t end = start;
+    while (end < line.size() && line[end] != ' ' && line[end] != '\t') {
+        end++;
+    }
+    string_view token = line.substr(start, end - start);
+    while (end < line.size() && (line[end] == ' ' || line[end] == '\t')) {
+        end++;
+    }
+    line.remove_prefix(end);
+    return token;
+}
+
+/**
+ * @brief Parses an ISBN, ignoring any hyphens in it.
+ *
+ * @param token The ISBN text.
+ * @param ISBN Set to the ISBN.
+ * @return true if the token was a valid ISBN, false otherwise.
+ */
+bool CommandProcessor::parseISBN(string_view token, long long &ISBN) {
+    long long value = 0;
+    int digits = 0;
+    for (char c : token) {
+        if (c >= '0' && c <= '9') {
+            if (++digits > 18) {
+                return false;
+            }
+            value = value * 10 + (c - '0');
+        } else if (c != '-') {
+            return false;
+        }
+    }
+    ISBN = value;
+    return digits != 0;
+}
+
+/**
+ * @brief Parses a decimal integer.
+ *
+ * @param token The text of the number, optionally starting with `-`.
+ * @param value Set to the number.
+ * @return true if the token was a valid number, false otherwise.
+ */
+bool CommandProcessor::parseNumber(string_view token, long long &value) {
+    bool negative = !token.empty() && token.front() == '-';
+    if (negative) {
+        token.remove_prefix(1);
+    }
+    if (token.empty() || token.size() > 18) {
+        return false;
+    }
+    long long result = 0;
+    for (char c : token) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        result = result * 10 + (c - '0');
+    }
+    value = negative ? -result : result;
+    return true;
+}
@@ -0,0 +1,264 @@
+#ifndef LIBRARYMANAGEMENT_COMMANDPROCESSOR_H
+#define LIBRARYMANAGEMENT_COMMANDPROCESSOR_H
+
+#include "AsyncLibrarian.h"
+#include "CirculationLog.h"
+#include "Librarian.h"
+#include "Task.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * @class CommandProcessor
+ * @brief Runs the librarian's line-oriented command language, for scripts and other non-interactive callers.
+ *
+ * Each line holds one command followed by its arguments, separated by spaces or tabs. Blank lines and lines
+ * starting with `#` are skipped. ISBNs may contain hyphens. The commands are:
+ *
+ * | Command                                         | Action                                          |
+ * |-------------------------------------------------|-------------------------------------------------|
+ * | `checkout <isbn> [patron]`                      | Check a book out, or place a hold if it is out. |
+ * | `return <isbn>`                                 | Return a book.                                  |
+ * | `reserve <isbn> [patron]`                       | Place a hold on a book.                         |
+ * | `cancel <isbn>`                                 | Cancel a reservation.                           |
+ * | `renew <isbn> <days>`                           | Set a book's days left.                         |
+ * | `advance <days>`                                | Process overdue books after some days pass.     |
+ * | `add <isbn>,<title>,<author>,<genre>,<year>`    | Add a book, in the catalog CSV format.          |
+ * | `remove <isbn>`                                 | Remove a book.                                  |
+ * | `search <isbn>`                                 | Print a book.                                   |
+ * | `title <title>`                                 | Print the book with a title.                    |
+ * | `fuzzy <text>`                                  | Print the closest titles and authors to text.   |
+ * | `range <first isbn> <last isbn>`                | Print the books in an ISBN range, in order.     |
+ * | `prefix <isbn prefix>`                          | Print a publisher's books, such as `978-0-14`.  |
+ * | `query <filter>`                                | Print the books matching a `CatalogQuery`.      |
+ * | `page <count> <cursor\|-> [filter]`             | Print a page of books in ISBN order, and a      |
+ * |                                                 | cursor for the next page (`-` for the first).   |
+ * | `archive <filter>`                              | Print the archived books matching a query.      |
+ * | `list`, `checkedout`, `overdue`, `reservations` | Print a listing.                                |
+ * | `patron`                                        | Register a patron and print its ID.             |
+ * | `account <patron>`                              | Print a patron's loans, holds and fines.        |
+ * | `export <path>`                                 | Write the catalog to a CSV file.                |
+ * | `stats [json\|reset]`                           | Print or clear latency metrics and cache hits.  |
+ * | `memory`                                        | Print the memory held by the catalog.           |
+ * | `quit`                                          | Stop reading commands.                          |
+ *
+ * Circulation commands print nothing when they succeed, so long scripts produce output only for the
+ * commands that ask for it. Given a `CirculationLog`, the processor records every successful change in it
+ * as the command line itself, so the log can be replayed as a script. A read-only processor, such as one serving
+ * a `LogReplica`, refuses those changes, and a server refuses `export` from clients that may not write its files.
+ * The processor records how many of each command it ran and how long they took.
+ */
+class CommandProcessor {
+public:
+    /**
+     * @brief Constructs a processor that runs commands against a librarian.
+     *
+     * @param librarian The librarian to run commands against.
+     * @param log The log to record successful changes in, or nullptr to not record them.
+     */
+    explicit CommandProcessor(Librarian& librarian, CirculationLog* log = nullptr);
+
+    /**
+     * @brief Runs one command line.
+     *
+     * @param line The command line, without its line break.
+     * @param out The stream to print the command's output and any error to.
+     * @return false if the line was `quit`, true otherwise.
+     */
+    bool execute(string_view line, ostream& out);
+
+    /**
+     * @brief Runs one command line as a coroutine on an `AsyncLibrarian`'s executor.
+     *
+     * Commands that change circulation state, or read it under the librarian's lock, wait for the facade's
+     * circulation lock by suspending. The other commands run at once. When the processor has a log, a change is
+     * not finished until its record is durable, and the coroutine suspends until then; a change whose record could
+     * not be written is reported as an error.
+     *
+     * @param line The command line, without its line break. Must stay valid until the task finishes.
+     * @param out The stream to print the command's output and any error to.
+     * @param async The facade to run the command through.
+     * @return A task producing false if the line was `quit`, true otherwise.
+     */
+    Task<bool> executeAsync(string_view line, ostream& out, AsyncLibrarian& async);
+
+    /**
+     * @brief Runs every command line of a stream until the end of the stream or a `quit` command.
+     *
+     * The stream is read in large blocks and split into lines in place, so no per-line strings are made.
+     *
+     * @param in The stream to read commands from.
+     * @param out The stream to print output to.
+     * @return The number of lines read.
+     */
+    long run(istream& in, ostream& out);
+
+    /**
+     * @brief Runs every command line of a file until the end of the file or a `quit` command.
+     *
+     * The file is read with an `IoBackend`, which is how a circulation log is replayed at startup.
+     *
+     * @param path Path of the file.
+     * @param out The stream to print output to.
+     * @return The number of lines read, or -1 if the file could not be read.
+     */
+    long runFile(const string& path, ostream& out);
+
+    /**
+     * @brief Prints how many times each command ran, its total time, throughput and mean latency.
+     *
+     * @param out The stream to print to.
+     */
+    void printStats(ostream& out) const;
+
+    /**
+     * @brief Gets the number of lines that were not valid commands so far.
+     *
+     * @return The number of invalid lines.
+     */
+    [[nodiscard]] unsigned long getErrorCount() const;
+
+    /**
+     * @brief Makes the processor refuse, or accept again, the commands that change the library.
+     *
+     * @param readOnly true to report changes as errors instead of running them.
+     */
+    void setReadOnly(bool readOnly);
+
+    /**
+     * @brief Makes the processor refuse, or accept again, the commands that write files on this machine.
+     *
+     * @param allowed false to report `export` as an error instead of running it.
+     */
+    void setFileWritesAllowed(bool allowed);
+
+    /**
+     * @brief Splits the next space- or tab-separated token off the front of a line.
+     *
+     * @param line The rest of the line. The token and the blanks around it are removed from it.
+     * @return The token, or an empty view at the end of the line.
+     */
+    static string_view nextToken(string_view& line);
+
+    /**
+     * @brief Parses an ISBN, ignoring any hyphens in it.
+     *
+     * @param token The ISBN text.
+     * @param ISBN Set to the ISBN.
+     * @return true if the token was a valid ISBN, false otherwise.
+     */
+    static bool parseISBN(string_view token, long long& ISBN);
+
+    /**
+     * @brief Parses a decimal integer.
+     *
+     * @param token The text of the number, optionally starting with `-`.
+     * @param value Set to the number.
+     * @return true if the token was a valid number, false otherwise.
+     */
+    static bool parseNumber(string_view token, long long& value);
+
+private:
+    /**
+     * @brief The commands of the language, used to index `stats`.
+     */
+    enum Command {
+        Checkout, Return, Reserve, Cancel, Renew, Advance, Add, Remove, Search, Title, Fuzzy, Range, Prefix, Query,
+        Page, Archive, List, CheckedOut, Overdue, Reservations, NewPatron, Account, Export, Stats, Memory, Quit,
+        COMMAND_COUNT
+    };
+
+    /**
+     * @brief Counters of one command.
+     */
+    struct CommandStats {
+        unsigned long count = 0; ///< Number of times the command ran.
+        chrono::nanoseconds time{0}; ///< Total time spent running the command.
+    };
+
+    /**
+     * @brief Counts a line and splits its command name off.
+     *
+     * @param line The command line. The command name is removed from it, leaving the arguments.
+     * @param out The stream to report an unknown or refused command to.
+     * @return The command, or COMMAND_COUNT if there is nothing to run.
+     */
+    Command begin(string_view& line, ostream& out);
+
+    /**
+     * @brief Records that a command ran and reports bad arguments.
+     *
+     * @param command The command.
+     * @param start When the command started.
+     * @param valid Whether the command's arguments were valid.
+     * @param out The stream to report bad arguments to.
+     */
+    void finish(Command command, chrono::steady_clock::time_point start, bool valid, ostream& out);
+
+    /**
+     * @brief Records a successful command in the log if it changed the library.
+     *
+     * @param command The command.
+     * @param text The whole command line.
+     * @return The record's sequence number in the log, or 0 if nothing was recorded.
+     */
+    unsigned long long record(Command command, string_view text);
+
+    /**
+     * @brief Tells whether a command changes the library, so it is recorded in the log.
+     *
+     * @param command The command.
+     * @return true for circulation changes, catalog changes and patron registration.
+     */
+    static bool changesLibrary(Command command);
+
+    /**
+     * @brief Tells whether a command writes a file at a path it is given.
+     *
+     * @param command The command.
+     * @return true for `export`.
+     */
+    static bool writesFiles(Command command);
+
+    /**
+     * @brief Tells whether a command must hold the circulation lock.
+     *
+     * @param command The command.
+     * @return true for commands that change circulation state or read it under the librarian's lock.
+     */
+    static bool usesCirculationLock(Command command);
+
+    /**
+     * @brief Runs a parsed command.
+     *
+     * @param command The command.
+     * @param args The rest of the line after the command name.
+     * @param out The stream to print output to.
+     * @return false if the arguments were not valid, true otherwise.
+     */
+    bool dispatch(Command command, string_view args, ostream& out);
+
+    /**
+     * @brief Looks up a command by name.
+     *
+     * @param name The command name.
+     * @return The command, or COMMAND_COUNT if there is no command with that name.
+     */
+    static Command lookup(string_view name);
+
+    static const string_view NAMES[COMMAND_COUNT]; ///< Name of each command, indexed by `Command`.
+
+    Librarian& librarian; ///< The librarian the commands run against.
+    CirculationLog* log; ///< The log successful changes are recorded in, or nullptr.
+    CommandStats stats[COMMAND_COUNT]; ///< Counters of each command.
+    unsigned long errors; ///< Number of lines that were not valid commands.
+    long lineNumber; ///< Number of lines passed to `execute` so far.
+    bool readOnly; ///< Whether commands that change the library are refused.
+    bool fileWritesAllowed; ///< Whether commands that write files are run.
+};
+
+#endif //LIBRARYMANAGEMENT_COMMANDPROCESSOR_H
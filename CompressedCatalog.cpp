@@ -0,0 +1,359 @@
+#include "CompressedCatalog.h"
+#include "LibraryHash.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * @brief Appends a number in 7-bit groups, lowest first, with the high bit set on all but the last.
+ *
+ * @param out The bytes to append to.
+ * @param value The number.
+ */
+template<typename Bytes>
+static void putVarint(Bytes& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/**
+ * @brief Reads a number written by `putVarint`.
+ *
+ * @param p The position to read from, moved past the number.
+ * @return The number.
+ */
+static uint32_t getVarint(const char*& p) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        auto byte = static_cast<unsigned char>(*p++);
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+/**
+ * @brief Decodes the book's title from its front-coded block.
+ *
+ * @return The title.
+ */
+string ArchivedBook::getTitle() const {
+    return catalog->titleAt(catalog->titleIds[row]);
+}
+
+/**
+ * @brief Looks up the book's author in the author dictionary.
+ *
+ * @return The author.
+ */
+string ArchivedBook::getAuthor() const {
+    return catalog->authors.at(catalog->authorCodes[row]);
+}
+
+/**
+ * @brief Looks up the book's genre in the genre dictionary.
+ *
+ * @return The genre.
+ */
+string ArchivedBook::getGenre() const {
+    return catalog->genres.at(catalog->genreCodes[row]);
+}
+
+/**
+ * @brief Gets the book's publication year.
+ *
+ * @return The year.
+ */
+short ArchivedBook::getPublicationYear() const {
+    return catalog->years[row];
+}
+
+/**
+ * @brief Gets the book's ISBN.
+ *
+ * @return The ISBN.
+ */
+long long ArchivedBook::getIsbn() const {
+    return catalog->isbns[row];
+}
+
+/**
+ * @brief Tells whether the book was available when it was archived.
+ *
+ * @return true if it was available.
+ */
+bool ArchivedBook::isAvailable() const {
+    return catalog->available[row];
+}
+
+/**
+ * @brief Get detailed information about the book, in the same format as `Book::getInfo`.
+ *
+ * @return A string containing the book's details.
+ */
+string ArchivedBook::getInfo() const {
+    return "Title: " + getTitle() +
+           "\n    Author: " + getAuthor() +
+           "\n    Genre: " + getGenre() +
+           "\n    ISBN: " + to_string(getIsbn()) +
+           "\n    Publication Year: " + to_string(getPublicationYear()) +
+           "\n    Available: " + (isAvailable() ? "Yes" : "No") +
+           "\n    Fines: 0" +
+           "\n    Days Left: 0";
+}
+
+/**
+ * @brief Replaces the contents with a catalog CSV file, in the format the inventory is loaded from.
+ *
+ * The file is read a line at a time, so building the catalog holds the titles once as raw text plus the finished
+ * columns, never a `Book` per row. Rows are sorted by ISBN, and of rows sharing an ISBN the last one is kept, as
+ * in the inventory. Rows without six fields or with a bad ISBN or year are skipped.
+ *
+ * @param path Path of the file.
+ * @return true if the file was read, false otherwise.
+ */
+bool CompressedCatalog::load(const string &path) {
+    ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    /**
+     * @brief A parsed row, with its title in `titleText`.
+     */
+    struct Row {
+        long long isbn; ///< The ISBN.
+        size_t titleStart; ///< Where the title starts in `titleText`.
+        uint32_t titleLength; ///< The title's length.
+        uint32_t author; ///< The author's code.
+        uint32_t genre; ///< The genre's code.
+        short year; ///< The publication year.
+        bool available; ///< Whether the book is available.
+    };
+    vector<Row> rows;
+    string titleText;
+    Dictionary newAuthors;
+    Dictionary newGenres;
+    unordered_map<string, uint32_t> authorIndex;
+    unordered_map<string, uint32_t> genreIndex;
+    auto encode = [](Dictionary& dictionary, unordered_map<string, uint32_t>& codes, const string& value) {
+        auto inserted = codes.emplace(value, static_cast<uint32_t>(codes.size()));
+        if (inserted.second) {
+            dictionary.bytes.insert(dictionary.bytes.end(), value.begin(), value.end());
+            dictionary.ends.push_back(static_cast<uint32_t>(dictionary.bytes.size()));
+        }
+        return inserted.first->second;
+    };
+
+    string line;
+    getline(file, line);
+    vector<string> fields;
+    while (getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        fields.clear();
+        stringstream ss(line);
+        string field;
+        while (getline(ss, field, ',')) {
+            fields.push_back(field);
+        }
+        if (fields.size() != 6) {
+            continue;
+        }
+        Row row{};
+        try {
+            row.isbn = LibraryHash::formatISBN(fields[0]);
+            row.year = static_cast<short>(stoi(fields[4]));
+        } catch (const exception&) {
+            continue;
+        }
+        transform(fields[5].begin(), fields[5].end(), fields[5].begin(), ::tolower);
+        row.available = fields[5] == "true";
+        row.titleStart = titleText.size();
+        row.titleLength = static_cast<uint32_t>(fields[1].size());
+        titleText += fields[1];
+        row.author = encode(newAuthors, authorIndex, fields[2]);
+        row.genre = encode(newGenres, genreIndex, fields[3]);
+        rows.push_back(row);
+    }
+
+    stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+        return a.isbn < b.isbn;
+    });
+    // Keep the last row of each run of equal ISBNs.
+    size_t kept = 0;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (i + 1 < rows.size() && rows[i + 1].isbn == rows[i].isbn) {
+            continue;
+        }
+        rows[kept++] = rows[i];
+    }
+    rows.resize(kept);
+
+    auto titleOf = [&titleText, &rows](uint32_t i) {
+        return string_view(titleText.data() + rows[i].titleStart, rows[i].titleLength);
+    };
+    vector<uint32_t> byTitle(rows.size());
+    for (uint32_t i = 0; i < byTitle.size(); i++) {
+        byTitle[i] = i;
+    }
+    sort(byTitle.begin(), byTitle.end(), [&titleOf](uint32_t a, uint32_t b) {
+        return titleOf(a) < titleOf(b);
+    });
+
+    Column<uint32_t> newTitleIds(rows.size());
+    Column<char> newTitleBytes;
+    Column<size_t> newTitleBlocks;
+    string_view previous;
+    uint32_t titles = 0;
+    for (size_t i = 0; i < byTitle.size(); i++) {
+        string_view title = titleOf(byTitle[i]);
+        if (i == 0 || title != previous) {
+            if (titles % TITLES_PER_BLOCK == 0) {
+                newTitleBlocks.push_back(newTitleBytes.size());
+                putVarint(newTitleBytes, static_cast<uint32_t>(title.size()));
+                newTitleBytes.insert(newTitleBytes.end(), title.begin(), title.end());
+            } else {
+                size_t shared = 0;
+                while (shared < title.size() && shared < previous.size() && title[shared] == previous[shared]) {
+                    shared++;
+                }
+                putVarint(newTitleBytes, static_cast<uint32_t>(shared));
+                putVarint(newTitleBytes, static_cast<uint32_t>(title.size() - shared));
+                newTitleBytes.insert(newTitleBytes.end(), title.begin() + static_cast<long>(shared), title.end());
+            }
+            previous = title;
+            titles++;
+        }
+        newTitleIds[byTitle[i]] = titles - 1;
+    }
+
+    isbns.assign(rows.size(), 0);
+    years.assign(rows.size(), 0);
+    available.assign(rows.size(), false);
+    Column<uint32_t> newAuthorCodes(rows.size());
+    Column<uint32_t> newGenreCodes(rows.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+        isbns[i] = rows[i].isbn;
+        years[i] = rows[i].year;
+        available[i] = rows[i].available;
+        newAuthorCodes[i] = rows[i].author;
+        newGenreCodes[i] = rows[i].genre;
+    }
+    newTitleBytes.shrink_to_fit();
+    newAuthors.bytes.shrink_to_fit();
+    newGenres.bytes.shrink_to_fit();
+    titleIds.swap(newTitleIds);
+    authorCodes.swap(newAuthorCodes);
+    genreCodes.swap(newGenreCodes);
+    titleBytes.swap(newTitleBytes);
+    titleBlocks.swap(newTitleBlocks);
+    authors.bytes.swap(newAuthors.bytes);
+    authors.ends.swap(newAuthors.ends);
+    genres.bytes.swap(newGenres.bytes);
+    genres.ends.swap(newGenres.ends);
+    return true;
+}
+
+/**
+ * @brief Gets the number of books.
+ *
+ * @return The number of books.
+ */
+size_t CompressedCatalog::size() const {
+    return isbns.size();
+}
+
+/**
+ * @brief Finds a book by its ISBN, by binary search of the ISBN column.
+ *
+ * @param ISBN The ISBN.
+ * @param book Set to the book if it is found.
+ * @return true if the book was found, false otherwise.
+ */
+bool CompressedCatalog::findByIsbn(long long ISBN, ArchivedBook &book) const {
+    auto it = lower_bound(isbns.begin(), isbns.end(), ISBN);
+    if (it == isbns.end() || *it != ISBN) {
+        return false;
+    }
+    book = {this, static_cast<uint32_t>(it - isbns.begin())};
+    return true;
+}
+
+/**
+ * @brief Calls a function on every book that matches a query, in ISBN order.
+ *
+ * Only the rows in the query's ISBN range are visited, found by binary search since the rows are sorted by ISBN.
+ * The query tests the numeric columns first and decodes a text field only for the terms that need it.
+ *
+ * @param query The compiled query.
+ * @param visit The function to call with each matching book.
+ * @return The number of matches.
+ */
+size_t CompressedCatalog::forEachMatch(const CatalogQuery &query,
+                                       const function<void(const ArchivedBook&)> &visit) const {
+    if (query.isEmpty()) {
+        return 0;
+    }
+    size_t first = 0;
+    size_t last = isbns.size();
+    long long low;
+    long long high;
+    if (query.isbnRange(low, high)) {
+        first = static_cast<size_t>(lower_bound(isbns.begin(), isbns.end(), low) - isbns.begin());
+        last = static_cast<size_t>(upper_bound(isbns.begin(), isbns.end(), high) - isbns.begin());
+    }
+    BookVersion state{0, true, 0, 0, nullptr};
+    size_t matched = 0;
+    for (size_t row = first; row < last; row++) {
+        ArchivedBook book{this, static_cast<uint32_t>(row)};
+        state.available = available[row];
+        if (query.matches(book, state)) {
+            visit(book);
+            matched++;
+        }
+    }
+    return matched;
+}
+
+/**
+ * @brief Gets a string.
+ *
+ * @param code The string's position.
+ * @return The string.
+ */
+string CompressedCatalog::Dictionary::at(uint32_t code) const {
+    uint32_t start = code == 0 ? 0 : ends[code - 1];
+    return {bytes.data() + start, ends[code] - start};
+}
+
+/**
+ * @brief Decodes a title.
+ *
+ * Starts from the whole first title of the title's block and applies the front-coded entries after it, so at
+ * most `TITLES_PER_BLOCK - 1` entries are read.
+ *
+ * @param id The title's position in sorted order.
+ * @return The title.
+ */
+string CompressedCatalog::titleAt(uint32_t id) const {
+    const char* p = titleBytes.data() + titleBlocks[id / TITLES_PER_BLOCK];
+    uint32_t length = getVarint(p);
+    string title(p, length);
+    p += length;
+    for (uint32_t i = 0; i < id % TITLES_PER_BLOCK; i++) {
+        uint32_t shared = getVarint(p);
+        uint32_t suffix = getVarint(p);
+        title.resize(shared);
+        title.append(p, suffix);
+        p += suffix;
+    }
+    return title;
+}
@@ -0,0 +1,181 @@
+#ifndef LIBRARYMANAGEMENT_COMPRESSEDCATALOG_H
+#define LIBRARYMANAGEMENT_COMPRESSEDCATALOG_H
+
+#include "CatalogQuery.h"
+#include "MemoryAccounting.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class CompressedCatalog;
+
+/**
+ * @brief A view of one book of a `CompressedCatalog`, which decodes its fields when they are read.
+ *
+ * The getters match `Book`'s, so a `CatalogQuery` can test archived books the same way as shelved ones, but the
+ * text fields are returned by value since they are only decoded on access.
+ */
+struct ArchivedBook {
+    const CompressedCatalog* catalog; ///< The catalog the book is in.
+    uint32_t row; ///< The book's row, in ISBN order.
+
+    /**
+     * @brief Decodes the book's title from its front-coded block.
+     *
+     * @return The title.
+     */
+    [[nodiscard]] string getTitle() const;
+
+    /**
+     * @brief Looks up the book's author in the author dictionary.
+     *
+     * @return The author.
+     */
+    [[nodiscard]] string getAuthor() const;
+
+    /**
+     * @brief Looks up the book's genre in the genre dictionary.
+     *
+     * @return The genre.
+     */
+    [[nodiscard]] string getGenre() const;
+
+    /**
+     * @brief Gets the book's publication year.
+     *
+     * @return The year.
+     */
+    [[nodiscard]] short getPublicationYear() const;
+
+    /**
+     * @brief Gets the book's ISBN.
+     *
+     * @return The ISBN.
+     */
+    [[nodiscard]] long long getIsbn() const;
+
+    /**
+     * @brief Tells whether the book was available when it was archived.
+     *
+     * @return true if it was available.
+     */
+    [[nodiscard]] bool isAvailable() const;
+
+    /**
+     * @brief Get detailed information about the book, in the same format as `Book::getInfo`.
+     *
+     * @return A string containing the book's details.
+     */
+    [[nodiscard]] string getInfo() const;
+};
+
+/**
+ * @class CompressedCatalog
+ * @brief A read-only, compressed copy of a catalog, for cold collections too large to keep as `Book` objects.
+ *
+ * A `Book` costs a few hundred bytes: three `std::string`s, atomics and loan links, plus the heap blocks of long
+ * titles. Archived books are stored in columns instead, one entry per book in ISBN order:
+ *
+ * - ISBNs, years and availability as plain arrays, which are what most queries test;
+ * - authors and genres as codes into dictionaries that hold each distinct name once;
+ * - titles as numbers into a sorted list of the distinct titles, front-coded in blocks of `TITLES_PER_BLOCK`:
+ *   the first title of a block is stored whole, and each following one as the length of the prefix it shares
+ *   with the previous title and the rest of its bytes. Decoding a title reads at most one block.
+ *
+ * Nothing is decoded until a field is read through an `ArchivedBook`. Queries test the numeric columns before
+ * they read any text, and a query that limits the ISBNs only visits that range of rows. The memory of every
+ * column is counted under `MemoryAccounting::Archive`.
+ *
+ * The catalog is built once by `load` and never changed afterwards, so it can be read from any thread.
+ */
+class CompressedCatalog {
+public:
+    static const uint32_t TITLES_PER_BLOCK = 16; ///< Titles per front-coded block.
+
+    /**
+     * @brief Constructs an empty catalog.
+     */
+    CompressedCatalog() = default;
+
+    CompressedCatalog(const CompressedCatalog&) = delete;
+    CompressedCatalog& operator=(const CompressedCatalog&) = delete;
+
+    /**
+     * @brief Replaces the contents with a catalog CSV file, in the format the inventory is loaded from.
+     *
+     * @param path Path of the file.
+     * @return true if the file was read, false otherwise.
+     */
+    bool load(const string& path);
+
+    /**
+     * @brief Gets the number of books.
+     *
+     * @return The number of books.
+     */
+    [[nodiscard]] size_t size() const;
+
+    /**
+     * @brief Finds a book by its ISBN, by binary search of the ISBN column.
+     *
+     * @param ISBN The ISBN.
+     * @param book Set to the book if it is found.
+     * @return true if the book was found, false otherwise.
+     */
+    bool findByIsbn(long long ISBN, ArchivedBook& book) const;
+
+    /**
+     * @brief Calls a function on every book that matches a query, in ISBN order.
+     *
+     * @param query The compiled query.
+     * @param visit The function to call with each matching book.
+     * @return The number of matches.
+     */
+    size_t forEachMatch(const CatalogQuery& query, const function<void(const ArchivedBook&)>& visit) const;
+
+private:
+    friend struct ArchivedBook;
+
+    template<typename T>
+    using Column = vector<T, CountingAllocator<T, MemoryAccounting::Archive>>;
+
+    /**
+     * @brief Distinct strings stored end to end, each named by its position.
+     */
+    struct Dictionary {
+        Column<char> bytes; ///< The strings, end to end.
+        Column<uint32_t> ends; ///< Where each string ends in `bytes`.
+
+        /**
+         * @brief Gets a string.
+         *
+         * @param code The string's position.
+         * @return The string.
+         */
+        [[nodiscard]] string at(uint32_t code) const;
+    };
+
+    /**
+     * @brief Decodes a title.
+     *
+     * @param id The title's position in sorted order.
+     * @return The title.
+     */
+    [[nodiscard]] string titleAt(uint32_t id) const;
+
+    Column<long long> isbns; ///< The ISBN of each book, ascending.
+    Column<short> years; ///< The publication year of each book.
+    Column<bool> available; ///< Whether each book was available when archived.
+    Column<uint32_t> titleIds; ///< The position of each book's title in sorted order.
+    Column<uint32_t> authorCodes; ///< The code of each book's author in `authors`.
+    Column<uint32_t> genreCodes; ///< The code of each book's genre in `genres`.
+    Column<char> titleBytes; ///< The front-coded blocks of titles.
+    Column<size_t> titleBlocks; ///< Where each block starts in `titleBytes`.
+    Dictionary authors; ///< The distinct authors.
+    Dictionary genres; ///< The distinct genres.
+};
+
+#endif //LIBRARYMANAGEMENT_COMPRESSEDCATALOG_H
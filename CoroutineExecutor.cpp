@@ -0,0 +1,132 @@
+#include "CoroutineExecutor.h"
+#include <iostream>
+
+/**
+ * @brief A coroutine nothing awaits, which frees itself when it finishes.
+ */
+struct DetachedCoroutine {
+    struct promise_type {
+        DetachedCoroutine get_return_object() {
+            return {};
+        }
+
+        suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {
+        }
+
+        void unhandled_exception() {
+        }
+    };
+};
+
+/**
+ * @brief Moves to the executor and runs a task there.
+ *
+ * @param executor The executor to run on.
+ * @param task The task to run.
+ */
+static DetachedCoroutine runDetached(CoroutineExecutor& executor, Task<void> task) {
+    co_await executor.schedule();
+    try {
+        co_await task;
+    } catch (const exception& e) {
+        cerr << "Task failed: " << e.what() << endl;
+    }
+}
+
+/**
+ * @brief Constructs an executor and starts its threads.
+ *
+ * @param threads Number of threads that resume coroutines.
+ */
+CoroutineExecutor::CoroutineExecutor(int threads) : stopping(false) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    for (int i = 0; i < threads; i++) {
+        this->threads.emplace_back(&CoroutineExecutor::workerLoop, this);
+    }
+}
+
+/**
+ * @brief Destructor. Runs every coroutine that is ready or becomes ready, then joins the threads.
+ */
+CoroutineExecutor::~CoroutineExecutor() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread& t : threads) {
+        t.join();
+    }
+}
+
+/**
+ * @brief Queues a suspended coroutine to be resumed on one of the executor's threads.
+ *
+ * @param coroutine The coroutine.
+ */
+void CoroutineExecutor::post(coroutine_handle<> coroutine) {
+    {
+        lock_guard<mutex> guard(lock);
+        ready.push_back(coroutine);
+    }
+    wake.notify_one();
+}
+
+/**
+ * @brief Moves the awaiting coroutine onto one of the executor's threads.
+ *
+ * @return An awaitable for `co_await`.
+ */
+CoroutineExecutor::ScheduleAwaiter CoroutineExecutor::schedule() {
+    return ScheduleAwaiter{*this};
+}
+
+/**
+ * @brief Starts a task on the executor without waiting for it.
+ *
+ * The task's frame is freed when it finishes. An exception that escapes the task is reported on
+ * standard error.
+ *
+ * @param task The task to start.
+ */
+void CoroutineExecutor::spawn(Task<void> task) {
+    runDetached(*this, std::move(task));
+}
+
+/**
+ * @brief Gets the number of threads that resume coroutines.
+ *
+ * @return The thread count.
+ */
+int CoroutineExecutor::getThreadCount() const {
+    return static_cast<int>(threads.size());
+}
+
+/**
+ * @brief Body of each thread. Resumes ready coroutines until the executor is destroyed.
+ */
+void CoroutineExecutor::workerLoop() {
+    for (;;) {
+        coroutine_handle<> next;
+        {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [this] { return stopping || !ready.empty(); });
+            if (ready.empty()) {
+                return;
+            }
+            next = ready.front();
+            ready.pop_front();
+        }
+        next.resume();
+    }
+}
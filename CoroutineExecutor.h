@@ -0,0 +1,105 @@
+#ifndef LIBRARYMANAGEMENT_COROUTINEEXECUTOR_H
+#define LIBRARYMANAGEMENT_COROUTINEEXECUTOR_H
+
+#include "Task.h"
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class CoroutineExecutor
+ * @brief A small pool of threads that resume suspended coroutines in the order they become ready.
+ *
+ * Request coroutines run on the executor until they wait for something, such as the circulation lock of
+ * an `AsyncLibrarian`, and then give their thread back instead of blocking it. Whatever they were waiting
+ * for posts them back to the executor once it is ready. Thousands of requests can be in flight on a
+ * handful of threads this way.
+ *
+ * Unlike `TaskScheduler`, which runs the newest task first to keep bulk loops cache-friendly, the executor
+ * is first in, first out, so requests are served in the order they arrive.
+ */
+class CoroutineExecutor {
+public:
+    /**
+     * @brief Constructs an executor and starts its threads.
+     *
+     * @param threads Number of threads that resume coroutines.
+     */
+    explicit CoroutineExecutor(int threads);
+
+    /**
+     * @brief Destructor. Runs every coroutine that is ready or becomes ready, then joins the threads.
+     */
+    ~CoroutineExecutor();
+
+    CoroutineExecutor(const CoroutineExecutor&) = delete;
+    CoroutineExecutor& operator=(const CoroutineExecutor&) = delete;
+
+    /**
+     * @brief Queues a suspended coroutine to be resumed on one of the executor's threads.
+     *
+     * @param coroutine The coroutine.
+     */
+    void post(coroutine_handle<> coroutine);
+
+    /**
+     * @brief Awaitable that moves the awaiting coroutine onto one of the executor's threads.
+     */
+    struct ScheduleAwaiter {
+        CoroutineExecutor& executor; ///< The executor to move to.
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(coroutine_handle<> awaiting) {
+            executor.post(awaiting);
+        }
+
+        void await_resume() const noexcept {
+        }
+    };
+
+    /**
+     * @brief Moves the awaiting coroutine onto one of the executor's threads.
+     *
+     * @return An awaitable for `co_await`.
+     */
+    ScheduleAwaiter schedule();
+
+    /**
+     * @brief Starts a task on the executor without waiting for it.
+     *
+     * The task's frame is freed when it finishes. An exception that escapes the task is reported on
+     * standard error.
+     *
+     * @param task The task to start.
+     */
+    void spawn(Task<void> task);
+
+    /**
+     * @brief Gets the number of threads that resume coroutines.
+     *
+     * @return The thread count.
+     */
+    [[nodiscard]] int getThreadCount() const;
+
+private:
+    /**
+     * @brief Body of each thread. Resumes ready coroutines until the executor is destroyed.
+     */
+    void workerLoop();
+
+    deque<coroutine_handle<>> ready; ///< Coroutines waiting to be resumed, oldest at the front.
+    mutex lock; ///< Guards `ready` and `stopping`.
+    condition_variable wake; ///< Signalled when a coroutine is posted or the executor stops.
+    bool stopping; ///< Set when the executor is being destroyed.
+    vector<thread> threads; ///< The executor's threads.
+};
+
+#endif //LIBRARYMANAGEMENT_COROUTINEEXECUTOR_H
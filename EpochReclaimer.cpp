@@ -0,0 +1,110 @@
+#include "EpochReclaimer.h"
+#include <thread>
+
+/**
+ * @brief Constructs a reclaimer with every slot unpinned.
+ */
+EpochReclaimer::EpochReclaimer() : globalEpoch(0) {
+    for (Slot& slot : slots) {
+        slot.epoch.store(IDLE);
+        slot.stamp.store(0);
+    }
+}
+
+/**
+ * @brief Destructor. Frees everything still waiting to be reclaimed.
+ */
+EpochReclaimer::~EpochReclaimer() {
+    for (auto& list : limbo) {
+        for (const Retired& r : list) {
+            r.free(r.p);
+        }
+    }
+}
+
+/**
+ * @brief Pins a reader slot and reads the stamp the reader will see.
+ *
+ * Waits for a slot if all `MAX_READERS` are pinned.
+ *
+ * @param clock The commit stamp of the most recent fully published change.
+ * @param stamp Set to the value of `clock` the reader should read at.
+ * @return The index of the pinned slot, to be passed to `unpin`.
+ */
+int EpochReclaimer::pin(const atomic<unsigned long long>& clock, unsigned long long& stamp) {
+    for (;;) {
+        for (int i = 0; i < MAX_READERS; i++) {
+            unsigned long long expected = IDLE;
+            if (slots[i].epoch.compare_exchange_strong(expected, globalEpoch.load())) {
+                // While the stamp is 0 writers keep every version, so reading the clock after pinning is safe.
+                stamp = clock.load();
+                slots[i].stamp.store(stamp);
+                return i;
+            }
+        }
+        this_thread::yield();
+    }
+}
+
+/**
+ * @brief Unpins a reader slot.
+ *
+ * @param slot The index returned by `pin`.
+ */
+void EpochReclaimer::unpin(int slot) {
+    slots[slot].stamp.store(0);
+    slots[slot].epoch.store(IDLE);
+}
+
+/**
+ * @brief Gets the oldest stamp any pinned reader is reading at.
+ *
+ * @param newest The stamp to return if no reader is pinned.
+ * @return The smallest pinned stamp, or `newest` if it is smaller.
+ */
+unsigned long long EpochReclaimer::oldestPinnedStamp(unsigned long long newest) const {
+    unsigned long long oldest = newest;
+    for (const Slot& slot : slots) {
+        if (slot.epoch.load() != IDLE) {
+            unsigned long long stamp = slot.stamp.load();
+            if (stamp < oldest) {
+                oldest = stamp;
+            }
+        }
+    }
+    return oldest;
+}
+
+/**
+ * @brief Hands memory over to be freed once no pinned reader can reach it.
+ *
+ * @param p Pointer to the memory.
+ * @param free Function that frees `p`.
+ */
+void EpochReclaimer::retire(void *p, void (*free)(void *)) {
+    lock_guard<mutex> guard(limboMutex);
+    limbo[globalEpoch.load() % 3].push_back({p, free});
+}
+
+/**
+ * @brief Advances the epoch if every pinned reader has caught up, and frees what became unreachable.
+ */
+void EpochReclaimer::collect() {
+    vector<Retired> freed;
+    {
+        lock_guard<mutex> guard(limboMutex);
+        unsigned long long epoch = globalEpoch.load();
+        for (const Slot& slot : slots) {
+            unsigned long long pinned = slot.epoch.load();
+            if (pinned != IDLE && pinned != epoch) {
+                return;
+            }
+        }
+        // Every pinned reader is in the current epoch, so nothing retired two epochs ago is reachable.
+        globalEpoch.store(epoch + 1);
+        freed.swap(limbo[(epoch + 1) % 3]);
+    }
+    for (const Retired& r : freed) {
+        r.free(r.p);
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef LIBRARYMANAGEMENT_EPOCHRECLAIMER_H
+#define LIBRARYMANAGEMENT_EPOCHRECLAIMER_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class EpochReclaimer
+ * @brief Epoch-based reclamation of memory that lock-free readers may still be looking at.
+ *
+ * A reader pins a slot for as long as it follows shared pointers. Writers retire memory instead of
+ * deleting it, and the memory is freed only once the global epoch has advanced twice, which cannot
+ * happen while any reader that pinned before the retirement is still pinned. Each pinned slot also
+ * records the commit stamp its reader is reading at, so writers can tell which old versions are
+ * still needed.
+ */
+class EpochReclaimer {
+public:
+    static const int MAX_READERS = 128; ///< Number of readers that can be pinned at the same time.
+
+    /**
+     * @brief Constructs a reclaimer with every slot unpinned.
+     */
+    EpochReclaimer();
+
+    /**
+     * @brief Destructor. Frees everything still waiting to be reclaimed.
+     */
+    ~EpochReclaimer();
+
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    /**
+     * @brief Pins a reader slot and reads the stamp the reader will see.
+     *
+     * Waits for a slot if all `MAX_READERS` are pinned.
+     *
+     * @param clock The commit stamp of the most recent fully published change.
+     * @param stamp Set to the value of `clock` the reader should read at.
+     * @return The index of the pinned slot, to be passed to `unpin`.
+     */
+    int pin(const atomic<unsigned long long>& clock, unsigned long long& stamp);
+
+    /**
+     * @brief Unpins a reader slot.
+     *
+     * @param slot The index returned by `pin`.
+     */
+    void unpin(int slot);
+
+    /**
+     * @brief Gets the oldest stamp any pinned reader is reading at.
+     *
+     * @param newest The stamp to return if no reader is pinned.
+     * @return The smallest pinned stamp, or `newest` if it is smaller.
+     */
+    [[nodiscard]] unsigned long long oldestPinnedStamp(unsigned long long newest) const;
+
+    /**
+     * @brief Hands memory over to be freed once no pinned reader can reach it.
+     *
+     * @param p Pointer to the memory.
+     * @param free Function that frees `p`.
+     */
+    void retire(void* p, void (*free)(void*));
+
+    /**
+     * @brief Advances the epoch if every pinned reader has caught up, and frees what became unreachable.
+     */
+    void collect();
+
+private:
+    static const unsigned long long IDLE = ~0ULL; ///< Epoch of a slot with no reader pinned.
+
+    /**
+     * @brief A retired allocation and the function that frees it.
+     */
+    struct Retired {
+        void* p; ///< The allocation.
+        void (*free)(void*); ///< Frees `p`.
+    };
+
+    /**
+     * @brief A reader slot, padded to its own cache line so readers don't contend.
+     */
+    struct alignas(64) Slot {
+        atomic<unsigned long long> epoch; ///< Epoch the reader pinned at, `IDLE` if unpinned.
+        atomic<unsigned long long> stamp; ///< Commit stamp the reader reads at, 0 while pinning.
+    };
+
+    atomic<unsigned long long> globalEpoch; ///< The current epoch.
+    Slot slots[MAX_READERS]; ///< Reader slots.
+    vector<Retired> limbo[3]; ///< Allocations retired in each of the last three epochs.
+    mutex limboMutex; ///< Guards `limbo` and advancing `globalEpoch`.
+};
+
+#endif //LIBRARYMANAGEMENT_EPOCHRECLAIMER_H
@@ -0,0 +1,401 @@
+#include "FuzzyIndex.h"
+#include <algorithm>
+#include <bit>
+#include <mutex>
+
+/**
+ * @brief Gets the distinct trigrams of a run of normalized symbols.
+ *
+ * @param symbols The symbols.
+ * @param length Number of symbols.
+ * @param trigrams Set to the trigrams, ascending.
+ */
+static void distinctTrigrams(const char* symbols, size_t length, vector<uint32_t>& trigrams) {
+    trigrams.clear();
+    for (size_t i = 0; i + 2 < length; i++) {
+        trigrams.push_back((static_cast<uint32_t>(symbols[i]) * FuzzyIndex::SYMBOLS +
+                            static_cast<uint32_t>(symbols[i + 1])) * FuzzyIndex::SYMBOLS +
+                           static_cast<uint32_t>(symbols[i + 2]));
+    }
+    sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+/**
+ * @brief Constructs an empty index.
+ */
+FuzzyIndex::FuzzyIndex() : postings(TRIGRAMS) {
+}
+
+/**
+ * @brief Indexes the title and author of many books at once, such as a whole catalog.
+ *
+ * The posting lists are counted first and then filled, so each is allocated once.
+ *
+ * @param books The books. Null entries are skipped.
+ */
+void FuzzyIndex::addAll(const vector<Book *> &books) {
+    unique_lock<shared_mutex> guard(lock);
+    auto first = static_cast<uint32_t>(documents.size());
+    documents.reserve(documents.size() + books.size() * 2);
+    for (Book* b : books) {
+        if (b != nullptr) {
+            addDocument(b, FuzzyField::Title, b->getTitle());
+            addDocument(b, FuzzyField::Author, b->getAuthor());
+        }
+    }
+    auto last = static_cast<uint32_t>(documents.size());
+
+    vector<uint32_t> counts(TRIGRAMS, 0);
+    vector<uint32_t> trigrams;
+    for (uint32_t doc = first; doc < last; doc++) {
+        trigramsOf(doc, trigrams);
+        for (uint32_t t : trigrams) {
+            counts[t]++;
+        }
+    }
+    for (int t = 0; t < TRIGRAMS; t++) {
+        if (counts[t] != 0) {
+            postings[t].reserve(postings[t].size() + counts[t]);
+        }
+    }
+    for (uint32_t doc = first; doc < last; doc++) {
+        trigramsOf(doc, trigrams);
+        for (uint32_t t : trigrams) {
+            postings[t].push_back(doc);
+        }
+    }
+}
+
+/**
+ * @brief Indexes the title and author of a book.
+ *
+ * @param book The book.
+ */
+void FuzzyIndex::add(Book *book) {
+    unique_lock<shared_mutex> guard(lock);
+    vector<uint32_t> trigrams;
+    for (uint32_t doc : {addDocument(book, FuzzyField::Title, book->getTitle()),
+                         addDocument(book, FuzzyField::Author, book->getAuthor())}) {
+        trigramsOf(doc, trigrams);
+        for (uint32_t t : trigrams) {
+            postings[t].push_back(doc);
+        }
+    }
+}
+
+/**
+ * @brief Removes a book from the index. Its posting entries stay until they are skipped by searches.
+ *
+ * The book's documents are found through the shortest posting list of each field. Fields too short to have
+ * a trigram can never be found by a search, so they are left alone.
+ *
+ * @param book The book.
+ */
+void FuzzyIndex::remove(const Book *book) {
+    unique_lock<shared_mutex> guard(lock);
+    vector<uint32_t> trigrams;
+    for (const string* value : {&book->getTitle(), &book->getAuthor()}) {
+        string symbols = normalize(*value);
+        distinctTrigrams(symbols.data(), symbols.size(), trigrams);
+        if (trigrams.empty()) {
+            continue;
+        }
+        uint32_t rarest = *min_element(trigrams.begin(), trigrams.end(), [&](uint32_t a, uint32_t b) {
+            return postings[a].size() < postings[b].size();
+        });
+        for (uint32_t doc : postings[rarest]) {
+            if (documents[doc].book == book) {
+                documents[doc].book = nullptr;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Finds the books whose title or author best matches a query.
+ *
+ * Matches are ranked by distance first, so when enough books contain the query exactly, the search stops
+ * there and the weaker filter that allows edits is never run.
+ *
+ * @param query The text to look for, which may be misspelled.
+ * @param limit The largest number of books to return.
+ * @param maxErrors The most edits a match may need, or -1 to allow about one edit per eight characters.
+ * @return The matches, best first: by edit distance, then titles before authors, then by how close the
+ *         field's length is to the query's. Each book appears at most once.
+ */
+vector<FuzzyMatch> FuzzyIndex::search(const string &query, size_t limit, int maxErrors) const {
+    string pattern = normalize(query);
+    if (pattern.size() > MAX_QUERY) {
+        pattern.resize(MAX_QUERY);
+    }
+    vector<uint32_t> trigrams;
+    distinctTrigrams(pattern.data(), pattern.size(), trigrams);
+    if (trigrams.empty() || limit == 0) {
+        return {};
+    }
+    // At least one trigram has to survive the edits for the index to find a match.
+    auto n = static_cast<int>(trigrams.size());
+    int k = maxErrors < 0 ? static_cast<int>(pattern.size() + 4) / 8 : maxErrors;
+    k = min(k, (n - 1) / 3);
+
+    shared_lock<shared_mutex> guard(lock);
+    vector<const PostingList*> lists;
+    for (uint32_t t : trigrams) {
+        lists.push_back(&postings[t]);
+    }
+    sort(lists.begin(), lists.end(), [](const PostingList* a, const PostingList* b) {
+        return a->size() < b->size();
+    });
+    vector<FuzzyMatch> matches = bestMatches(pattern, lists, 0, limit);
+    if (matches.size() < limit && k > 0) {
+        matches = bestMatches(pattern, lists, k, limit);
+    }
+    return matches;
+}
+
+/**
+ * @brief Normalizes text into symbols of the index's alphabet.
+ *
+ * @param text The text.
+ * @return The symbols, one per byte, each below `SYMBOLS`.
+ */
+string FuzzyIndex::normalize(string_view text) {
+    string symbols;
+    symbols.reserve(text.size());
+    bool space = true;
+    for (char ch : text) {
+        auto c = static_cast<unsigned char>(ch);
+        char symbol;
+        if (c >= 'a' && c <= 'z') {
+            symbol = static_cast<char>(c - 'a' + 1);
+        } else if (c >= 'A' && c <= 'Z') {
+            symbol = static_cast<char>(c - 'A' + 1);
+        } else if (c >= '0' && c <= '9') {
+            symbol = static_cast<char>(c - '0' + 27);
+        } else if (c >= 0x80) {
+            symbol = SYMBOLS - 1;
+        } else {
+            // Spaces and punctuation separate words; leading, trailing and repeated ones are dropped.
+            if (!space) {
+                symbols.push_back(0);
+                space = true;
+            }
+            continue;
+        }
+        symbols.push_back(symbol);
+        space = false;
+    }
+    if (!symbols.empty() && symbols.back() == 0) {
+        symbols.pop_back();
+    }
+    return symbols;
+}
+
+/**
+ * @brief Adds a document for one field of a book, without touching the posting lists.
+ *
+ * @param book The book.
+ * @param field Which field.
+ * @param value The field's text.
+ * @return The new document's number.
+ */
+uint32_t FuzzyIndex::addDocument(Book *book, FuzzyField field, const string &value) {
+    string symbols = normalize(value);
+    documents.push_back({book, text.size(), static_cast<uint32_t>(symbols.size()), field});
+    text.insert(text.end(), symbols.begin(), symbols.end());
+    return static_cast<uint32_t>(documents.size() - 1);
+}
+
+/**
+ * @brief Gets the distinct trigrams of a document.
+ *
+ * @param doc The document's number.
+ * @param trigrams Set to the trigrams, ascending.
+ */
+void FuzzyIndex::trigramsOf(uint32_t doc, vector<uint32_t> &trigrams) const {
+    distinctTrigrams(text.data() + documents[doc].offset, documents[doc].length, trigrams);
+}
+
+/**
+ * @brief Finds the best matches of a normalized query within a number of edits.
+ *
+ * An edit changes at most three of the query's `n` trigrams, so a match shares at least `n - 3 * errors` of
+ * them. Only the shortest lists that every such document must appear in are scanned for candidates; the
+ * longer lists merely confirm them.
+ *
+ * @param pattern The normalized query, at most `MAX_QUERY` symbols.
+ * @param lists The posting lists of the query's distinct trigrams, shortest first.
+ * @param errors The most edits a match may need.
+ * @param limit The largest number of books to return.
+ * @return The matches, best first, each book at most once.
+ */
+vector<FuzzyMatch> FuzzyIndex::bestMatches(const string &pattern, const vector<const PostingList *> &lists,
+                                           int errors, size_t limit) const {
+    auto n = static_cast<int>(lists.size());
+    int needed = n - 3 * errors;
+    int scanned = n - needed + 1;
+
+    // Each candidate's shared trigrams are counted in `hits`, which is left all zero again at the end.
+    static thread_local vector<uint8_t> hits;
+    if (hits.size() < documents.size()) {
+        hits.resize(documents.size());
+    }
+    vector<uint32_t> candidates;
+    for (int i = 0; i < scanned; i++) {
+        for (uint32_t doc : *lists[i]) {
+            if (hits[doc]++ == 0) {
+                candidates.push_back(doc);
+            }
+        }
+    }
+    // The longer lists are checked by binary search while there are few candidates, otherwise by walking
+    // them. Candidates that can no longer reach `needed` are dropped after each list.
+    for (int j = scanned; j < n && !candidates.empty(); j++) {
+        const PostingList& list = *lists[j];
+        if (candidates.size() * bit_width(list.size()) < list.size()) {
+            for (uint32_t doc : candidates) {
+                if (binary_search(list.begin(), list.end(), doc)) {
+                    hits[doc]++;
+                }
+            }
+        } else {
+            for (uint32_t doc : list) {
+                if (hits[doc] != 0) {
+                    hits[doc]++;
+                }
+            }
+        }
+        size_t kept = 0;
+        for (uint32_t doc : candidates) {
+            if (hits[doc] + (n - j - 1) >= needed) {
+                candidates[kept++] = doc;
+            } else {
+                hits[doc] = 0;
+            }
+        }
+        candidates.resize(kept);
+    }
+    // Verifying in document order reads `documents` and `text` front to back. Many candidates are put in
+    // that order faster by a pass over `hits` than by sorting.
+    if (candidates.size() > documents.size() / 32) {
+        candidates.clear();
+        for (uint32_t doc = 0; doc < documents.size(); doc++) {
+            if (hits[doc] != 0) {
+                candidates.push_back(doc);
+            }
+        }
+    } else {
+        sort(candidates.begin(), candidates.end());
+    }
+
+    uint64_t peq[SYMBOLS] = {};
+    for (size_t i = 0; i < pattern.size(); i++) {
+        peq[static_cast<int>(pattern[i])] |= uint64_t(1) << i;
+    }
+    struct Ranked {
+        FuzzyMatch match;
+        uint32_t lengthGap;
+        uint32_t doc;
+    };
+    vector<Ranked> found;
+    string_view symbols(text.data(), text.size());
+    for (size_t i = 0; i < candidates.size(); i++) {
+        // Candidates are scattered over the arrays, so the ones a few steps ahead are fetched early.
+        if (i + 16 < candidates.size()) {
+            __builtin_prefetch(&documents[candidates[i + 16]]);
+        }
+        if (i + 4 < candidates.size()) {
+            __builtin_prefetch(text.data() + documents[candidates[i + 4]].offset);
+        }
+        uint32_t doc = candidates[i];
+        bool enough = hits[doc] >= needed;
+        hits[doc] = 0;
+        const Document& d = documents[doc];
+        if (!enough || d.book == nullptr) {
+            continue;
+        }
+        int distance;
+        if (errors == 0) {
+            distance = symbols.substr(d.offset, d.length).find(pattern) == string_view::npos ? 1 : 0;
+        } else {
+            distance = bestMatchDistance(peq, pattern.size(), text.data() + d.offset, d.length, errors);
+        }
+        if (distance <= errors) {
+            uint32_t gap = d.length > pattern.size() ? d.length - static_cast<uint32_t>(pattern.size())
+                                                     : static_cast<uint32_t>(pattern.size()) - d.length;
+            found.push_back({{d.book, d.field, distance}, gap, doc});
+        }
+    }
+
+    // A book has two documents at most, so the best 2 * limit documents hold the best `limit` books.
+    auto best = found.begin() + static_cast<ptrdiff_t>(min(found.size(), 2 * limit));
+    partial_sort(found.begin(), best, found.end(), [](const Ranked& a, const Ranked& b) {
+        if (a.match.distance != b.match.distance) {
+            return a.match.distance < b.match.distance;
+        }
+        if (a.match.field != b.match.field) {
+            return a.match.field == FuzzyField::Title;
+        }
+        if (a.lengthGap != b.lengthGap) {
+            return a.lengthGap < b.lengthGap;
+        }
+        return a.doc < b.doc;
+    });
+    vector<FuzzyMatch> matches;
+    for (auto r = found.begin(); r != best && matches.size() < limit; ++r) {
+        bool seen = any_of(matches.begin(), matches.end(), [&](const FuzzyMatch& m) {
+            return m.book == r->match.book;
+        });
+        if (!seen) {
+            matches.push_back(r->match);
+        }
+    }
+    return matches;
+}
+
+/**
+ * @brief Computes the edit distance of the best match of a pattern anywhere in a text (Myers, 1999).
+ *
+ * Each column of the dynamic programming table is held as bit vectors of its vertical differences, so one
+ * text symbol is processed in a handful of word operations whatever the pattern's length. The top row stays
+ * zero, which lets a match start anywhere in the text. The bottom row drops by at most one per symbol, so
+ * the scan stops once it can no longer get within `maxDistance`.
+ *
+ * @param peq For each symbol, the bit mask of the pattern positions holding it.
+ * @param patternLength Length of the pattern, from 1 to 64.
+ * @param text The text's symbols.
+ * @param length Length of the text.
+ * @param maxDistance The largest distance of interest.
+ * @return The smallest number of edits that turns the pattern into a substring of the text, or some number
+ *         above `maxDistance` if that is more.
+ */
+int FuzzyIndex::bestMatchDistance(const uint64_t *peq, size_t patternLength, const char *text, size_t length,
+                                  int maxDistance) {
+    uint64_t pv = ~uint64_t(0);
+    uint64_t mv = 0;
+    uint64_t last = uint64_t(1) << (patternLength - 1);
+    int score = static_cast<int>(patternLength);
+    int best = score;
+    for (size_t j = 0; j < length; j++) {
+        uint64_t eq = peq[static_cast<int>(text[j])];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & last) {
+            score++;
+        } else if (mh & last) {
+            score--;
+        }
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        best = min(best, score);
+        if (best == 0 || (best > maxDistance && score - static_cast<int>(length - j - 1) > maxDistance)) {
+            break;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,172 @@
+#ifndef LIBRARYMANAGEMENT_FUZZYINDEX_H
+#define LIBRARYMANAGEMENT_FUZZYINDEX_H
+
+#include "Book.h"
+#include "MemoryAccounting.h"
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Which field of a book a fuzzy match was found in.
+ */
+enum class FuzzyField {
+    Title, ///< The book's title.
+    Author ///< The book's author.
+};
+
+/**
+ * @brief A book found by an approximate search.
+ */
+struct FuzzyMatch {
+    Book* book; ///< The book.
+    FuzzyField field; ///< The field the query matched.
+    int distance; ///< Edit distance between the query and the closest part of the field.
+};
+
+/**
+ * @class FuzzyIndex
+ * @brief A trigram index of book titles and authors for approximate search.
+ *
+ * Titles and authors are normalized first: letters are lowercased, punctuation becomes a space, runs of
+ * spaces are collapsed, and every other byte becomes one "other" symbol, leaving an alphabet of `SYMBOLS`.
+ * Each field is indexed under every three-symbol sequence it contains, in posting lists of ascending
+ * document numbers.
+ *
+ * A search allows `k` edits. An edit changes at most three of the query's trigrams, so a field containing
+ * a match shares at least `n - 3k` of the query's `n` distinct trigrams. Candidates are gathered from the
+ * shortest posting lists only, enough that any field with that many shared trigrams is in at least one of
+ * them, and checked against the longer lists by binary search. That way common trigrams such as "the" are
+ * never scanned. The candidates are then verified with Myers' bit-parallel edit distance, which finds the
+ * best match of the query anywhere in the field, 64 pattern positions per machine word. Exact matches are
+ * looked for first, since their filter is far stronger, and edits are only allowed when too few are found.
+ *
+ * Searches may run concurrently with each other; adding and removing books excludes them.
+ */
+class FuzzyIndex {
+public:
+    static const int SYMBOLS = 38; ///< Size of the normalized alphabet: space, a-z, 0-9 and other.
+    static const int TRIGRAMS = SYMBOLS * SYMBOLS * SYMBOLS; ///< Number of possible trigrams.
+    static const size_t MAX_QUERY = 64; ///< Queries are cut to this many normalized symbols.
+
+    /**
+     * @brief Constructs an empty index.
+     */
+    FuzzyIndex();
+
+    FuzzyIndex(const FuzzyIndex&) = delete;
+    FuzzyIndex& operator=(const FuzzyIndex&) = delete;
+
+    /**
+     * @brief Indexes the title and author of many books at once, such as a whole catalog.
+     *
+     * The posting lists are counted first and then filled, so each is allocated once.
+     *
+     * @param books The books. Null entries are skipped.
+     */
+    void addAll(const vector<Book*>& books);
+
+    /**
+     * @brief Indexes the title and author of a book.
+     *
+     * @param book The book.
+     */
+    void add(Book* book);
+
+    /**
+     * @brief Removes a book from the index. Its posting entries stay until they are skipped by searches.
+     *
+     * @param book The book.
+     */
+    void remove(const Book* book);
+
+    /**
+     * @brief Finds the books whose title or author best matches a query.
+     *
+     * @param query The text to look for, which may be misspelled.
+     * @param limit The largest number of books to return.
+     * @param maxErrors The most edits a match may need, or -1 to allow about one edit per eight characters.
+     * @return The matches, best first: by edit distance, then titles before authors, then by how close the
+     *         field's length is to the query's. Each book appears at most once.
+     */
+    [[nodiscard]] vector<FuzzyMatch> search(const string& query, size_t limit, int maxErrors = -1) const;
+
+    /**
+     * @brief Normalizes text into symbols of the index's alphabet.
+     *
+     * @param text The text.
+     * @return The symbols, one per byte, each below `SYMBOLS`.
+     */
+    static string normalize(string_view text);
+
+private:
+    /**
+     * @brief One indexed field of a book.
+     */
+    struct Document {
+        Book* book; ///< The book, nullptr once it is removed.
+        uint64_t offset; ///< Where the field's normalized symbols start in `text`.
+        uint32_t length; ///< Number of normalized symbols.
+        FuzzyField field; ///< Which field this is.
+    };
+
+    using DocumentList = vector<Document, CountingAllocator<Document, MemoryAccounting::TrigramIndex>>;
+    using PostingList = vector<uint32_t, CountingAllocator<uint32_t, MemoryAccounting::TrigramIndex>>;
+    using PostingTable = vector<PostingList, CountingAllocator<PostingList, MemoryAccounting::TrigramIndex>>;
+    using SymbolArena = vector<char, CountingAllocator<char, MemoryAccounting::TrigramIndex>>;
+
+    /**
+     * @brief Adds a document for one field of a book, without touching the posting lists.
+     *
+     * @param book The book.
+     * @param field Which field.
+     * @param value The field's text.
+     * @return The new document's number.
+     */
+    uint32_t addDocument(Book* book, FuzzyField field, const string& value);
+
+    /**
+     * @brief Gets the distinct trigrams of a document.
+     *
+     * @param doc The document's number.
+     * @param trigrams Set to the trigrams, ascending.
+     */
+    void trigramsOf(uint32_t doc, vector<uint32_t>& trigrams) const;
+
+    /**
+     * @brief Finds the best matches of a normalized query within a number of edits.
+     *
+     * @param pattern The normalized query, at most `MAX_QUERY` symbols.
+     * @param lists The posting lists of the query's distinct trigrams, shortest first.
+     * @param errors The most edits a match may need.
+     * @param limit The largest number of books to return.
+     * @return The matches, best first, each book at most once.
+     */
+    vector<FuzzyMatch> bestMatches(const string& pattern, const vector<const PostingList*>& lists, int errors,
+                                   size_t limit) const;
+
+    /**
+     * @brief Computes the edit distance of the best match of a pattern anywhere in a text (Myers, 1999).
+     *
+     * @param peq For each symbol, the bit mask of the pattern positions holding it.
+     * @param patternLength Length of the pattern, from 1 to 64.
+     * @param text The text's symbols.
+     * @param length Length of the text.
+     * @param maxDistance The largest distance of interest.
+     * @return The smallest number of edits that turns the pattern into a substring of the text, or some number
+     *         above `maxDistance` if that is more.
+     */
+    static int bestMatchDistance(const uint64_t* peq, size_t patternLength, const char* text, size_t length,
+                                 int maxDistance);
+
+    DocumentList documents; ///< Every indexed field, by document number.
+    SymbolArena text; ///< The normalized symbols of every document, back to back.
+    PostingTable postings; ///< Document numbers containing each trigram, ascending.
+    mutable shared_mutex lock; ///< Held shared by searches and exclusively by changes.
+};
+
+#endif //LIBRARYMANAGEMENT_FUZZYINDEX_H
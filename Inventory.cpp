@@ -4,67 +4,149 @@
 
 #include "Inventory.h"
 #include "LibraryHash.h"
+#include "Metrics.h"
+#include "TaskScheduler.h"
+#include "Tracer.h"
 #include <iostream>
 
+/**
+ * @brief Marker stored in a slot whose book was removed, so that lookups keep probing past it.
+ */
+static Book removedBook;
+static Book* const TOMBSTONE = &removedBook;
 
 /**
  * @brief Constructs an Inventory with a specified size.
  *
- * @param size The size of the inventory (number of books).
+ * The inventory grows past this size when it fills up.
+ *
+ * @param size The initial size of the inventory (number of books).
  */
-Inventory::Inventory(int size) {
-    books = new Book*[size];
-    this->size = size;
+Inventory::Inventory(int size) : table(makeTable(size)), count(0), used(0) {
 }
 
 /**
  * @brief Default constructor. Initializes an inventory with a default size of 10000 books.
  */
-Inventory::Inventory() {
-    books = new Book*[10000];
-    this->size = 10000;
+Inventory::Inventory() : table(makeTable(10000)), count(0), used(0) {
 }
 
 /**
  * @brief Destructor. Frees dynamically allocated memory for the inventory books.
  */
 Inventory::~Inventory() {
-    delete[] books;
+    retiredTables.push_back(table.load());
+    for (Table* t : retiredTables) {
+        SlotAllocator().deallocate(t->books, static_cast<size_t>(t->size));
+        delete t;
+    }
 }
 
 /**
  * @brief Adds a book to the inventory.
  *
- * Uses the hash function to determine the correct index for storing the book.
+ * Uses the hash function to determine the correct index for storing the book. A book already
+ * stored with the same ISBN is replaced.
  *
  * @param b Pointer to the Book object to be added.
  */
-void Inventory::addBook(Book *b) const {
-    books[LibraryHash::HashBook(b, size)] = b;
+void Inventory::addBook(Book *b) {
+    TraceSpan span("index book");
+    const long long ISBN = b->getIsbn();
+    for (;;) {
+        growIfNeeded();
+        shared_lock<shared_mutex> resizing(resizeLock);
+        lock_guard<mutex> guard(stripeFor(ISBN));
+        Table* t = table.load(memory_order_relaxed);
+        // Set before the book is stored, so a reader that finds the book would also pass the filter.
+        t->filter.add(ISBN);
+
+        // Look for the ISBN first, remembering the first reusable slot on the way.
+        int i = LibraryHash::ISBNToHash(ISBN, t->size);
+        int freeSlot = -1;
+        for (int probes = 0; probes < t->size; probes++) {
+            Book* current = t->books[i].load(memory_order_acquire);
+            if (current == nullptr) {
+                break;
+            }
+            if (current == TOMBSTONE) {
+                if (freeSlot == -1) {
+                    freeSlot = i;
+                }
+            } else if (current->getIsbn() == ISBN) {
+                t->books[i].store(b, memory_order_release);
+                return;
+            }
+            if (++i == t->size) {
+                i = 0;
+            }
+        }
+
+        // Writers holding other stripes may claim the same free slot, so keep probing if we lose the race.
+        if (freeSlot != -1) {
+            i = freeSlot;
+        }
+        for (int probes = 0; probes < t->size; probes++) {
+            Book* current = t->books[i].load(memory_order_acquire);
+            if ((current == nullptr || current == TOMBSTONE) &&
+                t->books[i].compare_exchange_strong(current, b, memory_order_release)) {
+                if (current == nullptr) {
+                    used++;
+                }
+                count++;
+                return;
+            }
+            if (++i == t->size) {
+                i = 0;
+            }
+        }
+        // Every slot was taken by concurrent writers, so grow and try again.
+    }
 }
 
 
 /**
  * @brief Removes a book from the inventory by ISBN.
  *
- * Sets the book's entry to `nullptr` based on its hash index.
+ * Replaces the book's entry with a tombstone based on its hash index.
  *
  * @param ISBN The ISBN of the book to be removed.
  */
-void Inventory::removeBook(const long long ISBN) const {
-    books[LibraryHash::ISBNToHash(ISBN,size)] = nullptr;
+void Inventory::removeBook(const long long ISBN) {
+    TraceSpan span("unindex book");
+    shared_lock<shared_mutex> resizing(resizeLock);
+    lock_guard<mutex> guard(stripeFor(ISBN));
+    Table* t = table.load(memory_order_relaxed);
+    if (!t->filter.mayContain(ISBN)) {
+        return;
+    }
+    int i = LibraryHash::ISBNToHash(ISBN, t->size);
+    for (int probes = 0; probes < t->size; probes++) {
+        Book* current = t->books[i].load(memory_order_acquire);
+        if (current == nullptr) {
+            return;
+        }
+        if (current != TOMBSTONE && current->getIsbn() == ISBN) {
+            t->books[i].store(TOMBSTONE, memory_order_release);
+            count--;
+            return;
+        }
+        if (++i == t->size) {
+            i = 0;
+        }
+    }
 }
 
 
 /**
  * @brief Removes a book from the inventory.
  *
- * Sets the book's entry to `nullptr` based on its hash index.
+ * Replaces the book's entry with a tombstone based on its hash index.
  *
  * @param b Pointer to the Book object to be removed.
  */
-void Inventory::removeBook(const Book *b) const {
-    books[LibraryHash::HashBook(b, size)] = nullptr;
+void Inventory::removeBook(const Book *b) {
+    removeBook(b->getIsbn());
 }
 
 /**
@@ -99,9 +181,12 @@ bool Inventory::isBookAvailable(string ISBN) const {
  * Iterates over the inventory and prints information about books that are available.
  */
 void Inventory::listAvailableBooks() const {
-    for (int i = 0; i < size; i++) {
-        if (books[i] != nullptr && books[i]->isAvailable()) {
-            cout << books[i]->getInfo() << endl;
+    TraceSpan span("list available books");
+    Table* t = table.load(memory_order_acquire);
+    for (int i = 0; i < t->size; i++) {
+        Book* b = t->books[i].load(memory_order_acquire);
+        if (b != nullptr && b != TOMBSTONE && b->isAvailable()) {
+            cout << b->getInfo() << endl;
         }
     }
 }
@@ -112,9 +197,12 @@ void Inventory::listAvailableBooks() const {
  * Iterates over the inventory and prints information about books that are not available.
  */
 void Inventory::listCheckedOutBooks() const {
-    for (int i = 0; i < size; i++) {
-        if (books[i] != nullptr && !books[i]->isAvailable()) {
-            cout << books[i]->getInfo() << endl;
+    TraceSpan span("list checked out books");
+    Table* t = table.load(memory_order_acquire);
+    for (int i = 0; i < t->size; i++) {
+        Book* b = t->books[i].load(memory_order_acquire);
+        if (b != nullptr && b != TOMBSTONE && !b->isAvailable()) {
+            cout << b->getInfo() << endl;
         }
     }
 }
@@ -135,18 +223,12 @@ bool Inventory::updateBookAvailablity(Book* b) {
 /**
  * @brief Counts the total number of books in the inventory.
  *
- * Iterates through the inventory and counts the number of non-null entries.
+ * Reads the count kept up to date by `addBook` and `removeBook`.
  *
  * @return The total number of books in the inventory.
  */
 long Inventory::countTotalBooks() const {
-    long count = 0;
-    for (int i = 0; i < size; i++) {
-        if (books[i] != nullptr) {
-            count++;
-        }
-    }
-    return count;
+    return count.load(memory_order_relaxed);
 }
 
 /**
@@ -155,9 +237,12 @@ long Inventory::countTotalBooks() const {
  * Iterates through the inventory and prints information about each non-null book.
  */
 void Inventory::print() const {
-    for (int i = 0; i < size; i++) {
-        if (books[i] != nullptr) {
-            cout << books[i]->getInfo() << endl << endl;
+    TraceSpan span("print inventory");
+    Table* t = table.load(memory_order_acquire);
+    for (int i = 0; i < t->size; i++) {
+        Book* b = t->books[i].load(memory_order_acquire);
+        if (b != nullptr && b != TOMBSTONE) {
+            cout << b->getInfo() << endl << endl;
         }
     }
 }
@@ -168,22 +253,43 @@ void Inventory::print() const {
  * Uses the ISBN hash to locate the book and check its availability.
  *
  * @param ISBN The ISBN of the book.
- * @return True if the book is available, false otherwise.
+ * @return True if the book is available, false otherwise or if it is not in the inventory.
  */
 bool Inventory::isBookAvailable(const long long int ISBN) const {
-    return books[LibraryHash::ISBNToHash(ISBN, size)]->isAvailable();
+    Book* b = findBookByISBN(ISBN);
+    return b != nullptr && b->isAvailable();
 }
 
 /**
  * @brief Finds a book in the inventory by its ISBN.
  *
- * Uses the ISBN hash to locate and return the book.
+ * Uses the ISBN hash to locate and return the book. ISBNs the filter rules out are not looked up.
  *
  * @param ISBN The ISBN of the book.
  * @return Pointer to the Book object, or nullptr if not found.
  */
 Book *Inventory::findBookByISBN(const long long int ISBN) const {
-    return books[LibraryHash::ISBNToHash(ISBN, size)];
+    MetricTimer timer(Metrics::FindByISBN);
+    Table* t = table.load(memory_order_acquire);
+    int i = LibraryHash::ISBNToHash(ISBN, t->size);
+    // Start loading the slot while the filter is read, so hits wait for one memory access rather than two.
+    __builtin_prefetch(&t->books[i]);
+    if (!t->filter.mayContain(ISBN)) {
+        return nullptr;
+    }
+    for (int probes = 0; probes < t->size; probes++) {
+        Book* b = t->books[i].load(memory_order_acquire);
+        if (b == nullptr) {
+            return nullptr;
+        }
+        if (b != TOMBSTONE && b->getIsbn() == ISBN) {
+            return b;
+        }
+        if (++i == t->size) {
+            i = 0;
+        }
+    }
+    return nullptr;
 }
 
 /**
@@ -195,10 +301,211 @@ Book *Inventory::findBookByISBN(const long long int ISBN) const {
  * @return Pointer to the Book object, or nullptr if not found.
  */
 Book *Inventory::findBookByTitle(const string& title) const {
-    for (int i = 0; i < size; i++) {
-        if (books[i] != nullptr && books[i]->getTitle() == title) {
-            return books[i];
+    MetricTimer timer(Metrics::FindByTitle);
+    Table* t = table.load(memory_order_acquire);
+    for (int i = 0; i < t->size; i++) {
+        Book* b = t->books[i].load(memory_order_acquire);
+        if (b != nullptr && b != TOMBSTONE && b->getTitle() == title) {
+            return b;
         }
     }
     return nullptr;
 }
+
+/**
+ * @brief Calls a function on every book in the inventory.
+ *
+ * Reads the slot array without locking, like the listing functions.
+ *
+ * @param visit The function to call with each book.
+ */
+void Inventory::forEachBook(const function<void(Book *)> &visit) const {
+    Table* t = table.load(memory_order_acquire);
+    for (int i = 0; i < t->size; i++) {
+        Book* b = t->books[i].load(memory_order_acquire);
+        if (b != nullptr && b != TOMBSTONE) {
+            visit(b);
+        }
+    }
+}
+
+/**
+ * @brief Calls a function on every book from several threads at once.
+ *
+ * The slots are split into `chunks` contiguous ranges that are visited on the shared `TaskScheduler`.
+ * Each range is visited by one thread in slot order.
+ *
+ * @param chunks The number of ranges to split the slots into.
+ * @param visit The function to call with the index of the range and each book in it.
+ */
+void Inventory::parallelForEachBook(size_t chunks, const function<void(size_t, Book *)> &visit) const {
+    Table* t = table.load(memory_order_acquire);
+    size_t slotsPerChunk = (t->size + chunks - 1) / chunks;
+    TaskScheduler::instance().parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; chunk++) {
+            size_t end = min(static_cast<size_t>(t->size), (chunk + 1) * slotsPerChunk);
+            for (size_t i = chunk * slotsPerChunk; i < end; i++) {
+                Book* b = t->books[i].load(memory_order_acquire);
+                if (b != nullptr && b != TOMBSTONE) {
+                    visit(chunk, b);
+                }
+            }
+        }
+    });
+}
+
+/**
+ * @brief Gets the hash slot an ISBN is stored in.
+ *
+ * @param ISBN The ISBN of the book.
+ * @return The index of the ISBN's slot in the inventory array.
+ */
+int Inventory::slotOf(const long long ISBN) const {
+    return LibraryHash::ISBNToHash(ISBN, table.load(memory_order_acquire)->size);
+}
+
+/**
+ * @brief Counts the slots a lookup of an ISBN examines, including the one it stops at.
+ *
+ * Long probe sequences show clustering in the hash table.
+ *
+ * @param ISBN The ISBN to look up.
+ * @return The number of slots examined.
+ */
+int Inventory::probeLength(const long long ISBN) const {
+    Table* t = table.load(memory_order_acquire);
+    int i = LibraryHash::ISBNToHash(ISBN, t->size);
+    int probes = 0;
+    while (probes < t->size) {
+        Book* b = t->books[i].load(memory_order_acquire);
+        probes++;
+        if (b == nullptr || (b != TOMBSTONE && b->getIsbn() == ISBN)) {
+            break;
+        }
+        if (++i == t->size) {
+            i = 0;
+        }
+    }
+    return probes;
+}
+
+/**
+ * @brief Starts loading the hash slot of an ISBN into the cache without waiting for it.
+ *
+ * Used by batch operations to overlap the memory accesses of many lookups.
+ *
+ * @param ISBN The ISBN of the book.
+ */
+void Inventory::prefetchISBN(const long long ISBN) const {
+    Table* t = table.load(memory_order_acquire);
+    t->filter.prefetch(ISBN);
+    __builtin_prefetch(&t->books[LibraryHash::ISBNToHash(ISBN, t->size)]);
+}
+
+/**
+ * @brief Allocates a table with every slot empty.
+ *
+ * @param size The number of slots.
+ * @return Pointer to the new table.
+ */
+Inventory::Table *Inventory::makeTable(int size) {
+    auto* t = new Table{nullptr, size, IsbnFilter(static_cast<size_t>(size))};
+    t->books = SlotAllocator().allocate(static_cast<size_t>(size));
+    for (int i = 0; i < size; i++) {
+        new (&t->books[i]) atomic<Book*>(nullptr);
+    }
+    return t;
+}
+
+/**
+ * @brief Gets the stripe mutex that guards writes of an ISBN.
+ *
+ * @param ISBN The ISBN of a book.
+ * @return Reference to the stripe's mutex.
+ */
+mutex &Inventory::stripeFor(const long long ISBN) const {
+    return stripes[static_cast<unsigned long long>(ISBN) % LOCK_STRIPES];
+}
+
+/**
+ * @brief Rebuilds the slot array if adding one more book would fill it past its load limit.
+ *
+ * Tombstones count toward the limit, so when the live books fill less than half of it the array is rebuilt at the
+ * same size to clear them; it is doubled only when the live books need the room.
+ */
+void Inventory::growIfNeeded() {
+    if ((used.load(memory_order_relaxed) + 1) * 10 <= table.load(memory_order_acquire)->size * 7L) {
+        return;
+    }
+    unique_lock<shared_mutex> resizing(resizeLock);
+    Table* old = table.load(memory_order_relaxed);
+    if ((used.load(memory_order_relaxed) + 1) * 10 <= old->size * 7L) {
+        return;
+    }
+    if ((count.load(memory_order_relaxed) + 1) * 20 <= old->size * 7L) {
+        rebuild(old, old->size);
+        return;
+    }
+    rebuild(old, old->size * 2);
+}
+
+/**
+ * @brief Grows the slot array up front so that adding a number of books does not have to grow it again.
+ *
+ * @param books The number of books about to be added.
+ */
+void Inventory::reserve(const long books) {
+    unique_lock<shared_mutex> resizing(resizeLock);
+    Table* old = table.load(memory_order_relaxed);
+    long needed = used.load(memory_order_relaxed) + books;
+    if (needed * 10 <= old->size * 7L) {
+        return;
+    }
+    int size = old->size;
+    while (needed * 10 > size * 7L) {
+        size *= 2;
+    }
+    rebuild(old, size);
+}
+
+/**
+ * @brief Copies the books of the current slot array into a new one of a given size and publishes it.
+ *
+ * Tombstones are dropped while the books are copied, which is done in parallel on the shared `TaskScheduler`,
+ * and the new array's filter is filled with the books that were copied. The new array is published with a single
+ * atomic store, so lock-free readers see either the old array or the complete new one. The caller must hold
+ * `resizeLock` exclusively.
+ *
+ * @param old The current slot array.
+ * @param size The number of slots in the new array.
+ */
+void Inventory::rebuild(Table *old, const int size) {
+    TraceSpan span("rebuild inventory table");
+    Table* t = makeTable(size);
+    long live = TaskScheduler::instance().parallelReduce(0, old->size, 16384, 0L,
+        [&](size_t first, size_t last) {
+            long moved = 0;
+            for (size_t i = first; i < last; i++) {
+                Book* b = old->books[i].load(memory_order_relaxed);
+                if (b == nullptr || b == TOMBSTONE) {
+                    continue;
+                }
+                t->filter.add(b->getIsbn());
+                // Other ranges are being copied at the same time, so claim the free slot atomically.
+                int j = LibraryHash::ISBNToHash(b->getIsbn(), t->size);
+                Book* expected = nullptr;
+                while (!t->books[j].compare_exchange_weak(expected, b, memory_order_relaxed)) {
+                    if (expected != nullptr && ++j == t->size) {
+                        j = 0;
+                    }
+                    expected = nullptr;
+                }
+                moved++;
+            }
+            return moved;
+        },
+        [](long a, long b) { return a + b; });
+    table.store(t, memory_order_release);
+    retiredTables.push_back(old);
+    used.store(live, memory_order_relaxed);
+}
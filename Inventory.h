@@ -6,7 +6,14 @@
 #define LIBRARYMANAGEMENT_INVENTORY_H
 
 #include "Book.h"
+#include "IsbnFilter.h"
 #include "LibraryHash.h"
+#include "MemoryAccounting.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
 
 using namespace std;
 
@@ -18,13 +25,26 @@ using namespace std;
  * It supports operations such as adding, removing, searching for books by title or ISBN, checking
  * availability, listing available or checked-out books, and updating book statuses. The inventory uses
  * hashing to store and locate books efficiently.
+ *
+ * The inventory is safe to share between threads. Lookups, scans and listings take no locks: they read
+ * the slot array with atomic loads while writers update it. Adding and removing books locks one of
+ * `LOCK_STRIPES` stripe mutexes chosen by ISBN, so writers of different ISBNs rarely wait on each other.
+ * Colliding ISBNs probe linearly to the next slot, and a removed book leaves a tombstone so that lookups
+ * keep probing past it. When the slots fill up the array is doubled and published for new readers, while
+ * readers still on the old array keep using it until the inventory is destroyed.
+ *
+ * Each slot array has an `IsbnFilter` of the ISBNs added to it, checked before the slots, so lookups of ISBNs
+ * the library does not own usually return after reading one cache line. Like tombstones, the filter bits of
+ * removed books stay set until the array is rebuilt.
  */
 class Inventory {
 public:
     /**
      * @brief Constructs an Inventory with a specified size.
      *
-     * @param size The size of the inventory (number of books).
+     * The inventory grows past this size when it fills up.
+     *
+     * @param size The initial size of the inventory (number of books).
      */
     explicit Inventory(int size);
 
@@ -41,29 +61,30 @@ public:
     /**
      * @brief Adds a book to the inventory.
      *
-     * Uses the hash function to determine the correct index for storing the book.
+     * Uses the hash function to determine the correct index for storing the book. A book already
+     * stored with the same ISBN is replaced.
      *
      * @param b Pointer to the Book object to be added.
      */
-    void addBook(Book* b) const;
+    void addBook(Book* b);
 
     /**
 	* @brief Removes a book from the inventory by ISBN.
     *
-	* Sets the book's entry to `nullptr` based on its hash index.
+	* Replaces the book's entry with a tombstone based on its hash index.
 	*
 	* @param ISBN The ISBN of the book to be removed.
 	*/
-    void removeBook(long long ISBN) const;
+    void removeBook(long long ISBN);
 
     /**
      * @brief Removes a book from the inventory.
      *
-     * Sets the book's entry to `nullptr` based on its hash index.
+     * Replaces the book's entry with a tombstone based on its hash index.
      *
      * @param b Pointer to the Book object to be removed.
      */
-    void removeBook(const Book* b) const;
+    void removeBook(const Book* b);
 
     /**
      * @brief Finds a book in the inventory by its ISBN.
@@ -112,7 +133,7 @@ public:
     /**
      * @brief Counts the total number of books in the inventory.
      *
-     * Iterates through the inventory and counts the number of non-null entries.
+     * Reads the count kept up to date by `addBook` and `removeBook`.
      *
      * @return The total number of books in the inventory.
      */
@@ -131,14 +152,14 @@ public:
      * Uses the ISBN hash to locate the book and check its availability.
      *
      * @param ISBN The ISBN of the book.
-     * @return True if the book is available, false otherwise.
+     * @return True if the book is available, false otherwise or if it is not in the inventory.
      */
     [[nodiscard]] bool isBookAvailable(long long int ISBN) const;
 
     /**
      * @brief Finds a book in the inventory by its ISBN.
      *
-     * Uses the ISBN hash to locate and return the book.
+     * Uses the ISBN hash to locate and return the book. ISBNs the filter rules out are not looked up.
      *
      * @param ISBN The ISBN of the book.
      * @return Pointer to the Book object, or nullptr if not found.
@@ -155,9 +176,115 @@ public:
      */
     [[nodiscard]] Book* findBookByTitle(const string& title) const;
 
+    /**
+     * @brief Calls a function on every book in the inventory.
+     *
+     * Reads the slot array without locking, like the listing functions.
+     *
+     * @param visit The function to call with each book.
+     */
+    void forEachBook(const function<void(Book*)>& visit) const;
+
+    /**
+     * @brief Calls a function on every book from several threads at once.
+     *
+     * The slots are split into `chunks` contiguous ranges that are visited on the shared `TaskScheduler`.
+     * Each range is visited by one thread in slot order.
+     *
+     * @param chunks The number of ranges to split the slots into.
+     * @param visit The function to call with the index of the range and each book in it.
+     */
+    void parallelForEachBook(size_t chunks, const function<void(size_t, Book*)>& visit) const;
+
+    /**
+     * @brief Grows the slot array up front so that adding a number of books does not have to grow it again.
+     *
+     * @param books The number of books about to be added.
+     */
+    void reserve(long books);
+
+    /**
+     * @brief Gets the hash slot an ISBN is stored in.
+     *
+     * @param ISBN The ISBN of the book.
+     * @return The index of the ISBN's slot in the inventory array.
+     */
+    [[nodiscard]] int slotOf(long long ISBN) const;
+
+    /**
+     * @brief Counts the slots a lookup of an ISBN examines, including the one it stops at.
+     *
+     * Long probe sequences show clustering in the hash table.
+     *
+     * @param ISBN The ISBN to look up.
+     * @return The number of slots examined.
+     */
+    [[nodiscard]] int probeLength(long long ISBN) const;
+
+    /**
+     * @brief Starts loading the hash slot of an ISBN into the cache without waiting for it.
+     *
+     * Used by batch operations to overlap the memory accesses of many lookups.
+     *
+     * @param ISBN The ISBN of the book.
+     */
+    void prefetchISBN(long long ISBN) const;
+
+    static const int LOCK_STRIPES = 64; ///< Number of mutexes that writers are spread across.
+
 private:
-    Book** books; ///< Array of pointers to the books in the inventory.
-    int size; ///< The size of the inventory array.
+    /**
+     * @brief A slot array. Published through `table` and never modified in size once published.
+     */
+    struct Table {
+        atomic<Book*>* books; ///< Array of pointers to the books in the inventory.
+        int size; ///< The size of the inventory array.
+        IsbnFilter filter; ///< The ISBNs added to this array.
+    };
+
+    /**
+     * @brief Allocates slot arrays, counted under `MemoryAccounting::InventorySlots`.
+     */
+    using SlotAllocator = CountingAllocator<atomic<Book*>, MemoryAccounting::InventorySlots>;
+
+    /**
+     * @brief Allocates a table with every slot empty.
+     *
+     * @param size The number of slots.
+     * @return Pointer to the new table.
+     */
+    static Table* makeTable(int size);
+
+    /**
+     * @brief Gets the stripe mutex that guards writes of an ISBN.
+     *
+     * @param ISBN The ISBN of a book.
+     * @return Reference to the stripe's mutex.
+     */
+    mutex& stripeFor(long long ISBN) const;
+
+    /**
+     * @brief Rebuilds the slot array if adding one more book would fill it past its load limit.
+     *
+     * Tombstones count toward the limit, so when the live books fill less than half of it the array is rebuilt at
+     * the same size to clear them; it is doubled only when the live books need the room.
+     */
+    void growIfNeeded();
+
+    /**
+     * @brief Copies the books of the current slot array into a new one of a given size and publishes it.
+     *
+     * @param old The current slot array.
+     * @param size The number of slots in the new array.
+     */
+    void rebuild(Table* old, int size);
+
+    atomic<Table*> table; ///< The current slot array.
+    vector<Table*> retiredTables; ///< Slot arrays replaced by growth, kept alive for readers still using them.
+    atomic<long> count; ///< Number of books in the inventory.
+    atomic<long> used; ///< Number of slots holding a book or a tombstone.
+    mutable shared_mutex resizeLock; ///< Held shared by writers and exclusively while growing the table.
+    mutable mutex stripes[LOCK_STRIPES]; ///< Striped mutexes serializing writes of the same ISBN.
 };
 
 #endif //LIBRARYMANAGEMENT_INVENTORY_H
@@ -0,0 +1,511 @@
+#include "IoBackend.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef LIBRARY_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+/**
+ * @brief Completion tag of operations that don't use a buffer, such as fsync.
+ */
+static const unsigned long long NO_BUFFER = 0;
+
+/**
+ * @brief Constructs a backend and sets up its ring and buffers.
+ *
+ * @param bufferCount Number of buffers, which is also the most writes or reads in flight at once.
+ * @param bufferSize Size of each buffer in bytes.
+ */
+IoBackend::IoBackend(unsigned bufferCount, size_t bufferSize)
+        : buffers(max(bufferCount, 2u)), bufferSize((max(bufferSize, size_t(4096)) + 4095) / 4096 * 4096),
+          current(-1), inFlight(0), failed(false) {
+    for (Buffer& b : buffers) {
+        b.data = static_cast<char*>(aligned_alloc(4096, this->bufferSize));
+    }
+#ifdef LIBRARY_HAVE_IO_URING
+    const char* mode = getenv("LIBRARY_IO");
+    if (mode == nullptr || strcmp(mode, "pwrite") != 0) {
+        setupRing(static_cast<unsigned>(buffers.size()) * 2);
+    }
+#endif
+}
+
+/**
+ * @brief Destructor. Writes anything still buffered, waits for outstanding I/O and frees the ring and
+ * buffers. Does not close files.
+ */
+IoBackend::~IoBackend() {
+    queueCurrent();
+    waitAll();
+#ifdef LIBRARY_HAVE_IO_URING
+    if (ringFd != -1) {
+        munmap(sqes, sqesSize);
+        if (cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        munmap(sqRing, sqRingSize);
+        close(ringFd);
+    }
+#endif
+    for (Buffer& b : buffers) {
+        free(b.data);
+    }
+}
+
+/**
+ * @brief Tells whether the backend is using io_uring or the pwrite fallback.
+ *
+ * @return true for io_uring, false for the fallback.
+ */
+bool IoBackend::usesIoUring() const {
+#ifdef LIBRARY_HAVE_IO_URING
+    return ringFd != -1;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Opens a file for writing, creating it if needed. Appends start at the end of the file.
+ *
+ * @param path Path of the file.
+ * @param truncate Whether to empty the file first.
+ * @return The file descriptor, or -1 if the file could not be opened.
+ */
+int IoBackend::openFile(const string &path, bool truncate) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info{};
+    fstat(fd, &info);
+    offsets.emplace_back(fd, truncate ? 0 : static_cast<long long>(info.st_size));
+    return fd;
+}
+
+/**
+ * @brief Appends data to an open file. The data is copied, and written once a buffer fills or the file is synced.
+ *
+ * @param fd The file, as returned by `openFile`.
+ * @param data The data.
+ */
+void IoBackend::append(int fd, string_view data) {
+    while (!data.empty()) {
+        if (current != -1 && buffers[current].fd != fd) {
+            queueCurrent();
+        }
+        if (current == -1) {
+            current = freeBuffer();
+            Buffer& b = buffers[current];
+            b.fd = fd;
+            b.offset = offsetOf(fd);
+            b.used = 0;
+        }
+        Buffer& b = buffers[current];
+        size_t n = min(bufferSize - b.used, data.size());
+        memcpy(b.data + b.used, data.data(), n);
+        b.used += n;
+        offsetOf(fd) += static_cast<long long>(n);
+        data.remove_prefix(n);
+        if (b.used == bufferSize) {
+            queueCurrent();
+        }
+    }
+}
+
+/**
+ * @brief Writes everything appended to a file and waits until it is on disk.
+ *
+ * @param fd The file.
+ * @return true if every write and the sync succeeded since the last check, false otherwise.
+ */
+bool IoBackend::sync(int fd) {
+    if (current != -1 && buffers[current].fd == fd) {
+        queueCurrent();
+    }
+#ifdef LIBRARY_HAVE_IO_URING
+    if (ringFd != -1) {
+        // Drain makes the fsync wait for every write queued before it.
+        queueOp(IORING_OP_FSYNC, fd, -1, nullptr, 0, 0, IOSQE_IO_DRAIN);
+        waitAll();
+        return takeStatus();
+    }
+#endif
+    if (fsync(fd) != 0) {
+        failed = true;
+    }
+    return takeStatus();
+}
+
+/**
+ * @brief Writes everything appended to a file, waits for it, and closes the file.
+ *
+ * @param fd The file.
+ * @return true if every write succeeded since the last check, false otherwise.
+ */
+bool IoBackend::closeFile(int fd) {
+    if (current != -1 && buffers[current].fd == fd) {
+        queueCurrent();
+    }
+    waitAll();
+    close(fd);
+    offsets.erase(remove_if(offsets.begin(), offsets.end(),
+                            [fd](const pair<int, long long>& entry) { return entry.first == fd; }), offsets.end());
+    return takeStatus();
+}
+
+/**
+ * @brief Reads a whole file.
+ *
+ * @param path Path of the file.
+ * @param contents Set to the contents of the file.
+ * @return true if the file was read, false otherwise.
+ */
+bool IoBackend::readFile(const string &path, string &contents) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info{};
+    fstat(fd, &info);
+    size_t size = static_cast<size_t>(info.st_size);
+    contents.resize(size);
+
+#ifdef LIBRARY_HAVE_IO_URING
+    if (ringFd != -1) {
+        queueCurrent();
+        size_t next = 0;
+        while (next < size || inFlight != 0) {
+            // Start a read in every free buffer, then wait for one to finish.
+            for (int i = 0; i < static_cast<int>(buffers.size()) && next < size; i++) {
+                Buffer& b = buffers[i];
+                if (b.inFlight) {
+                    continue;
+                }
+                b.fd = fd;
+                b.offset = static_cast<long long>(next);
+                b.used = min(bufferSize, size - next);
+                b.target = &contents[next];
+                b.inFlight = true;
+                queueOp(fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ, fd, i, b.data, b.used, b.offset, 0);
+                next += b.used;
+            }
+            if (inFlight != 0) {
+                enter(1);
+                reap();
+            }
+        }
+        close(fd);
+        return takeStatus();
+    }
+#endif
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, &contents[done], size - done, static_cast<off_t>(done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            failed = true;
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    close(fd);
+    return takeStatus();
+}
+
+/**
+ * @brief Gets the position the next append to a file goes to.
+ *
+ * @param fd The file.
+ * @return Reference to the position.
+ */
+long long &IoBackend::offsetOf(int fd) {
+    for (auto& entry : offsets) {
+        if (entry.first == fd) {
+            return entry.second;
+        }
+    }
+    offsets.emplace_back(fd, 0);
+    return offsets.back().second;
+}
+
+/**
+ * @brief Queues the current buffer to be written and switches to a free one.
+ */
+void IoBackend::queueCurrent() {
+    if (current == -1) {
+        return;
+    }
+    Buffer& b = buffers[current];
+    int index = current;
+    current = -1;
+    if (b.used == 0) {
+        return;
+    }
+#ifdef LIBRARY_HAVE_IO_URING
+    if (ringFd != -1) {
+        b.inFlight = true;
+        queueOp(fixedBuffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, b.fd, index, b.data, b.used, b.offset, 0);
+        // Submit in batches, early enough that the kernel writes while the caller fills the other buffers.
+        if (toSubmit * 2 >= buffers.size()) {
+            enter(0);
+        }
+        return;
+    }
+#endif
+    (void) index;
+    writeBlocking(b, 0);
+    b.used = 0;
+}
+
+/**
+ * @brief Gets a buffer no I/O is using, waiting for I/O to finish if every buffer is busy.
+ *
+ * @return The index of the buffer.
+ */
+int IoBackend::freeBuffer() {
+    for (;;) {
+        for (int i = 0; i < static_cast<int>(buffers.size()); i++) {
+            if (!buffers[i].inFlight && i != current) {
+                return i;
+            }
+        }
+#ifdef LIBRARY_HAVE_IO_URING
+        enter(1);
+        reap();
+#endif
+    }
+}
+
+/**
+ * @brief Writes a buffer with blocking pwrite calls.
+ *
+ * @param b The buffer.
+ * @param from Number of bytes at the front of the buffer already written.
+ */
+void IoBackend::writeBlocking(Buffer &b, size_t from) {
+    while (from < b.used) {
+        ssize_t n = pwrite(b.fd, b.data + from, b.used - from, static_cast<off_t>(b.offset + from));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            failed = true;
+            return;
+        }
+        from += static_cast<size_t>(n);
+    }
+}
+
+/**
+ * @brief Submits all queued I/O and waits for all of it to finish.
+ */
+void IoBackend::waitAll() {
+#ifdef LIBRARY_HAVE_IO_URING
+    if (ringFd != -1) {
+        if (toSubmit != 0) {
+            enter(0);
+        }
+        while (inFlight != 0) {
+            enter(1);
+            reap();
+        }
+    }
+#endif
+}
+
+/**
+ * @brief Gets the result of the last check and starts a new one.
+ *
+ * @return true if no I/O failed since the last check.
+ */
+bool IoBackend::takeStatus() {
+    bool ok = !failed;
+    failed = false;
+    return ok;
+}
+
+#ifdef LIBRARY_HAVE_IO_URING
+
+/**
+ * @brief Sets up the ring and registers the buffers.
+ *
+ * @param entries Number of submission queue entries.
+ * @return true if io_uring is usable, false otherwise.
+ */
+bool IoBackend::setupRing(unsigned entries) {
+    io_uring_params params{};
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+        return false;
+    }
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+    }
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    cqRing = single ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                    IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        munmap(sqRing, sqRingSize);
+        close(fd);
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(cqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = cq + params.cq_off.cqes;
+    ringFd = fd;
+
+    // Registered buffers are pinned once instead of on every operation. Without them, plain reads and writes still work.
+    vector<iovec> vectors(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+        vectors[i].iov_base = buffers[i].data;
+        vectors[i].iov_len = bufferSize;
+    }
+    fixedBuffers = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, vectors.data(),
+                           static_cast<unsigned>(vectors.size())) == 0;
+    return true;
+}
+
+/**
+ * @brief Queues one operation on the ring.
+ *
+ * @param opcode The io_uring operation.
+ * @param fd The file.
+ * @param buffer Index of the buffer, or -1 for an operation without one.
+ * @param address The memory to read or write.
+ * @param length Number of bytes.
+ * @param offset Position in the file.
+ * @param flags Submission flags.
+ */
+void IoBackend::queueOp(unsigned char opcode, int fd, int buffer, char *address, size_t length, long long offset,
+                        unsigned char flags) {
+    unsigned tail = *sqTail;
+    if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == sqEntries) {
+        enter(0);
+    }
+    unsigned index = tail & sqMask;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->flags = flags;
+    sqe->fd = fd;
+    sqe->off = static_cast<unsigned long long>(offset);
+    sqe->addr = reinterpret_cast<unsigned long long>(address);
+    sqe->len = static_cast<unsigned>(length);
+    if (buffer >= 0 && fixedBuffers) {
+        sqe->buf_index = static_cast<unsigned short>(buffer);
+    }
+    sqe->user_data = buffer >= 0 ? static_cast<unsigned long long>(buffer) + 1 : NO_BUFFER;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    toSubmit++;
+    inFlight++;
+}
+
+/**
+ * @brief Submits the queued operations and optionally waits for some to complete.
+ *
+ * @param waitFor Number of completions to wait for.
+ */
+void IoBackend::enter(unsigned waitFor) {
+    for (;;) {
+        long submitted = syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor,
+                                 waitFor != 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EBUSY) {
+                // The completion queue is full; make room and try again.
+                reap();
+                continue;
+            }
+            failed = true;
+            return;
+        }
+        toSubmit -= min(static_cast<unsigned>(submitted), toSubmit);
+        if (toSubmit == 0) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Handles every completion in the completion queue.
+ */
+void IoBackend::reap() {
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const io_uring_cqe& cqe = static_cast<io_uring_cqe*>(cqes)[head & cqMask];
+        inFlight--;
+        if (cqe.user_data == NO_BUFFER) {
+            if (cqe.res < 0) {
+                failed = true;
+            }
+            continue;
+        }
+        Buffer& b = buffers[cqe.user_data - 1];
+        b.inFlight = false;
+        if (cqe.res < 0) {
+            failed = true;
+        } else if (b.target != nullptr) {
+            // Finish a short read with a blocking one.
+            size_t done = static_cast<size_t>(cqe.res);
+            memcpy(b.target, b.data, done);
+            while (done < b.used) {
+                ssize_t n = pread(b.fd, b.target + done, b.used - done, static_cast<off_t>(b.offset + done));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    failed = true;
+                    break;
+                }
+                done += static_cast<size_t>(n);
+            }
+        } else if (static_cast<size_t>(cqe.res) < b.used) {
+            writeBlocking(b, static_cast<size_t>(cqe.res));
+        }
+        b.target = nullptr;
+        b.used = 0;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+#endif //LIBRARY_HAVE_IO_URING
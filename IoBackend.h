@@ -0,0 +1,213 @@
+#ifndef LIBRARYMANAGEMENT_IOBACKEND_H
+#define LIBRARYMANAGEMENT_IOBACKEND_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__linux__) && !defined(LIBRARY_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#define LIBRARY_HAVE_IO_URING 1
+#endif
+
+using namespace std;
+
+/**
+ * @class IoBackend
+ * @brief File I/O for catalog persistence, built on io_uring with a blocking pwrite/pread fallback.
+ *
+ * Data appended to a file is copied into one of a fixed set of buffers. When a buffer fills it is queued
+ * as a write and the next free buffer takes over, so the caller keeps producing data while earlier
+ * buffers are written. Queued writes are submitted to the kernel together, with one system call. The
+ * buffers are registered with the ring once, so the kernel does not have to map them for every write.
+ * Reads of a whole file keep several chunks in flight at once in the same buffers.
+ *
+ * io_uring is used when the kernel supports it, unless the `LIBRARY_IO` environment variable is
+ * `pwrite` or the build sets `LIBRARY_NO_IO_URING`. Otherwise every buffer is written with a blocking
+ * pwrite when it fills. Both modes produce the same files.
+ *
+ * A backend is not thread-safe; each thread that does I/O uses its own.
+ */
+class IoBackend {
+public:
+    /**
+     * @brief Constructs a backend and sets up its ring and buffers.
+     *
+     * @param bufferCount Number of buffers, which is also the most writes or reads in flight at once.
+     * @param bufferSize Size of each buffer in bytes.
+     */
+    explicit IoBackend(unsigned bufferCount = 8, size_t bufferSize = 256 * 1024);
+
+    /**
+     * @brief Destructor. Waits for outstanding I/O and frees the ring and buffers. Does not close files.
+     */
+    ~IoBackend();
+
+    IoBackend(const IoBackend&) = delete;
+    IoBackend& operator=(const IoBackend&) = delete;
+
+    /**
+     * @brief Tells whether the backend is using io_uring or the pwrite fallback.
+     *
+     * @return true for io_uring, false for the fallback.
+     */
+    [[nodiscard]] bool usesIoUring() const;
+
+    /**
+     * @brief Opens a file for writing, creating it if needed. Appends start at the end of the file.
+     *
+     * @param path Path of the file.
+     * @param truncate Whether to empty the file first.
+     * @return The file descriptor, or -1 if the file could not be opened.
+     */
+    int openFile(const string& path, bool truncate);
+
+    /**
+     * @brief Appends data to an open file. The data is copied, and written once a buffer fills or the file is synced.
+     *
+     * @param fd The file, as returned by `openFile`.
+     * @param data The data.
+     */
+    void append(int fd, string_view data);
+
+    /**
+     * @brief Writes everything appended to a file and waits until it is on disk.
+     *
+     * @param fd The file.
+     * @return true if every write and the sync succeeded since the last check, false otherwise.
+     */
+    bool sync(int fd);
+
+    /**
+     * @brief Writes everything appended to a file, waits for it, and closes the file.
+     *
+     * @param fd The file.
+     * @return true if every write succeeded since the last check, false otherwise.
+     */
+    bool closeFile(int fd);
+
+    /**
+     * @brief Reads a whole file.
+     *
+     * @param path Path of the file.
+     * @param contents Set to the contents of the file.
+     * @return true if the file was read, false otherwise.
+     */
+    bool readFile(const string& path, string& contents);
+
+private:
+    /**
+     * @brief One of the I/O buffers.
+     */
+    struct Buffer {
+        char* data = nullptr; ///< The buffer's memory.
+        size_t used = 0; ///< Number of bytes of data in the buffer.
+        int fd = -1; ///< File the data belongs to.
+        long long offset = 0; ///< Position in the file the data goes to.
+        char* target = nullptr; ///< Where a read into this buffer is copied to, or nullptr for writes.
+        bool inFlight = false; ///< Whether the kernel is reading or writing the buffer.
+    };
+
+    /**
+     * @brief Gets the position the next append to a file goes to.
+     *
+     * @param fd The file.
+     * @return Reference to the position.
+     */
+    long long& offsetOf(int fd);
+
+    /**
+     * @brief Queues the current buffer to be written and switches to a free one.
+     */
+    void queueCurrent();
+
+    /**
+     * @brief Gets a buffer no I/O is using, waiting for I/O to finish if every buffer is busy.
+     *
+     * @return The index of the buffer.
+     */
+    int freeBuffer();
+
+    /**
+     * @brief Writes a buffer with blocking pwrite calls.
+     *
+     * @param b The buffer.
+     * @param from Number of bytes at the front of the buffer already written.
+     */
+    void writeBlocking(Buffer& b, size_t from);
+
+    /**
+     * @brief Submits all queued I/O and waits for all of it to finish.
+     */
+    void waitAll();
+
+    /**
+     * @brief Gets the result of the last check and starts a new one.
+     *
+     * @return true if no I/O failed since the last check.
+     */
+    bool takeStatus();
+
+#ifdef LIBRARY_HAVE_IO_URING
+    /**
+     * @brief Sets up the ring and registers the buffers.
+     *
+     * @param entries Number of submission queue entries.
+     * @return true if io_uring is usable, false otherwise.
+     */
+    bool setupRing(unsigned entries);
+
+    /**
+     * @brief Queues one operation on the ring.
+     *
+     * @param opcode The io_uring operation.
+     * @param fd The file.
+     * @param buffer Index of the buffer, or -1 for an operation without one.
+     * @param address The memory to read or write.
+     * @param length Number of bytes.
+     * @param offset Position in the file.
+     * @param flags Submission flags.
+     */
+    void queueOp(unsigned char opcode, int fd, int buffer, char* address, size_t length, long long offset,
+                 unsigned char flags);
+
+    /**
+     * @brief Submits the queued operations and optionally waits for some to complete.
+     *
+     * @param waitFor Number of completions to wait for.
+     */
+    void enter(unsigned waitFor);
+
+    /**
+     * @brief Handles every completion in the completion queue.
+     */
+    void reap();
+
+    int ringFd = -1; ///< The io_uring instance, or -1 when using the fallback.
+    bool fixedBuffers = false; ///< Whether the buffers are registered with the ring.
+    void* sqRing = nullptr; ///< Mapped submission queue ring.
+    size_t sqRingSize = 0; ///< Size of the submission queue mapping.
+    void* cqRing = nullptr; ///< Mapped completion queue ring; the same as `sqRing` on kernels with a single mapping.
+    size_t cqRingSize = 0; ///< Size of the completion queue mapping.
+    void* sqes = nullptr; ///< Mapped submission queue entries.
+    size_t sqesSize = 0; ///< Size of the submission queue entry mapping.
+    unsigned* sqTail = nullptr; ///< Submission queue tail, written by the backend.
+    unsigned* sqHead = nullptr; ///< Submission queue head, written by the kernel.
+    unsigned sqMask = 0; ///< Submission queue index mask.
+    unsigned sqEntries = 0; ///< Submission queue size.
+    unsigned* sqArray = nullptr; ///< Submission queue index array.
+    unsigned* cqHead = nullptr; ///< Completion queue head, written by the backend.
+    unsigned* cqTail = nullptr; ///< Completion queue tail, written by the kernel.
+    unsigned cqMask = 0; ///< Completion queue index mask.
+    void* cqes = nullptr; ///< Completion queue entries.
+    unsigned toSubmit = 0; ///< Operations queued but not yet submitted.
+#endif
+
+    vector<Buffer> buffers; ///< The I/O buffers.
+    size_t bufferSize; ///< Size of each buffer.
+    int current; ///< Buffer appends are copied into, or -1 if none is assigned.
+    vector<pair<int, long long>> offsets; ///< Next append position of each open file.
+    unsigned inFlight; ///< Operations submitted or queued and not yet completed.
+    bool failed; ///< Set when an operation fails, cleared by `takeStatus`.
+};
+
+#endif //LIBRARYMANAGEMENT_IOBACKEND_H
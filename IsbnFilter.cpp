@@ -0,0 +1,24 @@
+#include "IsbnFilter.h"
+#include <algorithm>
+
+/**
+ * @brief Constructs an empty filter for a slot array.
+ *
+ * @param slots The number of slots in the array.
+ */
+IsbnFilter::IsbnFilter(size_t slots) : blockCount(max<size_t>(1, slots * BITS_PER_SLOT / (WORDS * 64))) {
+    blocks = BlockAllocator().allocate(blockCount);
+    for (size_t i = 0; i < blockCount; i++) {
+        Block* block = new (&blocks[i]) Block;
+        for (atomic<uint64_t>& word : block->words) {
+            word.store(0, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Destructor. Frees the blocks.
+ */
+IsbnFilter::~IsbnFilter() {
+    BlockAllocator().deallocate(blocks, blockCount);
+}
@@ -0,0 +1,127 @@
+#ifndef LIBRARYMANAGEMENT_ISBNFILTER_H
+#define LIBRARYMANAGEMENT_ISBNFILTER_H
+
+#include "LibraryHash.h"
+#include "MemoryAccounting.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * @class IsbnFilter
+ * @brief A cache-line-blocked Bloom filter of ISBNs, which tells most ISBNs that are not in the inventory
+ *        apart without reading the slot array.
+ *
+ * Each ISBN picks one 64-byte block and sets one bit in each of its `WORDS` words, so a lookup reads a single
+ * cache line. ISBNs that were added always pass; others pass with a probability of well under one percent
+ * when the filter has `BITS_PER_SLOT` bits for each slot of a table at most 70% full.
+ *
+ * Bits can be set from several threads at once and read without locks. They are never cleared, so a removed
+ * ISBN keeps passing until the filter is rebuilt, which only costs a probe of the slot array.
+ */
+class IsbnFilter {
+public:
+    static const int WORDS = 8; ///< 64-bit words per block, one bit of each set per ISBN.
+    static const size_t BITS_PER_SLOT = 8; ///< Filter bits for each slot of the table the filter covers.
+
+    /**
+     * @brief Constructs an empty filter for a slot array.
+     *
+     * @param slots The number of slots in the array.
+     */
+    explicit IsbnFilter(size_t slots);
+
+    /**
+     * @brief Destructor. Frees the blocks.
+     */
+    ~IsbnFilter();
+
+    IsbnFilter(const IsbnFilter&) = delete;
+    IsbnFilter& operator=(const IsbnFilter&) = delete;
+
+    /**
+     * @brief Adds an ISBN to the filter.
+     *
+     * @param ISBN The ISBN.
+     */
+    void add(long long ISBN) {
+        uint64_t hash = LibraryHash::mixISBN(ISBN);
+        Block& block = blocks[blockOf(hash)];
+        for (int i = 0; i < WORDS; i++) {
+            block.words[i].fetch_or(uint64_t(1) << bitOf(hash, i), memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Tells whether an ISBN may have been added.
+     *
+     * @param ISBN The ISBN.
+     * @return false if the ISBN was certainly not added, true if it probably was.
+     */
+    [[nodiscard]] bool mayContain(long long ISBN) const {
+        uint64_t hash = LibraryHash::mixISBN(ISBN);
+        const Block& block = blocks[blockOf(hash)];
+        uint64_t found = 1;
+        for (int i = 0; i < WORDS; i++) {
+            found &= block.words[i].load(memory_order_relaxed) >> bitOf(hash, i);
+        }
+        return found != 0;
+    }
+
+    /**
+     * @brief Starts loading the block of an ISBN into the cache without waiting for it.
+     *
+     * @param ISBN The ISBN.
+     */
+    void prefetch(long long ISBN) const {
+        __builtin_prefetch(&blocks[blockOf(LibraryHash::mixISBN(ISBN))]);
+    }
+
+private:
+    /**
+     * @brief One cache line of the filter.
+     */
+    struct alignas(64) Block {
+        atomic<uint64_t> words[WORDS]; ///< The filter bits.
+    };
+
+    /**
+     * @brief Allocates blocks, counted under `MemoryAccounting::InventoryFilter`.
+     */
+    using BlockAllocator = CountingAllocator<Block, MemoryAccounting::InventoryFilter>;
+
+    /**
+     * @brief Odd multipliers that pick the bit of each word.
+     */
+    static constexpr uint32_t SALTS[WORDS] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+    };
+
+    /**
+     * @brief Gets the block of a hash, from its upper half.
+     *
+     * @param hash The ISBN's hash.
+     * @return The index of the block.
+     */
+    [[nodiscard]] size_t blockOf(uint64_t hash) const {
+        return static_cast<size_t>(((hash >> 32) * blockCount) >> 32);
+    }
+
+    /**
+     * @brief Gets the bit of one word of the block that a hash sets, from its lower half.
+     *
+     * @param hash The ISBN's hash.
+     * @param word The word of the block.
+     * @return The bit, from 0 to 63.
+     */
+    static int bitOf(uint64_t hash, int word) {
+        return static_cast<int>((static_cast<uint32_t>(hash) * SALTS[word]) >> 26);
+    }
+
+    Block* blocks; ///< The filter bits, one cache line per block.
+    size_t blockCount; ///< Number of blocks.
+};
+
+#endif //LIBRARYMANAGEMENT_ISBNFILTER_H
@@ -0,0 +1,366 @@
+#include "IsbnIndex.h"
+#include <algorithm>
+#include <mutex>
+
+/**
+ * @brief Allocates a node and counts it under `MemoryAccounting::IsbnTree`.
+ *
+ * @param size The size of the node.
+ * @return Pointer to the space.
+ */
+void *IsbnIndex::Node::operator new(size_t size) {
+    void* p = ::operator new(size);
+    MemoryAccounting::allocated(MemoryAccounting::IsbnTree, size);
+    return p;
+}
+
+/**
+ * @brief Frees a node and counts it as freed.
+ *
+ * @param p Pointer to the node.
+ * @param size The size of the node.
+ */
+void IsbnIndex::Node::operator delete(void *p, size_t size) {
+    MemoryAccounting::freed(MemoryAccounting::IsbnTree, size);
+    ::operator delete(p);
+}
+
+/**
+ * @brief Constructs an empty index.
+ */
+IsbnIndex::IsbnIndex() : root(new Leaf()), count(0) {
+    root->leaf = true;
+}
+
+/**
+ * @brief Destructor. Frees the nodes, but not the books.
+ */
+IsbnIndex::~IsbnIndex() {
+    destroy(root);
+}
+
+/**
+ * @brief Replaces the contents of the index with many books at once, such as a whole catalog.
+ *
+ * The books are sorted and packed into full leaves, and each level of inner nodes is built from the one below,
+ * so every node is written once.
+ *
+ * @param books The books, in any order. Null entries are skipped, and of books sharing an ISBN the last
+ *              one is kept.
+ */
+void IsbnIndex::build(const vector<Book *> &books) {
+    vector<Book*> sorted;
+    sorted.reserve(books.size());
+    for (Book* b : books) {
+        if (b != nullptr) {
+            sorted.push_back(b);
+        }
+    }
+    stable_sort(sorted.begin(), sorted.end(), [](const Book* a, const Book* b) {
+        return *a < *b;
+    });
+    size_t kept = 0;
+    for (Book* b : sorted) {
+        if (kept > 0 && sorted[kept - 1]->getIsbn() == b->getIsbn()) {
+            sorted[kept - 1] = b;
+        } else {
+            sorted[kept++] = b;
+        }
+    }
+    sorted.resize(kept);
+
+    vector<Node*> level;
+    vector<long long> lowest;
+    Leaf* previous = nullptr;
+    for (size_t i = 0; i < sorted.size(); i += NODE_SLOTS) {
+        auto* leaf = new Leaf();
+        leaf->leaf = true;
+        leaf->count = static_cast<int>(min(sorted.size() - i, static_cast<size_t>(NODE_SLOTS)));
+        for (int j = 0; j < leaf->count; j++) {
+            leaf->keys[j] = sorted[i + j]->getIsbn();
+            leaf->books[j] = sorted[i + j];
+        }
+        if (previous != nullptr) {
+            previous->next = leaf;
+        }
+        previous = leaf;
+        level.push_back(leaf);
+        lowest.push_back(leaf->keys[0]);
+    }
+    if (level.empty()) {
+        auto* leaf = new Leaf();
+        leaf->leaf = true;
+        level.push_back(leaf);
+        lowest.push_back(0);
+    }
+    while (level.size() > 1) {
+        vector<Node*> parents;
+        vector<long long> parentLowest;
+        for (size_t i = 0; i < level.size(); i += NODE_SLOTS + 1) {
+            size_t end = min(level.size(), i + NODE_SLOTS + 1);
+            auto* inner = new Inner();
+            inner->leaf = false;
+            inner->count = static_cast<int>(end - i - 1);
+            inner->children[0] = level[i];
+            for (size_t j = i + 1; j < end; j++) {
+                inner->keys[j - i - 1] = lowest[j];
+                inner->children[j - i] = level[j];
+            }
+            parents.push_back(inner);
+            parentLowest.push_back(lowest[i]);
+        }
+        level.swap(parents);
+        lowest.swap(parentLowest);
+    }
+
+    unique_lock<shared_mutex> guard(lock);
+    destroy(root);
+    root = level.front();
+    count = sorted.size();
+}
+
+/**
+ * @brief Adds a book, replacing any book already indexed under its ISBN.
+ *
+ * @param book The book.
+ */
+void IsbnIndex::insert(Book *book) {
+    unique_lock<shared_mutex> guard(lock);
+    Split split = insertInto(root, book);
+    if (split.node != nullptr) {
+        auto* top = new Inner();
+        top->leaf = false;
+        top->count = 1;
+        top->keys[0] = split.key;
+        top->children[0] = root;
+        top->children[1] = split.node;
+        root = top;
+    }
+}
+
+/**
+ * @brief Removes the book indexed under an ISBN, if there is one.
+ *
+ * @param ISBN The ISBN.
+ */
+void IsbnIndex::erase(const long long ISBN) {
+    unique_lock<shared_mutex> guard(lock);
+    Leaf* leaf = leafFor(ISBN);
+    int i = static_cast<int>(lower_bound(leaf->keys, leaf->keys + leaf->count, ISBN) - leaf->keys);
+    if (i == leaf->count || leaf->keys[i] != ISBN) {
+        return;
+    }
+    copy(leaf->keys + i + 1, leaf->keys + leaf->count, leaf->keys + i);
+    copy(leaf->books + i + 1, leaf->books + leaf->count, leaf->books + i);
+    leaf->count--;
+    count--;
+}
+
+/**
+ * @brief Calls a function on every book with an ISBN in a range, in ascending ISBN order.
+ *
+ * The index is locked for reading during the scan, so the function must not change it.
+ *
+ * @param first The smallest ISBN to visit.
+ * @param last The largest ISBN to visit.
+ * @param visit The function to call with each book.
+ * @return The number of books visited.
+ */
+size_t IsbnIndex::forEachInRange(const long long first, const long long last,
+                                 const function<void(Book *)> &visit) const {
+    return forEachFrom(first, last, [&visit](Book* b) {
+        visit(b);
+        return true;
+    });
+}
+
+/**
+ * @brief Calls a function on books in ascending ISBN order, starting at an ISBN, until it returns false.
+ *
+ * Finding the start costs one lookup however many books come before it, so a listing can be read a page at
+ * a time by starting each page just past the last ISBN of the previous one. The index is locked for reading
+ * during the scan, so the function must not change it.
+ *
+ * @param first The smallest ISBN to visit.
+ * @param last The largest ISBN to visit.
+ * @param visit The function to call with each book. Returning false stops the scan.
+ * @return The number of books visited.
+ */
+size_t IsbnIndex::forEachFrom(const long long first, const long long last, const function<bool(Book *)> &visit) const {
+    shared_lock<shared_mutex> guard(lock);
+    size_t visited = 0;
+    if (first > last) {
+        return visited;
+    }
+    const Leaf* leaf = leafFor(first);
+    int i = static_cast<int>(lower_bound(leaf->keys, leaf->keys + leaf->count, first) - leaf->keys);
+    for (; leaf != nullptr; leaf = leaf->next, i = 0) {
+        for (; i < leaf->count; i++) {
+            if (leaf->keys[i] > last) {
+                return visited;
+            }
+            visited++;
+            if (!visit(leaf->books[i])) {
+                return visited;
+            }
+        }
+    }
+    return visited;
+}
+
+/**
+ * @brief Gets the number of books in the index.
+ *
+ * @return The number of books.
+ */
+size_t IsbnIndex::size() const {
+    shared_lock<shared_mutex> guard(lock);
+    return count;
+}
+
+/**
+ * @brief Gets the range of ISBN-13s that start with a prefix.
+ *
+ * @param prefix Up to 13 digits, which may be separated by hyphens, such as "978-0-14".
+ * @param first Set to the smallest ISBN with the prefix.
+ * @param last Set to the largest ISBN with the prefix.
+ * @return true if the prefix was valid, false otherwise.
+ */
+bool IsbnIndex::prefixRange(string_view prefix, long long &first, long long &last) {
+    long long value = 0;
+    int digits = 0;
+    for (char c : prefix) {
+        if (c >= '0' && c <= '9') {
+            if (++digits > ISBN_DIGITS) {
+                return false;
+            }
+            value = value * 10 + (c - '0');
+        } else if (c != '-') {
+            return false;
+        }
+    }
+    if (digits == 0) {
+        return false;
+    }
+    long long scale = 1;
+    for (int i = digits; i < ISBN_DIGITS; i++) {
+        scale *= 10;
+    }
+    first = value * scale;
+    last = first + scale - 1;
+    return true;
+}
+
+/**
+ * @brief Adds a book under a subtree, splitting nodes that overflow.
+ *
+ * A full node is split in half, and the key that separates the halves is passed up to be added to the parent.
+ *
+ * @param node The subtree's root.
+ * @param book The book.
+ * @return The new sibling of `node`, if it had to be split.
+ */
+IsbnIndex::Split IsbnIndex::insertInto(Node *node, Book *book) {
+    long long key = book->getIsbn();
+    if (node->leaf) {
+        auto* leaf = static_cast<Leaf*>(node);
+        int i = static_cast<int>(lower_bound(leaf->keys, leaf->keys + leaf->count, key) - leaf->keys);
+        if (i < leaf->count && leaf->keys[i] == key) {
+            leaf->books[i] = book;
+            return {nullptr, 0};
+        }
+        count++;
+        Leaf* target = leaf;
+        Leaf* right = nullptr;
+        if (leaf->count == NODE_SLOTS) {
+            right = new Leaf();
+            right->leaf = true;
+            int half = NODE_SLOTS / 2;
+            right->count = NODE_SLOTS - half;
+            copy(leaf->keys + half, leaf->keys + NODE_SLOTS, right->keys);
+            copy(leaf->books + half, leaf->books + NODE_SLOTS, right->books);
+            leaf->count = half;
+            right->next = leaf->next;
+            leaf->next = right;
+            if (i > half) {
+                target = right;
+                i -= half;
+            }
+        }
+        copy_backward(target->keys + i, target->keys + target->count, target->keys + target->count + 1);
+        copy_backward(target->books + i, target->books + target->count, target->books + target->count + 1);
+        target->keys[i] = key;
+        target->books[i] = book;
+        target->count++;
+        return {right, right == nullptr ? 0 : right->keys[0]};
+    }
+
+    auto* inner = static_cast<Inner*>(node);
+    int i = static_cast<int>(upper_bound(inner->keys, inner->keys + inner->count, key) - inner->keys);
+    Split below = insertInto(inner->children[i], book);
+    if (below.node == nullptr) {
+        return below;
+    }
+    if (inner->count < NODE_SLOTS) {
+        copy_backward(inner->keys + i, inner->keys + inner->count, inner->keys + inner->count + 1);
+        copy_backward(inner->children + i + 1, inner->children + inner->count + 1,
+                      inner->children + inner->count + 2);
+        inner->keys[i] = below.key;
+        inner->children[i + 1] = below.node;
+        inner->count++;
+        return {nullptr, 0};
+    }
+
+    // Lay out the overflowing node in full, then keep the lower half and move the upper half to a new sibling.
+    long long keys[NODE_SLOTS + 1];
+    Node* children[NODE_SLOTS + 2];
+    copy(inner->keys, inner->keys + i, keys);
+    keys[i] = below.key;
+    copy(inner->keys + i, inner->keys + NODE_SLOTS, keys + i + 1);
+    copy(inner->children, inner->children + i + 1, children);
+    children[i + 1] = below.node;
+    copy(inner->children + i + 1, inner->children + NODE_SLOTS + 1, children + i + 2);
+
+    int half = (NODE_SLOTS + 1) / 2;
+    auto* right = new Inner();
+    right->leaf = false;
+    right->count = NODE_SLOTS - half;
+    copy(keys + half + 1, keys + NODE_SLOTS + 1, right->keys);
+    copy(children + half + 1, children + NODE_SLOTS + 2, right->children);
+    inner->count = half;
+    copy(keys, keys + half, inner->keys);
+    copy(children, children + half + 1, inner->children);
+    return {right, keys[half]};
+}
+
+/**
+ * @brief Finds the leaf that holds, or would hold, an ISBN.
+ *
+ * @param ISBN The ISBN.
+ * @return The leaf.
+ */
+IsbnIndex::Leaf *IsbnIndex::leafFor(const long long ISBN) const {
+    Node* node = root;
+    while (!node->leaf) {
+        auto* inner = static_cast<Inner*>(node);
+        node = inner->children[upper_bound(inner->keys, inner->keys + inner->count, ISBN) - inner->keys];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+/**
+ * @brief Frees a subtree.
+ *
+ * @param node The subtree's root.
+ */
+void IsbnIndex::destroy(Node *node) {
+    if (node->leaf) {
+        delete static_cast<Leaf*>(node);
+        return;
+    }
+    auto* inner = static_cast<Inner*>(node);
+    for (int i = 0; i <= inner->count; i++) {
+        destroy(inner->children[i]);
+    }
+    delete inner;
+}
@@ -0,0 +1,189 @@
+#ifndef LIBRARYMANAGEMENT_ISBNINDEX_H
+#define LIBRARYMANAGEMENT_ISBNINDEX_H
+
+#include "Book.h"
+#include "MemoryAccounting.h"
+#include <functional>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class IsbnIndex
+ * @brief A B+tree of the catalog's books in ISBN order, for range and prefix scans.
+ *
+ * The inventory's hash table finds one ISBN quickly but has no order, so listing a publisher's books would mean
+ * reading and sorting the whole catalog. ISBN-13 prefixes name registration groups and publishers (every
+ * `978-0-14` is Penguin), so a prefix is a contiguous range of this index.
+ *
+ * Nodes hold `NODE_SLOTS` keys in a sorted array, a few cache lines each, so a lookup touches one node per level
+ * and a scan walks the chained leaves front to back. A catalog load builds the tree bottom-up with full leaves.
+ * Removing a book only takes its key out of its leaf; underfull nodes are not merged, since catalogs rarely
+ * shrink, and empty leaves are skipped by scans.
+ *
+ * Scans may run concurrently with each other; inserting and erasing excludes them.
+ */
+class IsbnIndex {
+public:
+    static const int NODE_SLOTS = 32; ///< Keys per node.
+    static const int ISBN_DIGITS = 13; ///< Digits of the ISBNs that prefixes are matched against.
+
+    /**
+     * @brief Constructs an empty index.
+     */
+    IsbnIndex();
+
+    /**
+     * @brief Destructor. Frees the nodes, but not the books.
+     */
+    ~IsbnIndex();
+
+    IsbnIndex(const IsbnIndex&) = delete;
+    IsbnIndex& operator=(const IsbnIndex&) = delete;
+
+    /**
+     * @brief Replaces the contents of the index with many books at once, such as a whole catalog.
+     *
+     * @param books The books, in any order. Null entries are skipped, and of books sharing an ISBN the last
+     *              one is kept.
+     */
+    void build(const vector<Book*>& books);
+
+    /**
+     * @brief Adds a book, replacing any book already indexed under its ISBN.
+     *
+     * @param book The book.
+     */
+    void insert(Book* book);
+
+    /**
+     * @brief Removes the book indexed under an ISBN, if there is one.
+     *
+     * @param ISBN The ISBN.
+     */
+    void erase(long long ISBN);
+
+    /**
+     * @brief Calls a function on every book with an ISBN in a range, in ascending ISBN order.
+     *
+     * The index is locked for reading during the scan, so the function must not change it.
+     *
+     * @param first The smallest ISBN to visit.
+     * @param last The largest ISBN to visit.
+     * @param visit The function to call with each book.
+     * @return The number of books visited.
+     */
+    size_t forEachInRange(long long first, long long last, const function<void(Book*)>& visit) const;
+
+    /**
+     * @brief Calls a function on books in ascending ISBN order, starting at an ISBN, until it returns false.
+     *
+     * Finding the start costs one lookup however many books come before it, so a listing can be read a page at
+     * a time by starting each page just past the last ISBN of the previous one. The index is locked for reading
+     * during the scan, so the function must not change it.
+     *
+     * @param first The smallest ISBN to visit.
+     * @param last The largest ISBN to visit.
+     * @param visit The function to call with each book. Returning false stops the scan.
+     * @return The number of books visited.
+     */
+    size_t forEachFrom(long long first, long long last, const function<bool(Book*)>& visit) const;
+
+    /**
+     * @brief Gets the number of books in the index.
+     *
+     * @return The number of books.
+     */
+    [[nodiscard]] size_t size() const;
+
+    /**
+     * @brief Gets the range of ISBN-13s that start with a prefix.
+     *
+     * @param prefix Up to 13 digits, which may be separated by hyphens, such as "978-0-14".
+     * @param first Set to the smallest ISBN with the prefix.
+     * @param last Set to the largest ISBN with the prefix.
+     * @return true if the prefix was valid, false otherwise.
+     */
+    static bool prefixRange(string_view prefix, long long& first, long long& last);
+
+private:
+    /**
+     * @brief The header shared by leaves and inner nodes.
+     */
+    struct Node {
+        bool leaf; ///< true for a leaf, false for an inner node.
+        int count; ///< Number of keys in use.
+        long long keys[NODE_SLOTS]; ///< The keys in use, ascending.
+
+        /**
+         * @brief Allocates a node and counts it under `MemoryAccounting::IsbnTree`.
+         *
+         * @param size The size of the node.
+         * @return Pointer to the space.
+         */
+        static void* operator new(size_t size);
+
+        /**
+         * @brief Frees a node and counts it as freed.
+         *
+         * @param p Pointer to the node.
+         * @param size The size of the node.
+         */
+        static void operator delete(void* p, size_t size);
+    };
+
+    /**
+     * @brief A leaf, holding the books of its keys.
+     */
+    struct Leaf : Node {
+        Book* books[NODE_SLOTS]; ///< The book of each key.
+        Leaf* next; ///< The leaf with the next larger keys, or nullptr for the last leaf.
+    };
+
+    /**
+     * @brief An inner node. Child `i` holds the keys from `keys[i - 1]` up to, but not including, `keys[i]`.
+     */
+    struct Inner : Node {
+        Node* children[NODE_SLOTS + 1]; ///< The subtrees, `count + 1` of them in use.
+    };
+
+    /**
+     * @brief A node split off from a full one during an insert.
+     */
+    struct Split {
+        Node* node; ///< The new right sibling, or nullptr if nothing was split.
+        long long key; ///< The smallest key in the new sibling's subtree.
+    };
+
+    /**
+     * @brief Adds a book under a subtree, splitting nodes that overflow.
+     *
+     * @param node The subtree's root.
+     * @param book The book.
+     * @return The new sibling of `node`, if it had to be split.
+     */
+    Split insertInto(Node* node, Book* book);
+
+    /**
+     * @brief Finds the leaf that holds, or would hold, an ISBN.
+     *
+     * @param ISBN The ISBN.
+     * @return The leaf.
+     */
+    [[nodiscard]] Leaf* leafFor(long long ISBN) const;
+
+    /**
+     * @brief Frees a subtree.
+     *
+     * @param node The subtree's root.
+     */
+    static void destroy(Node* node);
+
+    Node* root; ///< The root, a leaf while the index fits in one.
+    size_t count; ///< Number of books in the index.
+    mutable shared_mutex lock; ///< Held shared by scans and exclusively by changes.
+};
+
+#endif //LIBRARYMANAGEMENT_ISBNINDEX_H
@@ -0,0 +1,98 @@
+#include "LatencyHistogram.h"
+#include <cmath>
+
+/**
+ * @brief Constructs an empty histogram.
+ */
+LatencyHistogram::LatencyHistogram() : counts{}, total(0) {
+}
+
+/**
+ * @brief Gets the largest value that falls in a bucket.
+ *
+ * @param bucket The bucket index.
+ * @return The value in nanoseconds.
+ */
+uint64_t LatencyHistogram::highestInBucket(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return static_cast<uint64_t>(bucket);
+    }
+    int shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+    uint64_t sub = static_cast<uint64_t>((bucket - SUB_BUCKETS) % SUB_BUCKETS);
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/**
+ * @brief Adds a count to a bucket.
+ *
+ * @param bucket The bucket index.
+ * @param count The number of values to add.
+ */
+void LatencyHistogram::addToBucket(int bucket, uint64_t count) {
+    counts[bucket] += count;
+    total += count;
+}
+
+/**
+ * @brief Adds a value.
+ *
+ * @param value The value in nanoseconds.
+ */
+void LatencyHistogram::add(uint64_t value) {
+    addToBucket(bucketOf(value), 1);
+}
+
+/**
+ * @brief Adds every value of another histogram.
+ *
+ * @param other The histogram to merge.
+ */
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (int i = 0; i < BUCKETS; i++) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+}
+
+/**
+ * @brief Gets the number of values in a bucket.
+ *
+ * @param bucket The bucket index.
+ * @return The count.
+ */
+uint64_t LatencyHistogram::countInBucket(int bucket) const {
+    return counts[bucket];
+}
+
+/**
+ * @brief Gets the number of values.
+ *
+ * @return The count.
+ */
+uint64_t LatencyHistogram::getCount() const {
+    return total;
+}
+
+/**
+ * @brief Gets a percentile, as the highest value of the bucket it falls in.
+ *
+ * @param percentile The percentile, from 0 to 100.
+ * @return The value in nanoseconds, or 0 if the histogram is empty.
+ */
+uint64_t LatencyHistogram::valueAtPercentile(double percentile) const {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(ceil(percentile / 100.0 * static_cast<double>(total)));
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return highestInBucket(i);
+        }
+    }
+    return highestInBucket(BUCKETS - 1);
+}
@@ -0,0 +1,106 @@
+#ifndef LIBRARYMANAGEMENT_LATENCYHISTOGRAM_H
+#define LIBRARYMANAGEMENT_LATENCYHISTOGRAM_H
+
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * @class LatencyHistogram
+ * @brief A histogram of latencies in nanoseconds with a fixed relative precision, in the style of HdrHistogram.
+ *
+ * Values below `SUB_BUCKETS` have a bucket each. Above that, every power of two is split into `SUB_BUCKETS`
+ * equal buckets, so a value is known to within 1/16 of itself whether it is 50 ns or 5 s. The buckets are
+ * a flat array indexed by bit arithmetic, so adding a value takes a few instructions and no branches on
+ * the bucket layout. Values past `MAX_VALUE` (about 37 minutes) go in the last bucket.
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 4; ///< log2 of the number of buckets per power of two.
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS; ///< Number of buckets per power of two.
+    static const int MAX_BITS = 41; ///< Values are tracked up to 2^MAX_BITS - 1 nanoseconds.
+    static const uint64_t MAX_VALUE = (uint64_t(1) << MAX_BITS) - 1; ///< Largest value tracked exactly.
+    static const int BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BUCKET_BITS) * SUB_BUCKETS; ///< Number of buckets.
+
+    /**
+     * @brief Constructs an empty histogram.
+     */
+    LatencyHistogram();
+
+    /**
+     * @brief Gets the bucket a value falls in.
+     *
+     * @param value The value in nanoseconds.
+     * @return The bucket index.
+     */
+    static int bucketOf(uint64_t value) {
+        if (value > MAX_VALUE) {
+            value = MAX_VALUE;
+        }
+        if (value < SUB_BUCKETS) {
+            return static_cast<int>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        int shift = exponent - SUB_BUCKET_BITS;
+        return SUB_BUCKETS + shift * SUB_BUCKETS + static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    /**
+     * @brief Gets the largest value that falls in a bucket.
+     *
+     * @param bucket The bucket index.
+     * @return The value in nanoseconds.
+     */
+    static uint64_t highestInBucket(int bucket);
+
+    /**
+     * @brief Adds a count to a bucket.
+     *
+     * @param bucket The bucket index.
+     * @param count The number of values to add.
+     */
+    void addToBucket(int bucket, uint64_t count);
+
+    /**
+     * @brief Adds a value.
+     *
+     * @param value The value in nanoseconds.
+     */
+    void add(uint64_t value);
+
+    /**
+     * @brief Adds every value of another histogram.
+     *
+     * @param other The histogram to merge.
+     */
+    void merge(const LatencyHistogram& other);
+
+    /**
+     * @brief Gets the number of values in a bucket.
+     *
+     * @param bucket The bucket index.
+     * @return The count.
+     */
+    [[nodiscard]] uint64_t countInBucket(int bucket) const;
+
+    /**
+     * @brief Gets the number of values.
+     *
+     * @return The count.
+     */
+    [[nodiscard]] uint64_t getCount() const;
+
+    /**
+     * @brief Gets a percentile, as the highest value of the bucket it falls in.
+     *
+     * @param percentile The percentile, from 0 to 100.
+     * @return The value in nanoseconds, or 0 if the histogram is empty.
+     */
+    [[nodiscard]] uint64_t valueAtPercentile(double percentile) const;
+
+private:
+    uint64_t counts[BUCKETS]; ///< Number of values in each bucket.
+    uint64_t total; ///< Number of values.
+};
+
+#endif //LIBRARYMANAGEMENT_LATENCYHISTOGRAM_H
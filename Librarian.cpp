@@ -4,11 +4,19 @@
 
 #include "Librarian.h"
 #include "LibraryHash.h"
+#include "CatalogSnapshot.h"
+#include "IoBackend.h"
+#include "Metrics.h"
+#include "TaskScheduler.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <charconv>
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <vector>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 
 
 /**
@@ -17,49 +25,142 @@
  * Initializes the checkOut vector and loads the book inventory from a CSV file.
  * It populates the `inventory` with Book objects, and also tracks the books that are checked out.
  */
-Librarian::Librarian() {
+Librarian::Librarian() : Librarian("../Extras/BookInventory.csv") {
+}
+
+/**
+ * @brief Constructs a Librarian and loads the book inventory from a CSV file.
+ *
+ * The file is read with an `IoBackend`, then its lines are parsed into Book objects and added to the
+ * inventory in parallel on the shared `TaskScheduler`. Of rows sharing an ISBN, only the last is kept. Books that
+ * are not available are tracked as checked out.
+ *
+ * With `DetailLoading::Lazy` the file is mapped instead of read, and the books are made without their title,
+ * author and genre, which they read from the mapping when first asked. The file must not change while the
+ * librarian exists.
+ *
+ * @param catalogPath Path of the CSV file to load.
+ * @param loading When to read the books' title, author and genre.
+ */
+Librarian::Librarian(const string &catalogPath, DetailLoading loading)
+        : fuzzyIndexBuilt(false), publishedStamp(0), catalogGeneration(0) {
+    MetricTimer timer(Metrics::LoadCatalog);
+    TraceSpan span("load catalog");
     checkOut.reserve(10);
-    ifstream file("../Extras/BookInventory.csv");
-    vector<vector<string>> tempVec;
-    string discard;
-    if(!file.is_open()){
+    bool lazy = loading == DetailLoading::Lazy;
+    string contents;
+    string_view text;
+    vector<string_view> lines;
+    bool read;
+    if(lazy){
+        TraceSpan readSpan("map catalog file");
+        read = catalogFile.open(catalogPath);
+        text = catalogFile.getText();
+    } else {
+        TraceSpan readSpan("read catalog file");
+        read = IoBackend().readFile(catalogPath, contents);
+        text = contents;
+    }
+    if(!read){
         cout << "not open" << endl;
+    } else {
+        TraceSpan splitSpan("split catalog lines");
+        // Like reading the header with >> and then every line with getline: the rest of the header line is row 0,
+        // and there is always a last, empty row.
+        size_t start = text.find_first_not_of(" \t\r\n");
+        start = start == string::npos ? text.size() : text.find_first_of(" \t\r\n", start);
+        start = start == string::npos ? text.size() : start;
+        for(;;){
+            size_t end = text.find('\n', start);
+            if(end == string::npos){
+                if(start < text.size()){
+                    lines.emplace_back(text.data() + start, text.size() - start);
+                }
+                lines.emplace_back();
+                break;
+            }
+            lines.emplace_back(text.data() + start, end - start);
+            start = end + 1;
+        }
     }
-    file >> discard;
-    while(file){
-        string line, temp;
-        getline(file, line);
-        stringstream ss(line);
-        vector<string> tempStringVec;
-        while(getline(ss,temp,',')){
-            tempStringVec.push_back(temp);
-        }
-        tempVec.push_back(tempStringVec);
-    }
-    file.close();
-
-    for(int i = 0; i < tempVec.size(); i++){
-        if (tempVec[i].size() == 6) {
-            string title = tempVec[i].at(1);
-            long long ISBN = LibraryHash::formatISBN(tempVec[i].at(0));
-            string author = tempVec[i].at(2);
-            string genre = tempVec[i].at(3);
-            short pubYear = stoi(tempVec[i].at(4));
-            string boolTemp = tempVec[i].at(5);
-            transform(boolTemp.begin(), boolTemp.end(), boolTemp.begin(), ::tolower);
-            bool isAvailable = (boolTemp == "true");
-
-            Book* book = new Book(title, author, genre, pubYear, ISBN, isAvailable);
-            if(!book->isAvailable()){
-                book->setDaysCheckedOut(10);
-                checkOut.push_back(book);
+
+    inventory.reserve(static_cast<long>(lines.size()));
+    vector<Book*> books(lines.size(), nullptr);
+    TaskScheduler::instance().parallelFor(0, lines.size(), 1024, [&](size_t first, size_t last) {
+        TraceSpan blockSpan("parse catalog block");
+        for(size_t i = first; i < last; i++){
+            {
+                TraceSpan rowSpan("construct book");
+                books[i] = lazy ? parseBookLazily(catalogFile, lines[i]) : parseBook(lines[i]);
+            }
+            if(books[i] != nullptr){
+                inventory.addBook(books[i]);
             }
+        }
+    });
 
-            inventory.addBook(book);
-        } else {
+    // Rows sharing an ISBN raced for its slot, so the inventory kept whichever was added last. Keep the last row in
+    // the file instead, as a sequential load did, and delete the others.
+    vector<size_t> dropped;
+    long parsed = count_if(books.begin(), books.end(), [](Book* b) { return b != nullptr; });
+    if(inventory.countTotalBooks() != parsed){
+        TraceSpan duplicateSpan("resolve duplicate isbns");
+        unordered_map<long long, size_t> lastRow;
+        lastRow.reserve(books.size());
+        for(size_t i = 0; i < books.size(); i++){
+            if(books[i] != nullptr){
+                lastRow[books[i]->getIsbn()] = i;
+            }
+        }
+        for(size_t i = 0; i < books.size(); i++){
+            if(books[i] != nullptr && lastRow[books[i]->getIsbn()] != i){
+                dropped.push_back(i);
+                inventory.addBook(books[lastRow[books[i]->getIsbn()]]);
+            }
+        }
+        for(size_t i : dropped){
+            delete books[i];
+            books[i] = nullptr;
+        }
+    }
+
+    {
+        // Index exactly the books the inventory kept, so every book a search finds can be looked up by ISBN.
+        vector<Book*> shelved;
+        shelved.reserve(books.size());
+        inventory.forEachBook([&shelved](Book* b) {
+            shelved.push_back(b);
+        });
+        if(!lazy){
+            TraceSpan indexSpan("build fuzzy index");
+            fuzzyIndex.addAll(shelved);
+            fuzzyIndexBuilt.store(true, memory_order_release);
+        }
+        TraceSpan indexSpan("build isbn index");
+        isbnIndex.build(shelved);
+    }
+
+    TraceSpan trackSpan("track checked out books");
+    auto nextDropped = dropped.begin();
+    for(size_t i = 0; i < books.size(); i++){
+        Book* book = books[i];
+        if(nextDropped != dropped.end() && *nextDropped == i){
+            ++nextDropped;
+            continue;
+        }
+        if(book == nullptr){
             cout << "Skipping row " << i << " due to unexpected column count." << endl;
+            continue;
+        }
+        if(!book->isAvailable()){
+            book->setDaysCheckedOut(10);
+            addToCheckOut(book);
         }
+        markChanged(book);
     }
+    commitChanges();
+    // The load marked every book; later updates are far smaller, so don't keep a list sized for the catalog.
+    changedBooks.shrink_to_fit();
 }
 
 /**
@@ -72,17 +173,7 @@ Librarian::Librarian() {
  * @return Pointer to the checked out book, or nullptr if the book is reserved instead.
  */
 Book *Librarian::checkoutBook(long long ISBN)  {
-    Book* b = inventory.findBookByISBN(ISBN);
-    for(auto i : checkOut){
-        if(b == i){
-            reserveBook(ISBN);
-            return nullptr;
-        }
-    }
-    b->setDaysCheckedOut(10);
-    b->setIsAvailable(false);
-    checkOut.push_back(b);
-    return b;
+    return checkoutBook(ISBN, PatronStore::NO_PATRON);
 }
 
 /**
@@ -92,20 +183,107 @@ Book *Librarian::checkoutBook(long long ISBN)  {
  * If the book is already checked out, it reserves the book instead.
  *
  * @param b Pointer to the Book object to check out.
- * @param ISBN ISBN of the book to check out.
  * @return Pointer to the checked out book, or nullptr if the book is reserved instead.
  */
-Book *Librarian::checkoutBook(Book* b, long long ISBN)  {
-    for(auto i : checkOut){
-        if(b == i){
-            reserveBook(ISBN);
-            return nullptr;
+Book *Librarian::checkoutBook(Book* b)  {
+    MetricTimer timer(Metrics::Checkout);
+    lock_guard<mutex> guard(circulationMutex);
+    CirculationResult result = checkoutLocked(b, PatronStore::NO_PATRON);
+    commitChanges();
+    return result == CirculationResult::Ok ? b : nullptr;
+}
+
+/**
+ * @brief Checks out a book by its ISBN to a patron.
+ *
+ * Links the book into the patron's loan list. If the book is already checked out, a hold is placed
+ * for the patron instead. Nothing happens if the patron is at its loan limit.
+ *
+ * @param ISBN The ISBN of the book to check out.
+ * @param patron The ID of the borrowing patron, or 0 for none.
+ * @return Pointer to the checked-out book, or nullptr if the book was reserved or could not be loaned.
+ */
+Book *Librarian::checkoutBook(long long ISBN, PatronId patron) {
+    MetricTimer timer(Metrics::Checkout);
+    Book* b = inventory.findBookByISBN(ISBN);
+    lock_guard<mutex> guard(circulationMutex);
+    CirculationResult result = checkoutLocked(b, patron);
+    commitChanges();
+    return result == CirculationResult::Ok ? b : nullptr;
+}
+
+/**
+ * @brief Checks out a batch of books, such as one scanned at a self-checkout kiosk.
+ *
+ * Each ISBN is handled like `checkoutBook(ISBN, patron)`. The ISBNs are sorted by inventory slot and
+ * deduplicated, and the slots are prefetched before any book is checked out.
+ *
+ * @param ISBNs The ISBNs of the books to check out.
+ * @param patron The ID of the borrowing patron, or 0 for none.
+ * @return The result of each ISBN, in the same order as `ISBNs`.
+ */
+vector<CirculationResult> Librarian::checkoutBooks(const vector<long long> &ISBNs, PatronId patron) {
+    MetricTimer timer(Metrics::CheckoutBatch);
+    vector<CirculationResult> results(ISBNs.size(), CirculationResult::Ok);
+    vector<pair<size_t, Book*>> batch = resolveBatch(ISBNs, results);
+    lock_guard<mutex> guard(circulationMutex);
+    for(const auto& item : batch){
+        results[item.first] = checkoutLocked(item.second, patron);
+    }
+    commitChanges();
+    return results;
+}
+
+/**
+ * @brief Returns a batch of books, such as one emptied from a book drop.
+ *
+ * Each returned book goes to the first patron in its hold queue who may borrow another book, as in `returnBook`.
+ *
+ * @param ISBNs The ISBNs of the books to return.
+ * @return The result of each ISBN, in the same order as `ISBNs`.
+ */
+vector<CirculationResult> Librarian::returnBooks(const vector<long long> &ISBNs) {
+    MetricTimer timer(Metrics::ReturnBatch);
+    vector<CirculationResult> results(ISBNs.size(), CirculationResult::Ok);
+    vector<pair<size_t, Book*>> batch = resolveBatch(ISBNs, results);
+    lock_guard<mutex> guard(circulationMutex);
+    for(const auto& item : batch){
+        if(item.second == nullptr){
+            results[item.first] = CirculationResult::NotFound;
+        } else if(!releaseBook(item.second)){
+            results[item.first] = CirculationResult::NotCheckedOut;
+        } else {
+            fillHold(item.second);
         }
     }
-    b->setDaysCheckedOut(10);
-    b->setIsAvailable(false);
-    checkOut.push_back(b);
-    return b;
+    commitChanges();
+    return results;
+}
+
+/**
+ * @brief Renews a batch of checked-out books.
+ *
+ * @param ISBNs The ISBNs of the books to renew.
+ * @param days The number of days to set the checkout period of each book to.
+ * @return The result of each ISBN, in the same order as `ISBNs`.
+ */
+vector<CirculationResult> Librarian::renewBooks(const vector<long long> &ISBNs, int days) {
+    MetricTimer timer(Metrics::RenewBatch);
+    vector<CirculationResult> results(ISBNs.size(), CirculationResult::Ok);
+    vector<pair<size_t, Book*>> batch = resolveBatch(ISBNs, results);
+    lock_guard<mutex> guard(circulationMutex);
+    for(const auto& item : batch){
+        if(item.second == nullptr){
+            results[item.first] = CirculationResult::NotFound;
+        } else if(item.second->isAvailable()){
+            results[item.first] = CirculationResult::NotCheckedOut;
+        } else {
+            item.second->setDaysCheckedOut(days);
+            markChanged(item.second);
+        }
+    }
+    commitChanges();
+    return results;
 }
 
 /**
@@ -122,18 +300,21 @@ void Librarian::returnBook(long long ISBN){
 /**
  * @brief Returns a checked-out book to the inventory.
  *
- * Sets the book's availability to true and processes any reservations for the book.
+ * Sets the book's availability to true and loans it to the first patron in its hold queue who may borrow
+ * another book. Only that book's queue is read, so a return costs the same however many holds are waiting.
  *
  * @param book Pointer to the Book object to return.
  */
 void Librarian::returnBook(Book *book) {
-    for(const auto & i : checkOut){
-        if(book == i){
-            book->setIsAvailable(true);
-            processReservations();
-            break;
-        }
+    MetricTimer timer(Metrics::Return);
+    if(book == nullptr){
+        return;
+    }
+    lock_guard<mutex> guard(circulationMutex);
+    if(releaseBook(book)){
+        fillHold(book);
     }
+    commitChanges();
 }
 
 /**
@@ -144,34 +325,91 @@ void Librarian::returnBook(Book *book) {
  * @param ISBN The ISBN of the book to reserve.
  */
 void Librarian::reserveBook(const long long ISBN) {
-    reservations.push_back(inventory.findBookByISBN(ISBN));
+    reserveBook(ISBN, PatronStore::NO_PATRON);
+}
+
+/**
+ * @brief Reserves a book by its ISBN for a patron.
+ *
+ * Places a hold for the patron unless the patron is at its hold limit.
+ *
+ * @param ISBN The ISBN of the book to reserve.
+ * @param patron The ID of the patron placing the hold, or 0 for none.
+ */
+void Librarian::reserveBook(const long long ISBN, PatronId patron) {
+    MetricTimer timer(Metrics::Reserve);
+    Book* b = inventory.findBookByISBN(ISBN);
+    if(b == nullptr){
+        return;
+    }
+    lock_guard<mutex> guard(circulationMutex);
+    reserveLocked(b, patron);
 }
 
 /**
  * @brief Cancels the reservation for a book by its ISBN.
  *
- * Removes the book from the reservation list.
+ * Removes every hold in the book's hold queue.
  *
  * @param ISBN The ISBN of the book whose reservation to cancel.
  */
 void Librarian::cancelReservation(const long long ISBN) {
-    for (auto & reservation : reservations) {
-        if(reservation->getIsbn() == ISBN){
-            reservation = nullptr;
-        }
+    MetricTimer timer(Metrics::CancelReservation);
+    Book* b = inventory.findBookByISBN(ISBN);
+    if(b == nullptr){
+        return;
+    }
+    lock_guard<mutex> guard(circulationMutex);
+    while(b->getFirstHold() != -1){
+        patrons.removeHold(b->getFirstHold());
     }
 }
 
 /**
  * @brief Processes all reservations for books.
  *
- * Checks out any reserved books that are now available.
+ * Checks out any reserved books that are now available, oldest hold first. Returns fill holds as they happen,
+ * so this only finds holds placed on books that were already available, or whose patron was at the loan limit.
  */
 void Librarian::processReservations() {
-    for(auto & reservation : reservations){
-        if(reservation->isAvailable()){
-            checkoutBook(reservation->getIsbn());
-            reservation = nullptr;
+    MetricTimer timer(Metrics::ProcessReservations);
+    TraceSpan span("process reservations");
+    lock_guard<mutex> guard(circulationMutex);
+    processReservationsLocked();
+    commitChanges();
+}
+
+/**
+ * @brief Checks out reserved books that are now available, with `circulationMutex` already held.
+ */
+void Librarian::processReservationsLocked() {
+    MetricTimer timer(Metrics::ReservationScan);
+    TraceSpan span("reservation scan");
+    for (int hold = patrons.getOldestHold(); hold != -1;) {
+        int newer = patrons.getNewerHold(hold);
+        Book* b = patrons.getHoldBook(hold);
+        PatronId patron = patrons.getHoldPatron(hold);
+        if(b->isAvailable() && patrons.canBorrow(patron)){
+            patrons.removeHold(hold);
+            loanBook(b, patron);
+        }
+        hold = newer;
+    }
+}
+
+/**
+ * @brief Loans a returned book to the first patron in its hold queue who may borrow another book, with
+ *        `circulationMutex` already held.
+ *
+ * @param book Pointer to the returned book.
+ */
+void Librarian::fillHold(Book *book) {
+    for (int hold = book->getFirstHold(); hold != -1; hold = patrons.getNextHoldOnBook(hold)) {
+        PatronId patron = patrons.getHoldPatron(hold);
+        if(patrons.canBorrow(patron)){
+            patrons.removeHold(hold);
+            loanBook(book, patron);
+            return;
         }
     }
 }
@@ -184,8 +422,15 @@ void Librarian::processReservations() {
  * @param ISBN The ISBN of the book to renew.
  * @param days The number of days to extend the checkout period.
  */
-void Librarian::renewBook(long long int ISBN, int days) const {
-    inventory.findBookByISBN(ISBN)->setDaysCheckedOut(days);
+void Librarian::renewBook(long long int ISBN, int days) {
+    MetricTimer timer(Metrics::Renew);
+    Book* b = inventory.findBookByISBN(ISBN);
+    if(b != nullptr){
+        lock_guard<mutex> guard(circulationMutex);
+        b->setDaysCheckedOut(days);
+        markChanged(b);
+        commitChanges();
+    }
 }
 
 /**
@@ -195,26 +440,68 @@ void Librarian::renewBook(long long int ISBN, int days) const {
  *
  * @param days The number of days the overdue books are behind.
  */
-void Librarian::processOverdueBooks(const int days) const {
-    for(auto i : checkOut){
-        i->setDaysCheckedOut(i->getDaysCheckedOut()-days);
-        calculateFine(i);
+void Librarian::processOverdueBooks(const int days) {
+    MetricTimer timer(Metrics::OverdueRun);
+    TraceSpan span("overdue run");
+    lock_guard<mutex> guard(circulationMutex);
+    // Books are updated in parallel, but patron totals are shared between books so they are charged afterwards.
+    vector<int> fineChanges(checkOut.size());
+    TaskScheduler::instance().parallelFor(0, checkOut.size(), 4096, [&](size_t first, size_t last) {
+        TraceSpan blockSpan("accrue fines block");
+        for(size_t i = first; i < last; i++){
+            checkOut[i]->setDaysCheckedOut(checkOut[i]->getDaysCheckedOut()-days);
+            fineChanges[i] = accrueFine(checkOut[i]);
+        }
+    });
+    TraceSpan chargeSpan("charge patron fines");
+    for(size_t i = 0; i < checkOut.size(); i++){
+        if(fineChanges[i] != 0){
+            patrons.adjustFine(checkOut[i]->getBorrower(), fineChanges[i]);
+        }
     }
+    changedBooks.insert(changedBooks.end(), checkOut.begin(), checkOut.end());
+    commitChanges();
 }
 
 /**
  * @brief Calculates the fine for a book based on how many days it is overdue.
  *
  * If the book is overdue, it calculates the fine by multiplying the negative number of days by 10.
+ * The change in the fine is also applied to the borrowing patron's fine total.
  *
  * @param book Pointer to the Book object for which to calculate the fine.
  */
-void Librarian::calculateFine(Book *book) const {
-    for(auto i : checkOut){
-        if(i->getDaysCheckedOut() < 0) {
-            i->setFine(i->getDaysCheckedOut()*-10);
-        }
+void Librarian::calculateFine(Book *book) {
+    MetricTimer timer(Metrics::CalculateFine);
+    lock_guard<mutex> guard(circulationMutex);
+    chargeFine(book);
+    markChanged(book);
+    commitChanges();
+}
+
+/**
+ * @brief Updates the fine of a book and its borrower's fine total, with `circulationMutex` already held.
+ *
+ * @param book Pointer to the Book object for which to calculate the fine.
+ */
+void Librarian::chargeFine(Book *book) {
+    patrons.adjustFine(book->getBorrower(), accrueFine(book));
+}
+
+/**
+ * @brief Updates the fine of an overdue book.
+ *
+ * @param book Pointer to the Book object for which to calculate the fine.
+ * @return How much the fine went up by.
+ */
+int Librarian::accrueFine(Book *book) {
+    if(book->getDaysCheckedOut() < 0) {
+        int fine = book->getDaysCheckedOut()*-10;
+        int change = fine - book->getFine();
+        book->setFine(fine);
+        return change;
     }
+    return 0;
 }
 
 /**
@@ -224,8 +511,24 @@ void Librarian::calculateFine(Book *book) const {
  *
  * @param book Pointer to the Book object to add.
  */
-void Librarian::addNewBook(Book *book) const {
-    inventory.addBook(book);
+void Librarian::addNewBook(Book *book) {
+    MetricTimer timer(Metrics::AddBook);
+    lock_guard<mutex> guard(circulationMutex);
+    markChanged(book);
+    commitChanges();
+    {
+        unique_lock<mutex> unbuilt = holdUnbuiltFuzzyIndex();
+        Book* replaced = inventory.findBookByISBN(book->getIsbn());
+        inventory.addBook(book);
+        if(!unbuilt.owns_lock()){
+            if(replaced != nullptr && replaced != book){
+                fuzzyIndex.remove(replaced);
+            }
+            fuzzyIndex.add(book);
+        }
+    }
+    isbnIndex.insert(book);
+    catalogChanged();
 }
 
 
@@ -237,7 +540,18 @@ void Librarian::addNewBook(Book *book) const {
  * @param ISBN ISBN of the book to be removed
  */
 void Librarian::removeBookFromInventory(long long ISBN) {
-    inventory.removeBook(ISBN);
+    MetricTimer timer(Metrics::RemoveBook);
+    lock_guard<mutex> guard(circulationMutex);
+    {
+        unique_lock<mutex> unbuilt = holdUnbuiltFuzzyIndex();
+        Book* book = inventory.findBookByISBN(ISBN);
+        inventory.removeBook(ISBN);
+        if(book != nullptr && !unbuilt.owns_lock()){
+            fuzzyIndex.remove(book);
+        }
+    }
+    isbnIndex.erase(ISBN);
+    catalogChanged();
 }
 
 /**
@@ -247,53 +561,345 @@ void Librarian::removeBookFromInventory(long long ISBN) {
  *
  * @param book Pointer to the Book object to remove.
  */
-void Librarian::removeBookFromInventory(Book *book) const {
-    inventory.removeBook(book);
+void Librarian::removeBookFromInventory(Book *book) {
+    MetricTimer timer(Metrics::RemoveBook);
+    lock_guard<mutex> guard(circulationMutex);
+    {
+        unique_lock<mutex> unbuilt = holdUnbuiltFuzzyIndex();
+        inventory.removeBook(book);
+        if(!unbuilt.owns_lock()){
+            fuzzyIndex.remove(book);
+        }
+    }
+    isbnIndex.erase(book->getIsbn());
+    catalogChanged();
 }
 
 /**
  * @brief Lists all books in the inventory.
  *
- * Prints all books in the inventory to the console.
+ * Prints all books in the inventory to the console, as of a snapshot taken when the listing starts.
+ *
+ * @param out The stream to print to.
+ */
+void Librarian::listAllBooks(ostream &out) const {
+    MetricTimer timer(Metrics::ListAll);
+    TraceSpan span("list all books");
+    CatalogSnapshot view = snapshot();
+    view.forEachBook([&out](const Book* b, const BookVersion& state) {
+        out << b->getInfo(state) << "\n\n";
+    });
+}
+
+/**
+ * @brief Lists all checked-out books.
+ *
+ * Prints information about books that are checked out, as of a snapshot taken when the listing starts.
+ *
+ * @param out The stream to print to.
  */
-void Librarian::listAllBooks() const {
-    inventory.print();
+void Librarian::listCheckedOutBooks(ostream &out) const {
+    MetricTimer timer(Metrics::ListCheckedOut);
+    TraceSpan span("list checked out books");
+    CatalogSnapshot view = snapshot();
+    view.forEachBook([&out](const Book* b, const BookVersion& state) {
+        if(!state.available){
+            out << b->getInfo(state) << '\n';
+        }
+    });
 }
 
 /**
  * @brief Lists all overdue books.
  *
- * Prints information about books that are overdue.
+ * Prints information about books that are overdue, as of a snapshot taken when the listing starts.
+ *
+ * @param out The stream to print to.
+ */
+void Librarian::listOverdueBooks(ostream &out) const {
+    MetricTimer timer(Metrics::ListOverdue);
+    TraceSpan span("list overdue books");
+    CatalogSnapshot view = snapshot();
+    view.forEachBook([&out](const Book* b, const BookVersion& state) {
+        if(!state.available && state.daysCheckedOut < 0){
+            out << b->getInfo(state) << '\n';
+        }
+    });
+}
+
+/**
+ * @brief Lists the books with ISBNs in a range, in ISBN order.
+ *
+ * Reads the ordered ISBN index, so only the books in the range are visited. The books are printed as of a
+ * snapshot taken when the listing starts. Use `IsbnIndex::prefixRange` to list a publisher's prefix.
+ *
+ * @param first The smallest ISBN to list.
+ * @param last The largest ISBN to list.
+ * @param out The stream to print to.
+ * @return The number of books listed.
+ */
+size_t Librarian::listBooksInRange(long long first, long long last, ostream &out) const {
+    MetricTimer timer(Metrics::ListRange);
+    TraceSpan span("list isbn range");
+    CatalogSnapshot view = snapshot();
+    size_t listed = 0;
+    isbnIndex.forEachInRange(first, last, [&](const Book* b) {
+        // Books added after the snapshot was taken are left out, as in the other listings.
+        const BookVersion* state = view.stateOf(b);
+        if(state != nullptr){
+            out << b->getInfo(*state) << '\n';
+            listed++;
+        }
+    });
+    return listed;
+}
+
+/**
+ * @brief Lists one page of the books that match a query, in ISBN order, continuing where the previous page ended.
+ *
+ * A cursor holds the ISBN its page continues from, so it stays valid while books are added or removed: books
+ * added past it appear on later pages, and removals do not shift the books after it. Each page starts with one
+ * lookup in the ordered ISBN index, so its cost does not grow with the catalog. Every page reads its own
+ * snapshot, taken when the page starts.
+ *
+ * A page tests at most `PAGE_SCAN_LIMIT` books beyond `limit`, so a page of a sparse query such as
+ * `checkedout` may hold fewer books, or none, along with a cursor to carry on from.
+ *
+ * @param query The books to list; a default `CatalogQuery` lists them all.
+ * @param cursor The cursor returned with the previous page, or empty for the first page.
+ * @param limit The most books to list, at least one.
+ * @param visit The function to call with each book on the page and its state as of the page's snapshot.
+ * @param next Set to the cursor of the following page, or cleared if this page reached the end.
+ * @return false if the cursor is not valid or `limit` is zero, true otherwise.
+ */
+bool Librarian::listPage(const CatalogQuery &query, const string &cursor, size_t limit,
+                         const function<void(const Book *, const BookVersion &)> &visit, string &next) const {
+    MetricTimer timer(Metrics::ListPage);
+    // An empty page would hand back the cursor it was given, so a client following cursors would never finish.
+    if(limit == 0){
+        return false;
+    }
+    long long first;
+    long long last;
+    query.isbnRange(first, last);
+    if(!cursor.empty()){
+        long long resume;
+        if(!decodeCursor(cursor, resume)){
+            return false;
+        }
+        first = max(first, resume);
+    }
+    next.clear();
+    if(query.isEmpty()){
+        return true;
+    }
+    CatalogSnapshot view = snapshot();
+    size_t listed = 0;
+    size_t tested = 0;
+    isbnIndex.forEachFrom(first, last, [&](const Book* b) {
+        if(listed == limit || tested == limit + PAGE_SCAN_LIMIT){
+            // This book starts the next page.
+            next = encodeCursor(b->getIsbn());
+            return false;
+        }
+        tested++;
+        // Books added after the snapshot was taken are left out, as in the listings.
+        const BookVersion* state = view.stateOf(b);
+        if(state != nullptr && query.matches(*b, *state)){
+            visit(b, *state);
+            listed++;
+        }
+        return true;
+    });
+    return true;
+}
+
+/**
+ * @brief Finds the books that match a query, as of a snapshot taken when the query starts.
+ *
+ * If the query limits the ISBNs, only that range of the ordered ISBN index is visited, and the matches come in
+ * ISBN order. Otherwise every book is tested, in parallel on the shared `TaskScheduler`, and the matches are
+ * passed on in inventory order once the scan is done. Results of up to `CACHED_QUERY_RESULTS` books are kept
+ * in the search cache, so a repeated query only reads the states of its matches.
+ *
+ * @param query The compiled query.
+ * @param visit The function to call with each matching book and its state as of the snapshot.
+ * @return The number of matches.
  */
-void Librarian::listOverdueBooks() const {
-    for(auto i : checkOut){
-        if(i->getDaysCheckedOut() < 0 ){
-            cout << i->getInfo() << endl;
+size_t Librarian::queryBooks(const CatalogQuery &query,
+                             const function<void(const Book *, const BookVersion &)> &visit) const {
+    MetricTimer timer(Metrics::Query);
+    TraceSpan span("query catalog");
+    // The catalog generation is read before the snapshot is taken, as in the other searches. A query that tests
+    // circulation state also depends on the snapshot's stamp; both only grow, so their sum changes when either does.
+    unsigned long long generation = catalogGeneration.load(memory_order_acquire);
+    CatalogSnapshot view = snapshot();
+    if(query.readsCirculation()){
+        generation += view.getStamp();
+    }
+    vector<const Book*> cached;
+    if(queryCache.find(query.getText(), generation, cached)){
+        size_t matched = 0;
+        for(const Book* b : cached){
+            const BookVersion* state = view.stateOf(b);
+            if(state != nullptr){
+                visit(b, *state);
+                matched++;
+            }
+        }
+        return matched;
+    }
+
+    size_t matched = 0;
+    auto pass = [&](const Book* b, const BookVersion& state) {
+        if(matched++ < CACHED_QUERY_RESULTS){
+            cached.push_back(b);
         }
+        visit(b, state);
+    };
+    long long first;
+    long long last;
+    if(query.isEmpty()){
+        // The terms contradict each other, so there is nothing to read.
+    } else if(query.isbnRange(first, last)){
+        isbnIndex.forEachInRange(first, last, [&](const Book* b) {
+            // Books added after the snapshot was taken are left out, as in the listings.
+            const BookVersion* state = view.stateOf(b);
+            if(state != nullptr && query.matches(*b, *state)){
+                pass(b, *state);
+            }
+        });
+    } else {
+        size_t chunks = static_cast<size_t>(TaskScheduler::instance().getThreadCount()) * 8;
+        vector<vector<pair<const Book*, const BookVersion*>>> found(chunks);
+        view.parallelForEachBook(chunks, [&](size_t chunk, const Book* b, const BookVersion& state) {
+            if(query.matches(*b, state)){
+                found[chunk].emplace_back(b, &state);
+            }
+        });
+        for(const auto& part : found){
+            for(const auto& match : part){
+                pass(match.first, *match.second);
+            }
+        }
+    }
+    if(matched <= CACHED_QUERY_RESULTS){
+        queryCache.store(query.getText(), generation, cached);
+    }
+    return matched;
+}
+
+/**
+ * @brief Loads the archive from a catalog CSV file, replacing any archive loaded before.
+ *
+ * The archive must not be searched while it is being loaded, so load it before the librarian is shared.
+ *
+ * @param path Path of the file, in the format the inventory is loaded from.
+ * @return true if the file was read, false otherwise.
+ */
+bool Librarian::loadArchive(const string &path) {
+    TraceSpan span("load archive");
+    return archive.load(path);
+}
+
+/**
+ * @brief Gets the archive.
+ *
+ * @return The archive, empty if none was loaded.
+ */
+const CompressedCatalog &Librarian::getArchive() const {
+    return archive;
+}
+
+/**
+ * @brief Finds the archived books that match a query, in ISBN order.
+ *
+ * @param query The compiled query.
+ * @param visit The function to call with each matching book.
+ * @return The number of matches.
+ */
+size_t Librarian::queryArchive(const CatalogQuery &query, const function<void(const ArchivedBook &)> &visit) const {
+    MetricTimer timer(Metrics::QueryArchive);
+    TraceSpan span("query archive");
+    return archive.forEachMatch(query, visit);
+}
+
+/**
+ * @brief Writes the inventory to a CSV file in the format it is loaded from.
+ *
+ * Reads a snapshot, so the file is consistent even while books circulate. The rows are formatted in
+ * parallel on the shared `TaskScheduler` and then written in one pass through an `IoBackend`.
+ *
+ * @param path Path of the file to write.
+ * @return true if the file was written, false otherwise.
+ */
+bool Librarian::exportCatalog(const string &path) const {
+    MetricTimer timer(Metrics::ExportCatalog);
+    TraceSpan span("export catalog");
+    IoBackend io;
+    int fd = io.openFile(path, true);
+    if(fd == -1){
+        return false;
     }
+    io.append(fd, "ISBN,Title,Author,Genre,PublicationYear,IsAvailable\n");
+    CatalogSnapshot view = snapshot();
+    size_t chunks = static_cast<size_t>(TaskScheduler::instance().getThreadCount()) * 8;
+    vector<string> parts(chunks);
+    view.parallelForEachBook(chunks, [&](size_t chunk, const Book* b, const BookVersion& state) {
+        string& part = parts[chunk];
+        part += to_string(b->getIsbn());
+        part += ',';
+        part += b->getTitle();
+        part += ',';
+        part += b->getAuthor();
+        part += ',';
+        part += b->getGenre();
+        part += ',';
+        part += to_string(b->getPublicationYear());
+        part += state.available ? ",true\n" : ",false\n";
+    });
+    TraceSpan writeSpan("write catalog file");
+    for(const string& part : parts){
+        io.append(fd, part);
+    }
+    return io.closeFile(fd);
 }
 
 /**
  * @brief Lists all book reservations.
  *
  * Prints information about books that are currently reserved.
+ *
+ * @param out The stream to print to.
  */
-void Librarian::listReservations() const {
-    for(auto i : reservations){
-        cout << i->getInfo() << endl;
+void Librarian::listReservations(ostream &out) const {
+    MetricTimer timer(Metrics::ListReservations);
+    TraceSpan span("list reservations");
+    lock_guard<mutex> guard(circulationMutex);
+    for(int hold = patrons.getOldestHold(); hold != -1; hold = patrons.getNewerHold(hold)){
+        out << patrons.getHoldBook(hold)->getInfo() << '\n';
     }
 }
 
 /**
  * @brief Searches for a book by its title.
  *
- * Searches the inventory for a book with the specified title.
+ * Searches the inventory for a book with the specified title. Repeated titles are answered from the search
+ * cache until a book is added or removed.
  *
  * @param title The title of the book to search for.
  * @return Pointer to the Book object if found, nullptr if not found.
  */
 Book *Librarian::searchBooks(const string &title) const {
-    return inventory.findBookByTitle(title);
+    MetricTimer timer(Metrics::SearchTitle);
+    // Read the generation before searching, so a result that raced a change is stored as already stale.
+    unsigned long long generation = catalogGeneration.load(memory_order_acquire);
+    Book* book = nullptr;
+    if(!titleCache.find(title, generation, book)){
+        book = inventory.findBookByTitle(title);
+        titleCache.store(title, generation, book);
+    }
+    return book;
 }
 
 /**
@@ -305,5 +911,507 @@ Book *Librarian::searchBooks(const string &title) const {
  * @return Pointer to the Book object if found, nullptr if not found.
  */
 Book *Librarian::searchBooks(const long long int ISBN) const {
+    MetricTimer timer(Metrics::SearchISBN);
     return inventory.findBookByISBN(ISBN);
 }
+
+/**
+ * @brief Searches titles and authors for text that may be misspelled.
+ *
+ * @param query The text to look for, such as "Catcher in the Rey".
+ * @param limit The largest number of books to return.
+ * @return The closest matches, best first. See `FuzzyIndex::search`.
+ */
+vector<FuzzyMatch> Librarian::searchFuzzy(const string &query, size_t limit) const {
+    MetricTimer timer(Metrics::SearchFuzzy);
+    unsigned long long generation = catalogGeneration.load(memory_order_acquire);
+    string key = to_string(limit) + ' ' + query;
+    vector<FuzzyMatch> matches;
+    if(!fuzzyCache.find(key, generation, matches)){
+        buildFuzzyIndex();
+        matches = fuzzyIndex.search(query, limit);
+        fuzzyCache.store(key, generation, matches);
+    }
+    return matches;
+}
+
+/**
+ * @brief Gets the hit and miss counters of the title, fuzzy and query search caches.
+ *
+ * @return The counters, summed over the caches.
+ */
+SearchCacheStats Librarian::searchCacheStats() const {
+    SearchCacheStats total = {0, 0, 0, 0};
+    for(const SearchCacheStats& stats : {titleCache.stats(), fuzzyCache.stats(), queryCache.stats()}){
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.entries += stats.entries;
+        total.capacity += stats.capacity;
+    }
+    return total;
+}
+
+/**
+ * @brief Clears the hit and miss counters of the search caches, keeping the cached results.
+ */
+void Librarian::resetSearchCacheStats() {
+    titleCache.resetStats();
+    fuzzyCache.resetStats();
+    queryCache.resetStats();
+}
+
+/**
+ * @brief Registers a new patron.
+ *
+ * @return The ID of the new patron.
+ */
+PatronId Librarian::registerPatron() {
+    MetricTimer timer(Metrics::RegisterPatron);
+    lock_guard<mutex> guard(circulationMutex);
+    return patrons.addPatron();
+}
+
+/**
+ * @brief Lists a patron's loans, holds and fines.
+ *
+ * @param patron The ID of the patron.
+ * @param out The stream to print to.
+ */
+void Librarian::listPatronAccount(PatronId patron, ostream &out) const {
+    MetricTimer timer(Metrics::PatronAccount);
+    TraceSpan span("list patron account");
+    lock_guard<mutex> guard(circulationMutex);
+    if(!patrons.isPatron(patron)){
+        out << "No patron with ID " << patron << ".\n";
+        return;
+    }
+    patrons.print(patron, out);
+}
+
+/**
+ * @brief Takes a point-in-time snapshot of the inventory and its circulation state.
+ *
+ * The snapshot takes no locks and does not block circulation changes made while it is alive.
+ *
+ * @return The snapshot.
+ */
+CatalogSnapshot Librarian::snapshot() const {
+    return {inventory, reclaimer, publishedStamp};
+}
+
+/**
+ * @brief Gets the patron accounts.
+ *
+ * @return Reference to the patron store.
+ */
+const PatronStore &Librarian::getPatrons() const {
+    return patrons;
+}
+
+/**
+ * @brief Gets the book inventory. Lookups and scans of the inventory are safe from any thread.
+ *
+ * @return Reference to the inventory.
+ */
+const Inventory &Librarian::getInventory() const {
+    return inventory;
+}
+
+/**
+ * @brief Counts the books that are checked out.
+ *
+ * @return The number of checked-out books.
+ */
+size_t Librarian::countCheckedOut() const {
+    lock_guard<mutex> guard(circulationMutex);
+    return checkOut.size();
+}
+
+/**
+ * @brief Counts the holds waiting in the reservation queue.
+ *
+ * @return The number of holds.
+ */
+size_t Librarian::countReservations() const {
+    lock_guard<mutex> guard(circulationMutex);
+    return patrons.countHolds();
+}
+
+/**
+ * @brief Counts a string's heap block, if it has one, in a usage row.
+ *
+ * @param s The string.
+ * @param usage The row to add to.
+ */
+static void addStringHeap(const string& s, MemoryUsage& usage) {
+    // Short strings are stored inside the string object, which is part of the book's fixed fields.
+    const char* data = s.data();
+    if(data >= reinterpret_cast<const char*>(&s) && data < reinterpret_cast<const char*>(&s + 1)){
+        return;
+    }
+    usage.bytes += s.capacity() + 1;
+    usage.allocations++;
+    usage.totalAllocations++;
+}
+
+/**
+ * @brief Measures the memory held by the catalog.
+ *
+ * The books are measured by walking a snapshot: their fixed fields, and the heap blocks of titles, authors
+ * and genres too long to be stored inside the string itself. The other rows are the process-wide
+ * `MemoryAccounting` counters of the containers and book versions.
+ *
+ * @return One row per kind of memory.
+ */
+vector<MemoryUsage> Librarian::memoryUsage() const {
+    MemoryUsage books = {"book fixed fields", 0, 0, 0};
+    MemoryUsage titles = {"book title heap", 0, 0, 0};
+    MemoryUsage authors = {"book author heap", 0, 0, 0};
+    MemoryUsage genres = {"book genre heap", 0, 0, 0};
+    CatalogSnapshot view = snapshot();
+    view.forEachBook([&](const Book* b, const BookVersion&) {
+        books.bytes += sizeof(Book);
+        books.allocations++;
+        books.totalAllocations++;
+        // Asking a lazily loaded book for its details would read them, so only count those already in memory.
+        if(b->hasDetails()){
+            addStringHeap(b->getTitle(), titles);
+            addStringHeap(b->getAuthor(), authors);
+            addStringHeap(b->getGenre(), genres);
+        }
+    });
+    vector<MemoryUsage> rows = {books, titles, authors, genres};
+    for(int c = 0; c < MemoryAccounting::CATEGORY_COUNT; c++){
+        rows.push_back(MemoryAccounting::usage(static_cast<MemoryAccounting::Category>(c)));
+    }
+    return rows;
+}
+
+/**
+ * @brief Checks out a book to a patron, with `circulationMutex` already held.
+ *
+ * Places a hold instead if the book is already checked out.
+ *
+ * @param b Pointer to the book to check out, or nullptr if it was not found.
+ * @param patron The ID of the borrowing patron, or 0 for none.
+ * @return What was done: `Ok` if the book was loaned, `Reserved` if a hold was placed, or why neither was.
+ */
+CirculationResult Librarian::checkoutLocked(Book *b, PatronId patron) {
+    if(b == nullptr){
+        return CirculationResult::NotFound;
+    }
+    if(!b->isAvailable()){
+        return reserveLocked(b, patron) ? CirculationResult::Reserved : CirculationResult::HoldLimitReached;
+    }
+    if(!patrons.canBorrow(patron)){
+        return CirculationResult::LimitReached;
+    }
+    loanBook(b, patron);
+    return CirculationResult::Ok;
+}
+
+/**
+ * @brief Places a hold on a book for a patron, with `circulationMutex` already held.
+ *
+ * Does nothing if the patron is at its hold limit.
+ *
+ * @param b Pointer to the book to reserve.
+ * @param patron The ID of the patron placing the hold, or 0 for none.
+ * @return true if the hold was placed, false if the patron is at its hold limit.
+ */
+bool Librarian::reserveLocked(Book *b, PatronId patron) {
+    if(!patrons.canHold(patron)){
+        return false;
+    }
+    patrons.addHold(patron, b);
+    return true;
+}
+
+/**
+ * @brief Parses one line of the catalog CSV file into a book.
+ *
+ * @param line The line, with the ISBN, title, author, genre, publication year and availability.
+ * @return Pointer to a new Book, or nullptr if the line is not a valid row.
+ */
+Book *Librarian::parseBook(string_view line) {
+    stringstream ss{string(line)};
+    vector<string> fields;
+    string temp;
+    while(getline(ss,temp,',')){
+        fields.push_back(temp);
+    }
+    if(fields.size() != 6){
+        return nullptr;
+    }
+    try {
+        long long ISBN = LibraryHash::formatISBN(fields[0]);
+        short pubYear = static_cast<short>(stoi(fields[4]));
+        string boolTemp = fields[5];
+        transform(boolTemp.begin(), boolTemp.end(), boolTemp.begin(), ::tolower);
+        bool isAvailable = (boolTemp == "true");
+        return new Book(fields[1], fields[2], fields[3], pubYear, ISBN, isAvailable);
+    } catch (const exception&) {
+        return nullptr;
+    }
+}
+
+/**
+ * @brief Parses the ISBN, publication year and availability of a line of a mapped catalog file into a book that
+ *        reads the rest of the line when it is needed.
+ *
+ * Accepts the same rows as `parseBook`, but only the first, fifth and sixth fields are copied out of the file.
+ *
+ * @param file The mapped file.
+ * @param line The line, which must be part of the file's contents.
+ * @return Pointer to a new Book, or nullptr if the line is not a valid row.
+ */
+Book *Librarian::parseBookLazily(const CatalogFile &file, string_view line) {
+    // Split where getline would: a trailing comma ends the last field rather than starting an empty one.
+    string_view fields[6];
+    size_t count = 0;
+    size_t start = 0;
+    while(start < line.size()){
+        size_t end = min(line.find(',', start), line.size());
+        if(count == 6){
+            return nullptr;
+        }
+        fields[count++] = line.substr(start, end - start);
+        start = end + 1;
+    }
+    if(count != 6){
+        return nullptr;
+    }
+    try {
+        string isbnText(fields[0]);
+        long long ISBN = LibraryHash::formatISBN(isbnText);
+        short pubYear = static_cast<short>(stoi(string(fields[4])));
+        string boolTemp(fields[5]);
+        transform(boolTemp.begin(), boolTemp.end(), boolTemp.begin(), ::tolower);
+        bool isAvailable = (boolTemp == "true");
+        return new Book(&file, static_cast<uint64_t>(line.data() - file.getText().data()), pubYear, ISBN,
+                        isAvailable);
+    } catch (const exception&) {
+        return nullptr;
+    }
+}
+
+/**
+ * @brief Marks an available book as checked out to a patron.
+ *
+ * @param b Pointer to the book to check out.
+ * @param patron The ID of the borrowing patron, or 0 for none.
+ */
+void Librarian::loanBook(Book *b, PatronId patron) {
+    b->setDaysCheckedOut(10);
+    b->setFine(0);
+    b->setIsAvailable(false);
+    addToCheckOut(b);
+    patrons.linkLoan(patron, b);
+    markChanged(b);
+}
+
+/**
+ * @brief Marks a checked-out book as available without processing reservations.
+ *
+ * @param book Pointer to the book being returned.
+ * @return true if the book was checked out, false otherwise.
+ */
+bool Librarian::releaseBook(Book *book) {
+    if(book->getCheckOutSlot() == -1){
+        return false;
+    }
+    book->setIsAvailable(true);
+    removeFromCheckOut(book);
+    patrons.unlinkLoan(book);
+    markChanged(book);
+    return true;
+}
+
+/**
+ * @brief Resolves a batch of ISBNs to books in inventory slot order.
+ *
+ * Sorts the positions of `ISBNs` by inventory slot, marks repeated ISBNs as `Duplicate` in `results`,
+ * and prefetches the slots and then the books before returning them.
+ *
+ * @param ISBNs The ISBNs of the batch.
+ * @param results The per-item results, sized to match `ISBNs`. Duplicates are filled in.
+ * @return Pairs of a position in `ISBNs` and its book (nullptr if not found), for the unique ISBNs only.
+ */
+vector<pair<size_t, Book*>> Librarian::resolveBatch(const vector<long long> &ISBNs,
+                                                     vector<CirculationResult> &results) const {
+    vector<tuple<int, long long, size_t>> order;
+    order.reserve(ISBNs.size());
+    for(size_t i = 0; i < ISBNs.size(); i++){
+        order.emplace_back(inventory.slotOf(ISBNs[i]), ISBNs[i], i);
+    }
+    // Sorting by slot, then ISBN, then position keeps equal ISBNs adjacent with their first occurrence in front.
+    sort(order.begin(), order.end());
+
+    vector<pair<size_t, Book*>> batch;
+    batch.reserve(order.size());
+    for(size_t i = 0; i < order.size(); i++){
+        size_t pos = get<2>(order[i]);
+        if(i > 0 && get<1>(order[i - 1]) == get<1>(order[i])){
+            results[pos] = CirculationResult::Duplicate;
+            continue;
+        }
+        inventory.prefetchISBN(ISBNs[pos]);
+        batch.emplace_back(pos, nullptr);
+    }
+    for(auto& item : batch){
+        item.second = inventory.findBookByISBN(ISBNs[item.first]);
+        if(item.second != nullptr){
+            __builtin_prefetch(item.second);
+        }
+    }
+    return batch;
+}
+
+/**
+ * @brief Records that a book's circulation state changed in the update in progress.
+ *
+ * @param book Pointer to the changed book.
+ */
+void Librarian::markChanged(Book *book) {
+    changedBooks.push_back(book);
+}
+
+/**
+ * @brief Publishes the changes recorded by `markChanged` to snapshots under one new commit stamp.
+ *
+ * Old versions that no open snapshot can read any more are handed to the reclaimer.
+ */
+void Librarian::commitChanges() {
+    if(changedBooks.empty()){
+        return;
+    }
+    unsigned long long stamp = publishedStamp.load(memory_order_relaxed) + 1;
+    unsigned long long oldest = reclaimer.oldestPinnedStamp(stamp - 1);
+    vector<BookVersion*> unlinked;
+    if(changedBooks.size() < 4096){
+        for(Book* b : changedBooks){
+            unlinked.push_back(b->publishVersion(stamp, oldest));
+        }
+    } else {
+        // Large updates such as the overdue run are published in parallel, which needs each book only once.
+        TraceSpan publishSpan("publish versions");
+        sort(changedBooks.begin(), changedBooks.end());
+        changedBooks.erase(unique(changedBooks.begin(), changedBooks.end()), changedBooks.end());
+        unlinked.resize(changedBooks.size());
+        TaskScheduler::instance().parallelFor(0, changedBooks.size(), 4096, [&](size_t first, size_t last) {
+            for(size_t i = first; i < last; i++){
+                unlinked[i] = changedBooks[i]->publishVersion(stamp, oldest);
+            }
+        });
+    }
+    for(BookVersion* v : unlinked){
+        while(v != nullptr){
+            BookVersion* next = v->older.load(memory_order_relaxed);
+            reclaimer.retire(v, [](void* p) { delete static_cast<BookVersion*>(p); });
+            v = next;
+        }
+    }
+    changedBooks.clear();
+    publishedStamp.store(stamp, memory_order_release);
+    reclaimer.collect();
+}
+
+/**
+ * @brief Adds a book to the end of the `checkOut` list and records its position in the book.
+ *
+ * @param book Pointer to the book that was checked out.
+ */
+void Librarian::addToCheckOut(Book *book) {
+    book->setCheckOutSlot(static_cast<int>(checkOut.size()));
+    checkOut.push_back(book);
+}
+
+/**
+ * @brief Removes a book from the `checkOut` list by moving the last entry into its position.
+ *
+ * @param book Pointer to the book that was returned.
+ */
+void Librarian::removeFromCheckOut(Book *book) {
+    int slot = book->getCheckOutSlot();
+    Book* last = checkOut.back();
+    checkOut[slot] = last;
+    last->setCheckOutSlot(slot);
+    checkOut.pop_back();
+    book->setCheckOutSlot(-1);
+}
+
+/**
+ * @brief Makes every cached search result stale. Called after a book is added or removed.
+ *
+ * The bump is released after the change, so a search that reads the new generation also sees the change.
+ */
+void Librarian::catalogChanged() {
+    catalogGeneration.fetch_add(1, memory_order_release);
+}
+
+/**
+ * @brief Encodes the ISBN a page continues from as an opaque cursor.
+ *
+ * @param ISBN The first ISBN of the next page.
+ * @return The cursor.
+ */
+string Librarian::encodeCursor(const long long ISBN) {
+    char digits[17];
+    auto end = to_chars(digits, digits + sizeof(digits), ISBN, 16).ptr;
+    return 'c' + string(digits, end);
+}
+
+/**
+ * @brief Decodes a cursor made by `encodeCursor`.
+ *
+ * @param cursor The cursor.
+ * @param ISBN Set to the first ISBN of the page.
+ * @return true if the cursor was valid, false otherwise.
+ */
+bool Librarian::decodeCursor(string_view cursor, long long &ISBN) {
+    if(cursor.size() < 2 || cursor.front() != 'c'){
+        return false;
+    }
+    auto result = from_chars(cursor.data() + 1, cursor.data() + cursor.size(), ISBN, 16);
+    return result.ec == errc() && result.ptr == cursor.data() + cursor.size() && ISBN >= 0;
+}
+
+/**
+ * @brief Builds the fuzzy index from the inventory, unless it has been built already.
+ *
+ * A librarian that loaded its details lazily defers the index to the first fuzzy search, since indexing reads
+ * every title and author. Once built, the index is updated by every book added or removed.
+ */
+void Librarian::buildFuzzyIndex() const {
+    if(fuzzyIndexBuilt.load(memory_order_acquire)){
+        return;
+    }
+    lock_guard<mutex> guard(fuzzyIndexMutex);
+    if(fuzzyIndexBuilt.load(memory_order_relaxed)){
+        return;
+    }
+    TraceSpan span("build fuzzy index");
+    vector<Book*> books;
+    inventory.forEachBook([&books](Book* b) {
+        books.push_back(b);
+    });
+    fuzzyIndex.addAll(books);
+    fuzzyIndexBuilt.store(true, memory_order_release);
+}
+
+/**
+ * @brief Locks `fuzzyIndexMutex` if the fuzzy index is still to be built, so that a book added or removed
+ *        meanwhile is either in the inventory the index is built from or updated in the built index, not both.
+ *
+ * @return The lock, which owns nothing if the index is built.
+ */
+unique_lock<mutex> Librarian::holdUnbuiltFuzzyIndex() const {
+    unique_lock<mutex> guard;
+    if(!fuzzyIndexBuilt.load(memory_order_acquire)){
+        guard = unique_lock<mutex>(fuzzyIndexMutex);
+        if(fuzzyIndexBuilt.load(memory_order_relaxed)){
+            guard.unlock();
+        }
+    }
+    return guard;
+}
@@ -5,9 +5,44 @@
 #ifndef LIBRARYMANAGEMENT_LIBRARIAN_H
 #define LIBRARYMANAGEMENT_LIBRARIAN_H
 
+#include "CatalogFile.h"
+#include "CatalogQuery.h"
+#include "CatalogSnapshot.h"
+#include "CompressedCatalog.h"
+#include "EpochReclaimer.h"
+#include "FuzzyIndex.h"
 #include "Inventory.h"
+#include "IsbnIndex.h"
+#include "MemoryAccounting.h"
+#include "PatronStore.h"
+#include "SearchCache.h"
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string_view>
 #include <vector>
 
+/**
+ * @brief Outcome of one item of a batch circulation request.
+ */
+enum class CirculationResult {
+    Ok, ///< The operation was applied.
+    Reserved, ///< The book was already checked out, so a hold was placed instead.
+    NotFound, ///< No book with the ISBN is in the inventory.
+    NotCheckedOut, ///< The book could not be returned or renewed because it is not checked out.
+    LimitReached, ///< The patron is at its loan limit.
+    HoldLimitReached, ///< The book was already checked out and the patron is at its hold limit, so no hold was placed.
+    Duplicate ///< The ISBN appeared earlier in the same batch, which is the occurrence that was applied.
+};
+
+/**
+ * @brief When a librarian reads the title, author and genre of the books in its catalog file.
+ */
+enum class DetailLoading {
+    Eager, ///< All of them while the catalog loads.
+    Lazy ///< Each book's the first time they are asked for, from the mapped catalog file.
+};
+
 /**
  * @class Librarian
  * @brief Manages the library's book inventory, checkout system, reservations, and overdue books.
@@ -16,6 +51,26 @@
  * out books, returning them, managing reservations, processing overdue books, and calculating fines.
  * It also allows searching, adding, and removing books from the library's inventory.
  * The class tracks the availability of books and ensures that books are properly checked out or reserved.
+ *
+ * A single librarian may be shared by many threads. Searches and inventory listings read the inventory
+ * without locking. Circulation changes (checkouts, returns, holds, renewals and fines) hold `circulationMutex`
+ * for their whole update, so each one is atomic with respect to the others.
+ *
+ * Every circulation update is published under a new commit stamp once it is complete. Reports read a
+ * `CatalogSnapshot` at one stamp instead of the live books, so they see a consistent state without
+ * taking any locks, and old versions are freed through an `EpochReclaimer` once no snapshot needs them.
+ *
+ * Title and fuzzy searches are answered from a `SearchCache` when the same query was run since the catalog last
+ * changed. Adding or removing a book bumps `catalogGeneration`, which makes every cached result stale at once.
+ * Small results of `queryBooks` are cached the same way, and those of queries that test circulation state are
+ * also made stale by every published circulation update.
+ *
+ * Loaded with `DetailLoading::Lazy`, a librarian keeps its catalog file mapped and only parses each row's ISBN, year
+ * and availability at startup; see `Book`. The fuzzy index, which needs every title and author, is then built by
+ * the first fuzzy search.
+ *
+ * A librarian may also hold an archive: a cold collection kept in a read-only `CompressedCatalog` next to the
+ * inventory. Archived books cannot circulate, but `queryArchive` searches them with the same queries.
  */
 
 class Librarian {
@@ -28,6 +83,21 @@ public:
      */
     Librarian();
 
+    /**
+     * @brief Constructs a Librarian and loads the book inventory from a CSV file.
+     *
+     * The file is read with an `IoBackend`, then its lines are parsed into Book objects and added to the
+     * inventory in parallel on the shared `TaskScheduler`. Books that are not available are tracked as checked out.
+     *
+     * With `DetailLoading::Lazy` the file is mapped instead of read, and the books are made without their title,
+     * author and genre, which they read from the mapping when first asked. The file must not change while the
+     * librarian exists.
+     *
+     * @param catalogPath Path of the CSV file to load.
+     * @param loading When to read the books' title, author and genre.
+     */
+    explicit Librarian(const std::string& catalogPath, DetailLoading loading = DetailLoading::Eager);
+
     /**
      * @brief Checks out a book by its ISBN.
      *
@@ -46,10 +116,52 @@ public:
      * If the book is already checked out, it reserves the book instead.
      *
      * @param b Pointer to the Book object to check out.
-     * @param ISBN ISBN of the book to check out.
      * @return Pointer to the checked-out book, or nullptr if the book is reserved instead.
      */
-    Book* checkoutBook(Book* b, long long ISBN);
+    Book* checkoutBook(Book* b);
+
+    /**
+     * @brief Checks out a book by its ISBN to a patron.
+     *
+     * Links the book into the patron's loan list. If the book is already checked out, a hold is placed
+     * for the patron instead. Nothing happens if the patron is at its loan limit.
+     *
+     * @param ISBN The ISBN of the book to check out.
+     * @param patron The ID of the borrowing patron, or 0 for none.
+     * @return Pointer to the checked-out book, or nullptr if the book was reserved or could not be loaned.
+     */
+    Book* checkoutBook(long long ISBN, PatronId patron);
+
+    /**
+     * @brief Checks out a batch of books, such as one scanned at a self-checkout kiosk.
+     *
+     * Each ISBN is handled like `checkoutBook(ISBN, patron)`. The ISBNs are sorted by inventory slot and
+     * deduplicated, and the slots are prefetched before any book is checked out.
+     *
+     * @param ISBNs The ISBNs of the books to check out.
+     * @param patron The ID of the borrowing patron, or 0 for none.
+     * @return The result of each ISBN, in the same order as `ISBNs`.
+     */
+    std::vector<CirculationResult> checkoutBooks(const std::vector<long long>& ISBNs, PatronId patron = 0);
+
+    /**
+     * @brief Returns a batch of books, such as one emptied from a book drop.
+     *
+     * Each returned book goes to the first patron in its hold queue who may borrow another book, as in `returnBook`.
+     *
+     * @param ISBNs The ISBNs of the books to return.
+     * @return The result of each ISBN, in the same order as `ISBNs`.
+     */
+    std::vector<CirculationResult> returnBooks(const std::vector<long long>& ISBNs);
+
+    /**
+     * @brief Renews a batch of checked-out books.
+     *
+     * @param ISBNs The ISBNs of the books to renew.
+     * @param days The number of days to set the checkout period of each book to.
+     * @return The result of each ISBN, in the same order as `ISBNs`.
+     */
+    std::vector<CirculationResult> renewBooks(const std::vector<long long>& ISBNs, int days);
 
     /**
      * @brief Returns a book by its ISBN.
@@ -63,7 +175,8 @@ public:
     /**
      * @brief Returns a checked-out book to the inventory.
      *
-     * Sets the book's availability to true and processes any reservations for the book.
+     * Sets the book's availability to true and loans it to the first patron in its hold queue who may borrow
+     * another book. Only that book's queue is read, so a return costs the same however many holds are waiting.
      *
      * @param book Pointer to the Book object to return.
      */
@@ -78,10 +191,20 @@ public:
      */
     void reserveBook(long long ISBN);
 
+    /**
+     * @brief Reserves a book by its ISBN for a patron.
+     *
+     * Places a hold for the patron unless the patron is at its hold limit.
+     *
+     * @param ISBN The ISBN of the book to reserve.
+     * @param patron The ID of the patron placing the hold, or 0 for none.
+     */
+    void reserveBook(long long ISBN, PatronId patron);
+
     /**
      * @brief Cancels the reservation for a book by its ISBN.
      *
-     * Removes the book from the reservation list.
+     * Removes every hold in the book's hold queue.
      *
      * @param ISBN The ISBN of the book whose reservation to cancel.
      */
@@ -90,7 +213,8 @@ public:
     /**
      * @brief Processes all reservations for books.
      *
-     * Checks out any reserved books that are now available.
+     * Checks out any reserved books that are now available, oldest hold first. Returns fill holds as they happen,
+     * so this only finds holds placed on books that were already available, or whose patron was at the loan limit.
      */
     void processReservations();
 
@@ -102,25 +226,28 @@ public:
      * @param ISBN The ISBN of the book to renew.
      * @param days The number of days to extend the checkout period.
      */
-    void renewBook(long long ISBN, int days) const;
+    void renewBook(long long ISBN, int days);
 
     /**
      * @brief Processes overdue books and calculates fines.
      *
      * Reduces the number of days checked out for each book and calculates any fines for overdue books.
+     * The checked-out books are processed in parallel on the shared `TaskScheduler`.
      *
      * @param days The number of days the overdue books are behind.
      */
-    void processOverdueBooks(int days) const;
+    void processOverdueBooks(int days);
 
     /**
      * @brief Calculates the fine for a book based on how many days it is overdue.
      *
      * If the book is overdue, it calculates the fine by multiplying the negative number of days by 10.
      *
+     * The change in the fine is also applied to the borrowing patron's fine total.
+     *
      * @param book Pointer to the Book object for which to calculate the fine.
      */
-    void calculateFine(Book* book) const;
+    void calculateFine(Book* book);
 
     /**
      * @brief Adds a new book to the inventory.
@@ -129,7 +256,7 @@ public:
      *
      * @param book Pointer to the Book object to add.
      */
-    void addNewBook(Book* book) const;
+    void addNewBook(Book* book);
 
     /**
 	* @brief Removes a book from the inventory.
@@ -147,33 +274,152 @@ public:
      *
      * @param book Pointer to the Book object to remove.
      */
-    void removeBookFromInventory(Book* book) const;
+    void removeBookFromInventory(Book* book);
 
     /**
      * @brief Lists all books in the inventory.
      *
-     * Prints all books in the inventory to the console.
+     * Prints all books in the inventory to the console, as of a snapshot taken when the listing starts.
+     *
+     * @param out The stream to print to.
      */
-    void listAllBooks() const;
+    void listAllBooks(std::ostream& out = std::cout) const;
+
+    /**
+     * @brief Lists all checked-out books.
+     *
+     * Prints information about books that are checked out, as of a snapshot taken when the listing starts.
+     *
+     * @param out The stream to print to.
+     */
+    void listCheckedOutBooks(std::ostream& out = std::cout) const;
 
     /**
      * @brief Lists all overdue books.
      *
-     * Prints information about books that are overdue.
+     * Prints information about books that are overdue, as of a snapshot taken when the listing starts.
+     *
+     * @param out The stream to print to.
      */
-    void listOverdueBooks() const;
+    void listOverdueBooks(std::ostream& out = std::cout) const;
+
+    /**
+     * @brief Lists the books with ISBNs in a range, in ISBN order.
+     *
+     * Reads the ordered ISBN index, so only the books in the range are visited. The books are printed as of a
+     * snapshot taken when the listing starts. Use `IsbnIndex::prefixRange` to list a publisher's prefix.
+     *
+     * @param first The smallest ISBN to list.
+     * @param last The largest ISBN to list.
+     * @param out The stream to print to.
+     * @return The number of books listed.
+     */
+    size_t listBooksInRange(long long first, long long last, std::ostream& out = std::cout) const;
+
+    /**
+     * @brief Lists one page of the books that match a query, in ISBN order, continuing where the previous page ended.
+     *
+     * A cursor holds the ISBN its page continues from, so it stays valid while books are added or removed: books
+     * added past it appear on later pages, and removals do not shift the books after it. Each page starts with one
+     * lookup in the ordered ISBN index, so its cost does not grow with the catalog. Every page reads its own
+     * snapshot, taken when the page starts.
+     *
+     * A page tests at most `PAGE_SCAN_LIMIT` books beyond `limit`, so a page of a sparse query such as
+     * `checkedout` may hold fewer books, or none, along with a cursor to carry on from.
+     *
+     * @param query The books to list; a default `CatalogQuery` lists them all.
+     * @param cursor The cursor returned with the previous page, or empty for the first page.
+     * @param limit The most books to list, at least one.
+     * @param visit The function to call with each book on the page and its state as of the page's snapshot.
+     * @param next Set to the cursor of the following page, or cleared if this page reached the end.
+     * @return false if the cursor is not valid or `limit` is zero, true otherwise.
+     */
+    bool listPage(const CatalogQuery& query, const std::string& cursor, size_t limit,
+                  const std::function<void(const Book*, const BookVersion&)>& visit, std::string& next) const;
+
+    /**
+     * @brief Encodes the ISBN a page continues from as an opaque cursor.
+     *
+     * @param ISBN The first ISBN of the next page.
+     * @return The cursor.
+     */
+    static std::string encodeCursor(long long ISBN);
+
+    /**
+     * @brief Decodes a cursor made by `encodeCursor`.
+     *
+     * @param cursor The cursor.
+     * @param ISBN Set to the first ISBN of the page.
+     * @return true if the cursor was valid, false otherwise.
+     */
+    static bool decodeCursor(std::string_view cursor, long long& ISBN);
+
+    /**
+     * @brief Finds the books that match a query, as of a snapshot taken when the query starts.
+     *
+     * If the query limits the ISBNs, only that range of the ordered ISBN index is visited, and the matches come in
+     * ISBN order. Otherwise every book is tested, in parallel on the shared `TaskScheduler`, and the matches are
+     * passed on in inventory order once the scan is done. Results of up to `CACHED_QUERY_RESULTS` books are kept
+     * in the search cache, so a repeated query only reads the states of its matches.
+     *
+     * @param query The compiled query.
+     * @param visit The function to call with each matching book and its state as of the snapshot.
+     * @return The number of matches.
+     */
+    size_t queryBooks(const CatalogQuery& query,
+                      const std::function<void(const Book*, const BookVersion&)>& visit) const;
+
+    /**
+     * @brief Loads the archive from a catalog CSV file, replacing any archive loaded before.
+     *
+     * The archive must not be searched while it is being loaded, so load it before the librarian is shared.
+     *
+     * @param path Path of the file, in the format the inventory is loaded from.
+     * @return true if the file was read, false otherwise.
+     */
+    bool loadArchive(const std::string& path);
+
+    /**
+     * @brief Gets the archive.
+     *
+     * @return The archive, empty if none was loaded.
+     */
+    [[nodiscard]] const CompressedCatalog& getArchive() const;
+
+    /**
+     * @brief Finds the archived books that match a query, in ISBN order.
+     *
+     * @param query The compiled query.
+     * @param visit The function to call with each matching book.
+     * @return The number of matches.
+     */
+    size_t queryArchive(const CatalogQuery& query, const std::function<void(const ArchivedBook&)>& visit) const;
+
+    /**
+     * @brief Writes the inventory to a CSV file in the format it is loaded from.
+     *
+     * Reads a snapshot, so the file is consistent even while books circulate. The rows are formatted in
+     * parallel on the shared `TaskScheduler` and then written in one pass through an `IoBackend`.
+     *
+     * @param path Path of the file to write.
+     * @return true if the file was written, false otherwise.
+     */
+    bool exportCatalog(const std::string& path) const;
 
     /**
      * @brief Lists all book reservations.
      *
      * Prints information about books that are currently reserved.
+     *
+     * @param out The stream to print to.
      */
-    void listReservations() const;
+    void listReservations(std::ostream& out = std::cout) const;
 
     /**
      * @brief Searches for a book by its title.
      *
-     * Searches the inventory for a book with the specified title.
+     * Searches the inventory for a book with the specified title. Repeated titles are answered from the search
+     * cache until a book is added or removed.
      *
      * @param title The title of the book to search for.
      * @return Pointer to the Book object if found, nullptr if not found.
@@ -190,10 +436,259 @@ public:
      */
     [[nodiscard]] Book* searchBooks(long long ISBN) const;
 
+    /**
+     * @brief Searches titles and authors for text that may be misspelled.
+     *
+     * @param query The text to look for, such as "Catcher in the Rey".
+     * @param limit The largest number of books to return.
+     * @return The closest matches, best first. See `FuzzyIndex::search`.
+     */
+    [[nodiscard]] std::vector<FuzzyMatch> searchFuzzy(const std::string& query, size_t limit = 10) const;
+
+    /**
+     * @brief Gets the hit and miss counters of the title, fuzzy and query search caches.
+     *
+     * @return The counters, summed over the caches.
+     */
+    [[nodiscard]] SearchCacheStats searchCacheStats() const;
+
+    /**
+     * @brief Clears the hit and miss counters of the search caches, keeping the cached results.
+     */
+    void resetSearchCacheStats();
+
+    /**
+     * @brief Registers a new patron.
+     *
+     * @return The ID of the new patron.
+     */
+    PatronId registerPatron();
+
+    /**
+     * @brief Lists a patron's loans, holds and fines.
+     *
+     * @param patron The ID of the patron.
+     * @param out The stream to print to.
+     */
+    void listPatronAccount(PatronId patron, std::ostream& out = std::cout) const;
+
+    /**
+     * @brief Takes a point-in-time snapshot of the inventory and its circulation state.
+     *
+     * The snapshot takes no locks and does not block circulation changes made while it is alive.
+     *
+     * @return The snapshot.
+     */
+    [[nodiscard]] CatalogSnapshot snapshot() const;
+
+    /**
+     * @brief Gets the patron accounts.
+     *
+     * The store is not locked, so it should only be read while no other thread is changing circulation.
+     *
+     * @return Reference to the patron store.
+     */
+    [[nodiscard]] const PatronStore& getPatrons() const;
+
+    /**
+     * @brief Gets the book inventory. Lookups and scans of the inventory are safe from any thread.
+     *
+     * @return Reference to the inventory.
+     */
+    [[nodiscard]] const Inventory& getInventory() const;
+
+    /**
+     * @brief Counts the books that are checked out.
+     *
+     * @return The number of checked-out books.
+     */
+    [[nodiscard]] size_t countCheckedOut() const;
+
+    /**
+     * @brief Counts the holds waiting in the reservation queue.
+     *
+     * @return The number of holds.
+     */
+    [[nodiscard]] size_t countReservations() const;
+
+    /**
+     * @brief Measures the memory held by the catalog.
+     *
+     * The books are measured by walking a snapshot: their fixed fields, and the heap blocks of titles, authors
+     * and genres too long to be stored inside the string itself. The other rows are the process-wide
+     * `MemoryAccounting` counters of the containers and book versions.
+     *
+     * @return One row per kind of memory.
+     */
+    [[nodiscard]] std::vector<MemoryUsage> memoryUsage() const;
+
+    static const size_t CACHED_QUERY_RESULTS = 256; ///< Queries with more matches than this are not cached.
+    static const size_t PAGE_SCAN_LIMIT = 4096; ///< Books a page may test beyond its limit before it stops.
+
 private:
+    /**
+     * @brief Checks out a book to a patron, with `circulationMutex` already held.
+     *
+     * Places a hold instead if the book is already checked out.
+     *
+     * @param b Pointer to the book to check out, or nullptr if it was not found.
+     * @param patron The ID of the borrowing patron, or 0 for none.
+     * @return What was done: `Ok` if the book was loaned, `Reserved` if a hold was placed, or why neither was.
+     */
+    CirculationResult checkoutLocked(Book* b, PatronId patron);
+
+    /**
+     * @brief Places a hold on a book for a patron, with `circulationMutex` already held.
+     *
+     * Does nothing if the patron is at its hold limit.
+     *
+     * @param b Pointer to the book to reserve.
+     * @param patron The ID of the patron placing the hold, or 0 for none.
+     * @return true if the hold was placed, false if the patron is at its hold limit.
+     */
+    bool reserveLocked(Book* b, PatronId patron);
+
+    /**
+     * @brief Checks out reserved books that are now available, with `circulationMutex` already held.
+     */
+    void processReservationsLocked();
+
+    /**
+     * @brief Loans a returned book to the first patron in its hold queue who may borrow another book, with
+     *        `circulationMutex` already held.
+     *
+     * @param book Pointer to the returned book.
+     */
+    void fillHold(Book* book);
+
+    /**
+     * @brief Updates the fine of a book and its borrower's fine total, with `circulationMutex` already held.
+     *
+     * @param book Pointer to the Book object for which to calculate the fine.
+     */
+    void chargeFine(Book* book);
+
+    /**
+     * @brief Updates the fine of an overdue book.
+     *
+     * @param book Pointer to the Book object for which to calculate the fine.
+     * @return How much the fine went up by.
+     */
+    static int accrueFine(Book* book);
+
+    /**
+     * @brief Parses one line of the catalog CSV file into a book.
+     *
+     * @param line The line, with the ISBN, title, author, genre, publication year and availability.
+     * @return Pointer to a new Book, or nullptr if the line is not a valid row.
+     */
+    static Book* parseBook(std::string_view line);
+
+    /**
+     * @brief Parses the ISBN, publication year and availability of a line of a mapped catalog file into a book that
+     *        reads the rest of the line when it is needed.
+     *
+     * @param file The mapped file.
+     * @param line The line, which must be part of the file's contents.
+     * @return Pointer to a new Book, or nullptr if the line is not a valid row.
+     */
+    static Book* parseBookLazily(const CatalogFile& file, std::string_view line);
+
+    /**
+     * @brief Marks an available book as checked out to a patron.
+     *
+     * @param b Pointer to the book to check out.
+     * @param patron The ID of the borrowing patron, or 0 for none.
+     */
+    void loanBook(Book* b, PatronId patron);
+
+    /**
+     * @brief Marks a checked-out book as available without processing reservations.
+     *
+     * @param book Pointer to the book being returned.
+     * @return true if the book was checked out, false otherwise.
+     */
+    bool releaseBook(Book* book);
+
+    /**
+     * @brief Resolves a batch of ISBNs to books in inventory slot order.
+     *
+     * Sorts the positions of `ISBNs` by inventory slot, marks repeated ISBNs as `Duplicate` in `results`,
+     * and prefetches the slots and then the books before returning them.
+     *
+     * @param ISBNs The ISBNs of the batch.
+     * @param results The per-item results, sized to match `ISBNs`. Duplicates are filled in.
+     * @return Pairs of a position in `ISBNs` and its book (nullptr if not found), for the unique ISBNs only.
+     */
+    std::vector<std::pair<size_t, Book*>> resolveBatch(const std::vector<long long>& ISBNs,
+                                                       std::vector<CirculationResult>& results) const;
+
+    /**
+     * @brief Records that a book's circulation state changed in the update in progress.
+     *
+     * @param book Pointer to the changed book.
+     */
+    void markChanged(Book* book);
+
+    /**
+     * @brief Publishes the changes recorded by `markChanged` to snapshots under one new commit stamp.
+     *
+     * Old versions that no open snapshot can read any more are handed to the reclaimer.
+     */
+    void commitChanges();
+
+    /**
+     * @brief Adds a book to the end of the `checkOut` list and records its position in the book.
+     *
+     * @param book Pointer to the book that was checked out.
+     */
+    void addToCheckOut(Book* book);
+
+    /**
+     * @brief Removes a book from the `checkOut` list by moving the last entry into its position.
+     *
+     * @param book Pointer to the book that was returned.
+     */
+    void removeFromCheckOut(Book* book);
+
+    /**
+     * @brief Makes every cached search result stale. Called after a book is added or removed.
+     */
+    void catalogChanged();
+
+    /**
+     * @brief Builds the fuzzy index from the inventory, unless it has been built already.
+     */
+    void buildFuzzyIndex() const;
+
+    /**
+     * @brief Locks `fuzzyIndexMutex` if the fuzzy index is still to be built, so that a book added or removed
+     *        meanwhile is either in the inventory the index is built from or updated in the built index, not both.
+     *
+     * @return The lock, which owns nothing if the index is built.
+     */
+    std::unique_lock<std::mutex> holdUnbuiltFuzzyIndex() const;
+
+    using CheckOutList = std::vector<Book*, CountingAllocator<Book*, MemoryAccounting::CheckedOutList>>;
+    using ChangeList = std::vector<Book*, CountingAllocator<Book*, MemoryAccounting::ChangedBooks>>;
+
     Inventory inventory; ///< The inventory of books in the library.
-    std::vector<Book*> reservations; ///< List of books that are reserved.
-    std::vector<Book*> checkOut; ///< List of books that are checked out.
+    CatalogFile catalogFile; ///< The mapped catalog file, which lazily loaded books read their details from.
+    mutable FuzzyIndex fuzzyIndex; ///< Trigram index of titles and authors, built on first use when loading lazily.
+    mutable std::mutex fuzzyIndexMutex; ///< Held while the fuzzy index is built, and by changes that race the build.
+    mutable std::atomic<bool> fuzzyIndexBuilt; ///< Whether the fuzzy index has been built and is kept up to date.
+    IsbnIndex isbnIndex; ///< The books in ISBN order, for range and prefix listings.
+    PatronStore patrons; ///< The patron accounts, along with their loans and holds.
+    CheckOutList checkOut; ///< List of books that are checked out.
+    mutable std::mutex circulationMutex; ///< Guards `patrons`, `checkOut` and book circulation changes.
+    mutable EpochReclaimer reclaimer; ///< Frees book versions once no snapshot can read them.
+    std::atomic<unsigned long long> publishedStamp; ///< Commit stamp of the most recently published update.
+    ChangeList changedBooks; ///< Books changed by the update in progress, guarded by `circulationMutex`.
+    std::atomic<unsigned long long> catalogGeneration; ///< Bumped after every book added or removed.
+    mutable SearchCache<Book*> titleCache; ///< Results of `searchBooks` by title, under `catalogGeneration`.
+    mutable SearchCache<std::vector<FuzzyMatch>> fuzzyCache; ///< Results of `searchFuzzy`, under `catalogGeneration`.
+    mutable SearchCache<std::vector<const Book*>> queryCache; ///< Small results of `queryBooks`.
+    CompressedCatalog archive; ///< The cold collection, searched by `queryArchive`.
 };
 
 #endif //LIBRARYMANAGEMENT_LIBRARIAN_H
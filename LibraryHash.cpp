@@ -12,7 +12,7 @@
  * @return Hash value
  */
 int LibraryHash::HashBook(const Book *b, const int size) {
-    return static_cast<int>(b->getIsbn()/4943)%size;
+    return ISBNToHash(b->getIsbn(), size);
 }
 
 /**
@@ -22,7 +22,10 @@ int LibraryHash::HashBook(const Book *b, const int size) {
  * @return hashmap value
  */
 int LibraryHash::ISBNToHash(const long long int ISBN, const int size) {
-    return static_cast<int>((ISBN/4943)%size);
+    // Multiplying by a large odd constant spreads consecutive ISBNs from the same publisher across the
+    // whole table, which keeps the inventory's linear probe sequences short.
+    unsigned long long mixed = static_cast<unsigned long long>(ISBN) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<int>((mixed >> 32) % static_cast<unsigned long long>(size));
 }
 
 /**
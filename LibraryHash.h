@@ -44,6 +44,26 @@ public:
      */
     static int ISBNToHash(long long ISBN, int size);
 
+    /**
+     * @brief Mixes an ISBN into a 64-bit hash whose bits are all well distributed.
+     *
+     * Unlike `ISBNToHash`, the whole result is usable, and it is independent of the inventory slot, so
+     * filters in front of the inventory do not collide along with its probe sequences.
+     *
+     * @param ISBN The ISBN of the book.
+     * @return The hash.
+     */
+    static unsigned long long mixISBN(long long ISBN) {
+        // The finalizer of MurmurHash3: every input bit affects every output bit.
+        auto h = static_cast<unsigned long long>(ISBN);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
     /**
      * @brief Formats an ISBN string to a long long integer.
      *
@@ -0,0 +1,488 @@
+#include "LibraryServer.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * @brief A stream buffer that appends everything written to it to a string.
+ */
+class StringAppender : public streambuf {
+public:
+    explicit StringAppender(string& target) : target(target) {
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (c != traits_type::eof()) {
+            target.push_back(static_cast<char>(c));
+        }
+        return c;
+    }
+
+    streamsize xsputn(const char* s, streamsize n) override {
+        target.append(s, static_cast<size_t>(n));
+        return n;
+    }
+
+private:
+    string& target;
+};
+
+/**
+ * @brief Input stops being read from a connection while this many bytes of requests and responses are buffered.
+ */
+static const size_t MAX_PENDING = 4 << 20;
+
+/**
+ * @brief Creates a listening socket for an address.
+ *
+ * @param address `host:port` or `:port` (loopback only) for TCP, or `unix:path` for a Unix domain socket.
+ * @param unixPath Set to the socket path for a Unix domain socket.
+ * @return The listening socket, non-blocking.
+ * @throws runtime_error if the address is not valid or cannot be listened on.
+ */
+int LibraryServer::listenOn(const string &address, string &unixPath) {
+    int fd;
+    if (address.rfind("unix:", 0) == 0) {
+        unixPath = address.substr(5);
+        sockaddr_un addr{};
+        if (unixPath.empty() || unixPath.size() >= sizeof(addr.sun_path)) {
+            throw runtime_error("Invalid socket path " + unixPath);
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, unixPath.c_str());
+        unlink(unixPath.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            throw runtime_error("Could not bind " + unixPath + ": " + strerror(errno));
+        }
+    } else {
+        size_t colon = address.rfind(':');
+        if (colon == string::npos) {
+            throw runtime_error("Invalid address " + address);
+        }
+        string host = address.substr(0, colon);
+        string port = address.substr(colon + 1);
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        // `:port` is only reachable from this machine; serving the network takes a host such as `0.0.0.0:port`.
+        if (host.empty()) {
+            host = "127.0.0.1";
+        }
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) {
+            throw runtime_error("Invalid address " + address);
+        }
+        fd = socket(found->ai_family, found->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, found->ai_protocol);
+        int on = 1;
+        if (fd >= 0) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        }
+        bool bound = fd >= 0 && bind(fd, found->ai_addr, found->ai_addrlen) == 0;
+        freeaddrinfo(found);
+        if (!bound) {
+            throw runtime_error("Could not bind " + address + ": " + strerror(errno));
+        }
+    }
+    if (listen(fd, SOMAXCONN) < 0) {
+        throw runtime_error("Could not listen on " + address + ": " + strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * @brief Constructs a connection's state.
+ *
+ * @param fd The connection's socket.
+ * @param librarian The librarian the connection's requests run against.
+ * @param log The log the connection's changes are recorded in, or nullptr.
+ * @param readOnly Whether the connection's requests may not change the library.
+ * @param fileWrites Whether the connection's requests may write files, as `export` does.
+ */
+LibraryServer::Connection::Connection(int fd, Librarian &librarian, CirculationLog *log, bool readOnly,
+                                      bool fileWrites)
+        : fd(fd), processor(librarian, log) {
+    processor.setReadOnly(readOnly);
+    processor.setFileWritesAllowed(fileWrites);
+}
+
+/**
+ * @brief Constructs a server and starts listening.
+ *
+ * @param async The librarian to serve, and the executor requests run on.
+ * @param address `host:port` or `:port` (loopback only) for TCP, or `unix:path` for a Unix domain socket.
+ * @param log The log changes are recorded in before they are answered, or nullptr for none.
+ * @param readOnly true to refuse requests that change the library, as on a `LogReplica`.
+ * @throws runtime_error if the address is not valid or cannot be listened on.
+ */
+LibraryServer::LibraryServer(AsyncLibrarian &async, const string &address, CirculationLog *log, bool readOnly)
+        : async(async), log(log), readOnly(readOnly), requests(0), activeRequests(0) {
+    listenFd = listenOn(address, unixPath);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    readyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    for (int fd : {listenFd, wakeFd, readyFd}) {
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+/**
+ * @brief Destructor. Waits for requests still running, then closes every connection and the listening socket.
+ */
+LibraryServer::~LibraryServer() {
+    {
+        unique_lock<mutex> guard(readyLock);
+        idle.wait(guard, [this] { return activeRequests == 0; });
+    }
+    for (auto& entry : connections) {
+        close(entry.first);
+    }
+    close(listenFd);
+    close(wakeFd);
+    close(readyFd);
+    close(epollFd);
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+    }
+}
+
+/**
+ * @brief Runs the event loop until `stop` is called.
+ */
+void LibraryServer::run() {
+    epoll_event events[128];
+    for (;;) {
+        int ready = epoll_wait(epollFd, events, 128, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                return;
+            }
+            if (fd == listenFd) {
+                acceptConnections();
+                continue;
+            }
+            if (fd == readyFd) {
+                flushAnswered();
+                continue;
+            }
+            auto found = connections.find(fd);
+            if (found == connections.end()) {
+                continue;
+            }
+            shared_ptr<Connection> c = found->second;
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN)) {
+                closeConnection(*c);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !flush(*c)) {
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                readRequests(c);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Makes `run` return. Safe to call from another thread or a signal handler.
+ */
+void LibraryServer::stop() {
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void) ignored;
+}
+
+/**
+ * @brief Gets the number of requests answered so far.
+ *
+ * @return The number of requests.
+ */
+unsigned long LibraryServer::getRequestCount() const {
+    return requests.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Accepts every pending connection.
+ */
+void LibraryServer::acceptConnections() {
+    for (;;) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        // Responses are small and sent as soon as a batch of requests is done, so don't let Nagle hold them back.
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        auto c = make_shared<Connection>(fd, async.getLibrarian(), log, readOnly,
+                                          !readOnly && !unixPath.empty());
+        epoll_event ev{};
+        ev.events = c->events;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+        connections[fd] = std::move(c);
+    }
+}
+
+/**
+ * @brief Reads from a connection and starts a coroutine to answer its complete requests.
+ *
+ * @param c The connection.
+ */
+void LibraryServer::readRequests(const shared_ptr<Connection> &c) {
+    char buffer[65536];
+    lock_guard<mutex> guard(c->lock);
+    size_t before = c->input.size();
+    for (;;) {
+        ssize_t n = read(c->fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            c->input.append(buffer, static_cast<size_t>(n));
+            if (static_cast<size_t>(n) < sizeof(buffer)) {
+                break;
+            }
+        } else if (n == 0) {
+            c->peerClosed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            closeConnectionLocked(*c);
+            return;
+        }
+    }
+
+    if (!c->busy && !c->quit && c->input.find('\n', before) != string::npos) {
+        c->busy = true;
+        {
+            lock_guard<mutex> counting(readyLock);
+            activeRequests++;
+        }
+        async.getExecutor().spawn(answer(c));
+    }
+    flushLocked(*c);
+}
+
+/**
+ * @brief Runs a connection's complete requests in order and queues their responses for the event loop.
+ *
+ * Runs until the connection has no complete request left, waiting on the executor whenever a request
+ * suspends. Only one of these runs per connection at a time, so responses keep the order of the requests.
+ *
+ * @param c The connection.
+ * @return The coroutine.
+ */
+Task<void> LibraryServer::answer(shared_ptr<Connection> c) {
+    string batch, responses, body;
+    StringAppender appender(body);
+    ostream out(&appender);
+    for (;;) {
+        {
+            lock_guard<mutex> guard(c->lock);
+            size_t end = c->input.rfind('\n');
+            if (end == string::npos || c->quit) {
+                c->busy = false;
+                break;
+            }
+            batch.assign(c->input, 0, end + 1);
+            c->input.erase(0, end + 1);
+        }
+
+        responses.clear();
+        bool quit = false;
+        size_t start = 0;
+        for (size_t end = batch.find('\n'); end != string::npos; end = batch.find('\n', start)) {
+            string_view line(batch.data() + start, end - start);
+            start = end + 1;
+            body.clear();
+            unsigned long errorsBefore = c->processor.getErrorCount();
+            if (!co_await c->processor.executeAsync(line, out, async)) {
+                quit = true;
+                break;
+            }
+            responses += c->processor.getErrorCount() == errorsBefore ? '+' : '-';
+            responses += to_string(body.size());
+            responses += '\n';
+            responses += body;
+            requests.fetch_add(1, memory_order_relaxed);
+        }
+
+        {
+            lock_guard<mutex> guard(c->lock);
+            c->output += responses;
+            c->quit = c->quit || quit;
+        }
+        markAnswered(c);
+    }
+
+    // Once idle, the connection may be waiting on this coroutine to close.
+    markAnswered(c);
+    lock_guard<mutex> counting(readyLock);
+    if (--activeRequests == 0) {
+        idle.notify_all();
+    }
+}
+
+/**
+ * @brief Queues a connection for the event loop to send its new responses, and wakes the loop.
+ *
+ * @param c The connection.
+ */
+void LibraryServer::markAnswered(const shared_ptr<Connection> &c) {
+    {
+        lock_guard<mutex> guard(readyLock);
+        answered.push_back(c);
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(readyFd, &one, sizeof(one));
+    (void) ignored;
+}
+
+/**
+ * @brief Sends the responses of every connection queued by `markAnswered`.
+ */
+void LibraryServer::flushAnswered() {
+    uint64_t count;
+    ssize_t ignored = read(readyFd, &count, sizeof(count));
+    (void) ignored;
+    vector<shared_ptr<Connection>> batch;
+    {
+        lock_guard<mutex> guard(readyLock);
+        batch.swap(answered);
+    }
+    for (const shared_ptr<Connection>& c : batch) {
+        if (c->open) {
+            flush(*c);
+        }
+    }
+}
+
+/**
+ * @brief Writes as much of a connection's pending output as the socket accepts.
+ *
+ * @param c The connection.
+ * @return false if the connection was closed, true otherwise.
+ */
+bool LibraryServer::flush(Connection &c) {
+    lock_guard<mutex> guard(c.lock);
+    return flushLocked(c);
+}
+
+/**
+ * @brief Writes as much of a connection's pending output as the socket accepts. The caller holds `c.lock`.
+ *
+ * Closes the connection once everything is written if the client sent `quit`, or closed its end and no
+ * request is still running.
+ *
+ * @param c The connection.
+ * @return false if the connection was closed, true otherwise.
+ */
+bool LibraryServer::flushLocked(Connection &c) {
+    if (!c.open) {
+        return false;
+    }
+    while (c.written < c.output.size()) {
+        ssize_t n = send(c.fd, c.output.data() + c.written, c.output.size() - c.written, MSG_NOSIGNAL);
+        if (n > 0) {
+            c.written += static_cast<size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            closeConnectionLocked(c);
+            return false;
+        }
+    }
+    if (c.written == c.output.size()) {
+        c.output.clear();
+        c.written = 0;
+        if (c.quit || (c.peerClosed && !c.busy)) {
+            closeConnectionLocked(c);
+            return false;
+        }
+    }
+    updateInterest(c);
+    return true;
+}
+
+/**
+ * @brief Updates the events a connection is registered for, depending on how much it has buffered.
+ *
+ * Writability is only watched while output is pending. Reading is paused while too much input or output
+ * is buffered, so a client that pipelines requests without reading the responses can't make the server
+ * buffer without limit. The caller holds `c.lock`.
+ *
+ * @param c The connection.
+ */
+void LibraryServer::updateInterest(Connection &c) {
+    unsigned int events = 0;
+    size_t pending = c.output.size() - c.written;
+    if (pending != 0) {
+        events |= EPOLLOUT;
+    }
+    if (!c.quit && !c.peerClosed && pending + c.input.size() < MAX_PENDING) {
+        events |= EPOLLIN;
+    }
+    if (events == c.events) {
+        return;
+    }
+    c.events = events;
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = c.fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+/**
+ * @brief Closes a connection.
+ *
+ * @param c The connection.
+ */
+void LibraryServer::closeConnection(Connection &c) {
+    lock_guard<mutex> guard(c.lock);
+    closeConnectionLocked(c);
+}
+
+/**
+ * @brief Closes a connection. The caller holds `c.lock`.
+ *
+ * A coroutine still answering the connection's requests keeps its state alive and finishes, but its
+ * responses are dropped.
+ *
+ * @param c The connection.
+ */
+void LibraryServer::closeConnectionLocked(Connection &c) {
+    if (!c.open) {
+        return;
+    }
+    c.open = false;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, c.fd, nullptr);
+    close(c.fd);
+    connections.erase(c.fd);
+}
+
+#endif //__linux__
@@ -0,0 +1,202 @@
+#ifndef LIBRARYMANAGEMENT_LIBRARYSERVER_H
+#define LIBRARYMANAGEMENT_LIBRARYSERVER_H
+
+#ifdef __linux__
+
+#include "AsyncLibrarian.h"
+#include "CommandProcessor.h"
+#include "Task.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class LibraryServer
+ * @brief Serves one librarian to many desk terminals and kiosks over a TCP or Unix domain socket.
+ *
+ * One thread runs a non-blocking epoll loop that accepts connections and reads and writes the sockets.
+ * The requests themselves run as coroutines on the `AsyncLibrarian`'s executor, one coroutine per
+ * connection with requests waiting, so a request that has to wait for the circulation lock suspends and
+ * leaves its thread to other connections.
+ *
+ * A request is one line in the `CommandProcessor` command language, such as `checkout 9780141439600 3`.
+ * Each request gets one response, in order: a header line of `+` (or `-` if the request was not a valid
+ * command) followed by the length of the body in bytes, then the body, which is the text the command
+ * printed. For example, a successful checkout is answered with `+0\n`. Clients may pipeline any number of
+ * requests without waiting for responses; the complete requests that arrive together are run in order
+ * and all their responses are sent with one write. A `quit` request closes the connection once the responses
+ * before it are sent.
+ *
+ * With a `CirculationLog`, a request that changes the library is answered only once its log record is on disk.
+ *
+ * `export` writes a file on the server's machine, so it is only accepted on a Unix domain socket, whose file
+ * permissions decide who may connect, and never on a read-only server.
+ *
+ * Only available on Linux.
+ */
+class LibraryServer {
+public:
+    /**
+     * @brief Constructs a server and starts listening.
+     *
+     * @param async The librarian to serve, and the executor requests run on.
+     * @param address `host:port` or `:port` (loopback only) for TCP, or `unix:path` for a Unix domain socket.
+     * @param log The log changes are recorded in before they are answered, or nullptr for none.
+     * @param readOnly true to refuse requests that change the library, as on a `LogReplica`.
+     * @throws runtime_error if the address is not valid or cannot be listened on.
+     */
+    LibraryServer(AsyncLibrarian& async, const string& address, CirculationLog* log = nullptr, bool readOnly = false);
+
+    /**
+     * @brief Destructor. Waits for requests still running, then closes every connection and the listening socket.
+     */
+    ~LibraryServer();
+
+    LibraryServer(const LibraryServer&) = delete;
+    LibraryServer& operator=(const LibraryServer&) = delete;
+
+    /**
+     * @brief Runs the event loop until `stop` is called.
+     */
+    void run();
+
+    /**
+     * @brief Makes `run` return. Safe to call from another thread or a signal handler.
+     */
+    void stop();
+
+    /**
+     * @brief Gets the number of requests answered so far.
+     *
+     * @return The number of requests.
+     */
+    [[nodiscard]] unsigned long getRequestCount() const;
+
+    /**
+     * @brief Creates a listening socket for an address.
+     *
+     * @param address `host:port` or `:port` (loopback only) for TCP, or `unix:path` for a Unix domain socket.
+     * @param unixPath Set to the socket path for a Unix domain socket.
+     * @return The listening socket, non-blocking.
+     * @throws runtime_error if the address is not valid or cannot be listened on.
+     */
+    static int listenOn(const string& address, string& unixPath);
+
+private:
+    /**
+     * @brief One client connection and its buffered input and output.
+     *
+     * Shared between the event loop, which reads and writes the socket, and the coroutine answering the
+     * connection's requests. The fields below `lock` are guarded by it.
+     */
+    struct Connection {
+        Connection(int fd, Librarian& librarian, CirculationLog* log, bool readOnly, bool fileWrites);
+
+        const int fd; ///< The connection's socket.
+        CommandProcessor processor; ///< Runs the connection's requests; its line numbers count this connection's requests.
+        mutex lock; ///< Guards the fields below.
+        string input; ///< Bytes read that have not been taken by the answering coroutine yet.
+        string output; ///< Responses not yet written to the socket.
+        size_t written = 0; ///< Number of bytes at the front of `output` already written.
+        bool busy = false; ///< Whether a coroutine is answering the connection's requests.
+        bool quit = false; ///< Set once `quit` is run; the connection closes when `output` is written.
+        bool peerClosed = false; ///< Set once the client closes its end; the connection closes once answered.
+        bool open = true; ///< Cleared when the connection is closed.
+        unsigned int events = EPOLLIN; ///< The epoll events the socket is registered for.
+    };
+
+    /**
+     * @brief Accepts every pending connection.
+     */
+    void acceptConnections();
+
+    /**
+     * @brief Reads from a connection and starts a coroutine to answer its complete requests.
+     *
+     * @param c The connection.
+     */
+    void readRequests(const shared_ptr<Connection>& c);
+
+    /**
+     * @brief Runs a connection's complete requests in order and queues their responses for the event loop.
+     *
+     * @param c The connection.
+     * @return The coroutine.
+     */
+    Task<void> answer(shared_ptr<Connection> c);
+
+    /**
+     * @brief Queues a connection for the event loop to send its new responses, and wakes the loop.
+     *
+     * @param c The connection.
+     */
+    void markAnswered(const shared_ptr<Connection>& c);
+
+    /**
+     * @brief Sends the responses of every connection queued by `markAnswered`.
+     */
+    void flushAnswered();
+
+    /**
+     * @brief Writes as much of a connection's pending output as the socket accepts.
+     *
+     * @param c The connection.
+     * @return false if the connection was closed, true otherwise.
+     */
+    bool flush(Connection& c);
+
+    /**
+     * @brief Writes as much of a connection's pending output as the socket accepts. The caller holds `c.lock`.
+     *
+     * @param c The connection.
+     * @return false if the connection was closed, true otherwise.
+     */
+    bool flushLocked(Connection& c);
+
+    /**
+     * @brief Updates the events a connection is registered for, depending on how much it has buffered.
+     *
+     * @param c The connection.
+     */
+    void updateInterest(Connection& c);
+
+    /**
+     * @brief Closes a connection.
+     *
+     * @param c The connection.
+     */
+    void closeConnection(Connection& c);
+
+    /**
+     * @brief Closes a connection. The caller holds `c.lock`.
+     *
+     * @param c The connection.
+     */
+    void closeConnectionLocked(Connection& c);
+
+    AsyncLibrarian& async; ///< The librarian being served.
+    CirculationLog* log; ///< The log changes are recorded in, or nullptr.
+    bool readOnly; ///< Whether requests that change the library are refused.
+    string unixPath; ///< Path of the Unix domain socket, removed on destruction, or empty for TCP.
+    int listenFd; ///< The listening socket.
+    int epollFd; ///< The epoll instance.
+    int wakeFd; ///< Eventfd written by `stop`.
+    int readyFd; ///< Eventfd written when a coroutine has responses for the event loop to send.
+    unordered_map<int, shared_ptr<Connection>> connections; ///< Open connections by socket. Only used by the event loop.
+    atomic<unsigned long> requests; ///< Number of requests answered.
+    mutex readyLock; ///< Guards `answered` and `activeRequests`.
+    vector<shared_ptr<Connection>> answered; ///< Connections with responses for the event loop to send.
+    int activeRequests; ///< Number of coroutines answering requests.
+    condition_variable idle; ///< Signalled when `activeRequests` drops to zero.
+};
+
+#endif //__linux__
+
+#endif //LIBRARYMANAGEMENT_LIBRARYSERVER_H
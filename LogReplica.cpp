@@ -0,0 +1,222 @@
+#include "LogReplica.h"
+
+#ifdef __linux__
+
+#include "Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * @brief Connects to an address.
+ *
+ * @param address `host:port` or `:port` (this machine) for TCP, or `unix:path` for a Unix domain socket.
+ * @return The connected socket, or -1 if the address is not valid or nothing accepts there.
+ */
+static int connectTo(const string& address) {
+    if (address.rfind("unix:", 0) == 0) {
+        sockaddr_un addr{};
+        string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    size_t colon = address.rfind(':');
+    if (colon == string::npos) {
+        return -1;
+    }
+    string host = address.substr(0, colon);
+    string port = address.substr(colon + 1);
+    if (host.empty()) {
+        host = "127.0.0.1";
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) {
+        return -1;
+    }
+    int fd = socket(found->ai_family, found->ai_socktype | SOCK_CLOEXEC, found->ai_protocol);
+    if (fd >= 0 && connect(fd, found->ai_addr, found->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(found);
+    if (fd >= 0) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+/**
+ * @brief Gets the current time in microseconds since the epoch, the clock the primary stamps records with.
+ *
+ * @return The time.
+ */
+static long long nowMicros() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Starts following a primary's log in the background.
+ *
+ * @param librarian The librarian to apply the log to.
+ * @param primary The address the primary's `LogShipper` listens on, `host:port` or `unix:path`.
+ */
+LogReplica::LogReplica(Librarian &librarian, const string &primary)
+        : primary(primary), applier(librarian), discard(nullptr), applied(0), primaryPosition(0), stopping(false) {
+    worker = thread(&LogReplica::loop, this);
+}
+
+/**
+ * @brief Destructor. Stops following the log.
+ */
+LogReplica::~LogReplica() {
+    stopping.store(true);
+    worker.join();
+}
+
+/**
+ * @brief Gets the number of the primary's records applied so far.
+ *
+ * @return The position of the last record applied.
+ */
+unsigned long long LogReplica::getAppliedPosition() const {
+    return applied.load();
+}
+
+/**
+ * @brief Gets the position of the last record the primary has shipped, as of its last message.
+ *
+ * @return The primary's position.
+ */
+unsigned long long LogReplica::getPrimaryPosition() const {
+    return primaryPosition.load();
+}
+
+/**
+ * @brief Body of the following thread. Connects to the primary and applies its records until stopped.
+ */
+void LogReplica::loop() {
+    bool connected = false;
+    while (!stopping.load()) {
+        int fd = connectTo(primary);
+        if (fd >= 0) {
+            string request = "follow " + to_string(applied.load()) + '\n';
+            if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+                cerr << "Following the primary at " << primary << " from record " << applied.load() << "." << endl;
+                connected = true;
+                follow(fd);
+            }
+            close(fd);
+            if (connected && !stopping.load()) {
+                cerr << "Lost the primary at " << primary << "; reconnecting." << endl;
+                connected = false;
+            }
+        }
+        for (int waited = 0; waited < RETRY_MS && !stopping.load(); waited += 20) {
+            this_thread::sleep_for(chrono::milliseconds(20));
+        }
+    }
+}
+
+/**
+ * @brief Follows the primary over one connection, until it drops or the replica stops.
+ *
+ * The socket is polled with a short timeout, so the replica notices it is being stopped while the primary is idle.
+ *
+ * @param fd The connection.
+ */
+void LogReplica::follow(int fd) {
+    string input;
+    char buffer[1 << 16];
+    while (!stopping.load()) {
+        pollfd ready{fd, POLLIN, 0};
+        int events = poll(&ready, 1, 100);
+        if (events < 0 && errno == EINTR) {
+            continue;
+        }
+        if (events < 0) {
+            return;
+        }
+        if (events == 0) {
+            continue;
+        }
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        input.append(buffer, static_cast<size_t>(n));
+        size_t start = 0;
+        for (size_t end; (end = input.find('\n', start)) != string::npos; start = end + 1) {
+            if (!apply(string_view(input.data() + start, end - start))) {
+                return;
+            }
+        }
+        input.erase(0, start);
+    }
+}
+
+/**
+ * @brief Applies one line the primary sent: a record, or a heartbeat.
+ *
+ * Records at or before the last one applied are skipped, since a reconnect may resend them. A record further ahead
+ * means one was lost, so the connection is dropped and the replica asks again from where it is.
+ *
+ * @param line The line, without its line break.
+ * @return false if the line is not valid or does not follow the last record applied, true otherwise.
+ */
+bool LogReplica::apply(string_view line) {
+    if (line.empty() || (line.front() != 'r' && line.front() != 'h')) {
+        return false;
+    }
+    bool heartbeat = line.front() == 'h';
+    line.remove_prefix(1);
+    long long position;
+    long long micros;
+    if (!CommandProcessor::parseNumber(CommandProcessor::nextToken(line), position) || position < 0 ||
+        !CommandProcessor::parseNumber(CommandProcessor::nextToken(line), micros)) {
+        return false;
+    }
+    auto at = static_cast<unsigned long long>(position);
+    if (at > primaryPosition.load()) {
+        primaryPosition.store(at);
+    }
+    if (heartbeat || at <= applied.load()) {
+        return true;
+    }
+    if (at != applied.load() + 1) {
+        return false;
+    }
+    applier.execute(line, discard);
+    applied.store(at);
+#ifndef LIBRARY_NO_STATS
+    if (micros > 0 && Metrics::countCall(Metrics::ReplicaLag)) {
+        Metrics::record(Metrics::ReplicaLag, static_cast<uint64_t>(max(nowMicros() - micros, 0LL)) * 1000);
+    }
+#endif
+    return true;
+}
+
+#endif //__linux__
@@ -0,0 +1,95 @@
+#ifndef LIBRARYMANAGEMENT_LOGREPLICA_H
+#define LIBRARYMANAGEMENT_LOGREPLICA_H
+
+#ifdef __linux__
+
+#include "CommandProcessor.h"
+#include "Librarian.h"
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+using namespace std;
+
+/**
+ * @class LogReplica
+ * @brief Keeps a librarian up to date by applying the circulation log a primary's `LogShipper` streams to it.
+ *
+ * The replica must start from the same catalog as the primary. A thread connects to the primary, asks for the
+ * records after the last one it applied, and runs each record as a command against the librarian as it arrives,
+ * so the replica's state follows the primary's a few milliseconds behind. If the connection drops, the thread
+ * reconnects every `RETRY_MS` and resumes where it stopped.
+ *
+ * The replica is meant to serve lookups, listings and reports with a read-only `LibraryServer`; the thread applying
+ * the log is then the only writer. For each record shipped live, the time from the primary shipping it to the
+ * replica applying it is recorded under `Metrics::ReplicaLag`. Only available on Linux.
+ */
+class LogReplica {
+public:
+    static const int RETRY_MS = 200; ///< How long to wait before reconnecting to the primary.
+
+    /**
+     * @brief Starts following a primary's log in the background.
+     *
+     * @param librarian The librarian to apply the log to.
+     * @param primary The address the primary's `LogShipper` listens on, `host:port` or `unix:path`.
+     */
+    LogReplica(Librarian& librarian, const string& primary);
+
+    /**
+     * @brief Destructor. Stops following the log.
+     */
+    ~LogReplica();
+
+    LogReplica(const LogReplica&) = delete;
+    LogReplica& operator=(const LogReplica&) = delete;
+
+    /**
+     * @brief Gets the number of the primary's records applied so far.
+     *
+     * @return The position of the last record applied.
+     */
+    [[nodiscard]] unsigned long long getAppliedPosition() const;
+
+    /**
+     * @brief Gets the position of the last record the primary has shipped, as of its last message.
+     *
+     * @return The primary's position.
+     */
+    [[nodiscard]] unsigned long long getPrimaryPosition() const;
+
+private:
+    /**
+     * @brief Body of the following thread. Connects to the primary and applies its records until stopped.
+     */
+    void loop();
+
+    /**
+     * @brief Follows the primary over one connection, until it drops or the replica stops.
+     *
+     * @param fd The connection.
+     */
+    void follow(int fd);
+
+    /**
+     * @brief Applies one line the primary sent: a record, or a heartbeat.
+     *
+     * @param line The line, without its line break.
+     * @return false if the line is not valid or does not follow the last record applied, true otherwise.
+     */
+    bool apply(string_view line);
+
+    string primary; ///< The primary's address.
+    CommandProcessor applier; ///< Runs the records against the librarian.
+    ostream discard; ///< Takes the records' output, of which there is none for valid changes.
+    atomic<unsigned long long> applied; ///< Position of the last record applied.
+    atomic<unsigned long long> primaryPosition; ///< Position of the last record the primary reported.
+    atomic<bool> stopping; ///< Set when the replica is being destroyed.
+    thread worker; ///< The following thread.
+};
+
+#endif //__linux__
+
+#endif //LIBRARYMANAGEMENT_LOGREPLICA_H
@@ -0,0 +1,345 @@
+#include "LogShipper.h"
+
+#ifdef __linux__
+
+#include "LibraryServer.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * @brief Gets the current time in microseconds since the epoch, the clock replicas measure their lag against.
+ *
+ * @return The time.
+ */
+static long long nowMicros() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Starts listening for replicas.
+ *
+ * @param address `host:port` or `:port` (loopback only) for TCP, or `unix:path` for a Unix domain socket.
+ * @param logPath Path of the primary's circulation log.
+ * @param replayed Number of records the log held at startup; the first record shipped comes after them.
+ * @throws runtime_error if the address is not valid or cannot be listened on.
+ */
+LogShipper::LogShipper(const string &address, const string &logPath, unsigned long long replayed)
+        : logPath(logPath), replayed(replayed), followers(0), stopping(false), distributed(replayed),
+          shipped(replayed) {
+    listenFd = LibraryServer::listenOn(address, unixPath);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    for (int fd : {listenFd, wakeFd}) {
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    worker = thread(&LogShipper::loop, this);
+}
+
+/**
+ * @brief Destructor. Stops the shipping thread and disconnects every replica.
+ */
+LogShipper::~LogShipper() {
+    stopping.store(true);
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void) ignored;
+    worker.join();
+    while (!replicas.empty()) {
+        closeReplica(replicas.begin()->first);
+    }
+    close(listenFd);
+    close(wakeFd);
+    close(epollFd);
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+    }
+}
+
+/**
+ * @brief Queues a batch of durable records for every replica.
+ *
+ * Called on the log's flusher thread, so the records are only numbered and queued here, and the shipping thread
+ * is woken to send them.
+ *
+ * @param records The records, each ending in a line break.
+ * @param last The log sequence number of the batch's last record.
+ */
+void LogShipper::ship(string_view records, unsigned long long last) {
+    auto count = static_cast<unsigned long long>(std::count(records.begin(), records.end(), '\n'));
+    unsigned long long position = replayed + last - count;
+    string stamp = ' ' + to_string(nowMicros()) + ' ';
+    string lines;
+    lines.reserve(records.size() + count * 32);
+    size_t start = 0;
+    while (start < records.size()) {
+        size_t end = records.find('\n', start);
+        lines += "r ";
+        lines += to_string(++position);
+        lines += stamp;
+        lines.append(records.substr(start, end - start + 1));
+        start = end + 1;
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        pending += lines;
+        shipped = replayed + last;
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void) ignored;
+}
+
+/**
+ * @brief Gets the number of replicas following the log.
+ *
+ * @return The number of replicas.
+ */
+size_t LogShipper::getReplicaCount() const {
+    return followers.load();
+}
+
+/**
+ * @brief Body of the shipping thread. Accepts replicas, answers their requests and sends them the log.
+ *
+ * The loop wakes at least every `HEARTBEAT_MS`, so idle replicas hear from the primary even when nothing changes.
+ */
+void LogShipper::loop() {
+    epoll_event events[64];
+    auto lastBeat = chrono::steady_clock::now();
+    while (!stopping.load()) {
+        int ready = epoll_wait(epollFd, events, 64, HEARTBEAT_MS);
+        if (ready < 0 && errno != EINTR) {
+            return;
+        }
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                uint64_t count;
+                ssize_t ignored = read(wakeFd, &count, sizeof(count));
+                (void) ignored;
+                continue;
+            }
+            if (fd == listenFd) {
+                acceptReplicas();
+                continue;
+            }
+            auto it = replicas.find(fd);
+            if (it == replicas.end()) {
+                continue;
+            }
+            if ((events[i].events & EPOLLIN) && !readRequest(fd, it->second)) {
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeReplica(fd);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flush(fd, it->second);
+            }
+        }
+        distribute();
+
+        auto now = chrono::steady_clock::now();
+        if (now - lastBeat >= chrono::milliseconds(HEARTBEAT_MS)) {
+            lastBeat = now;
+            string beat = "h " + to_string(distributed) + ' ' + to_string(nowMicros()) + '\n';
+            for (auto it = replicas.begin(); it != replicas.end();) {
+                int fd = it->first;
+                Replica& replica = it->second;
+                // Advanced first, since a failed write closes the replica.
+                ++it;
+                if (replica.following && replica.written == replica.output.size()) {
+                    replica.output += beat;
+                    flush(fd, replica);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Accepts every pending replica connection.
+ */
+void LogShipper::acceptReplicas() {
+    for (;;) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        // Records are sent as soon as they are durable, so don't let Nagle hold them back.
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+        replicas[fd] = Replica();
+    }
+}
+
+/**
+ * @brief Reads a replica's `follow` request and queues the records it has not applied from the log file.
+ *
+ * Every record shipped so far is distributed first, so the records read back from the file are exactly the ones
+ * before the replica's first live record. They are on disk, since records are only shipped once they are durable.
+ *
+ * @param fd The replica's socket.
+ * @param replica The replica.
+ * @return false if the replica was closed, true otherwise.
+ */
+bool LogShipper::readRequest(int fd, Replica &replica) {
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            if (!replica.following) {
+                replica.input.append(buffer, static_cast<size_t>(n));
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        closeReplica(fd);
+        return false;
+    }
+    if (replica.following) {
+        return true;
+    }
+    size_t end = replica.input.find('\n');
+    if (end == string::npos) {
+        if (replica.input.size() > sizeof(buffer)) {
+            closeReplica(fd);
+            return false;
+        }
+        return true;
+    }
+    string_view request(replica.input.data(), end);
+    unsigned long long from = 0;
+    if (!request.starts_with("follow ") ||
+        from_chars(request.data() + 7, request.data() + request.size(), from).ec != errc()) {
+        closeReplica(fd);
+        return false;
+    }
+    replica.input.clear();
+
+    distribute();
+    if (from > distributed) {
+        cerr << "A replica asked for record " << from << ", past the end of " << logPath << "." << endl;
+        closeReplica(fd);
+        return false;
+    }
+    ifstream file(logPath, ios::binary);
+    string line;
+    for (unsigned long long position = 0; position < distributed && getline(file, line);) {
+        if (++position > from) {
+            replica.output += "r " + to_string(position) + " 0 ";
+            replica.output += line;
+            replica.output += '\n';
+        }
+    }
+    replica.following = true;
+    followers++;
+    return flush(fd, replica);
+}
+
+/**
+ * @brief Moves the records queued by `ship` to every following replica's output.
+ *
+ * A replica whose unsent output grows past `MAX_BACKLOG` is disconnected rather than buffered without limit.
+ */
+void LogShipper::distribute() {
+    string batch;
+    {
+        lock_guard<mutex> guard(lock);
+        batch.swap(pending);
+        distributed = shipped;
+    }
+    if (batch.empty()) {
+        return;
+    }
+    for (auto it = replicas.begin(); it != replicas.end();) {
+        int fd = it->first;
+        Replica& replica = it->second;
+        ++it;
+        if (!replica.following) {
+            continue;
+        }
+        replica.output += batch;
+        if (replica.output.size() - replica.written > MAX_BACKLOG) {
+            cerr << "A replica fell more than " << (MAX_BACKLOG >> 20) << " MB behind and was disconnected." << endl;
+            closeReplica(fd);
+            continue;
+        }
+        flush(fd, replica);
+    }
+}
+
+/**
+ * @brief Writes as much of a replica's output as the socket accepts.
+ *
+ * @param fd The replica's socket.
+ * @param replica The replica.
+ * @return false if the replica was closed, true otherwise.
+ */
+bool LogShipper::flush(int fd, Replica &replica) {
+    while (replica.written < replica.output.size()) {
+        ssize_t n = send(fd, replica.output.data() + replica.written, replica.output.size() - replica.written,
+                         MSG_NOSIGNAL);
+        if (n > 0) {
+            replica.written += static_cast<size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            closeReplica(fd);
+            return false;
+        }
+    }
+    if (replica.written == replica.output.size()) {
+        replica.output.clear();
+        replica.written = 0;
+    } else if (replica.written > (1 << 20)) {
+        replica.output.erase(0, replica.written);
+        replica.written = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Closes a replica's connection and forgets it.
+ *
+ * @param fd The replica's socket.
+ */
+void LogShipper::closeReplica(int fd) {
+    auto it = replicas.find(fd);
+    if (it == replicas.end()) {
+        return;
+    }
+    if (it->second.following) {
+        followers--;
+    }
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    replicas.erase(it);
+}
+
+#endif //__linux__
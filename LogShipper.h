@@ -0,0 +1,141 @@
+#ifndef LIBRARYMANAGEMENT_LOGSHIPPER_H
+#define LIBRARYMANAGEMENT_LOGSHIPPER_H
+
+#ifdef __linux__
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+using namespace std;
+
+/**
+ * @class LogShipper
+ * @brief Streams a primary's circulation log to read-only replicas over a TCP or Unix domain socket.
+ *
+ * The shipper is the `CirculationLog`'s durable listener, so a change reaches the replicas only once it is on the
+ * primary's disk, and never one the primary could still lose. Records are numbered by their position in the log
+ * file, counting the records replayed at startup, so a replica can resume where it left off.
+ *
+ * A replica connects and sends `follow <position>`, the number of records it has applied. The shipper answers with
+ * every later record, read back from the log file, and then each new record as it becomes durable:
+ *
+ * - `r <position> <micros> <record>` carries one record, with the time it was shipped in microseconds since the
+ *   epoch, or 0 for a record read back from the file;
+ * - `h <position> <micros>` is a heartbeat, sent to idle replicas every `HEARTBEAT_MS`, giving the position of the
+ *   last record shipped.
+ *
+ * A replica that falls `MAX_BACKLOG` bytes behind is disconnected; it catches up from the file when it reconnects.
+ * One thread runs a non-blocking epoll loop for every replica. Only available on Linux.
+ */
+class LogShipper {
+public:
+    static constexpr int HEARTBEAT_MS = 100; ///< Idle replicas are sent a heartbeat this often.
+    static const size_t MAX_BACKLOG = 64 << 20; ///< A replica with more unsent bytes than this is disconnected.
+
+    /**
+     * @brief Starts listening for replicas.
+     *
+     * @param address `host:port` or `:port` (loopback only) for TCP, or `unix:path` for a Unix domain socket.
+     * @param logPath Path of the primary's circulation log.
+     * @param replayed Number of records the log held at startup; the first record shipped comes after them.
+     * @throws runtime_error if the address is not valid or cannot be listened on.
+     */
+    LogShipper(const string& address, const string& logPath, unsigned long long replayed);
+
+    /**
+     * @brief Destructor. Stops the shipping thread and disconnects every replica.
+     */
+    ~LogShipper();
+
+    LogShipper(const LogShipper&) = delete;
+    LogShipper& operator=(const LogShipper&) = delete;
+
+    /**
+     * @brief Queues a batch of durable records for every replica.
+     *
+     * @param records The records, each ending in a line break.
+     * @param last The log sequence number of the batch's last record.
+     */
+    void ship(string_view records, unsigned long long last);
+
+    /**
+     * @brief Gets the number of replicas following the log.
+     *
+     * @return The number of replicas.
+     */
+    [[nodiscard]] size_t getReplicaCount() const;
+
+private:
+    /**
+     * @brief One replica connection. Only used by the shipping thread.
+     */
+    struct Replica {
+        string input; ///< Bytes of the `follow` request read so far.
+        string output; ///< Lines not yet written to the socket.
+        size_t written = 0; ///< Number of bytes at the front of `output` already written.
+        bool following = false; ///< Set once the replica has asked for the log.
+    };
+
+    /**
+     * @brief Body of the shipping thread. Accepts replicas, answers their requests and sends them the log.
+     */
+    void loop();
+
+    /**
+     * @brief Accepts every pending replica connection.
+     */
+    void acceptReplicas();
+
+    /**
+     * @brief Reads a replica's `follow` request and queues the records it has not applied from the log file.
+     *
+     * @param fd The replica's socket.
+     * @param replica The replica.
+     * @return false if the replica was closed, true otherwise.
+     */
+    bool readRequest(int fd, Replica& replica);
+
+    /**
+     * @brief Moves the records queued by `ship` to every following replica's output.
+     */
+    void distribute();
+
+    /**
+     * @brief Writes as much of a replica's output as the socket accepts.
+     *
+     * @param fd The replica's socket.
+     * @param replica The replica.
+     * @return false if the replica was closed, true otherwise.
+     */
+    bool flush(int fd, Replica& replica);
+
+    /**
+     * @brief Closes a replica's connection and forgets it.
+     *
+     * @param fd The replica's socket.
+     */
+    void closeReplica(int fd);
+
+    string logPath; ///< Path of the circulation log.
+    unsigned long long replayed; ///< Number of records the log held at startup.
+    string unixPath; ///< Path of the Unix domain socket, removed on destruction, or empty for TCP.
+    int listenFd; ///< The listening socket.
+    int epollFd; ///< The epoll instance.
+    int wakeFd; ///< Eventfd written when records are queued or the shipper stops.
+    unordered_map<int, Replica> replicas; ///< Replica connections by socket. Only used by the shipping thread.
+    atomic<size_t> followers; ///< Number of replicas following the log.
+    atomic<bool> stopping; ///< Set when the shipper is being destroyed.
+    unsigned long long distributed; ///< Position of the last record moved to the replicas. Only used by the thread.
+    thread worker; ///< The shipping thread.
+    mutable mutex lock; ///< Guards the fields below.
+    string pending; ///< Lines queued by `ship` that the shipping thread has not distributed yet.
+    unsigned long long shipped; ///< Position of the last record queued by `ship`.
+};
+
+#endif //__linux__
+
+#endif //LIBRARYMANAGEMENT_LOGSHIPPER_H
@@ -0,0 +1,79 @@
+#include "MemoryAccounting.h"
+#include <atomic>
+#include <iomanip>
+
+const string_view MemoryAccounting::NAMES[CATEGORY_COUNT] = {
+    "book versions", "inventory slots", "checked out list", "changed books", "patrons", "holds", "trigram index",
+    "isbn tree", "inventory filter", "archive"
+};
+
+/**
+ * @brief Counters of one category.
+ */
+struct CategoryCounters {
+    atomic<size_t> bytes{0}; ///< Bytes currently allocated.
+    atomic<size_t> allocations{0}; ///< Allocations currently live.
+    atomic<size_t> totalAllocations{0}; ///< Allocations made so far.
+};
+
+/**
+ * @brief The counters of every category.
+ */
+static CategoryCounters counters[MemoryAccounting::CATEGORY_COUNT];
+
+/**
+ * @brief Counts an allocation.
+ *
+ * @param category What the memory is for.
+ * @param bytes The size of the allocation.
+ */
+void MemoryAccounting::allocated(Category category, size_t bytes) {
+    counters[category].bytes.fetch_add(bytes, memory_order_relaxed);
+    counters[category].allocations.fetch_add(1, memory_order_relaxed);
+    counters[category].totalAllocations.fetch_add(1, memory_order_relaxed);
+}
+
+/**
+ * @brief Counts a freed allocation.
+ *
+ * @param category What the memory was for.
+ * @param bytes The size of the allocation.
+ */
+void MemoryAccounting::freed(Category category, size_t bytes) {
+    counters[category].bytes.fetch_sub(bytes, memory_order_relaxed);
+    counters[category].allocations.fetch_sub(1, memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the memory currently counted under a category.
+ *
+ * @param category The category.
+ * @return Its usage, named after the category.
+ */
+MemoryUsage MemoryAccounting::usage(Category category) {
+    return {NAMES[category], counters[category].bytes.load(memory_order_relaxed),
+            counters[category].allocations.load(memory_order_relaxed),
+            counters[category].totalAllocations.load(memory_order_relaxed)};
+}
+
+/**
+ * @brief Prints a table of memory usage with a total row.
+ *
+ * @param rows The usage to print.
+ * @param out The stream to print to.
+ */
+void MemoryAccounting::print(const vector<MemoryUsage> &rows, ostream &out) {
+    out << left << setw(24) << "memory" << right << setw(14) << "bytes" << setw(10) << "MiB"
+        << setw(14) << "allocations" << setw(14) << "total allocs" << '\n';
+    MemoryUsage total = {"total", 0, 0, 0};
+    out << fixed << setprecision(1);
+    for (const MemoryUsage& row : rows) {
+        out << left << setw(24) << row.name << right << setw(14) << row.bytes << setw(10) << row.bytes / 1048576.0
+            << setw(14) << row.allocations << setw(14) << row.totalAllocations << '\n';
+        total.bytes += row.bytes;
+        total.allocations += row.allocations;
+        total.totalAllocations += row.totalAllocations;
+    }
+    out << left << setw(24) << total.name << right << setw(14) << total.bytes << setw(10) << total.bytes / 1048576.0
+        << setw(14) << total.allocations << setw(14) << total.totalAllocations << '\n';
+}
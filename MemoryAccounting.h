@@ -0,0 +1,148 @@
+#ifndef LIBRARYMANAGEMENT_MEMORYACCOUNTING_H
+#define LIBRARYMANAGEMENT_MEMORYACCOUNTING_H
+
+#include <cstddef>
+#include <iostream>
+#include <new>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Memory used by one part of the catalog.
+ */
+struct MemoryUsage {
+    string_view name; ///< What the memory holds.
+    size_t bytes; ///< Bytes currently allocated.
+    size_t allocations; ///< Allocations currently live.
+    size_t totalAllocations; ///< Allocations made since the process started, including freed ones.
+};
+
+/**
+ * @class MemoryAccounting
+ * @brief Process-wide counters of the memory held by the library's containers, by category.
+ *
+ * Containers count their memory by allocating through `CountingAllocator`, and single objects such as book
+ * versions call `allocated` and `freed` from their own `operator new` and `operator delete`. The counters are
+ * process-wide, so with several librarians in one process they add up all of them. Bytes are what was
+ * requested from the allocator, without the allocator's own overhead.
+ */
+class MemoryAccounting {
+public:
+    /**
+     * @brief The kinds of memory that are counted.
+     */
+    enum Category {
+        BookVersions, InventorySlots, CheckedOutList, ChangedBooks, Patrons, Holds, TrigramIndex, IsbnTree,
+        InventoryFilter, Archive, CATEGORY_COUNT
+    };
+
+    static const string_view NAMES[CATEGORY_COUNT]; ///< Name of each category, as printed.
+
+    /**
+     * @brief Counts an allocation.
+     *
+     * @param category What the memory is for.
+     * @param bytes The size of the allocation.
+     */
+    static void allocated(Category category, size_t bytes);
+
+    /**
+     * @brief Counts a freed allocation.
+     *
+     * @param category What the memory was for.
+     * @param bytes The size of the allocation.
+     */
+    static void freed(Category category, size_t bytes);
+
+    /**
+     * @brief Gets the memory currently counted under a category.
+     *
+     * @param category The category.
+     * @return Its usage, named after the category.
+     */
+    static MemoryUsage usage(Category category);
+
+    /**
+     * @brief Prints a table of memory usage with a total row.
+     *
+     * @param rows The usage to print.
+     * @param out The stream to print to.
+     */
+    static void print(const vector<MemoryUsage>& rows, ostream& out = cout);
+};
+
+/**
+ * @class CountingAllocator
+ * @brief A standard allocator that counts its memory under a `MemoryAccounting` category.
+ *
+ * @tparam T The type allocated.
+ * @tparam C The category the memory is counted under.
+ */
+template<typename T, MemoryAccounting::Category C>
+class CountingAllocator {
+public:
+    using value_type = T;
+
+    /**
+     * @brief The same allocator for another type, counted under the same category.
+     */
+    template<typename U>
+    struct rebind {
+        using other = CountingAllocator<U, C>;
+    };
+
+    CountingAllocator() noexcept = default;
+
+    /**
+     * @brief Converts from the allocator of another type.
+     */
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U, C>&) noexcept {
+    }
+
+    /**
+     * @brief Allocates and counts space for objects, aligned for their type even when it is over-aligned.
+     *
+     * @param n The number of objects.
+     * @return Pointer to uninitialized space for them.
+     */
+    T* allocate(size_t n) {
+        T* p;
+        if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            p = static_cast<T*>(::operator new(n * sizeof(T), align_val_t(alignof(T))));
+        } else {
+            p = static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        MemoryAccounting::allocated(C, n * sizeof(T));
+        return p;
+    }
+
+    /**
+     * @brief Frees space from `allocate` and counts it as freed.
+     *
+     * @param p Pointer to the space.
+     * @param n The number of objects it was allocated for.
+     */
+    void deallocate(T* p, size_t n) noexcept {
+        MemoryAccounting::freed(C, n * sizeof(T));
+        if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(p, align_val_t(alignof(T)));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    template<typename U>
+    bool operator==(const CountingAllocator<U, C>&) const noexcept {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const CountingAllocator<U, C>&) const noexcept {
+        return false;
+    }
+};
+
+#endif //LIBRARYMANAGEMENT_MEMORYACCOUNTING_H
@@ -0,0 +1,255 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+
+const string_view Metrics::NAMES[METRIC_COUNT] = {
+    "load catalog", "checkout", "checkout batch", "return", "return batch", "renew batch", "reserve",
+    "cancel reservation", "process reservations", "reservation scan", "renew", "overdue run", "calculate fine",
+    "add book", "remove book", "list all", "list checked out", "list overdue", "list reservations",
+    "export catalog", "search title", "search isbn", "register patron", "patron account", "find by isbn",
+    "find by title", "search fuzzy", "list isbn range", "query catalog", "list page", "query archive", "replica lag"
+};
+
+const unsigned Metrics::SAMPLE_INTERVALS[METRIC_COUNT] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 64, 1, 1, 1, 1, 1, 1, 1
+};
+
+/**
+ * @brief One thread's counters. Only its thread writes them.
+ */
+struct MetricsBlock {
+    atomic<uint64_t> calls[Metrics::METRIC_COUNT]; ///< Number of calls of each metric.
+    unsigned untilSample[Metrics::METRIC_COUNT]; ///< Calls of each metric left before the next timed one.
+    atomic<uint64_t> buckets[Metrics::METRIC_COUNT][LatencyHistogram::BUCKETS]; ///< Histogram of each metric.
+    atomic<uint64_t> totals[Metrics::METRIC_COUNT]; ///< Total nanoseconds of each metric.
+    atomic<uint64_t> longest[Metrics::METRIC_COUNT]; ///< Slowest run of each metric.
+    MetricsBlock* next; ///< The block registered before this one.
+};
+
+/**
+ * @brief Every thread's block, newest first. Blocks are never removed.
+ */
+static atomic<MetricsBlock*> blocks{nullptr};
+
+/**
+ * @brief Guards the baseline below.
+ */
+static mutex baselineLock;
+
+/**
+ * @brief Bucket counts at the last reset, subtracted when reading. Resetting this way never races with a writer.
+ */
+static uint64_t baselineBuckets[Metrics::METRIC_COUNT][LatencyHistogram::BUCKETS];
+
+/**
+ * @brief Total nanoseconds at the last reset.
+ */
+static uint64_t baselineTotals[Metrics::METRIC_COUNT];
+
+/**
+ * @brief Call counts at the last reset.
+ */
+static uint64_t baselineCalls[Metrics::METRIC_COUNT];
+
+/**
+ * @brief Gets the calling thread's block, creating and registering it on the thread's first call.
+ *
+ * @return The block.
+ */
+static MetricsBlock* threadBlock() {
+    thread_local MetricsBlock* block = nullptr;
+    if (block == nullptr) {
+        block = new MetricsBlock();
+        block->next = blocks.load(memory_order_relaxed);
+        while (!blocks.compare_exchange_weak(block->next, block, memory_order_release, memory_order_relaxed)) {
+        }
+    }
+    return block;
+}
+
+/**
+ * @brief Adds one to a counter only the calling thread writes.
+ *
+ * A load and a store are enough, and cheaper than an atomic add, because no other thread writes the counter.
+ *
+ * @param counter The counter.
+ * @param amount The amount to add.
+ */
+static void bump(atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+/**
+ * @brief Gets a percentile of a merged histogram, no higher than the slowest call recorded.
+ *
+ * A percentile is reported as the highest value of its bucket, which can be past every value actually recorded.
+ *
+ * @param histogram The histogram.
+ * @param percentile The percentile, from 0 to 100.
+ * @param maxNanoseconds The time of the slowest call.
+ * @return The value in nanoseconds.
+ */
+static uint64_t percentileOf(const LatencyHistogram &histogram, double percentile, uint64_t maxNanoseconds) {
+    return min(histogram.valueAtPercentile(percentile), maxNanoseconds);
+}
+
+/**
+ * @brief Counts a call of an operation and tells whether to time it.
+ *
+ * @param metric The operation.
+ * @return true if this call should be timed and passed to `record`.
+ */
+bool Metrics::countCall(Metric metric) {
+    MetricsBlock* block = threadBlock();
+    bump(block->calls[metric], 1);
+    if (block->untilSample[metric] != 0) {
+        block->untilSample[metric]--;
+        return false;
+    }
+    block->untilSample[metric] = SAMPLE_INTERVALS[metric] - 1;
+    return true;
+}
+
+/**
+ * @brief Records the time of one timed call of an operation.
+ *
+ * @param metric The operation.
+ * @param nanoseconds How long it took.
+ */
+void Metrics::record(Metric metric, uint64_t nanoseconds) {
+    MetricsBlock* block = threadBlock();
+    bump(block->buckets[metric][LatencyHistogram::bucketOf(nanoseconds)], 1);
+    bump(block->totals[metric], nanoseconds);
+    if (nanoseconds > block->longest[metric].load(memory_order_relaxed)) {
+        block->longest[metric].store(nanoseconds, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Merges every thread's histogram of an operation.
+ *
+ * @param metric The operation.
+ * @param calls Set to the number of calls.
+ * @param histogram Set to the merged histogram of the timed calls.
+ * @param totalNanoseconds Set to the total time of the timed calls.
+ * @param maxNanoseconds Set to the time of the slowest timed call.
+ */
+void Metrics::collect(Metric metric, uint64_t &calls, LatencyHistogram &histogram, uint64_t &totalNanoseconds,
+                      uint64_t &maxNanoseconds) {
+    uint64_t counts[LatencyHistogram::BUCKETS] = {};
+    calls = 0;
+    totalNanoseconds = 0;
+    maxNanoseconds = 0;
+    for (MetricsBlock* b = blocks.load(memory_order_acquire); b != nullptr; b = b->next) {
+        for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            counts[i] += b->buckets[metric][i].load(memory_order_relaxed);
+        }
+        calls += b->calls[metric].load(memory_order_relaxed);
+        totalNanoseconds += b->totals[metric].load(memory_order_relaxed);
+        maxNanoseconds = max(maxNanoseconds, b->longest[metric].load(memory_order_relaxed));
+    }
+    histogram = LatencyHistogram();
+    lock_guard<mutex> guard(baselineLock);
+    for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+        if (counts[i] > baselineBuckets[metric][i]) {
+            histogram.addToBucket(i, counts[i] - baselineBuckets[metric][i]);
+        }
+    }
+    calls -= min(calls, baselineCalls[metric]);
+    totalNanoseconds -= min(totalNanoseconds, baselineTotals[metric]);
+}
+
+/**
+ * @brief Prints a table of the operations that ran, with their counts, mean, percentiles and maximum.
+ *
+ * @param out The stream to print to.
+ */
+void Metrics::print(ostream &out) {
+    out << left << setw(22) << "operation" << right << setw(12) << "count" << setw(11) << "mean us"
+        << setw(11) << "p50 us" << setw(11) << "p90 us" << setw(11) << "p99 us" << setw(11) << "p99.9 us"
+        << setw(11) << "max us" << '\n';
+    LatencyHistogram histogram;
+    uint64_t calls, total, longest;
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        collect(static_cast<Metric>(m), calls, histogram, total, longest);
+        uint64_t timed = histogram.getCount();
+        if (timed == 0) {
+            continue;
+        }
+        out << left << setw(22) << NAMES[m] << right << setw(12) << calls << fixed << setprecision(2)
+            << setw(11) << total / 1e3 / timed
+            << setw(11) << percentileOf(histogram, 50, longest) / 1e3
+            << setw(11) << percentileOf(histogram, 90, longest) / 1e3
+            << setw(11) << percentileOf(histogram, 99, longest) / 1e3
+            << setw(11) << percentileOf(histogram, 99.9, longest) / 1e3
+            << setw(11) << longest / 1e3 << '\n';
+    }
+}
+
+/**
+ * @brief Writes every operation's counters and non-empty histogram buckets as JSON.
+ *
+ * Each bucket is written as a pair of the highest value it holds and its count. `count` is the number of calls,
+ * and `timed` the number of them in the histogram.
+ *
+ * @param out The stream to write to.
+ */
+void Metrics::writeJson(ostream &out) {
+    out << "{\"operations\": [";
+    LatencyHistogram histogram;
+    uint64_t calls, total, longest;
+    bool first = true;
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        collect(static_cast<Metric>(m), calls, histogram, total, longest);
+        uint64_t timed = histogram.getCount();
+        if (timed == 0) {
+            continue;
+        }
+        out << (first ? "\n" : ",\n") << "  {\"name\": \"" << NAMES[m] << "\", \"count\": " << calls
+            << ", \"timed\": " << timed << ", \"total_timed_ns\": " << total << ", \"mean_ns\": " << total / timed
+            << ", \"p50_ns\": " << percentileOf(histogram, 50, longest)
+            << ", \"p90_ns\": " << percentileOf(histogram, 90, longest)
+            << ", \"p99_ns\": " << percentileOf(histogram, 99, longest)
+            << ", \"p999_ns\": " << percentileOf(histogram, 99.9, longest)
+            << ", \"max_ns\": " << longest << ", \"buckets\": [";
+        bool firstBucket = true;
+        for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            if (histogram.countInBucket(i) != 0) {
+                out << (firstBucket ? "" : ", ") << '[' << LatencyHistogram::highestInBucket(i) << ", "
+                    << histogram.countInBucket(i) << ']';
+                firstBucket = false;
+            }
+        }
+        out << "]}";
+        first = false;
+    }
+    out << "\n]}\n";
+}
+
+/**
+ * @brief Clears every counter. Runs still in progress on other threads may be counted either way.
+ *
+ * The counters themselves are left alone, since only their threads write them; the current values become
+ * the baseline that later reads subtract. The slowest runs are cleared directly.
+ */
+void Metrics::reset() {
+    lock_guard<mutex> guard(baselineLock);
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            baselineBuckets[m][i] = 0;
+        }
+        baselineTotals[m] = 0;
+        baselineCalls[m] = 0;
+    }
+    for (MetricsBlock* b = blocks.load(memory_order_acquire); b != nullptr; b = b->next) {
+        for (int m = 0; m < METRIC_COUNT; m++) {
+            for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+                baselineBuckets[m][i] += b->buckets[m][i].load(memory_order_relaxed);
+            }
+            baselineTotals[m] += b->totals[m].load(memory_order_relaxed);
+            baselineCalls[m] += b->calls[m].load(memory_order_relaxed);
+            b->longest[m].store(0, memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef LIBRARYMANAGEMENT_METRICS_H
+#define LIBRARYMANAGEMENT_METRICS_H
+
+#include "LatencyHistogram.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * @class Metrics
+ * @brief Process-wide counters and latency histograms of the librarian's operations and inventory lookups.
+ *
+ * Each thread records into its own block of counters, created the first time the thread records anything,
+ * so recording takes no locks and never writes to memory another thread writes. A block is only written
+ * by its thread, with relaxed atomic stores, and readers merge every thread's block with relaxed loads.
+ * Blocks outlive their threads, so work done on threads that have exited is still counted.
+ *
+ * Every call of an operation is counted, but reading the clock costs more than an inventory lookup, so the
+ * lookups are only timed once every `SAMPLE_INTERVALS` calls; their histograms hold that sample of calls.
+ * Operations are timed with `MetricTimer`. Building with `LIBRARY_NO_STATS` compiles the timers out.
+ *
+ * `ReplicaLag` is not an operation's duration but, on a `LogReplica`, the time from a change becoming durable on
+ * the primary to the replica applying it; it is recorded directly with `record`.
+ */
+class Metrics {
+public:
+    /**
+     * @brief The operations that are measured.
+     */
+    enum Metric {
+        LoadCatalog, Checkout, CheckoutBatch, Return, ReturnBatch, RenewBatch, Reserve, CancelReservation,
+        ProcessReservations, ReservationScan, Renew, OverdueRun, CalculateFine, AddBook, RemoveBook, ListAll,
+        ListCheckedOut, ListOverdue, ListReservations, ExportCatalog, SearchTitle, SearchISBN, RegisterPatron,
+        PatronAccount, FindByISBN, FindByTitle, SearchFuzzy, ListRange, Query, ListPage, QueryArchive, ReplicaLag,
+        METRIC_COUNT
+    };
+
+    static const string_view NAMES[METRIC_COUNT]; ///< Name of each metric, as printed and in JSON.
+    static const unsigned SAMPLE_INTERVALS[METRIC_COUNT]; ///< Each metric times one call in this many.
+
+    /**
+     * @brief Counts a call of an operation and tells whether to time it.
+     *
+     * @param metric The operation.
+     * @return true if this call should be timed and passed to `record`.
+     */
+    static bool countCall(Metric metric);
+
+    /**
+     * @brief Records the time of one timed call of an operation.
+     *
+     * @param metric The operation.
+     * @param nanoseconds How long it took.
+     */
+    static void record(Metric metric, uint64_t nanoseconds);
+
+    /**
+     * @brief Merges every thread's histogram of an operation.
+     *
+     * @param metric The operation.
+     * @param calls Set to the number of calls.
+     * @param histogram Set to the merged histogram of the timed calls.
+     * @param totalNanoseconds Set to the total time of the timed calls.
+     * @param maxNanoseconds Set to the time of the slowest timed call.
+     */
+    static void collect(Metric metric, uint64_t& calls, LatencyHistogram& histogram, uint64_t& totalNanoseconds,
+                        uint64_t& maxNanoseconds);
+
+    /**
+     * @brief Prints a table of the operations that ran, with their counts, mean, percentiles and maximum.
+     *
+     * @param out The stream to print to.
+     */
+    static void print(ostream& out = cout);
+
+    /**
+     * @brief Writes every operation's counters and non-empty histogram buckets as JSON.
+     *
+     * @param out The stream to write to.
+     */
+    static void writeJson(ostream& out);
+
+    /**
+     * @brief Clears every counter. Runs still in progress on other threads may be counted either way.
+     */
+    static void reset();
+};
+
+/**
+ * @class MetricTimer
+ * @brief Times the scope it lives in and records it under a metric when the scope ends.
+ */
+class MetricTimer {
+public:
+    /**
+     * @brief Counts the call and starts timing it, if it is one of the timed calls.
+     *
+     * @param metric The operation being timed.
+     */
+    explicit MetricTimer(Metrics::Metric metric) {
+#ifndef LIBRARY_NO_STATS
+        this->metric = metric;
+        timing = Metrics::countCall(metric);
+        if (timing) {
+            start = chrono::steady_clock::now();
+        }
+#else
+        (void) metric;
+#endif
+    }
+
+    /**
+     * @brief Stops timing and records the time, if this call is timed.
+     */
+    ~MetricTimer() {
+#ifndef LIBRARY_NO_STATS
+        if (timing) {
+            Metrics::record(metric, static_cast<uint64_t>(
+                    chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()));
+        }
+#endif
+    }
+
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+
+private:
+#ifndef LIBRARY_NO_STATS
+    Metrics::Metric metric; ///< The operation being timed.
+    bool timing; ///< Whether this call is timed.
+    chrono::steady_clock::time_point start; ///< When timing started.
+#endif
+};
+
+#endif //LIBRARYMANAGEMENT_METRICS_H
@@ -0,0 +1,57 @@
+#include "Patron.h"
+
+/**
+ * @brief Default constructor. Initializes a patron with no loans, holds or fines.
+ */
+Patron::Patron() {
+    firstLoan = nullptr;
+    firstHold = -1;
+    loanCount = 0;
+    holdCount = 0;
+    fineTotal = 0;
+}
+
+/**
+ * @brief Get the most recently loaned book of the patron.
+ *
+ * @return Pointer to the head of the patron's loan list, or nullptr if the patron has no loans.
+ */
+Book *Patron::getFirstLoan() const {
+    return firstLoan;
+}
+
+/**
+ * @brief Get the most recently placed hold of the patron.
+ *
+ * @return Handle of the head of the patron's hold list, or -1 if the patron has no holds.
+ */
+int Patron::getFirstHold() const {
+    return firstHold;
+}
+
+/**
+ * @brief Get the number of books the patron has checked out.
+ *
+ * @return The number of loans.
+ */
+short Patron::getLoanCount() const {
+    return loanCount;
+}
+
+/**
+ * @brief Get the number of holds the patron has placed.
+ *
+ * @return The number of holds.
+ */
+short Patron::getHoldCount() const {
+    return holdCount;
+}
+
+/**
+ * @brief Get the sum of the fines on the patron's loans.
+ *
+ * @return The cached fine total.
+ */
+int Patron::getFineTotal() const {
+    return fineTotal;
+}
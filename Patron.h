@@ -0,0 +1,72 @@
+#ifndef LIBRARYMANAGEMENT_PATRON_H
+#define LIBRARYMANAGEMENT_PATRON_H
+
+#include "Book.h"
+
+/**
+ * @brief Compact identifier of a patron. ID 0 is reserved to mean "no patron".
+ */
+typedef unsigned int PatronId;
+
+/**
+ * @class Patron
+ * @brief A library patron's account record.
+ *
+ * A patron only stores the heads of its loan and hold lists along with their lengths and a cached
+ * fine total, so every patron has the same small fixed size no matter how many books it has borrowed.
+ * The loan list is threaded through the loaned `Book` objects themselves, and the hold list is threaded
+ * through the hold records kept by `PatronStore`, which is the only class that modifies a patron.
+ */
+class Patron {
+public:
+    /**
+     * @brief Default constructor. Initializes a patron with no loans, holds or fines.
+     */
+    Patron();
+
+    /**
+     * @brief Get the most recently loaned book of the patron.
+     *
+     * @return Pointer to the head of the patron's loan list, or nullptr if the patron has no loans.
+     */
+    [[nodiscard]] Book* getFirstLoan() const;
+
+    /**
+     * @brief Get the most recently placed hold of the patron.
+     *
+     * @return Handle of the head of the patron's hold list, or -1 if the patron has no holds.
+     */
+    [[nodiscard]] int getFirstHold() const;
+
+    /**
+     * @brief Get the number of books the patron has checked out.
+     *
+     * @return The number of loans.
+     */
+    [[nodiscard]] short getLoanCount() const;
+
+    /**
+     * @brief Get the number of holds the patron has placed.
+     *
+     * @return The number of holds.
+     */
+    [[nodiscard]] short getHoldCount() const;
+
+    /**
+     * @brief Get the sum of the fines on the patron's loans.
+     *
+     * @return The cached fine total.
+     */
+    [[nodiscard]] int getFineTotal() const;
+
+private:
+    friend class PatronStore;
+
+    Book* firstLoan; ///< Head of the loan list, linked through `Book::getNextLoan`.
+    int firstHold; ///< Handle of the head of the hold list, -1 if empty.
+    short loanCount; ///< Number of books in the loan list.
+    short holdCount; ///< Number of holds in the hold list.
+    int fineTotal; ///< Cached sum of the fines owed by the patron.
+};
+
+#endif //LIBRARYMANAGEMENT_PATRON_H
@@ -0,0 +1,316 @@
+#include "PatronStore.h"
+#include <iostream>
+
+/**
+ * @brief Constructs an empty patron store.
+ *
+ * @param maxLoans The maximum number of books a patron may have checked out at once.
+ * @param maxHolds The maximum number of holds a patron may have placed at once.
+ */
+PatronStore::PatronStore(short maxLoans, short maxHolds) : maxLoans(maxLoans), maxHolds(maxHolds) {
+    patrons.emplace_back();
+    freeHold = -1;
+    oldestHold = -1;
+    newestHold = -1;
+    holdTotal = 0;
+}
+
+/**
+ * @brief Registers a new patron.
+ *
+ * @return The ID of the new patron.
+ */
+PatronId PatronStore::addPatron() {
+    patrons.emplace_back();
+    return static_cast<PatronId>(patrons.size() - 1);
+}
+
+/**
+ * @brief Checks if an ID belongs to a registered patron.
+ *
+ * @param id The patron ID to check.
+ * @return true if the patron exists, false otherwise.
+ */
+bool PatronStore::isPatron(PatronId id) const {
+    return id != NO_PATRON && id < patrons.size();
+}
+
+/**
+ * @brief Gets a patron by ID.
+ *
+ * @param id The ID of a registered patron.
+ * @return Reference to the patron's record.
+ */
+const Patron &PatronStore::getPatron(PatronId id) const {
+    return patrons[id];
+}
+
+/**
+ * @brief Counts the registered patrons.
+ *
+ * @return The number of patrons.
+ */
+size_t PatronStore::countPatrons() const {
+    return patrons.size() - 1;
+}
+
+/**
+ * @brief Checks if a patron is under its loan limit.
+ *
+ * @param id The patron ID, or `NO_PATRON`.
+ * @return true if the patron may check out another book. Always true for `NO_PATRON`, and false for
+ * an unregistered ID.
+ */
+bool PatronStore::canBorrow(PatronId id) const {
+    return id == NO_PATRON || (isPatron(id) && patrons[id].loanCount < maxLoans);
+}
+
+/**
+ * @brief Checks if a patron is under its hold limit.
+ *
+ * @param id The patron ID, or `NO_PATRON`.
+ * @return true if the patron may place another hold. Always true for `NO_PATRON`, and false for
+ * an unregistered ID.
+ */
+bool PatronStore::canHold(PatronId id) const {
+    return id == NO_PATRON || (isPatron(id) && patrons[id].holdCount < maxHolds);
+}
+
+/**
+ * @brief Records a loan of a book to a patron.
+ *
+ * Sets the book's borrower and links it at the head of the patron's loan list.
+ *
+ * @param id The borrowing patron's ID, or `NO_PATRON` to record no borrower.
+ * @param book Pointer to the book being loaned.
+ */
+void PatronStore::linkLoan(PatronId id, Book *book) {
+    book->setBorrower(id);
+    book->setPrevLoan(nullptr);
+    book->setNextLoan(nullptr);
+    if (id == NO_PATRON) {
+        return;
+    }
+    Patron& p = patrons[id];
+    book->setNextLoan(p.firstLoan);
+    if (p.firstLoan != nullptr) {
+        p.firstLoan->setPrevLoan(book);
+    }
+    p.firstLoan = book;
+    p.loanCount++;
+}
+
+/**
+ * @brief Removes a book from its borrower's loan list.
+ *
+ * Clears the book's borrower. Does nothing if the book has no borrower.
+ *
+ * @param book Pointer to the book being returned.
+ */
+void PatronStore::unlinkLoan(Book *book) {
+    PatronId id = book->getBorrower();
+    if (id == NO_PATRON) {
+        return;
+    }
+    Patron& p = patrons[id];
+    if (book->getPrevLoan() != nullptr) {
+        book->getPrevLoan()->setNextLoan(book->getNextLoan());
+    } else {
+        p.firstLoan = book->getNextLoan();
+    }
+    if (book->getNextLoan() != nullptr) {
+        book->getNextLoan()->setPrevLoan(book->getPrevLoan());
+    }
+    p.loanCount--;
+    book->setBorrower(NO_PATRON);
+    book->setPrevLoan(nullptr);
+    book->setNextLoan(nullptr);
+}
+
+/**
+ * @brief Places a hold on a book, at the back of the book's hold queue.
+ *
+ * @param id The patron placing the hold, or `NO_PATRON` for an anonymous hold.
+ * @param book Pointer to the book being held.
+ * @return Handle of the new hold record.
+ */
+int PatronStore::addHold(PatronId id, Book *book) {
+    int hold = freeHold;
+    if (hold != -1) {
+        freeHold = holds[hold].next;
+    } else {
+        hold = static_cast<int>(holds.size());
+        holds.emplace_back();
+    }
+    Hold& h = holds[hold];
+    h.book = book;
+    h.patron = id;
+    h.prev = -1;
+    h.next = -1;
+    h.nextOnBook = -1;
+    int first = book->getFirstHold();
+    if (first == -1) {
+        book->setFirstHold(hold);
+        h.prevOnBook = hold;
+    } else {
+        h.prevOnBook = holds[first].prevOnBook;
+        holds[h.prevOnBook].nextOnBook = hold;
+        holds[first].prevOnBook = hold;
+    }
+    h.older = newestHold;
+    h.newer = -1;
+    if (newestHold != -1) {
+        holds[newestHold].newer = hold;
+    } else {
+        oldestHold = hold;
+    }
+    newestHold = hold;
+    holdTotal++;
+    if (id != NO_PATRON) {
+        Patron& p = patrons[id];
+        h.next = p.firstHold;
+        if (p.firstHold != -1) {
+            holds[p.firstHold].prev = hold;
+        }
+        p.firstHold = hold;
+        p.holdCount++;
+    }
+    return hold;
+}
+
+/**
+ * @brief Removes a hold from its patron's list, its book's queue and the list of all holds, and returns
+ *        its record to the free list.
+ *
+ * @param hold Handle of the hold to remove.
+ */
+void PatronStore::removeHold(int hold) {
+    Hold& h = holds[hold];
+    int first = h.book->getFirstHold();
+    if (hold == first) {
+        h.book->setFirstHold(h.nextOnBook);
+    } else {
+        holds[h.prevOnBook].nextOnBook = h.nextOnBook;
+    }
+    if (h.nextOnBook != -1) {
+        holds[h.nextOnBook].prevOnBook = h.prevOnBook;
+    } else if (hold != first) {
+        holds[first].prevOnBook = h.prevOnBook;
+    }
+    if (h.older != -1) {
+        holds[h.older].newer = h.newer;
+    } else {
+        oldestHold = h.newer;
+    }
+    if (h.newer != -1) {
+        holds[h.newer].older = h.older;
+    } else {
+        newestHold = h.older;
+    }
+    holdTotal--;
+    if (h.patron != NO_PATRON) {
+        Patron& p = patrons[h.patron];
+        if (h.prev != -1) {
+            holds[h.prev].next = h.next;
+        } else {
+            p.firstHold = h.next;
+        }
+        if (h.next != -1) {
+            holds[h.next].prev = h.prev;
+        }
+        p.holdCount--;
+    }
+    h.book = nullptr;
+    h.patron = NO_PATRON;
+    h.prev = -1;
+    h.next = freeHold;
+    freeHold = hold;
+}
+
+/**
+ * @brief Gets the book a hold was placed on.
+ *
+ * @param hold Handle of the hold.
+ * @return Pointer to the held book.
+ */
+Book *PatronStore::getHoldBook(int hold) const {
+    return holds[hold].book;
+}
+
+/**
+ * @brief Gets the patron that placed a hold.
+ *
+ * @param hold Handle of the hold.
+ * @return The patron's ID, or `NO_PATRON` for an anonymous hold.
+ */
+PatronId PatronStore::getHoldPatron(int hold) const {
+    return holds[hold].patron;
+}
+
+/**
+ * @brief Gets the hold after this one in its book's queue.
+ *
+ * @param hold Handle of the hold.
+ * @return Handle of the next hold on the same book, or -1 if this is the last one.
+ */
+int PatronStore::getNextHoldOnBook(int hold) const {
+    return holds[hold].nextOnBook;
+}
+
+/**
+ * @brief Gets the oldest hold on any book.
+ *
+ * @return Handle of the hold, or -1 if there are none.
+ */
+int PatronStore::getOldestHold() const {
+    return oldestHold;
+}
+
+/**
+ * @brief Gets the hold placed after this one, on any book.
+ *
+ * @param hold Handle of the hold.
+ * @return Handle of the next newer hold, or -1 if this is the newest.
+ */
+int PatronStore::getNewerHold(int hold) const {
+    return holds[hold].newer;
+}
+
+/**
+ * @brief Counts the holds placed and not yet removed.
+ *
+ * @return The number of holds.
+ */
+size_t PatronStore::countHolds() const {
+    return holdTotal;
+}
+
+/**
+ * @brief Adds to a patron's cached fine total.
+ *
+ * @param id The patron ID, or `NO_PATRON` to do nothing.
+ * @param delta The amount to add, which may be negative.
+ */
+void PatronStore::adjustFine(PatronId id, int delta) {
+    if (id != NO_PATRON) {
+        patrons[id].fineTotal += delta;
+    }
+}
+
+/**
+ * @brief Prints the loans, holds and fine total of a patron.
+ *
+ * @param id The patron ID.
+ * @param out The stream to print to.
+ */
+void PatronStore::print(PatronId id, ostream &out) const {
+    const Patron& p = patrons[id];
+    out << "Patron " << id << ": " << p.loanCount << " loans, " << p.holdCount << " holds, fines owed: "
+        << p.fineTotal << '\n';
+    for (Book* b = p.firstLoan; b != nullptr; b = b->getNextLoan()) {
+        out << "  Loan: " << b->getInfo() << '\n';
+    }
+    for (int h = p.firstHold; h != -1; h = holds[h].next) {
+        out << "  Hold: " << holds[h].book->getInfo() << '\n';
+    }
+}
@@ -0,0 +1,211 @@
+#ifndef LIBRARYMANAGEMENT_PATRONSTORE_H
+#define LIBRARYMANAGEMENT_PATRONSTORE_H
+
+#include "MemoryAccounting.h"
+#include "Patron.h"
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class PatronStore
+ * @brief Stores every patron account and the holds they have placed.
+ *
+ * Patrons live in a flat array indexed by their `PatronId`, so looking a patron up is a single index.
+ * Each patron's loans are kept in a doubly linked list threaded through the loaned `Book` objects, and
+ * each patron's holds are kept in a doubly linked list of hold records stored in a pooled array with a
+ * free list. The same records are also linked into a first-in, first-out queue per book, headed by the
+ * book's `getFirstHold`, and into one list of every hold in the order they were placed. Linking and
+ * unlinking a loan or hold, finding the next hold on a book, and checking a patron's loan or hold limit,
+ * are all constant time. Holds may also be placed without a patron (ID 0), in which case they are not
+ * linked into any patron's list.
+ */
+class PatronStore {
+public:
+    static const PatronId NO_PATRON = 0; ///< ID used for loans and holds that belong to no patron.
+
+    /**
+     * @brief Constructs an empty patron store.
+     *
+     * @param maxLoans The maximum number of books a patron may have checked out at once.
+     * @param maxHolds The maximum number of holds a patron may have placed at once.
+     */
+    explicit PatronStore(short maxLoans = 10, short maxHolds = 10);
+
+    /**
+     * @brief Registers a new patron.
+     *
+     * @return The ID of the new patron.
+     */
+    PatronId addPatron();
+
+    /**
+     * @brief Checks if an ID belongs to a registered patron.
+     *
+     * @param id The patron ID to check.
+     * @return true if the patron exists, false otherwise.
+     */
+    [[nodiscard]] bool isPatron(PatronId id) const;
+
+    /**
+     * @brief Gets a patron by ID.
+     *
+     * @param id The ID of a registered patron.
+     * @return Reference to the patron's record.
+     */
+    [[nodiscard]] const Patron& getPatron(PatronId id) const;
+
+    /**
+     * @brief Counts the registered patrons.
+     *
+     * @return The number of patrons.
+     */
+    [[nodiscard]] size_t countPatrons() const;
+
+    /**
+     * @brief Checks if a patron is under its loan limit.
+     *
+     * @param id The patron ID, or `NO_PATRON`.
+     * @return true if the patron may check out another book. Always true for `NO_PATRON`, and false for
+     * an unregistered ID.
+     */
+    [[nodiscard]] bool canBorrow(PatronId id) const;
+
+    /**
+     * @brief Checks if a patron is under its hold limit.
+     *
+     * @param id The patron ID, or `NO_PATRON`.
+     * @return true if the patron may place another hold. Always true for `NO_PATRON`, and false for
+     * an unregistered ID.
+     */
+    [[nodiscard]] bool canHold(PatronId id) const;
+
+    /**
+     * @brief Records a loan of a book to a patron.
+     *
+     * Sets the book's borrower and links it at the head of the patron's loan list.
+     *
+     * @param id The borrowing patron's ID, or `NO_PATRON` to record no borrower.
+     * @param book Pointer to the book being loaned.
+     */
+    void linkLoan(PatronId id, Book* book);
+
+    /**
+     * @brief Removes a book from its borrower's loan list.
+     *
+     * Clears the book's borrower. Does nothing if the book has no borrower.
+     *
+     * @param book Pointer to the book being returned.
+     */
+    void unlinkLoan(Book* book);
+
+    /**
+     * @brief Places a hold on a book, at the back of the book's hold queue.
+     *
+     * @param id The patron placing the hold, or `NO_PATRON` for an anonymous hold.
+     * @param book Pointer to the book being held.
+     * @return Handle of the new hold record.
+     */
+    int addHold(PatronId id, Book* book);
+
+    /**
+     * @brief Removes a hold from its patron's list, its book's queue and the list of all holds, and returns
+     *        its record to the free list.
+     *
+     * @param hold Handle of the hold to remove.
+     */
+    void removeHold(int hold);
+
+    /**
+     * @brief Gets the book a hold was placed on.
+     *
+     * @param hold Handle of the hold.
+     * @return Pointer to the held book.
+     */
+    [[nodiscard]] Book* getHoldBook(int hold) const;
+
+    /**
+     * @brief Gets the patron that placed a hold.
+     *
+     * @param hold Handle of the hold.
+     * @return The patron's ID, or `NO_PATRON` for an anonymous hold.
+     */
+    [[nodiscard]] PatronId getHoldPatron(int hold) const;
+
+    /**
+     * @brief Gets the hold after this one in its book's queue.
+     *
+     * @param hold Handle of the hold.
+     * @return Handle of the next hold on the same book, or -1 if this is the last one.
+     */
+    [[nodiscard]] int getNextHoldOnBook(int hold) const;
+
+    /**
+     * @brief Gets the oldest hold on any book.
+     *
+     * @return Handle of the hold, or -1 if there are none.
+     */
+    [[nodiscard]] int getOldestHold() const;
+
+    /**
+     * @brief Gets the hold placed after this one, on any book.
+     *
+     * @param hold Handle of the hold.
+     * @return Handle of the next newer hold, or -1 if this is the newest.
+     */
+    [[nodiscard]] int getNewerHold(int hold) const;
+
+    /**
+     * @brief Counts the holds placed and not yet removed.
+     *
+     * @return The number of holds.
+     */
+    [[nodiscard]] size_t countHolds() const;
+
+    /**
+     * @brief Adds to a patron's cached fine total.
+     *
+     * @param id The patron ID, or `NO_PATRON` to do nothing.
+     * @param delta The amount to add, which may be negative.
+     */
+    void adjustFine(PatronId id, int delta);
+
+    /**
+     * @brief Prints the loans, holds and fine total of a patron.
+     *
+     * @param id The patron ID.
+     * @param out The stream to print to.
+     */
+    void print(PatronId id, ostream& out = cout) const;
+
+private:
+    /**
+     * @brief A hold placed by a patron, linked into that patron's hold list, its book's queue and the list of
+     *        all holds.
+     */
+    struct Hold {
+        Book* book; ///< The held book, nullptr while the record is free.
+        PatronId patron; ///< The patron that placed the hold.
+        int prev; ///< Previous hold of the same patron, -1 if none.
+        int next; ///< Next hold of the same patron, or the next free record while free.
+        int prevOnBook; ///< Previous hold on the same book; the book's first hold points at its last.
+        int nextOnBook; ///< Next hold on the same book, -1 if none.
+        int older; ///< Hold placed before this one, -1 if none.
+        int newer; ///< Hold placed after this one, -1 if none.
+    };
+
+    using PatronList = vector<Patron, CountingAllocator<Patron, MemoryAccounting::Patrons>>;
+    using HoldPool = vector<Hold, CountingAllocator<Hold, MemoryAccounting::Holds>>;
+
+    PatronList patrons; ///< Patron records indexed by ID. Index 0 is the unused `NO_PATRON` slot.
+    HoldPool holds; ///< Pool of hold records indexed by handle.
+    int freeHold; ///< Head of the list of free hold records, -1 if none.
+    int oldestHold; ///< Oldest hold placed, -1 if none.
+    int newestHold; ///< Newest hold placed, -1 if none.
+    size_t holdTotal; ///< Number of holds placed and not yet removed.
+    short maxLoans; ///< Loan limit per patron.
+    short maxHolds; ///< Hold limit per patron.
+};
+
+#endif //LIBRARYMANAGEMENT_PATRONSTORE_H
@@ -0,0 +1,196 @@
+#ifndef LIBRARYMANAGEMENT_SEARCHCACHE_H
+#define LIBRARYMANAGEMENT_SEARCHCACHE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Counters of a search cache.
+ */
+struct SearchCacheStats {
+    uint64_t hits; ///< Lookups answered from the cache.
+    uint64_t misses; ///< Lookups that found no entry, or only one computed before the catalog last changed.
+    size_t entries; ///< Entries held.
+    size_t capacity; ///< The most entries the cache holds.
+
+    /**
+     * @brief Prints the counters on one line.
+     *
+     * @param out The stream to print to.
+     */
+    void print(ostream& out = cout) const {
+        uint64_t lookups = hits + misses;
+        out << "search cache: " << hits << " hits, " << misses << " misses (" << fixed << setprecision(1)
+            << (lookups == 0 ? 0.0 : 100.0 * static_cast<double>(hits) / static_cast<double>(lookups))
+            << "% hit rate), " << entries << " of " << capacity << " entries\n";
+    }
+};
+
+/**
+ * @class SearchCache
+ * @brief A bounded cache of search results, keyed by the query, in front of the searches that scan the catalog.
+ *
+ * Every result is stored with the generation of the data it was computed from, and a lookup passes the current
+ * generation: an entry from any other generation is a miss. The librarian bumps its generations after each change
+ * the results depend on, so nothing has to be erased when the catalog changes, and a search that raced a change
+ * stores its result under the generation it read beforehand, which no later lookup matches.
+ *
+ * Keys are spread over `SHARDS` shards, each with its own lock, so concurrent searches rarely wait for each other.
+ * A full shard evicts with the CLOCK algorithm: a hit sets the entry's reference bit, and the hand clears bits
+ * as it sweeps until it finds an entry without one. Popular queries are kept like under LRU, but a hit only sets a
+ * flag instead of moving the entry to the front of a list.
+ *
+ * @tparam Value The result of a search. Results are copied out, so they should be small, such as a few pointers.
+ */
+template<typename Value>
+class SearchCache {
+public:
+    static const size_t SHARDS = 16; ///< Number of independently locked shards.
+    static const size_t DEFAULT_CAPACITY = 4096; ///< Entries held by default, across all shards.
+
+    /**
+     * @brief Constructs an empty cache.
+     *
+     * @param capacity The most entries to hold, split evenly over the shards.
+     */
+    explicit SearchCache(size_t capacity = DEFAULT_CAPACITY) : shardCapacity(max<size_t>(1, capacity / SHARDS)) {
+    }
+
+    SearchCache(const SearchCache&) = delete;
+    SearchCache& operator=(const SearchCache&) = delete;
+
+    /**
+     * @brief Looks up the result of a query.
+     *
+     * @param key The query.
+     * @param generation The generation of the data the result must have been computed from.
+     * @param value Set to the cached result on a hit.
+     * @return true on a hit, false on a miss.
+     */
+    bool find(const string& key, unsigned long long generation, Value& value) {
+        Shard& shard = shardOf(key);
+        lock_guard<mutex> guard(shard.lock);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end() || shard.entries[it->second].generation != generation) {
+            shard.misses++;
+            return false;
+        }
+        Entry& entry = shard.entries[it->second];
+        entry.referenced = true;
+        value = entry.value;
+        shard.hits++;
+        return true;
+    }
+
+    /**
+     * @brief Stores the result of a query, replacing any older result and evicting another query if it is full.
+     *
+     * @param key The query.
+     * @param generation The generation read before the result was computed.
+     * @param value The result.
+     */
+    void store(const string& key, unsigned long long generation, const Value& value) {
+        Shard& shard = shardOf(key);
+        lock_guard<mutex> guard(shard.lock);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            Entry& entry = shard.entries[it->second];
+            entry.generation = generation;
+            entry.value = value;
+            entry.referenced = true;
+            return;
+        }
+        if (shard.entries.size() < shardCapacity) {
+            const string* stored = &shard.index.emplace(key, shard.entries.size()).first->first;
+            shard.entries.push_back({stored, generation, value, false});
+            return;
+        }
+        while (shard.entries[shard.hand].referenced) {
+            shard.entries[shard.hand].referenced = false;
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+        }
+        Entry& victim = shard.entries[shard.hand];
+        shard.index.erase(shard.index.find(*victim.key));
+        victim.key = &shard.index.emplace(key, shard.hand).first->first;
+        victim.generation = generation;
+        victim.value = value;
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+    }
+
+    /**
+     * @brief Gets the hit and miss counters and the number of entries.
+     *
+     * @return The counters, summed over the shards.
+     */
+    [[nodiscard]] SearchCacheStats stats() const {
+        SearchCacheStats total = {0, 0, 0, shardCapacity * SHARDS};
+        for (const Shard& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            total.hits += shard.hits;
+            total.misses += shard.misses;
+            total.entries += shard.entries.size();
+        }
+        return total;
+    }
+
+    /**
+     * @brief Clears the hit and miss counters, keeping the entries.
+     */
+    void resetStats() {
+        for (Shard& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            shard.hits = 0;
+            shard.misses = 0;
+        }
+    }
+
+private:
+    using Index = unordered_map<string, size_t>;
+
+    /**
+     * @brief One cached result.
+     */
+    struct Entry {
+        const string* key; ///< The entry's query, owned by its shard's index.
+        unsigned long long generation; ///< The generation the result was computed from.
+        Value value; ///< The result.
+        bool referenced; ///< Set by hits and cleared by the CLOCK hand; entries without it are evicted first.
+    };
+
+    /**
+     * @brief The entries of the keys that hash to one shard, on their own cache lines.
+     */
+    struct alignas(64) Shard {
+        mutable mutex lock; ///< Guards the rest of the shard.
+        Index index; ///< Position in `entries` of each cached query.
+        vector<Entry> entries; ///< The entries, in the order the CLOCK hand visits them.
+        size_t hand = 0; ///< The next entry the CLOCK hand looks at.
+        uint64_t hits = 0; ///< Lookups of this shard that hit.
+        uint64_t misses = 0; ///< Lookups of this shard that missed.
+    };
+
+    /**
+     * @brief Gets the shard of a query.
+     *
+     * @param key The query.
+     * @return The shard.
+     */
+    Shard& shardOf(const string& key) {
+        return shards[hash<string>()(key) % SHARDS];
+    }
+
+    Shard shards[SHARDS]; ///< The shards.
+    size_t shardCapacity; ///< The most entries each shard holds.
+};
+
+#endif //LIBRARYMANAGEMENT_SEARCHCACHE_H
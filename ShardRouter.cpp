@@ -0,0 +1,705 @@
+#include "ShardRouter.h"
+
+#ifdef __linux__
+
+#include "CommandProcessor.h"
+#include "Librarian.h"
+#include "LibraryHash.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * @brief Salt mixed into ISBNs before they are hashed to a shard, so shards split the hash differently from the
+ * ISBN filter, which uses the same hash unsalted.
+ */
+static const long long SHARD_SALT = 0x5DEECE66DLL;
+
+/**
+ * @brief The number of matches `fuzzy` lists, which is the default limit of `Librarian::searchFuzzy`.
+ */
+static const size_t FUZZY_LIMIT = 10;
+
+/**
+ * @brief Splits a response body into the blocks that start at lines with any of the given prefixes.
+ *
+ * Text before the first such line is dropped. Each block runs up to the next block, or the end of the body.
+ *
+ * @param body The body.
+ * @param prefixes The prefixes a block's first line starts with.
+ * @return The blocks, in order.
+ */
+static vector<string_view> splitBlocks(string_view body, initializer_list<string_view> prefixes) {
+    vector<string_view> blocks;
+    size_t start = string_view::npos;
+    size_t position = 0;
+    while (position < body.size()) {
+        size_t end = body.find('\n', position);
+        end = end == string_view::npos ? body.size() : end + 1;
+        string_view line = body.substr(position, end - position);
+        bool starts = any_of(prefixes.begin(), prefixes.end(), [line](string_view prefix) {
+            return line.starts_with(prefix);
+        });
+        if (starts) {
+            if (start != string_view::npos) {
+                blocks.push_back(body.substr(start, position - start));
+            }
+            start = position;
+        }
+        position = end;
+    }
+    if (start != string_view::npos) {
+        blocks.push_back(body.substr(start));
+    }
+    return blocks;
+}
+
+/**
+ * @brief Reads the ISBN of a book printed by `Book::getInfo`.
+ *
+ * @param block The book's text.
+ * @return The ISBN, or 0 if the text has none.
+ */
+static long long isbnOf(string_view block) {
+    const string_view label = "\n    ISBN: ";
+    size_t at = block.find(label);
+    long long ISBN = 0;
+    if (at != string_view::npos) {
+        from_chars(block.data() + at + label.size(), block.data() + block.size(), ISBN);
+    }
+    return ISBN;
+}
+
+/**
+ * @brief Splits a catalog into shards and starts a shard process for each, waiting until all of them serve.
+ *
+ * The processes are started together, so they load their parts of the catalog in parallel. Each runs this
+ * program with `--listen` on a Unix domain socket, and its standard output is discarded.
+ *
+ * @param catalogPath Path of the catalog CSV file.
+ * @param shards Number of shards.
+ * @param shardOptions Options passed to every shard process, such as `--threads 2`.
+ * @param logPath Path the shards' circulation logs are named after, with the shard number appended, or empty.
+ * @param archivePath Path of an archive for the first shard to load, or empty for none.
+ * @throws runtime_error if the catalog cannot be read or a shard does not start.
+ */
+ShardRouter::ShardRouter(const string &catalogPath, int shards, const vector<string> &shardOptions,
+                         const string &logPath, const string &archivePath)
+        : shards(static_cast<size_t>(max(shards, 1))), lineNumber(0), errors(0) {
+    const char* temp = getenv("TMPDIR");
+    string pattern = string(temp != nullptr && *temp != '\0' ? temp : "/tmp") + "/library-shards-XXXXXX";
+    if (mkdtemp(pattern.data()) == nullptr) {
+        throw runtime_error("Could not create a directory for the shards: " + string(strerror(errno)));
+    }
+    directory = pattern;
+    try {
+        for (size_t i = 0; i < this->shards.size(); i++) {
+            this->shards[i].catalogPath = directory + "/shard" + to_string(i) + ".csv";
+            this->shards[i].socketPath = directory + "/shard" + to_string(i) + ".sock";
+        }
+        partition(catalogPath);
+        for (int i = 0; i < static_cast<int>(this->shards.size()); i++) {
+            vector<string> options = shardOptions;
+            if (!logPath.empty()) {
+                options.insert(options.end(), {"--log", logPath + "." + to_string(i)});
+            }
+            if (i == 0 && !archivePath.empty()) {
+                options.insert(options.end(), {"--archive", archivePath});
+            }
+            start(i, options);
+        }
+        for (int i = 0; i < static_cast<int>(this->shards.size()); i++) {
+            connectTo(i);
+        }
+    } catch (...) {
+        stop();
+        throw;
+    }
+}
+
+/**
+ * @brief Destructor. Stops the shard processes and removes their files.
+ */
+ShardRouter::~ShardRouter() {
+    stop();
+}
+
+/**
+ * @brief Gets the shard that owns an ISBN.
+ *
+ * The salted hash of the ISBN is split into `shards` equal ranges, so ISBNs from one publisher's prefix are
+ * spread over every shard rather than crowding one.
+ *
+ * @param ISBN The ISBN.
+ * @param shards Number of shards.
+ * @return The shard, from 0 to `shards - 1`.
+ */
+int ShardRouter::shardOf(long long ISBN, int shards) {
+    unsigned __int128 hash = LibraryHash::mixISBN(ISBN ^ SHARD_SALT);
+    return static_cast<int>((hash * static_cast<unsigned>(shards)) >> 64);
+}
+
+/**
+ * @brief Runs one command line on the shards it concerns.
+ *
+ * @param line The command line, without its line break.
+ * @param out The stream to print the command's output and any error to.
+ * @return false if the line was `quit`, true otherwise.
+ */
+bool ShardRouter::execute(string_view line, ostream &out) {
+    lineNumber++;
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    string_view args = line;
+    string_view name = CommandProcessor::nextToken(args);
+    if (name.empty() || name.front() == '#') {
+        return true;
+    }
+    if (name == "quit") {
+        return false;
+    }
+    int count = static_cast<int>(shards.size());
+    long long ISBN = 0;
+    long long number = 0;
+    if (name == "checkout" || name == "return" || name == "reserve" || name == "cancel" || name == "renew" ||
+        name == "remove" || name == "search" || name == "add") {
+        string_view key = name == "add" ? args.substr(0, args.find(',')) : CommandProcessor::nextToken(args);
+        // A line without a valid ISBN goes to any shard, which reports its bad arguments.
+        int shard = CommandProcessor::parseISBN(key, ISBN) ? shardOf(ISBN, count) : 0;
+        send(shard, line);
+        print(receive(shard), out);
+    } else if (name == "list" || name == "checkedout" || name == "overdue" || name == "reservations" ||
+               name == "query") {
+        vector<Response> responses = broadcast(line);
+        bool found = false;
+        for (const Response& response : responses) {
+            if (!splitBlocks(response.body, {"Title: "}).empty()) {
+                out << response.body;
+                found = true;
+            }
+        }
+        if (!found) {
+            print(responses[0], out);
+        }
+    } else if (name == "title") {
+        vector<Response> responses = broadcast(line);
+        auto hit = find_if(responses.begin(), responses.end(), [](const Response& response) {
+            return response.body.starts_with("Title: ");
+        });
+        print(hit == responses.end() ? responses[0] : *hit, out);
+    } else if (name == "fuzzy") {
+        printMergedByDistance(broadcast(line), out);
+    } else if (name == "range" || name == "prefix") {
+        printMergedByIsbn(broadcast(line), out);
+    } else if (name == "page" && CommandProcessor::parseNumber(CommandProcessor::nextToken(args), number) &&
+               number > 0) {
+        page(line, number, out);
+    } else if (name == "account") {
+        printAccount(broadcast(line), out);
+    } else if (name == "export" && !args.empty()) {
+        exportCatalog(string(args), out);
+    } else if (name == "stats" || name == "memory") {
+        vector<Response> responses = broadcast(line);
+        if (!responses[0].ok) {
+            print(responses[0], out);
+        } else if (args == "json") {
+            // One JSON array of the shards' reports, so the output stays valid JSON.
+            out << '[';
+            for (int i = 0; i < count; i++) {
+                out << (i == 0 ? "" : ",") << responses[i].body;
+            }
+            out << "]\n";
+        } else if (args != "reset") {
+            for (int i = 0; i < count; i++) {
+                out << "Shard " << i << ":\n" << responses[i].body;
+            }
+        }
+    } else if (name == "patron" || name == "advance") {
+        // Every shard registers the same patrons in the same order, so the IDs they give agree.
+        print(broadcast(line)[0], out);
+    } else {
+        // Unknown commands, bad arguments and the archive, which only the first shard loads.
+        send(0, line);
+        print(receive(0), out);
+    }
+    return true;
+}
+
+/**
+ * @brief Runs every command line of a stream until the end of the stream or a `quit` command.
+ *
+ * @param in The stream to read commands from.
+ * @param out The stream to print output to.
+ * @return The number of lines read.
+ */
+long ShardRouter::run(istream &in, ostream &out) {
+    long lines = 0;
+    string line;
+    while (getline(in, line)) {
+        lines++;
+        if (!execute(line, out)) {
+            break;
+        }
+    }
+    return lines;
+}
+
+/**
+ * @brief Gets the number of lines that were not valid commands so far.
+ *
+ * @return The number of invalid lines.
+ */
+unsigned long ShardRouter::getErrorCount() const {
+    return errors;
+}
+
+/**
+ * @brief Writes each shard's rows of the catalog to its own file, with the catalog's header line.
+ *
+ * The catalog is read a line at a time, so it is never held in memory whole. A row is assigned by its first
+ * field, read the way the librarian reads ISBNs; rows whose ISBN cannot be read go to the first shard, which
+ * reports them when it loads.
+ *
+ * @param catalogPath Path of the catalog CSV file.
+ * @throws runtime_error if a file cannot be read or written.
+ */
+void ShardRouter::partition(const string &catalogPath) {
+    ifstream catalog(catalogPath, ios::binary);
+    if (!catalog) {
+        throw runtime_error("Could not read " + catalogPath);
+    }
+    vector<ofstream> parts(shards.size());
+    string line;
+    getline(catalog, line);
+    for (size_t i = 0; i < shards.size(); i++) {
+        parts[i].open(shards[i].catalogPath, ios::binary);
+        parts[i] << line << '\n';
+    }
+    int count = static_cast<int>(shards.size());
+    while (getline(catalog, line)) {
+        int shard = 0;
+        string ISBN = line.substr(0, line.find(','));
+        try {
+            shard = shardOf(LibraryHash::formatISBN(ISBN), count);
+        } catch (const exception&) {
+        }
+        parts[static_cast<size_t>(shard)] << line << '\n';
+    }
+    for (size_t i = 0; i < shards.size(); i++) {
+        parts[i].close();
+        if (!parts[i]) {
+            throw runtime_error("Could not write " + shards[i].catalogPath);
+        }
+    }
+}
+
+/**
+ * @brief Starts a shard process, without waiting for it to load its catalog.
+ *
+ * @param shard The shard's number.
+ * @param options The options to pass to the process after its catalog and socket.
+ * @throws runtime_error if the process cannot be started.
+ */
+void ShardRouter::start(int shard, const vector<string> &options) {
+    Shard& s = shards[static_cast<size_t>(shard)];
+    vector<string> arguments = {"library-shard", "--catalog", s.catalogPath, "--listen", "unix:" + s.socketPath};
+    arguments.insert(arguments.end(), options.begin(), options.end());
+    vector<char*> argv;
+    for (string& argument : arguments) {
+        argv.push_back(argument.data());
+    }
+    argv.push_back(nullptr);
+    s.pid = fork();
+    if (s.pid < 0) {
+        throw runtime_error("Could not start shard " + to_string(shard) + ": " + strerror(errno));
+    }
+    if (s.pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+}
+
+/**
+ * @brief Waits until a shard process serves and connects to it.
+ *
+ * The shard's socket only accepts once its catalog is loaded, so the connection is retried until it does.
+ *
+ * @param shard The shard's number.
+ * @throws runtime_error if the process exits first.
+ */
+void ShardRouter::connectTo(int shard) {
+    Shard& s = shards[static_cast<size_t>(shard)];
+    sockaddr_un addr{};
+    if (s.socketPath.size() >= sizeof(addr.sun_path)) {
+        throw runtime_error("Invalid socket path " + s.socketPath);
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, s.socketPath.c_str());
+    for (;;) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+            s.fd = fd;
+            return;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        int status;
+        if (waitpid(s.pid, &status, WNOHANG) == s.pid) {
+            s.pid = -1;
+            throw runtime_error("Shard " + to_string(shard) + " exited before it served");
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+}
+
+/**
+ * @brief Closes the connections, stops the shard processes and removes their files.
+ *
+ * Closing a connection lets a shard finish the requests it has, and SIGTERM then stops its server.
+ */
+void ShardRouter::stop() {
+    for (Shard& s : shards) {
+        if (s.fd >= 0) {
+            close(s.fd);
+            s.fd = -1;
+        }
+        if (s.pid > 0) {
+            kill(s.pid, SIGTERM);
+        }
+    }
+    for (Shard& s : shards) {
+        if (s.pid > 0) {
+            waitpid(s.pid, nullptr, 0);
+            s.pid = -1;
+        }
+        unlink(s.catalogPath.c_str());
+        unlink(s.socketPath.c_str());
+    }
+    if (!directory.empty()) {
+        rmdir(directory.c_str());
+        directory.clear();
+    }
+}
+
+/**
+ * @brief Sends a request to a shard without waiting for the response.
+ *
+ * @param shard The shard's number.
+ * @param line The request.
+ * @throws runtime_error if the shard has gone.
+ */
+void ShardRouter::send(int shard, string_view line) {
+    string request(line);
+    request += '\n';
+    size_t sent = 0;
+    while (sent < request.size()) {
+        ssize_t n = ::send(shards[static_cast<size_t>(shard)].fd, request.data() + sent, request.size() - sent,
+                           MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw runtime_error("Lost shard " + to_string(shard) + ": " + strerror(errno));
+        }
+        sent += static_cast<size_t>(n);
+    }
+}
+
+/**
+ * @brief Waits for a shard's response to its oldest unanswered request.
+ *
+ * @param shard The shard's number.
+ * @return The response.
+ * @throws runtime_error if the shard has gone.
+ */
+ShardRouter::Response ShardRouter::receive(int shard) {
+    Shard& s = shards[static_cast<size_t>(shard)];
+    for (;;) {
+        size_t header = s.input.find('\n');
+        if (header != string::npos) {
+            size_t length = 0;
+            from_chars(s.input.data() + 1, s.input.data() + header, length);
+            if (s.input.size() - header - 1 >= length) {
+                Response response{s.input[0] == '+', s.input.substr(header + 1, length)};
+                s.input.erase(0, header + 1 + length);
+                return response;
+            }
+        }
+        char buffer[1 << 16];
+        ssize_t n = read(s.fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw runtime_error("Lost shard " + to_string(shard));
+        }
+        s.input.append(buffer, static_cast<size_t>(n));
+    }
+}
+
+/**
+ * @brief Sends a request to every shard and waits for all the responses, so the shards run it in parallel.
+ *
+ * @param line The request.
+ * @return The responses, by shard.
+ */
+vector<ShardRouter::Response> ShardRouter::broadcast(string_view line) {
+    int count = static_cast<int>(shards.size());
+    for (int i = 0; i < count; i++) {
+        send(i, line);
+    }
+    vector<Response> responses;
+    responses.reserve(shards.size());
+    for (int i = 0; i < count; i++) {
+        responses.push_back(receive(i));
+    }
+    return responses;
+}
+
+/**
+ * @brief Prints a response, or reports its error under the router's line number.
+ *
+ * A shard numbers the lines of its own connection, so the `line N` that starts its error is replaced.
+ *
+ * @param response The response.
+ * @param out The stream to print to.
+ */
+void ShardRouter::print(const Response &response, ostream &out) {
+    if (response.ok) {
+        out << response.body;
+        return;
+    }
+    errors++;
+    size_t colon = response.body.find(": ");
+    if (response.body.starts_with("line ") && colon != string::npos) {
+        out << "line " << lineNumber << response.body.substr(colon);
+    } else {
+        out << response.body;
+    }
+}
+
+/**
+ * @brief Prints the books every shard listed, merged in ISBN order.
+ *
+ * Each shard lists its books in ISBN order, so merging them gives the order of one librarian's listing. If no
+ * shard has a book, the first shard's answer is printed.
+ *
+ * @param responses The responses, by shard.
+ * @param out The stream to print to.
+ */
+void ShardRouter::printMergedByIsbn(const vector<Response> &responses, ostream &out) {
+    vector<pair<long long, string_view>> books;
+    for (const Response& response : responses) {
+        for (string_view block : splitBlocks(response.body, {"Title: "})) {
+            books.emplace_back(isbnOf(block), block);
+        }
+    }
+    if (books.empty()) {
+        print(responses[0], out);
+        return;
+    }
+    stable_sort(books.begin(), books.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    for (const auto& book : books) {
+        out << book.second;
+    }
+}
+
+/**
+ * @brief Prints the fuzzy matches of every shard, best first, up to the number one librarian would list.
+ *
+ * Matches are ranked by edit distance, then title matches before author matches, as `FuzzyIndex` ranks them.
+ * Each shard lists its own best matches, so the best matches over all shards are among them.
+ *
+ * @param responses The responses, by shard.
+ * @param out The stream to print to.
+ */
+void ShardRouter::printMergedByDistance(const vector<Response> &responses, ostream &out) {
+    /**
+     * @brief A match as a shard printed it.
+     */
+    struct Match {
+        long long distance; ///< The edit distance.
+        bool author; ///< Whether the match was on the author.
+        string_view text; ///< The printed match.
+    };
+    vector<Match> matches;
+    for (const Response& response : responses) {
+        for (string_view block : splitBlocks(response.body, {"Title matched with ", "Author matched with "})) {
+            Match match{0, block.starts_with("Author"), block};
+            string_view rest = block.substr(block.find(" with ") + 6);
+            CommandProcessor::parseNumber(rest.substr(0, rest.find(' ')), match.distance);
+            matches.push_back(match);
+        }
+    }
+    if (matches.empty()) {
+        print(responses[0], out);
+        return;
+    }
+    stable_sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+        return a.distance != b.distance ? a.distance < b.distance : a.author < b.author;
+    });
+    matches.resize(min(matches.size(), FUZZY_LIMIT));
+    for (const Match& match : matches) {
+        out << match.text;
+    }
+}
+
+/**
+ * @brief Runs a `page` request on every shard and prints the first books of the merged pages.
+ *
+ * Every shard lists the page from the same cursor. A shard that did not reach its end has only listed its books
+ * before its next cursor, so the merged books are complete only up to the smallest of those cursors: the page
+ * shows at most `count` of the books before it, and the next page starts at the first book not shown.
+ *
+ * @param line The request.
+ * @param count The number of books on a page.
+ * @param out The stream to print to.
+ */
+void ShardRouter::page(string_view line, long long count, ostream &out) {
+    vector<Response> responses = broadcast(line);
+    vector<pair<long long, string_view>> books;
+    long long bound = LLONG_MAX;
+    for (const Response& response : responses) {
+        string_view body = response.body;
+        size_t last = body.size() < 2 ? 0 : body.rfind('\n', body.size() - 2) + 1;
+        string_view tail = body.substr(last);
+        long long next;
+        if (tail.starts_with("Next page: ") &&
+            Librarian::decodeCursor(tail.substr(11, tail.size() - 12), next)) {
+            bound = min(bound, next);
+        } else if (tail != "Last page.\n") {
+            // A bad cursor or query, which every shard reports alike.
+            print(responses[0], out);
+            return;
+        }
+        for (string_view block : splitBlocks(body.substr(0, last), {"Title: "})) {
+            books.emplace_back(isbnOf(block), block);
+        }
+    }
+    stable_sort(books.begin(), books.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    long long shown = 0;
+    long long next = bound;
+    for (const auto& book : books) {
+        if (book.first >= bound) {
+            break;
+        }
+        if (shown == count) {
+            next = book.first;
+            break;
+        }
+        out << book.second;
+        shown++;
+    }
+    if (next == LLONG_MAX) {
+        out << "Last page.\n";
+    } else {
+        out << "Next page: " << Librarian::encodeCursor(next) << '\n';
+    }
+}
+
+/**
+ * @brief Prints a patron's account over every shard, with the loans, holds and fines added up.
+ *
+ * @param responses The responses, by shard.
+ * @param out The stream to print to.
+ */
+void ShardRouter::printAccount(const vector<Response> &responses, ostream &out) {
+    long long patron;
+    int loans = 0;
+    int holds = 0;
+    long long fines = 0;
+    for (const Response& response : responses) {
+        int shardLoans;
+        int shardHolds;
+        long long shardFines;
+        if (!response.ok || sscanf(response.body.c_str(), "Patron %lld: %d loans, %d holds, fines owed: %lld",
+                                   &patron, &shardLoans, &shardHolds, &shardFines) != 4) {
+            // Bad arguments, or no such patron, which every shard reports alike.
+            print(responses[0], out);
+            return;
+        }
+        loans += shardLoans;
+        holds += shardHolds;
+        fines += shardFines;
+    }
+    out << "Patron " << patron << ": " << loans << " loans, " << holds << " holds, fines owed: " << fines << '\n';
+    for (string_view kind : {"  Loan: ", "  Hold: "}) {
+        for (const Response& response : responses) {
+            for (string_view block : splitBlocks(response.body, {kind})) {
+                // A loan block runs on to the holds after it; keep only its own lines.
+                size_t end = kind == "  Loan: " ? block.find("\n  Hold: ") : string_view::npos;
+                out << block.substr(0, end == string_view::npos ? block.size() : end + 1);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Has every shard export its part of the catalog and joins the parts into one file.
+ *
+ * The shards write their parts in parallel, next to the file, and the parts are joined with one header line.
+ *
+ * @param path Path of the file to write.
+ * @param out The stream to print errors to.
+ */
+void ShardRouter::exportCatalog(const string &path, ostream &out) {
+    int count = static_cast<int>(shards.size());
+    for (int i = 0; i < count; i++) {
+        send(i, "export " + path + ".shard" + to_string(i));
+    }
+    bool written = true;
+    for (int i = 0; i < count; i++) {
+        Response response = receive(i);
+        written = written && response.ok && response.body.empty();
+    }
+    ofstream file;
+    if (written) {
+        file.open(path, ios::binary);
+    }
+    string line;
+    for (int i = 0; i < count; i++) {
+        string partPath = path + ".shard" + to_string(i);
+        {
+            ifstream part(partPath, ios::binary);
+            if (written && file && part && getline(part, line)) {
+                if (i == 0) {
+                    file << line << '\n';
+                }
+                // Inserting an empty buffer would mark the file as failed.
+                if (part.peek() != char_traits<char>::eof()) {
+                    file << part.rdbuf();
+                }
+            }
+        }
+        unlink(partPath.c_str());
+    }
+    file.close();
+    if (!written || !file) {
+        out << "Could not write " << path << ".\n";
+    }
+}
+
+#endif //__linux__
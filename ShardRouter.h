@@ -0,0 +1,233 @@
+#ifndef LIBRARYMANAGEMENT_SHARDROUTER_H
+#define LIBRARYMANAGEMENT_SHARDROUTER_H
+
+#ifdef __linux__
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class ShardRouter
+ * @brief Splits a catalog over several shard processes and runs commands against them as if they were one library.
+ *
+ * Each shard is a child process serving its part of the catalog with a `LibraryServer` on a Unix domain socket in
+ * a private directory. Books are assigned to shards by a hash of their ISBN, split into equal ranges, so a shard
+ * holds about `1/N` of the catalog and has its own circulation lock. The router runs the `CommandProcessor`
+ * command language and forwards each command:
+ *
+ * - commands about one book (`checkout`, `return`, `reserve`, `cancel`, `renew`, `add`, `remove`, `search`) go to
+ *   the shard that owns its ISBN;
+ * - listings and searches are sent to every shard at once, and their answers are gathered: `range`, `prefix` and
+ *   `page` are merged in ISBN order, `fuzzy` by edit distance, `title` takes the first shard that found the book,
+ *   and `account` adds up the patron's loans, holds and fines;
+ * - `patron` and `advance` run on every shard. Every shard registers the same patrons in the same order, so a
+ *   patron has the same ID everywhere;
+ * - `export` has every shard write its part and joins the parts into one file;
+ * - `stats` and `memory` print each shard's report under its own heading.
+ *
+ * Errors are reported with the router's line numbers. A listing that runs on every shard is not one consistent
+ * snapshot: each shard reads its own, so a listing may see a change on one shard and not yet on another.
+ *
+ * Each shard keeps its own copy of the patron accounts, so the loan and hold limits apply per shard: a patron may
+ * have up to the limit on every shard, and `account` reports the totals. Enforcing them across shards would take
+ * a round trip to every shard before each checkout, and holds filled by a return would still only see their own
+ * shard's loans.
+ *
+ * A router is not thread-safe. Only available on Linux.
+ */
+class ShardRouter {
+public:
+    /**
+     * @brief Splits a catalog into shards and starts a shard process for each, waiting until all of them serve.
+     *
+     * @param catalogPath Path of the catalog CSV file.
+     * @param shards Number of shards.
+     * @param shardOptions Options passed to every shard process, such as `--threads 2`.
+     * @param logPath Path the shards' circulation logs are named after, with the shard number appended, or empty.
+     * @param archivePath Path of an archive for the first shard to load, or empty for none.
+     * @throws runtime_error if the catalog cannot be read or a shard does not start.
+     */
+    ShardRouter(const string& catalogPath, int shards, const vector<string>& shardOptions, const string& logPath,
+                const string& archivePath);
+
+    /**
+     * @brief Destructor. Stops the shard processes and removes their files.
+     */
+    ~ShardRouter();
+
+    ShardRouter(const ShardRouter&) = delete;
+    ShardRouter& operator=(const ShardRouter&) = delete;
+
+    /**
+     * @brief Gets the shard that owns an ISBN.
+     *
+     * @param ISBN The ISBN.
+     * @param shards Number of shards.
+     * @return The shard, from 0 to `shards - 1`.
+     */
+    static int shardOf(long long ISBN, int shards);
+
+    /**
+     * @brief Runs one command line on the shards it concerns.
+     *
+     * @param line The command line, without its line break.
+     * @param out The stream to print the command's output and any error to.
+     * @return false if the line was `quit`, true otherwise.
+     */
+    bool execute(string_view line, ostream& out);
+
+    /**
+     * @brief Runs every command line of a stream until the end of the stream or a `quit` command.
+     *
+     * @param in The stream to read commands from.
+     * @param out The stream to print output to.
+     * @return The number of lines read.
+     */
+    long run(istream& in, ostream& out);
+
+    /**
+     * @brief Gets the number of lines that were not valid commands so far.
+     *
+     * @return The number of invalid lines.
+     */
+    [[nodiscard]] unsigned long getErrorCount() const;
+
+private:
+    /**
+     * @brief One shard process and the connection to it.
+     */
+    struct Shard {
+        pid_t pid = -1; ///< The process, or -1 if it is not running.
+        int fd = -1; ///< The connection to the process's server, or -1.
+        string catalogPath; ///< The shard's part of the catalog.
+        string socketPath; ///< The socket the shard serves on.
+        string input; ///< Bytes read from the connection that are not part of a response yet.
+    };
+
+    /**
+     * @brief A shard's answer to one request.
+     */
+    struct Response {
+        bool ok; ///< false if the shard reported the request as not valid.
+        string body; ///< The text the command printed.
+    };
+
+    /**
+     * @brief Writes each shard's rows of the catalog to its own file, with the catalog's header line.
+     *
+     * @param catalogPath Path of the catalog CSV file.
+     * @throws runtime_error if a file cannot be read or written.
+     */
+    void partition(const string& catalogPath);
+
+    /**
+     * @brief Starts a shard process, without waiting for it to load its catalog.
+     *
+     * @param shard The shard's number.
+     * @param options The options to pass to the process after its catalog and socket.
+     * @throws runtime_error if the process cannot be started.
+     */
+    void start(int shard, const vector<string>& options);
+
+    /**
+     * @brief Waits until a shard process serves and connects to it.
+     *
+     * @param shard The shard's number.
+     * @throws runtime_error if the process exits first.
+     */
+    void connectTo(int shard);
+
+    /**
+     * @brief Closes the connections, stops the shard processes and removes their files.
+     */
+    void stop();
+
+    /**
+     * @brief Sends a request to a shard without waiting for the response.
+     *
+     * @param shard The shard's number.
+     * @param line The request.
+     * @throws runtime_error if the shard has gone.
+     */
+    void send(int shard, string_view line);
+
+    /**
+     * @brief Waits for a shard's response to its oldest unanswered request.
+     *
+     * @param shard The shard's number.
+     * @return The response.
+     * @throws runtime_error if the shard has gone.
+     */
+    Response receive(int shard);
+
+    /**
+     * @brief Sends a request to every shard and waits for all the responses, so the shards run it in parallel.
+     *
+     * @param line The request.
+     * @return The responses, by shard.
+     */
+    vector<Response> broadcast(string_view line);
+
+    /**
+     * @brief Prints a response, or reports its error under the router's line number.
+     *
+     * @param response The response.
+     * @param out The stream to print to.
+     */
+    void print(const Response& response, ostream& out);
+
+    /**
+     * @brief Prints the books every shard listed, merged in ISBN order.
+     *
+     * @param responses The responses, by shard.
+     * @param out The stream to print to.
+     */
+    void printMergedByIsbn(const vector<Response>& responses, ostream& out);
+
+    /**
+     * @brief Prints the fuzzy matches of every shard, best first, up to the number one librarian would list.
+     *
+     * @param responses The responses, by shard.
+     * @param out The stream to print to.
+     */
+    void printMergedByDistance(const vector<Response>& responses, ostream& out);
+
+    /**
+     * @brief Runs a `page` request on every shard and prints the first books of the merged pages.
+     *
+     * @param line The request.
+     * @param count The number of books on a page.
+     * @param out The stream to print to.
+     */
+    void page(string_view line, long long count, ostream& out);
+
+    /**
+     * @brief Prints a patron's account over every shard, with the loans, holds and fines added up.
+     *
+     * @param responses The responses, by shard.
+     * @param out The stream to print to.
+     */
+    void printAccount(const vector<Response>& responses, ostream& out);
+
+    /**
+     * @brief Has every shard export its part of the catalog and joins the parts into one file.
+     *
+     * @param path Path of the file to write.
+     * @param out The stream to print errors to.
+     */
+    void exportCatalog(const string& path, ostream& out);
+
+    string directory; ///< The private directory holding the shards' catalogs and sockets.
+    vector<Shard> shards; ///< The shards.
+    long lineNumber; ///< Number of lines passed to `execute` so far.
+    unsigned long errors; ///< Number of lines that were not valid commands.
+};
+
+#endif //__linux__
+
+#endif //LIBRARYMANAGEMENT_SHARDROUTER_H
@@ -0,0 +1,143 @@
+#ifndef LIBRARYMANAGEMENT_TASK_H
+#define LIBRARYMANAGEMENT_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+using namespace std;
+
+/**
+ * @brief Holds the value a `Task` coroutine returns.
+ */
+template<typename T>
+struct TaskResult {
+    optional<T> value; ///< The returned value, once the coroutine has returned.
+
+    template<typename U>
+    void return_value(U&& v) {
+        value.emplace(std::forward<U>(v));
+    }
+
+    T take() {
+        return std::move(*value);
+    }
+};
+
+/**
+ * @brief `TaskResult` for coroutines that return nothing.
+ */
+template<>
+struct TaskResult<void> {
+    void return_void() {
+    }
+
+    void take() {
+    }
+};
+
+/**
+ * @class Task
+ * @brief A coroutine that produces a value of type T when awaited.
+ *
+ * A task does not start until it is awaited with `co_await`. The awaiting coroutine is suspended while
+ * the task runs and is resumed directly when the task returns, without going through a queue, so a chain
+ * of awaited tasks costs no more than the calls it makes. Exceptions thrown by the task are rethrown
+ * in the awaiting coroutine. Use `CoroutineExecutor::spawn` to start a task that nothing awaits.
+ *
+ * @tparam T The type of the result, or void.
+ */
+template<typename T>
+class Task {
+public:
+    /**
+     * @brief The coroutine promise of a task.
+     */
+    struct promise_type : TaskResult<T> {
+        coroutine_handle<> continuation; ///< The coroutine awaiting this task.
+        exception_ptr error; ///< The exception the task ended with, if any.
+
+        Task get_return_object() {
+            return Task(coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        /**
+         * @brief Resumes the awaiting coroutine when the task finishes.
+         */
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            coroutine_handle<> await_suspend(coroutine_handle<promise_type> finished) noexcept {
+                coroutine_handle<> next = finished.promise().continuation;
+                return next ? next : noop_coroutine();
+            }
+
+            void await_resume() noexcept {
+            }
+        };
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void unhandled_exception() {
+            error = current_exception();
+        }
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    /**
+     * @brief Destructor. Frees the coroutine frame.
+     */
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() {
+        if (handle.promise().error) {
+            rethrow_exception(handle.promise().error);
+        }
+        return handle.promise().take();
+    }
+
+private:
+    explicit Task(coroutine_handle<promise_type> handle) : handle(handle) {
+    }
+
+    coroutine_handle<promise_type> handle; ///< The task's coroutine.
+};
+
+#endif //LIBRARYMANAGEMENT_TASK_H
@@ -0,0 +1,201 @@
+#include "TaskScheduler.h"
+#include <cstdlib>
+
+/**
+ * @brief Index of the worker running on this thread, or -1 on threads that aren't workers.
+ */
+static thread_local int currentWorker = -1;
+
+/**
+ * @brief Scheduler whose worker is running on this thread, or nullptr.
+ */
+static thread_local const TaskScheduler* currentScheduler = nullptr;
+
+/**
+ * @brief Thread count requested for the process-wide scheduler, 0 for the default.
+ */
+static atomic<int> defaultThreadCount(0);
+
+/**
+ * @brief Constructs a scheduler.
+ *
+ * @param threads Number of threads that run tasks, including the thread that starts a loop. 1 runs everything serially.
+ */
+TaskScheduler::TaskScheduler(int threads) : queued(0), nextQueue(0), stopping(false) {
+    for (int i = 1; i < threads; i++) {
+        workers.push_back(make_unique<Worker>());
+    }
+    for (int i = 0; i < static_cast<int>(workers.size()); i++) {
+        this->threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+/**
+ * @brief Destructor. Stops and joins the worker threads.
+ */
+TaskScheduler::~TaskScheduler() {
+    {
+        lock_guard<mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread& t : threads) {
+        t.join();
+    }
+}
+
+/**
+ * @brief Gets the process-wide scheduler, creating it on first use.
+ *
+ * @return Reference to the scheduler.
+ */
+TaskScheduler &TaskScheduler::instance() {
+    static TaskScheduler scheduler([] {
+        int threads = defaultThreadCount.load();
+        if (threads <= 0) {
+            const char* env = getenv("LIBRARY_THREADS");
+            threads = env != nullptr ? atoi(env) : 0;
+        }
+        if (threads <= 0) {
+            threads = static_cast<int>(thread::hardware_concurrency());
+        }
+        return threads > 0 ? threads : 1;
+    }());
+    return scheduler;
+}
+
+/**
+ * @brief Sets the number of threads the process-wide scheduler is created with.
+ *
+ * Has no effect once `instance()` has been called.
+ *
+ * @param threads Number of threads, or 0 to use the default.
+ */
+void TaskScheduler::setDefaultThreadCount(int threads) {
+    defaultThreadCount = threads;
+}
+
+/**
+ * @brief Gets the number of threads that run tasks, including the thread that starts a loop.
+ *
+ * @return The thread count.
+ */
+int TaskScheduler::getThreadCount() const {
+    return static_cast<int>(workers.size()) + 1;
+}
+
+/**
+ * @brief Runs a loop body over a range of indexes in parallel.
+ *
+ * The range is split in halves until pieces are at most `grain` long, and each piece is passed to `body`.
+ * Returns once every piece has run.
+ *
+ * @param begin First index of the range.
+ * @param end One past the last index of the range.
+ * @param grain Largest piece handed to `body` at once.
+ * @param body Called with the first and one-past-last index of each piece, from several threads at once.
+ */
+void TaskScheduler::parallelFor(size_t begin, size_t end, size_t grain, const function<void(size_t, size_t)> &body) {
+    if (end <= begin) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    if (workers.empty() || end - begin <= grain) {
+        body(begin, end);
+        return;
+    }
+
+    atomic<size_t> pending(0);
+    // Keeps the left half and queues the right half, so thieves take the largest pieces left.
+    function<void(size_t, size_t)> split = [&](size_t from, size_t to) {
+        while (to - from > grain) {
+            size_t mid = from + (to - from) / 2;
+            pending++;
+            push([&split, &pending, mid, to] {
+                split(mid, to);
+                pending--;
+            });
+            to = mid;
+        }
+        body(from, to);
+    };
+    split(begin, end);
+
+    int self = currentScheduler == this ? currentWorker : -1;
+    while (pending.load() != 0) {
+        if (!runOne(self)) {
+            this_thread::yield();
+        }
+    }
+}
+
+/**
+ * @brief Queues a task on the calling worker's queue, or on the next worker's queue for other threads.
+ *
+ * @param task The task to queue.
+ */
+void TaskScheduler::push(function<void()> task) {
+    size_t index = currentScheduler == this ? currentWorker : nextQueue++ % workers.size();
+    {
+        lock_guard<mutex> guard(workers[index]->lock);
+        workers[index]->tasks.push_back(move(task));
+    }
+    queued++;
+    {
+        lock_guard<mutex> guard(sleepLock);
+    }
+    wake.notify_one();
+}
+
+/**
+ * @brief Runs one queued task, preferring the worker's own queue and stealing otherwise.
+ *
+ * @param self Index of the calling worker, or -1 if the caller is not a worker.
+ * @return true if a task was run, false if every queue was empty.
+ */
+bool TaskScheduler::runOne(int self) {
+    function<void()> task;
+    if (self >= 0) {
+        Worker& own = *workers[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    size_t count = workers.size();
+    size_t start = self >= 0 ? self + 1 : nextQueue.load();
+    for (size_t i = 0; !task && i < count; i++) {
+        Worker& victim = *workers[(start + i) % count];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    queued--;
+    task();
+    return true;
+}
+
+/**
+ * @brief Body of a worker thread. Runs tasks until the scheduler is destroyed.
+ *
+ * @param self Index of the worker.
+ */
+void TaskScheduler::workerLoop(int self) {
+    currentWorker = self;
+    currentScheduler = this;
+    while (!stopping.load()) {
+        if (runOne(self)) {
+            continue;
+        }
+        unique_lock<mutex> guard(sleepLock);
+        wake.wait(guard, [this] { return stopping.load() || queued.load() != 0; });
+    }
+}
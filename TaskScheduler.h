@@ -0,0 +1,155 @@
+#ifndef LIBRARYMANAGEMENT_TASKSCHEDULER_H
+#define LIBRARYMANAGEMENT_TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @class TaskScheduler
+ * @brief A work-stealing thread pool for the library's bulk jobs.
+ *
+ * Each worker thread has its own task queue. A worker runs the newest task of its own queue first and
+ * steals the oldest task of another worker's queue when its own is empty, so a large job split into
+ * halves spreads itself across idle workers. A thread that starts a parallel loop also runs tasks until
+ * the loop is done, which makes nested parallel loops safe.
+ *
+ * The process-wide scheduler is created on first use of `instance()` with the number of threads given
+ * to `setDefaultThreadCount`, or the `LIBRARY_THREADS` environment variable, or one per core.
+ */
+class TaskScheduler {
+public:
+    /**
+     * @brief Constructs a scheduler.
+     *
+     * @param threads Number of threads that run tasks, including the thread that starts a loop. 1 runs everything serially.
+     */
+    explicit TaskScheduler(int threads);
+
+    /**
+     * @brief Destructor. Stops and joins the worker threads.
+     */
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    /**
+     * @brief Gets the process-wide scheduler, creating it on first use.
+     *
+     * @return Reference to the scheduler.
+     */
+    static TaskScheduler& instance();
+
+    /**
+     * @brief Sets the number of threads the process-wide scheduler is created with.
+     *
+     * Has no effect once `instance()` has been called.
+     *
+     * @param threads Number of threads, or 0 to use the default.
+     */
+    static void setDefaultThreadCount(int threads);
+
+    /**
+     * @brief Gets the number of threads that run tasks, including the thread that starts a loop.
+     *
+     * @return The thread count.
+     */
+    [[nodiscard]] int getThreadCount() const;
+
+    /**
+     * @brief Runs a loop body over a range of indexes in parallel.
+     *
+     * The range is split in halves until pieces are at most `grain` long, and each piece is passed to `body`.
+     * Returns once every piece has run.
+     *
+     * @param begin First index of the range.
+     * @param end One past the last index of the range.
+     * @param grain Largest piece handed to `body` at once.
+     * @param body Called with the first and one-past-last index of each piece, from several threads at once.
+     */
+    void parallelFor(size_t begin, size_t end, size_t grain, const function<void(size_t, size_t)>& body);
+
+    /**
+     * @brief Maps pieces of a range in parallel and combines the results in index order.
+     *
+     * @param begin First index of the range.
+     * @param end One past the last index of the range.
+     * @param grain Length of each piece passed to `map`.
+     * @param identity The result of an empty range.
+     * @param map Called with the first and one-past-last index of a piece, returning the piece's result.
+     * @param combine Combines two results. Results are combined from left to right.
+     * @return The combined result of every piece.
+     */
+    template<typename T, typename Map, typename Combine>
+    T parallelReduce(size_t begin, size_t end, size_t grain, T identity, const Map& map, const Combine& combine) {
+        if (end <= begin) {
+            return identity;
+        }
+        if (grain == 0) {
+            grain = 1;
+        }
+        size_t pieces = (end - begin + grain - 1) / grain;
+        vector<T> partial(pieces, identity);
+        parallelFor(0, pieces, 1, [&](size_t first, size_t last) {
+            for (size_t p = first; p < last; p++) {
+                size_t from = begin + p * grain;
+                size_t to = from + grain < end ? from + grain : end;
+                partial[p] = map(from, to);
+            }
+        });
+        T result = identity;
+        for (const T& r : partial) {
+            result = combine(result, r);
+        }
+        return result;
+    }
+
+private:
+    /**
+     * @brief A worker's task queue.
+     */
+    struct Worker {
+        deque<function<void()>> tasks; ///< Tasks, newest at the back.
+        mutex lock; ///< Guards `tasks`.
+    };
+
+    /**
+     * @brief Queues a task on the calling worker's queue, or on the next worker's queue for other threads.
+     *
+     * @param task The task to queue.
+     */
+    void push(function<void()> task);
+
+    /**
+     * @brief Runs one queued task, preferring the worker's own queue and stealing otherwise.
+     *
+     * @param self Index of the calling worker, or -1 if the caller is not a worker.
+     * @return true if a task was run, false if every queue was empty.
+     */
+    bool runOne(int self);
+
+    /**
+     * @brief Body of a worker thread. Runs tasks until the scheduler is destroyed.
+     *
+     * @param self Index of the worker.
+     */
+    void workerLoop(int self);
+
+    vector<unique_ptr<Worker>> workers; ///< Task queues, one per worker thread.
+    vector<thread> threads; ///< Worker threads.
+    atomic<size_t> queued; ///< Number of tasks waiting in all queues.
+    atomic<size_t> nextQueue; ///< Round-robin position for tasks queued by non-worker threads.
+    atomic<bool> stopping; ///< Set when the scheduler is being destroyed.
+    mutex sleepLock; ///< Guards sleeping on `wake`.
+    condition_variable wake; ///< Signalled when a task is queued or the scheduler stops.
+};
+
+#endif //LIBRARYMANAGEMENT_TASKSCHEDULER_H
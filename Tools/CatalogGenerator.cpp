@@ -0,0 +1,519 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "IoBackend.h"
+#include "TaskScheduler.h"
+#include "ZipfSampler.h"
+
+using namespace std;
+
+/**
+ * @brief A small, fast random number generator (SplitMix64).
+ *
+ * Its output depends only on the seed, not on the platform or standard library, so the same seed
+ * produces the same catalog and workload everywhere.
+ */
+struct Random {
+    uint64_t state; ///< The generator state.
+
+    /**
+     * @brief Gets the next 64 random bits.
+     *
+     * @return The bits.
+     */
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /**
+     * @brief Gets a random number in [0, n).
+     *
+     * @param n The bound.
+     * @return The number.
+     */
+    uint64_t below(uint64_t n) {
+        return next() % n;
+    }
+
+    /**
+     * @brief Gets a random number in [0, 1).
+     *
+     * @return The number.
+     */
+    double uniform() {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+
+    /**
+     * @brief Gets the next 64 random bits, so the generator can be used where the standard generators are.
+     *
+     * @return The bits.
+     */
+    uint64_t operator()() {
+        return next();
+    }
+};
+
+/**
+ * @brief Settings taken from the command line.
+ */
+struct GeneratorOptions {
+    uint64_t books = 100000; ///< Number of books in the catalog.
+    uint64_t ops = 0; ///< Number of workload commands.
+    uint64_t patrons = 1000; ///< Number of patrons the workload registers and uses.
+    uint64_t seed = 1; ///< The seed everything is derived from.
+    double authorSkew = 1.0; ///< Zipf exponent of the authors' popularity.
+    double genreSkew = 1.2; ///< Zipf exponent of the genres' popularity.
+    double hotSkew = 0.99; ///< Zipf exponent of the books' popularity in the workload.
+    double mix[5] = {40, 30, 10, 20, 0}; ///< Weights of checkout, return, reserve, search and title commands.
+    string catalogPath; ///< File the catalog is written to, or empty for none.
+    string workloadPath; ///< File the workload is written to, or empty for none.
+};
+
+/**
+ * @brief Names of the workload commands, in the order of `GeneratorOptions::mix`.
+ */
+static const char* const MIX_NAMES[] = {"checkout", "return", "reserve", "search", "title"};
+
+/**
+ * @brief The genres, most popular first.
+ */
+static const char* const GENRES[] = {
+        "Fiction", "Mystery", "Romance", "Fantasy", "Thriller", "Science Fiction", "Biography", "History",
+        "Classic", "Young Adult", "Horror", "Poetry", "Dystopian", "Self-Help", "Travel", "Cooking", "Science",
+        "Philosophy", "Graphic Novel", "Children", "Religion", "Art", "Drama", "Humor"};
+
+/**
+ * @brief First names authors are made from.
+ */
+static const char* const FIRST_NAMES[] = {
+        "James", "Mary", "John", "Patricia", "Robert", "Jennifer", "Michael", "Linda", "William", "Elizabeth",
+        "David", "Barbara", "Richard", "Susan", "Joseph", "Jessica", "Thomas", "Sarah", "Charles", "Karen",
+        "Daniel", "Nancy", "Matthew", "Lisa", "Anthony", "Margaret", "Mark", "Sandra", "Paul", "Ashley",
+        "Steven", "Emily", "Andrew", "Donna", "Kenneth", "Michelle", "George", "Carol", "Joshua", "Amanda",
+        "Kevin", "Melissa", "Brian", "Deborah", "Edward", "Stephanie", "Ronald", "Rebecca", "Timothy", "Laura",
+        "Jason", "Helen", "Jeffrey", "Sharon", "Ryan", "Cynthia", "Jacob", "Kathleen", "Gary", "Amy",
+        "Nicholas", "Shirley", "Eric", "Angela"};
+
+/**
+ * @brief Last names authors are made from.
+ */
+static const char* const LAST_NAMES[] = {
+        "Smith", "Johnson", "Williams", "Brown", "Jones", "Garcia", "Miller", "Davis", "Rodriguez", "Martinez",
+        "Hernandez", "Lopez", "Gonzalez", "Wilson", "Anderson", "Thomas", "Taylor", "Moore", "Jackson", "Martin",
+        "Lee", "Perez", "Thompson", "White", "Harris", "Sanchez", "Clark", "Ramirez", "Lewis", "Robinson",
+        "Walker", "Young", "Allen", "King", "Wright", "Scott", "Torres", "Nguyen", "Hill", "Flores", "Green",
+        "Adams", "Nelson", "Baker", "Hall", "Rivera", "Campbell", "Mitchell", "Carter", "Roberts", "Gomez",
+        "Phillips", "Evans", "Turner", "Diaz", "Parker", "Cruz", "Edwards", "Collins", "Reyes", "Stewart",
+        "Morris", "Morales", "Murphy"};
+
+/**
+ * @brief Words titles are made from.
+ */
+static const char* const TITLE_WORDS[] = {
+        "Night", "House", "Shadow", "River", "Garden", "Secret", "Last", "Lost", "Summer", "Winter", "Light",
+        "Dark", "Stone", "Fire", "Water", "King", "Queen", "Daughter", "Son", "Road", "Song", "War", "Peace",
+        "City", "Island", "Sea", "Storm", "Heart", "Silent", "Broken", "Golden", "Silver", "Red", "Blue", "Black",
+        "White", "Wild", "Little", "Great", "Hidden", "Forgotten", "Time", "Memory", "Dream", "Star", "Moon",
+        "Sun", "World", "Empire", "Kingdom", "Journey", "Return", "Beginning", "End", "Love", "Death", "Life",
+        "Story", "Book", "Letters", "Girl", "Boy", "Man", "Woman", "Children", "Stranger", "Friend", "Enemy",
+        "Door", "Window", "Mountain", "Forest", "Field", "Bridge", "Tower", "Castle", "Ghost", "Witch", "Dragon",
+        "Blood", "Bone", "Glass", "Iron", "Salt", "Wind", "Rain", "Snow", "Ash", "Dust", "Echo", "Promise",
+        "Lie", "Truth", "Game", "Hunt", "Fall", "Rise", "Edge", "Line", "Circle", "Map", "Key", "Crown", "Sword",
+        "Ship", "Train", "Station", "Harbor", "Valley", "Midnight", "Morning", "Evening", "Thousand", "Hundred",
+        "Seven", "Three", "Second", "First", "Final", "Other", "Quiet", "Burning", "Falling", "Rising"};
+
+/**
+ * @brief Short words that join the words of a title.
+ */
+static const char* const TITLE_JOINERS[] = {"of", "and", "in", "the", "of the", "in the", "for"};
+
+/**
+ * @brief Relative frequency of titles with 1 to 10 words.
+ */
+static const unsigned TITLE_WORD_WEIGHTS[] = {8, 22, 26, 18, 10, 7, 4, 2, 2, 1};
+
+/**
+ * @brief Gets the number of elements of an array.
+ */
+template<typename T, size_t N>
+static constexpr size_t countOf(const T (&)[N]) {
+    return N;
+}
+
+/**
+ * @brief Gets a generator whose output depends only on the seed, a stream and an index.
+ *
+ * Each book gets its own generator, so any book can be regenerated on its own and blocks of books can be
+ * generated on any number of threads with the same result.
+ *
+ * @param seed The seed.
+ * @param stream Separates generators used for different purposes.
+ * @param index The index of the item.
+ * @return The generator.
+ */
+static Random randomFor(uint64_t seed, uint64_t stream, uint64_t index) {
+    Random mixer{seed ^ (stream * 0xD1B54A32D192ED03ULL)};
+    Random random{mixer.next() ^ (index * 0x9E3779B97F4A7C15ULL)};
+    random.next();
+    return random;
+}
+
+/**
+ * @brief Generates the books of a catalog. Every field of a book is a function of the seed and its index.
+ */
+class CatalogModel {
+public:
+    /**
+     * @brief Constructs a model of a catalog.
+     *
+     * @param options The generator settings.
+     */
+    explicit CatalogModel(const GeneratorOptions& options)
+            : seed(options.seed), books(options.books),
+              authorCount(max<uint64_t>(100, options.books / 25)),
+              authors(authorCount, options.authorSkew),
+              genres(countOf(GENRES), options.genreSkew) {
+        for (unsigned weight : TITLE_WORD_WEIGHTS) {
+            titleWordTotal += weight;
+        }
+    }
+
+    /**
+     * @brief Gets the ISBN-13 of a book, with its check digit.
+     *
+     * Books are spread over the 978 prefix's billion ISBNs by a bijection, so every book's ISBN is different but
+     * neighbouring books do not get neighbouring ISBNs.
+     *
+     * @param index The index of the book.
+     * @return The ISBN.
+     */
+    static uint64_t isbn(uint64_t index) {
+        uint64_t body = 978000000000ULL + (index * 387420489ULL + 12345) % 1000000000ULL;
+        unsigned sum = 0;
+        uint64_t rest = body;
+        for (int position = 12; position >= 1; position--) {
+            sum += static_cast<unsigned>(rest % 10) * (position % 2 == 0 ? 3 : 1);
+            rest /= 10;
+        }
+        return body * 10 + (10 - sum % 10) % 10;
+    }
+
+    /**
+     * @brief Appends a book's title.
+     *
+     * @param out The text to append to.
+     * @param index The index of the book.
+     */
+    void appendTitle(string& out, uint64_t index) const {
+        Random random = randomFor(seed, 1, index);
+        appendTitle(out, random);
+    }
+
+    /**
+     * @brief Appends a book as a row of the catalog CSV.
+     *
+     * @param out The text to append to.
+     * @param index The index of the book.
+     */
+    void appendRow(string& out, uint64_t index) const {
+        Random random = randomFor(seed, 1, index);
+        appendNumber(out, isbn(index));
+        out += ',';
+        appendTitle(out, random);
+        out += ',';
+        appendAuthor(out, authors.sample(random));
+        out += ',';
+        out += GENRES[genres.sample(random) - 1];
+        out += ',';
+        // Most books in a collection are recent, with a long tail back to the first printed books.
+        double age = -log(1.0 - random.uniform()) * 25.0;
+        appendNumber(out, 2025 - min<uint64_t>(static_cast<uint64_t>(age), 575));
+        out += random.below(10) == 0 ? ",false\n" : ",true\n";
+    }
+
+private:
+    /**
+     * @brief Appends a number in decimal.
+     */
+    static void appendNumber(string& out, uint64_t value) {
+        char digits[20];
+        int length = 0;
+        do {
+            digits[length++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (length > 0) {
+            out += digits[--length];
+        }
+    }
+
+    /**
+     * @brief Appends a title of one to ten words drawn with the given generator.
+     */
+    void appendTitle(string& out, Random& random) const {
+        unsigned pick = static_cast<unsigned>(random.below(titleWordTotal));
+        unsigned words = 1;
+        while (pick >= TITLE_WORD_WEIGHTS[words - 1]) {
+            pick -= TITLE_WORD_WEIGHTS[words - 1];
+            words++;
+        }
+        if (words > 1 && random.below(3) == 0) {
+            out += "The ";
+        }
+        for (unsigned w = 0; w < words; w++) {
+            if (w > 0) {
+                out += ' ';
+                if (w + 1 < words && random.below(4) == 0) {
+                    out += TITLE_JOINERS[random.below(countOf(TITLE_JOINERS))];
+                    out += ' ';
+                }
+            }
+            out += TITLE_WORDS[random.below(countOf(TITLE_WORDS))];
+        }
+    }
+
+    /**
+     * @brief Appends the name of the author with a popularity rank.
+     *
+     * Ranks are mapped to names by a hash, so the most popular authors do not all share a first name.
+     * Beyond the first and last name combinations a middle initial tells authors apart.
+     */
+    static void appendAuthor(string& out, uint64_t rank) {
+        Random names{rank};
+        uint64_t h = names.next();
+        out += FIRST_NAMES[h % countOf(FIRST_NAMES)];
+        out += ' ';
+        uint64_t combinations = countOf(FIRST_NAMES) * countOf(LAST_NAMES);
+        if (rank > combinations) {
+            out += static_cast<char>('A' + (rank / combinations) % 26);
+            out += ". ";
+        }
+        out += LAST_NAMES[(h >> 32) % countOf(LAST_NAMES)];
+    }
+
+    uint64_t seed; ///< The seed.
+    uint64_t books; ///< Number of books.
+    uint64_t authorCount; ///< Number of distinct authors.
+    ZipfSampler authors; ///< Draws an author's popularity rank.
+    ZipfSampler genres; ///< Draws a genre's popularity rank.
+    unsigned titleWordTotal = 0; ///< Sum of `TITLE_WORD_WEIGHTS`.
+};
+
+/**
+ * @brief Writes the catalog CSV.
+ *
+ * Blocks of rows are generated in parallel and written in order, so the file is the same whatever the
+ * number of threads.
+ *
+ * @param options The generator settings.
+ * @param model The catalog model.
+ * @return true if the file was written, false otherwise.
+ */
+static bool writeCatalog(const GeneratorOptions& options, const CatalogModel& model) {
+    IoBackend io;
+    int fd = io.openFile(options.catalogPath, true);
+    if (fd == -1) {
+        cerr << "Could not open " << options.catalogPath << "." << endl;
+        return false;
+    }
+    io.append(fd, "ISBN,Title,Author,Genre,PublicationYear,IsAvailable\n");
+
+    const uint64_t blockRows = 1 << 16;
+    TaskScheduler& scheduler = TaskScheduler::instance();
+    vector<string> blocks(static_cast<size_t>(scheduler.getThreadCount()) * 4);
+    for (uint64_t first = 0; first < options.books; first += blockRows * blocks.size()) {
+        scheduler.parallelFor(0, blocks.size(), 1, [&](size_t from, size_t to) {
+            for (size_t b = from; b < to; b++) {
+                blocks[b].clear();
+                uint64_t start = first + b * blockRows;
+                uint64_t end = min(options.books, start + blockRows);
+                for (uint64_t i = start; i < end; i++) {
+                    model.appendRow(blocks[b], i);
+                }
+            }
+        });
+        for (const string& block : blocks) {
+            io.append(fd, block);
+        }
+    }
+    return io.closeFile(fd);
+}
+
+/**
+ * @brief Writes a circulation workload as a `CommandProcessor` script against the generated catalog.
+ *
+ * The script first registers the patrons, then issues commands drawn from the mix. Books are chosen by a Zipf
+ * distribution over a shuffled order of the catalog, so a few hot titles get most of the traffic. Returns are
+ * drawn from the books the workload has checked out, and fall back to a checkout when none are out.
+ *
+ * @param options The generator settings.
+ * @param model The catalog model.
+ * @return true if the file was written, false otherwise.
+ */
+static bool writeWorkload(const GeneratorOptions& options, const CatalogModel& model) {
+    IoBackend io;
+    int fd = io.openFile(options.workloadPath, true);
+    if (fd == -1) {
+        cerr << "Could not open " << options.workloadPath << "." << endl;
+        return false;
+    }
+    string out;
+    for (uint64_t p = 0; p < options.patrons; p++) {
+        out += "patron\n";
+    }
+
+    double mixTotal = 0;
+    for (double weight : options.mix) {
+        mixTotal += weight;
+    }
+    Random random = randomFor(options.seed, 2, 0);
+    ZipfSampler hot(options.books, options.hotSkew);
+    // The hot ranks are spread over the catalog by a bijection, as the ISBNs are.
+    uint64_t stride = 2654435761ULL;
+    while (gcd(stride, options.books) != 1) {
+        stride += 2;
+    }
+    vector<bool> checkedOut(options.books, false);
+    vector<uint64_t> loans;
+    for (uint64_t op = 0; op < options.ops; op++) {
+        double pick = random.uniform() * mixTotal;
+        int command = 0;
+        while (command < 4 && pick >= options.mix[command]) {
+            pick -= options.mix[command];
+            command++;
+        }
+        uint64_t book = ((hot.sample(random) - 1) * stride) % options.books;
+        if (command == 1 && loans.empty()) {
+            command = 0;
+        }
+        out += MIX_NAMES[command];
+        out += ' ';
+        switch (command) {
+            case 0:
+                out += to_string(CatalogModel::isbn(book)) + ' ' + to_string(random.below(options.patrons) + 1);
+                if (!checkedOut[book]) {
+                    checkedOut[book] = true;
+                    loans.push_back(book);
+                }
+                break;
+            case 1: {
+                size_t loan = random.below(loans.size());
+                book = loans[loan];
+                loans[loan] = loans.back();
+                loans.pop_back();
+                checkedOut[book] = false;
+                out += to_string(CatalogModel::isbn(book));
+                break;
+            }
+            case 2:
+                out += to_string(CatalogModel::isbn(book)) + ' ' + to_string(random.below(options.patrons) + 1);
+                break;
+            case 3:
+                out += to_string(CatalogModel::isbn(book));
+                break;
+            default:
+                model.appendTitle(out, book);
+                break;
+        }
+        out += '\n';
+        if (out.size() >= 1 << 20) {
+            io.append(fd, out);
+            out.clear();
+        }
+    }
+    io.append(fd, out);
+    return io.closeFile(fd);
+}
+
+/**
+ * @brief Parses a command mix such as `checkout=40,return=30,search=30`. Commands not named get no weight.
+ *
+ * @param text The mix.
+ * @param mix Set to the weights.
+ * @return true if the mix was valid, false otherwise.
+ */
+static bool parseMix(const string& text, double (&mix)[5]) {
+    double parsed[5] = {0, 0, 0, 0, 0};
+    stringstream list(text);
+    string item;
+    while (getline(list, item, ',')) {
+        size_t equals = item.find('=');
+        int command = 0;
+        while (command < 5 && item.compare(0, equals, MIX_NAMES[command]) != 0) {
+            command++;
+        }
+        if (equals == string::npos || command == 5) {
+            return false;
+        }
+        parsed[command] = stod(item.substr(equals + 1));
+    }
+    if (parsed[0] + parsed[1] + parsed[2] + parsed[3] + parsed[4] <= 0) {
+        return false;
+    }
+    memcpy(mix, parsed, sizeof(parsed));
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // --books N --catalog FILE writes a catalog of N books. --ops N --workload FILE writes a script of N commands
+    // against it, for --script or a server client. --seed S makes a different catalog; the same seed always gives
+    // the same files. --patrons N, --mix checkout=40,return=30,reserve=10,search=20,title=0, and the Zipf exponents
+    // --hot-skew (books in the workload), --author-skew and --genre-skew shape the data. --threads N as elsewhere.
+    GeneratorOptions options;
+    for (int i = 1; i + 1 < argc; i++) {
+        string option = argv[i];
+        if (option == "--books") {
+            options.books = stoull(argv[++i]);
+        } else if (option == "--ops") {
+            options.ops = stoull(argv[++i]);
+        } else if (option == "--patrons") {
+            options.patrons = stoull(argv[++i]);
+        } else if (option == "--seed") {
+            options.seed = stoull(argv[++i]);
+        } else if (option == "--author-skew") {
+            options.authorSkew = stod(argv[++i]);
+        } else if (option == "--genre-skew") {
+            options.genreSkew = stod(argv[++i]);
+        } else if (option == "--hot-skew") {
+            options.hotSkew = stod(argv[++i]);
+        } else if (option == "--mix") {
+            if (!parseMix(argv[++i], options.mix)) {
+                cerr << "Invalid mix " << argv[i] << "." << endl;
+                return 1;
+            }
+        } else if (option == "--catalog") {
+            options.catalogPath = argv[++i];
+        } else if (option == "--workload") {
+            options.workloadPath = argv[++i];
+        } else if (option == "--threads") {
+            TaskScheduler::setDefaultThreadCount(stoi(argv[++i]));
+        }
+    }
+    if (options.books == 0 || options.books > 1000000000ULL || options.patrons == 0) {
+        cerr << "--books must be between 1 and 1000000000, and --patrons at least 1." << endl;
+        return 1;
+    }
+    if (options.catalogPath.empty() && options.workloadPath.empty()) {
+        cerr << "Nothing to do: give --catalog FILE and/or --workload FILE." << endl;
+        return 1;
+    }
+
+    CatalogModel model(options);
+    if (!options.catalogPath.empty() && !writeCatalog(options, model)) {
+        return 1;
+    }
+    if (!options.workloadPath.empty() && !writeWorkload(options, model)) {
+        return 1;
+    }
+    return 0;
+}
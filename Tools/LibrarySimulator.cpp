@@ -0,0 +1,66 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "CirculationSimulator.h"
+#include "Librarian.h"
+#include "TaskScheduler.h"
+#include "Tracer.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    // --catalog FILE loads the catalog to simulate, such as one written by library_generate. --days N and
+    // --patrons N size the run. --visits R is how often each patron visits per day, --books-per-visit N how many
+    // books they look for, and --hot-skew S how concentrated demand is on popular titles. --hold-probability,
+    // --late-probability and --renew-probability shape patron behaviour. --seed S picks a different run, and
+    // --threads N sets how many threads the overnight jobs use. --trace FILE writes the spans of the catalog
+    // load and the overnight jobs as a Chrome trace, when the library is built with tracing.
+    string catalogPath = "../Extras/BookInventory.csv";
+    string tracePath;
+    SimulationConfig config;
+    for (int i = 1; i + 1 < argc; i++) {
+        string option = argv[i];
+        if (option == "--catalog") {
+            catalogPath = argv[++i];
+        } else if (option == "--days") {
+            config.days = stoi(argv[++i]);
+        } else if (option == "--patrons") {
+            config.patrons = stol(argv[++i]);
+        } else if (option == "--visits") {
+            config.visitsPerPatronPerDay = stod(argv[++i]);
+        } else if (option == "--books-per-visit") {
+            config.booksPerVisit = stod(argv[++i]);
+        } else if (option == "--hot-skew") {
+            config.hotSkew = stod(argv[++i]);
+        } else if (option == "--hold-probability") {
+            config.holdProbability = stod(argv[++i]);
+        } else if (option == "--late-probability") {
+            config.lateProbability = stod(argv[++i]);
+        } else if (option == "--renew-probability") {
+            config.renewProbability = stod(argv[++i]);
+        } else if (option == "--seed") {
+            config.seed = stoull(argv[++i]);
+        } else if (option == "--threads") {
+            TaskScheduler::setDefaultThreadCount(stoi(argv[++i]));
+        } else if (option == "--trace") {
+            tracePath = argv[++i];
+        }
+    }
+
+    Librarian l(catalogPath);
+    cout << "Simulating " << config.days << " days of " << config.patrons << " patrons over "
+         << l.getInventory().countTotalBooks() << " books." << endl;
+    CirculationSimulator simulator(l, config);
+    simulator.run(cout);
+    simulator.printReport(cout);
+    if (!tracePath.empty()) {
+        ofstream file(tracePath);
+        Tracer::writeChromeTrace(file);
+        if (!file) {
+            cerr << "Could not write " << tracePath << "." << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include "Tracer.h"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+
+/**
+ * @brief One recorded span. The fields are atomic so a reader never races a writer reusing the slot.
+ */
+struct TraceEvent {
+    atomic<const char*> name; ///< The span's name.
+    atomic<uint64_t> start; ///< When the span started, on the trace clock.
+    atomic<uint64_t> end; ///< When the span ended, on the trace clock.
+};
+
+/**
+ * @brief A ring of spans. Only its thread writes it.
+ */
+template<uint64_t Capacity>
+struct TraceRing {
+    TraceEvent events[Capacity]; ///< The spans, indexed by their number modulo `Capacity`.
+    atomic<uint64_t> started; ///< Number of spans whose slot has started being written.
+    atomic<uint64_t> written; ///< Number of spans recorded so far.
+
+    /**
+     * @brief Records a span, overwriting the oldest one if the ring is full.
+     *
+     * @param name The span's name.
+     * @param start When the span started.
+     * @param end When the span ended.
+     */
+    void record(const char* name, uint64_t start, uint64_t end) {
+        uint64_t n = written.load(memory_order_relaxed);
+        // Like a seqlock: a reader that sees any of the new fields also sees `started`, and skips the slot.
+        started.store(n + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        TraceEvent& event = events[n % Capacity];
+        event.name.store(name, memory_order_relaxed);
+        event.start.store(start, memory_order_relaxed);
+        event.end.store(end, memory_order_relaxed);
+        written.store(n + 1, memory_order_release);
+    }
+
+    /**
+     * @brief Writes the ring's spans as Chrome trace events, each preceded by a comma.
+     *
+     * A span whose slot was reused by its thread while it was being read is left out.
+     *
+     * @param out The stream to write to.
+     * @param thread The thread's number in the trace.
+     */
+    void write(ostream& out, int thread) const {
+        uint64_t last = written.load(memory_order_acquire);
+        for (uint64_t i = last > Capacity ? last - Capacity : 0; i < last; i++) {
+            const TraceEvent& event = events[i % Capacity];
+            const char* name = event.name.load(memory_order_relaxed);
+            uint64_t start = event.start.load(memory_order_relaxed);
+            uint64_t end = event.end.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (started.load(memory_order_relaxed) - i > Capacity) {
+                continue;
+            }
+            out << ",\n  {\"name\": \"" << name << "\", \"cat\": \"library\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                << thread << ", \"ts\": " << start / 1e3 << ", \"dur\": " << (end - start) / 1e3 << '}';
+        }
+    }
+};
+
+/**
+ * @brief One thread's spans.
+ *
+ * Long spans get a ring of their own, so that a flood of short ones, such as one per catalog row, cannot push
+ * the catalog read or a nightly job out of the trace.
+ */
+struct TraceBuffer {
+    TraceRing<Tracer::CAPACITY> shortSpans; ///< Spans shorter than `LONG_SPAN`.
+    TraceRing<Tracer::LONG_CAPACITY> longSpans; ///< Spans of at least `LONG_SPAN`.
+    int thread; ///< The thread's number in the trace.
+    TraceBuffer* next; ///< The buffer registered before this one.
+};
+
+/**
+ * @brief Every thread's buffer, newest first. Buffers are never removed.
+ */
+static atomic<TraceBuffer*> buffers{nullptr};
+
+/**
+ * @brief Number of buffers registered so far, which numbers the threads.
+ */
+static atomic<int> bufferCount{0};
+
+/**
+ * @brief The time the trace clock counts from.
+ */
+static const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+/**
+ * @brief Gets the calling thread's buffer, creating and registering it on the thread's first span.
+ *
+ * @return The buffer.
+ */
+static TraceBuffer* threadBuffer() {
+    thread_local TraceBuffer* buffer = nullptr;
+    if (buffer == nullptr) {
+        buffer = new TraceBuffer();
+        buffer->thread = bufferCount.fetch_add(1, memory_order_relaxed) + 1;
+        buffer->next = buffers.load(memory_order_relaxed);
+        while (!buffers.compare_exchange_weak(buffer->next, buffer, memory_order_release, memory_order_relaxed)) {
+        }
+    }
+    return buffer;
+}
+
+/**
+ * @brief Gets the current time on the trace clock.
+ *
+ * @return Nanoseconds since the process started tracing.
+ */
+uint64_t Tracer::now() {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - epoch).count());
+}
+
+/**
+ * @brief Records a finished span on the calling thread.
+ *
+ * @param name The span's name. Must stay valid for the life of the process, like a string literal.
+ * @param start When the span started, from `now`.
+ * @param end When the span ended, from `now`.
+ */
+void Tracer::record(const char *name, uint64_t start, uint64_t end) {
+    TraceBuffer* buffer = threadBuffer();
+    if (end - start >= LONG_SPAN) {
+        buffer->longSpans.record(name, start, end);
+    } else {
+        buffer->shortSpans.record(name, start, end);
+    }
+}
+
+/**
+ * @brief Writes every thread's recorded spans as a Chrome trace JSON document.
+ *
+ * Each span is a complete ("X") event with its start and duration in microseconds.
+ *
+ * @param out The stream to write to.
+ */
+void Tracer::writeChromeTrace(ostream &out) {
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    bool first = true;
+    out << fixed << setprecision(3);
+    for (TraceBuffer* b = buffers.load(memory_order_acquire); b != nullptr; b = b->next) {
+        out << (first ? "\n" : ",\n") << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+            << b->thread << ", \"args\": {\"name\": \"thread " << b->thread << "\"}}";
+        first = false;
+        b->longSpans.write(out, b->thread);
+        b->shortSpans.write(out, b->thread);
+    }
+    out << "\n]}\n";
+}
+
+/**
+ * @brief Tells whether spans are recorded in this build.
+ *
+ * @return true if the library was built with `LIBRARY_TRACE`.
+ */
+bool Tracer::isEnabled() {
+#ifdef LIBRARY_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
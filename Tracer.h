@@ -0,0 +1,99 @@
+#ifndef LIBRARYMANAGEMENT_TRACER_H
+#define LIBRARYMANAGEMENT_TRACER_H
+
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * @class Tracer
+ * @brief Records timed spans of the librarian's hot paths and exports them in the Chrome trace event format.
+ *
+ * Each thread writes its spans into its own ring buffers, created the first time the thread records a span, so
+ * recording takes no locks. Spans of at least `LONG_SPAN` go in a ring of `LONG_CAPACITY` and shorter ones in a
+ * ring of `CAPACITY`. When a ring is full its oldest spans are overwritten, keeping the most recent work. The
+ * exported JSON opens in Perfetto (ui.perfetto.dev) or chrome://tracing, with one track per thread.
+ *
+ * Spans are recorded with `TraceSpan`, which only records when the library is built with `LIBRARY_TRACE`
+ * (the `LIBRARY_TRACING` CMake option). Otherwise spans compile to nothing and the export is empty.
+ */
+class Tracer {
+public:
+    static const uint64_t CAPACITY = 1 << 16; ///< Number of short spans each thread keeps.
+    static const uint64_t LONG_CAPACITY = 1 << 12; ///< Number of long spans each thread keeps.
+    static const uint64_t LONG_SPAN = 100000; ///< Nanoseconds from which a span counts as long.
+
+    /**
+     * @brief Gets the current time on the trace clock.
+     *
+     * @return Nanoseconds since the process started tracing.
+     */
+    static uint64_t now();
+
+    /**
+     * @brief Records a finished span on the calling thread.
+     *
+     * @param name The span's name. Must stay valid for the life of the process, like a string literal.
+     * @param start When the span started, from `now`.
+     * @param end When the span ended, from `now`.
+     */
+    static void record(const char* name, uint64_t start, uint64_t end);
+
+    /**
+     * @brief Writes every thread's recorded spans as a Chrome trace JSON document.
+     *
+     * Spans still being written by other threads may be left out.
+     *
+     * @param out The stream to write to.
+     */
+    static void writeChromeTrace(ostream& out);
+
+    /**
+     * @brief Tells whether spans are recorded in this build.
+     *
+     * @return true if the library was built with `LIBRARY_TRACE`.
+     */
+    static bool isEnabled();
+};
+
+/**
+ * @class TraceSpan
+ * @brief Records the scope it lives in as a span when the scope ends. Does nothing unless built with `LIBRARY_TRACE`.
+ */
+class TraceSpan {
+public:
+    /**
+     * @brief Starts the span.
+     *
+     * @param name The span's name. Must stay valid for the life of the process, like a string literal.
+     */
+    explicit TraceSpan(const char* name) {
+#ifdef LIBRARY_TRACE
+        this->name = name;
+        start = Tracer::now();
+#else
+        (void) name;
+#endif
+    }
+
+    /**
+     * @brief Ends the span and records it.
+     */
+    ~TraceSpan() {
+#ifdef LIBRARY_TRACE
+        Tracer::record(name, start, Tracer::now());
+#endif
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+#ifdef LIBRARY_TRACE
+    const char* name; ///< The span's name.
+    uint64_t start; ///< When the span started, on the trace clock.
+#endif
+};
+
+#endif //LIBRARYMANAGEMENT_TRACER_H
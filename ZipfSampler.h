@@ -0,0 +1,94 @@
+#ifndef LIBRARYMANAGEMENT_ZIPFSAMPLER_H
+#define LIBRARYMANAGEMENT_ZIPFSAMPLER_H
+
+#include <cmath>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * @brief Samples ranks 1..n from a Zipf distribution without a table, by rejection-inversion.
+ *
+ * Rank k is drawn with probability proportional to 1 / k^exponent, so rank 1 is the most popular.
+ * Each sample takes constant time and no memory, which keeps skewed choices among 100M books cheap. Used to
+ * model popular books, authors and genres.
+ */
+class ZipfSampler {
+public:
+    /**
+     * @brief Constructs a sampler.
+     *
+     * @param n Number of ranks.
+     * @param exponent The skew; 0 is uniform, and larger values concentrate the samples on the first ranks.
+     */
+    ZipfSampler(uint64_t n, double exponent)
+            : n(n), exponent(exponent) {
+        integralFirst = integral(1.5) - 1.0;
+        integralLast = integral(static_cast<double>(n) + 0.5);
+        squeeze = 2.0 - integralInverse(integral(2.5) - density(2.0));
+    }
+
+    /**
+     * @brief Draws a rank.
+     *
+     * @param random A generator of 64 random bits per call, such as `mt19937_64`.
+     * @return A rank from 1 to n.
+     */
+    template<typename Generator>
+    uint64_t sample(Generator& random) const {
+        if (exponent == 0.0) {
+            return random() % n + 1;
+        }
+        for (;;) {
+            double u = integralLast + static_cast<double>(random() >> 11) * 0x1.0p-53 * (integralFirst - integralLast);
+            double x = integralInverse(u);
+            double k = floor(x + 0.5);
+            if (k < 1.0) {
+                k = 1.0;
+            } else if (k > static_cast<double>(n)) {
+                k = static_cast<double>(n);
+            }
+            if (k - x <= squeeze || u >= integral(k + 0.5) - density(k)) {
+                return static_cast<uint64_t>(k);
+            }
+        }
+    }
+
+private:
+    /**
+     * @brief The unnormalized density 1 / x^exponent.
+     */
+    double density(double x) const {
+        return exp(-exponent * log(x));
+    }
+
+    /**
+     * @brief An antiderivative of the density.
+     */
+    double integral(double x) const {
+        double logX = log(x);
+        double t = (1.0 - exponent) * logX;
+        double ratio = fabs(t) > 1e-8 ? expm1(t) / t : 1.0 + t / 2.0 * (1.0 + t / 3.0 * (1.0 + t / 4.0));
+        return ratio * logX;
+    }
+
+    /**
+     * @brief The inverse of `integral`.
+     */
+    double integralInverse(double x) const {
+        double t = x * (1.0 - exponent);
+        if (t < -1.0) {
+            t = -1.0;
+        }
+        double ratio = fabs(t) > 1e-8 ? log1p(t) / t : 1.0 - t * (0.5 - t * (1.0 / 3.0 - 0.25 * t));
+        return exp(ratio * x);
+    }
+
+    uint64_t n; ///< Number of ranks.
+    double exponent; ///< The skew.
+    double integralFirst; ///< `integral` at the lower edge of rank 1, less that rank's own mass.
+    double integralLast; ///< `integral` at the upper edge of rank n.
+    double squeeze; ///< Ranks this close to the sampled point are accepted without the full test.
+};
+
+#endif //LIBRARYMANAGEMENT_ZIPFSAMPLER_H
@@ -1,32 +1,372 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <__filesystem/operations.h>
+#include <memory>
+#include <stdexcept>
 
+#include "AsyncLibrarian.h"
+#include "CirculationLog.h"
+#include "CommandProcessor.h"
+#include "CoroutineExecutor.h"
 #include "Librarian.h"
 #include "LibraryHash.h"
+#include "LibraryServer.h"
+#include "LogReplica.h"
+#include "LogShipper.h"
+#include "MemoryAccounting.h"
+#include "Metrics.h"
+#include "ShardRouter.h"
+#include "TaskScheduler.h"
+#include "Tracer.h"
 
 using namespace std;
-int main() {
-    Librarian l;
 
-    char userOption;
-    string ISBN, title, authorName, genre;
+/**
+ * @brief Replays a circulation log into the librarian, so the changes made before a restart are restored.
+ *
+ * @param l The librarian to replay the log into.
+ * @param logPath Path of the log. Nothing is replayed if it does not exist yet.
+ * @return The number of records replayed.
+ */
+static long replayLog(Librarian& l, const string& logPath) {
+    ostream discard(nullptr);
+    CommandProcessor replay(l);
+    long changes = replay.runFile(logPath, discard);
+    if (changes > 0) {
+        cerr << "Replayed " << changes << " changes from " << logPath << "." << endl;
+    }
+    return max(changes, 0L);
+}
+
+/**
+ * @brief Replays a command script through a CommandProcessor without the interactive menu.
+ *
+ * Output is buffered and written to standard output, and the throughput of each command is printed to
+ * standard error once the script ends.
+ *
+ * @param l The librarian to run the script against.
+ * @param path Path of the script, or "-" to read standard input.
+ * @param logPath Path of the circulation log the script's changes are recorded in, or empty for none.
+ * @return The process exit code.
+ */
+static int runScript(Librarian& l, const string& path, const string& logPath) {
+    ios::sync_with_stdio(false);
+    cin.tie(nullptr);
+    ifstream file;
+    if (path != "-") {
+        file.open(path, ios::binary);
+        if (!file.is_open()) {
+            cerr << "Could not open " << path << "." << endl;
+            return 1;
+        }
+    }
+    unique_ptr<CirculationLog> log;
+    if (!logPath.empty()) {
+        log = make_unique<CirculationLog>(logPath, nullptr);
+    }
+    CommandProcessor processor(l, log.get());
+    processor.run(path == "-" ? cin : file, cout);
+    cout.flush();
+    processor.printStats(cerr);
+    return 0;
+}
+
+/**
+ * @brief Writes the operation metrics and the trace as JSON, once the program is done.
+ *
+ * @param statsPath Path of the metrics JSON file, or empty to write none.
+ * @param tracePath Path of the Chrome trace JSON file, or empty to write none.
+ * @param status The exit code the program is about to return.
+ * @return The exit code, or 1 if a file could not be written.
+ */
+static int writeReports(const string& statsPath, const string& tracePath, int status) {
+    if (!statsPath.empty()) {
+        ofstream file(statsPath);
+        Metrics::writeJson(file);
+        if (!file) {
+            cerr << "Could not write " << statsPath << "." << endl;
+            status = 1;
+        }
+    }
+    if (!tracePath.empty()) {
+        if (!Tracer::isEnabled()) {
+            cerr << "Tracing is not built in; configure with -DLIBRARY_TRACING=ON to record spans." << endl;
+        }
+        ofstream file(tracePath);
+        Tracer::writeChromeTrace(file);
+        if (!file) {
+            cerr << "Could not write " << tracePath << "." << endl;
+            status = 1;
+        }
+    }
+    return status;
+}
+
+#ifdef __linux__
+/**
+ * @brief The running server, stopped by SIGINT and SIGTERM.
+ */
+static LibraryServer* volatile runningServer = nullptr;
+
+/**
+ * @brief Handles SIGINT and SIGTERM by stopping the running server, if there still is one.
+ *
+ * @param signum The signal.
+ */
+static void stopRunningServer([[maybe_unused]] int signum) {
+    LibraryServer* server = runningServer;
+    if (server != nullptr) {
+        server->stop();
+    }
+}
+
+/**
+ * @brief Runs a server until SIGINT or SIGTERM stops it.
+ *
+ * The handlers are removed again before the server can go away, even if it throws, so a late signal ends the
+ * process normally instead of reaching a destroyed server.
+ *
+ * @param server The server.
+ */
+static void runUntilSignalled(LibraryServer& server) {
+    runningServer = &server;
+    signal(SIGINT, stopRunningServer);
+    signal(SIGTERM, stopRunningServer);
+    auto restore = [] {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        runningServer = nullptr;
+    };
+    try {
+        server.run();
+    } catch (...) {
+        restore();
+        throw;
+    }
+    restore();
+}
+
+/**
+ * @brief Serves the librarian on a socket until the process is interrupted or terminated.
+ *
+ * @param l The librarian to serve.
+ * @param address The address to listen on, as taken by LibraryServer.
+ * @param workers Number of executor threads the requests run on.
+ * @param logPath Path of the circulation log changes are recorded in before they are answered, or empty for none.
+ * @param shipAddress The address to ship the log to replicas on (see LogShipper), or empty to ship nothing.
+ * @param replayed Number of records the log held at startup.
+ * @param primaryAddress The address of the primary to follow as a read-only replica (see LogReplica), or empty.
+ * @return The process exit code.
+ */
+static int runServer(Librarian& l, const string& address, int workers, const string& logPath,
+                     const string& shipAddress, long replayed, const string& primaryAddress) {
+    CoroutineExecutor executor(workers);
+    AsyncLibrarian async(l, executor);
+    // Destroyed after the log, which hands it the last records as they become durable.
+    unique_ptr<LogShipper> shipper;
+    // Destroyed before the executor stops, so coroutines still waiting on the log can be resumed.
+    unique_ptr<CirculationLog> log;
+    if (!logPath.empty()) {
+        log = make_unique<CirculationLog>(logPath, &executor);
+    }
+    int status = 0;
+    try {
+        if (!shipAddress.empty()) {
+            shipper = make_unique<LogShipper>(shipAddress, logPath, static_cast<unsigned long long>(replayed));
+            log->setDurableListener([ship = shipper.get()](string_view records, unsigned long long last) {
+                ship->ship(records, last);
+            });
+        }
+        LibraryServer server(async, address, log.get(), !primaryAddress.empty());
+        unique_ptr<LogReplica> replica;
+        if (!primaryAddress.empty()) {
+            replica = make_unique<LogReplica>(l, primaryAddress);
+        }
+        cout << "Listening on " << address << "." << endl;
+        runUntilSignalled(server);
+        cout << "Answered " << server.getRequestCount() << " requests." << endl;
+        if (replica != nullptr) {
+            cout << "Applied " << replica->getAppliedPosition() << " of the primary's "
+                 << replica->getPrimaryPosition() << " records." << endl;
+        }
+    } catch (const runtime_error& e) {
+        cerr << e.what() << endl;
+        status = 1;
+    }
+    return status;
+}
+
+/**
+ * @brief Splits the catalog over shard processes and replays a command script through a ShardRouter.
+ *
+ * Output is buffered and written to standard output, and the script's throughput is printed to standard error
+ * once it ends.
+ *
+ * @param catalogPath Path of the catalog CSV file.
+ * @param shards Number of shard processes.
+ * @param shardOptions Options passed to every shard process.
+ * @param path Path of the script, or "-" to read standard input.
+ * @param logPath Path the shards' circulation logs are named after, or empty for none.
+ * @param archivePath Path of an archive for the first shard to load, or empty for none.
+ * @return The process exit code.
+ */
+static int runRouter(const string& catalogPath, int shards, const vector<string>& shardOptions, const string& path,
+                     const string& logPath, const string& archivePath) {
+    ios::sync_with_stdio(false);
+    cin.tie(nullptr);
+    ifstream file;
+    if (path != "-") {
+        file.open(path, ios::binary);
+        if (!file.is_open()) {
+            cerr << "Could not open " << path << "." << endl;
+            return 1;
+        }
+    }
+    try {
+        ShardRouter router(catalogPath, shards, shardOptions, logPath, archivePath);
+        auto start = chrono::steady_clock::now();
+        long lines = router.run(path == "-" ? cin : file, cout);
+        cout.flush();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cerr << "Ran " << lines << " lines on " << shards << " shards in " << fixed << setprecision(1)
+             << seconds * 1e3 << " ms (" << setprecision(0) << (seconds > 0 ? lines / seconds : 0.0)
+             << " lines/s)." << endl;
+        if (router.getErrorCount() != 0) {
+            cerr << router.getErrorCount() << " lines were not valid commands." << endl;
+        }
+    } catch (const runtime_error& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    // --threads N sets how many threads the bulk jobs use; LIBRARY_THREADS does the same when it is not given.
+    // --script FILE replays a command script (see CommandProcessor) instead of showing the menu; - reads stdin.
+    // --listen ADDR serves the same commands on a socket (see LibraryServer); Linux only. --workers N sets
+    // how many threads the server's request coroutines run on. --log FILE replays a circulation log at startup
+    // and records every change in it (see CirculationLog). --stats-json FILE writes the latency histograms of
+    // the librarian's operations (see Metrics) to FILE on exit, and --trace FILE writes the spans of the catalog
+    // load, nightly jobs and listings as a Chrome trace (see Tracer). --archive FILE loads a cold collection into a
+    // compressed, read-only archive that the archive command searches (see CompressedCatalog). --details lazy
+    // maps the catalog and reads each book's title, author and genre only when they are first needed. --shards N
+    // splits the catalog over N child processes by ISBN hash and runs the script through a router (see
+    // ShardRouter), with each patron's loan and hold limits applied per shard; Linux only. --ship ADDR makes a server
+    // with a --log the primary of read-only replicas, streaming the log to them on ADDR (see LogShipper), and
+    // --replica-of ADDR makes a server a read-only replica that applies the log the primary at ADDR ships (see
+    // LogReplica); Linux only.
+    string catalogPath = "../Extras/BookInventory.csv";
+    string scriptPath, listenAddress, logPath, statsPath, tracePath, archivePath, shipAddress, primaryAddress;
+    DetailLoading loading = DetailLoading::Eager;
+    int workers = 4;
+    int shards = 0;
+    vector<string> shardOptions;
+    for (int i = 1; i + 1 < argc; i++) {
+        string option = argv[i];
+        if (option == "--threads") {
+            TaskScheduler::setDefaultThreadCount(stoi(argv[i + 1]));
+            shardOptions.insert(shardOptions.end(), {argv[i], argv[i + 1]});
+            i++;
+        } else if (option == "--catalog") {
+            catalogPath = argv[++i];
+        } else if (option == "--script") {
+            scriptPath = argv[++i];
+        } else if (option == "--listen") {
+            listenAddress = argv[++i];
+        } else if (option == "--workers") {
+            workers = stoi(argv[++i]);
+        } else if (option == "--log") {
+            logPath = argv[++i];
+        } else if (option == "--stats-json") {
+            statsPath = argv[++i];
+        } else if (option == "--trace") {
+            tracePath = argv[++i];
+        } else if (option == "--archive") {
+            archivePath = argv[++i];
+        } else if (option == "--details") {
+            shardOptions.insert(shardOptions.end(), {argv[i], argv[i + 1]});
+            loading = string(argv[++i]) == "lazy" ? DetailLoading::Lazy : DetailLoading::Eager;
+        } else if (option == "--shards") {
+            shards = stoi(argv[++i]);
+        } else if (option == "--ship") {
+            shipAddress = argv[++i];
+        } else if (option == "--replica-of") {
+            primaryAddress = argv[++i];
+        }
+    }
+    if (!shipAddress.empty() && (listenAddress.empty() || logPath.empty())) {
+        cerr << "--ship needs --listen and --log." << endl;
+        return 1;
+    }
+    if (!primaryAddress.empty() && (listenAddress.empty() || !logPath.empty())) {
+        cerr << "--replica-of needs --listen, and a replica keeps no --log of its own." << endl;
+        return 1;
+    }
+    if (shards > 0) {
+#ifdef __linux__
+        if (scriptPath.empty()) {
+            cerr << "--shards needs --script." << endl;
+            return 1;
+        }
+        return writeReports(statsPath, tracePath,
+                            runRouter(catalogPath, shards, shardOptions, scriptPath, logPath, archivePath));
+#else
+        cerr << "--shards is only supported on Linux." << endl;
+        return 1;
+#endif
+    }
+    Librarian l(catalogPath, loading);
+    if (!archivePath.empty() && !l.loadArchive(archivePath)) {
+        cerr << "Could not read the archive " << archivePath << "." << endl;
+    }
+    long replayed = 0;
+    if (!logPath.empty()) {
+        replayed = replayLog(l, logPath);
+    }
+    if (!scriptPath.empty()) {
+        return writeReports(statsPath, tracePath, runScript(l, scriptPath, logPath));
+    }
+    if (!listenAddress.empty()) {
+#ifdef __linux__
+        return writeReports(statsPath, tracePath,
+                            runServer(l, listenAddress, workers, logPath, shipAddress, replayed, primaryAddress));
+#else
+        cerr << "--listen is only supported on Linux." << endl;
+        return 1;
+#endif
+    }
+
+    char userOption = 0;
+    char more;
+    string ISBN, title, authorName, genre, path, filter, error, cursor, next;
     short pubYear;
-    long long num;
+    long long num, lastISBN;
     int days;
+    PatronId patron;
     Book* b;
+    vector<FuzzyMatch> matches;
+    CatalogQuery query;
 
     while (userOption != 'q') {
         cout << "Options: " << endl;
         cout << "   1- Checkout book. 2- Return book. 3- Reserve Book. 4- Cancel Reservation. 5- Renew Book." <<
                  endl << "   6- Add New Book. 7- Remove Book. 8- Search Books. O- List Overdue Books. R- List Reservations. " << endl <<
-                    "   L- List Books. q- Quit program" << endl;
+                    "   L- List Books. P- Register Patron. A- Patron Account. E- Export Catalog. S- Statistics." << endl <<
+                    "   F- Fuzzy Search. I- List by ISBN Prefix. Q- Query Books. M- Memory Usage. q- Quit program" << endl;
         cin >> userOption;
         switch (userOption) {
             case '1':
                 cout << "Enter ISBN: " << endl;
                 cin >> ISBN;
                 num = LibraryHash::formatISBN(ISBN);
-                l.checkoutBook(num);
+                cout << "Enter Patron ID (0 for none): " << endl;
+                cin >> patron;
+                l.checkoutBook(num, patron);
                 break;
             case '2':
                 cout << "Enter ISBN: " << endl;
@@ -38,7 +378,9 @@ int main() {
                 cout << "Enter ISBN: " << endl;
                 cin >> ISBN;
                 num = LibraryHash::formatISBN(ISBN);
-                l.reserveBook(num);
+                cout << "Enter Patron ID (0 for none): " << endl;
+                cin >> patron;
+                l.reserveBook(num, patron);
                 break;
             case '4':
                 cout << "Enter ISBN: " << endl;
@@ -83,10 +425,60 @@ int main() {
                 cout << "Enter ISBN: " << endl;
                 cin >> ISBN;
                 num = LibraryHash::formatISBN(ISBN);
-                cout << l.searchBooks(num)->getInfo() << endl;
+                b = l.searchBooks(num);
+                if (b == nullptr) {
+                    cout << "Book not found." << endl;
+                } else {
+                    cout << b->getInfo() << endl;
+                }
+                break;
+            case 'F':
+                cout << "Enter Title or Author: " << endl;
+                cin.ignore();
+                getline(cin, title);
+                matches = l.searchFuzzy(title);
+                if (matches.empty()) {
+                    cout << "Book not found." << endl;
+                }
+                for (const FuzzyMatch& m : matches) {
+                    cout << m.book->getInfo() << endl;
+                }
+                break;
+            case 'I':
+                cout << "Enter ISBN prefix, such as 978-0-14: " << endl;
+                cin >> ISBN;
+                if (!IsbnIndex::prefixRange(ISBN, num, lastISBN)) {
+                    cout << "Invalid ISBN prefix." << endl;
+                } else if (l.listBooksInRange(num, lastISBN) == 0) {
+                    cout << "Book not found." << endl;
+                }
+                break;
+            case 'Q':
+                cout << "Enter Query, such as genre=Dystopian AND year<1960 AND available: " << endl;
+                cin.ignore();
+                getline(cin, filter);
+                if (!CatalogQuery::compile(filter, query, error)) {
+                    cout << "Invalid query: " << error << "." << endl;
+                } else if (l.queryBooks(query, [](const Book* book, const BookVersion& state) {
+                    cout << book->getInfo(state) << endl;
+                }) == 0) {
+                    cout << "Book not found." << endl;
+                }
                 break;
             case 'L':
-                l.listAllBooks();
+                // Show the catalog a screen at a time, in ISBN order, rather than all at once.
+                cursor.clear();
+                do {
+                    l.listPage(CatalogQuery(), cursor, 10, [](const Book* book, const BookVersion& state) {
+                        cout << book->getInfo(state) << endl << endl;
+                    }, next);
+                    if (next.empty()) {
+                        break;
+                    }
+                    cursor = next;
+                    cout << "Show more? (y/n): " << endl;
+                    cin >> more;
+                } while (more == 'y' || more == 'Y');
                 break;
             case 'O':
                 l.listOverdueBooks();
@@ -94,11 +486,35 @@ int main() {
             case 'R':
                 l.listReservations();
                 break;
+            case 'P':
+                cout << "New Patron ID: " << l.registerPatron() << endl;
+                break;
+            case 'A':
+                cout << "Enter Patron ID: " << endl;
+                cin >> patron;
+                l.listPatronAccount(patron);
+                break;
+            case 'E':
+                cout << "Enter File Path: " << endl;
+                cin >> path;
+                if (!l.exportCatalog(path)) {
+                    cout << "Could not write " << path << "." << endl;
+                }
+                break;
+            case 'S':
+                Metrics::print();
+                l.searchCacheStats().print();
+                break;
+            case 'M':
+                MemoryAccounting::print(l.memoryUsage());
+                break;
+            case 'q':
+                break;
             default:
                 cout << "Invalid Input." << endl;
                 break;
         }
     }
 
-    return 0;
+    return writeReports(statsPath, tracePath, 0);
 }